@@ -16,6 +16,7 @@
 
 #include <android-base/logging.h>
 #include <android/binder_manager.h>
+#include <sys/mman.h>
 #include <utils/Log.h>
 
 #include <memory>
@@ -137,10 +138,21 @@ void FaceTracker::stop() {
  */
 
 ndk::ScopedAStatus StreamCallback::deliverPacket(const PacketDescriptor& in_packet) {
-    std::string output(in_packet.data.begin(), in_packet.data.end());
-
     FaceOutput faceData;
-    faceData.ParseFromString(output);
+    if (!in_packet.dataFds.empty()) {
+        // Large outputs are delivered through shared memory.
+        void* mappedData = mmap(nullptr, in_packet.size, PROT_READ, MAP_SHARED,
+                                in_packet.dataFds[0].get(), 0);
+        if (mappedData == MAP_FAILED) {
+            LOG(ERROR) << "Unable to map the packet data";
+            return ndk::ScopedAStatus::ok();
+        }
+        faceData.ParseFromArray(mappedData, in_packet.size);
+        munmap(mappedData, in_packet.size);
+    } else {
+        std::string output(in_packet.data.begin(), in_packet.data.end());
+        faceData.ParseFromString(output);
+    }
 
     BoundingBox currentBox = faceData.box();
 
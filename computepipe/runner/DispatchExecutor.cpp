@@ -0,0 +1,125 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "DispatchExecutor.h"
+
+#include <android-base/logging.h>
+
+#include <utility>
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace runner {
+
+DispatchExecutor::DispatchExecutor(uint32_t workerCount) : mState(std::make_shared<State>()) {
+    if (workerCount == 0) {
+        LOG(WARNING) << "Dispatch executor needs at least one worker";
+        workerCount = 1;
+    }
+    for (uint32_t i = 0; i < workerCount; i++) {
+        mWorkers.emplace_back(runTasks, mState);
+    }
+}
+
+DispatchExecutor::~DispatchExecutor() {
+    std::deque<Task> droppedTasks;
+    {
+        std::lock_guard lock(mState->lock);
+        mState->isStopping = true;
+        droppedTasks.swap(mState->tasks);
+    }
+    mState->taskReady.notify_all();
+    mState->keyDrained.notify_all();
+    for (auto& worker : mWorkers) {
+        if (worker.get_id() == std::this_thread::get_id()) {
+            // Destroyed by one of its tasks. The worker exits once it returns.
+            worker.detach();
+        } else {
+            worker.join();
+        }
+    }
+}
+
+bool DispatchExecutor::post(int key, std::function<void()> task, uint32_t maxPendingTasks) {
+    {
+        std::lock_guard lock(mState->lock);
+        if (mState->isStopping) {
+            return false;
+        }
+        uint32_t& pendingCount = mState->pendingCounts[key];
+        if (maxPendingTasks > 0 && pendingCount >= maxPendingTasks) {
+            return false;
+        }
+        pendingCount++;
+        mState->tasks.push_back({key, std::move(task)});
+    }
+    mState->taskReady.notify_one();
+    return true;
+}
+
+void DispatchExecutor::drain(int key) {
+    std::unique_lock lock(mState->lock);
+    mState->keyDrained.wait(lock, [this, key]() {
+        return mState->isStopping ||
+               mState->pendingCounts.find(key) == mState->pendingCounts.end();
+    });
+}
+
+void DispatchExecutor::runTasks(std::shared_ptr<State> state) {
+    std::unique_lock lock(state->lock);
+    while (true) {
+        // The first task whose key has no task running.
+        auto next = state->tasks.end();
+        state->taskReady.wait(lock, [&state, &next]() {
+            if (state->isStopping) {
+                return true;
+            }
+            for (next = state->tasks.begin(); next != state->tasks.end(); ++next) {
+                if (state->runningKeys.find(next->key) == state->runningKeys.end()) {
+                    return true;
+                }
+            }
+            return false;
+        });
+        if (state->isStopping) {
+            return;
+        }
+
+        Task task = std::move(*next);
+        state->tasks.erase(next);
+        state->runningKeys.insert(task.key);
+        lock.unlock();
+
+        task.run();
+        // Objects captured by the task are released without the lock held.
+        task.run = nullptr;
+
+        lock.lock();
+        state->runningKeys.erase(task.key);
+        auto pendingCount = state->pendingCounts.find(task.key);
+        if (--pendingCount->second == 0) {
+            state->pendingCounts.erase(pendingCount);
+            state->keyDrained.notify_all();
+        } else {
+            // The next task of the key may be picked by an idle worker.
+            state->taskReady.notify_one();
+        }
+    }
+}
+
+}  // namespace runner
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
@@ -19,6 +19,7 @@
 #include "OutputConfig.pb.h"
 #include "PacketDescriptor.pb.h"
 #include "PipeOptionsConverter.h"
+#include "SemanticDataConverter.h"
 #include "StatusUtil.h"
 
 #include <aidl/android/automotive/computepipe/runner/PacketDescriptor.h>
@@ -95,12 +96,14 @@ Status AidlClientImpl::DispatchSemanticData(int32_t streamId,
     if (status != SUCCESS) {
         return status;
     }
-    desc.data = std::vector(reinterpret_cast<const signed char*>(packetHandle->getData()),
-        reinterpret_cast<const signed char*>(packetHandle->getData() + packetHandle->getSize()));
     desc.size = packetHandle->getSize();
-    if (static_cast<int32_t>(desc.data.size()) != desc.size) {
-        LOG(ERROR) << "mismatch in char data size and reported size";
-        return Status::INVALID_ARGUMENT;
+    if (packetHandle->getSize() > kMaxInlineSemanticDataSize) {
+        status = ToSharedMemory(packetHandle->getData(), packetHandle->getSize(), &desc);
+    } else {
+        status = ToInlineData(packetHandle->getData(), packetHandle->getSize(), &desc);
+    }
+    if (status != Status::SUCCESS) {
+        return status;
     }
     desc.sourceTimeStampMillis = packetHandle->getTimeStamp();
     desc.bufId = 0;
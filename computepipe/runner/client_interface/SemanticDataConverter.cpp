@@ -0,0 +1,72 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "SemanticDataConverter.h"
+
+#include <sys/mman.h>
+
+#include <cstring>
+#include <vector>
+
+#include <android-base/logging.h>
+#include <android/binder_auto_utils.h>
+#include <cutils/ashmem.h>
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace runner {
+namespace client_interface {
+namespace aidl_client {
+
+using ::aidl::android::automotive::computepipe::runner::PacketDescriptor;
+using ::ndk::ScopedFileDescriptor;
+
+Status ToInlineData(const char* data, uint32_t size, PacketDescriptor* desc) {
+    desc->data = std::vector(reinterpret_cast<const signed char*>(data),
+                             reinterpret_cast<const signed char*>(data + size));
+    if (desc->data.size() != size) {
+        LOG(ERROR) << "mismatch in char data size and reported size";
+        return Status::INVALID_ARGUMENT;
+    }
+    return Status::SUCCESS;
+}
+
+Status ToSharedMemory(const char* data, uint32_t size, PacketDescriptor* desc) {
+    ScopedFileDescriptor fd(ashmem_create_region("computepipe_semantic_data", size));
+    if (fd.get() < 0) {
+        LOG(ERROR) << "Unable to create shared memory of size " << size;
+        return Status::NO_MEMORY;
+    }
+    void* mappedData = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd.get(), 0);
+    if (mappedData == MAP_FAILED) {
+        PLOG(ERROR) << "Unable to map shared memory";
+        return Status::INTERNAL_ERROR;
+    }
+    memcpy(mappedData, data, size);
+    munmap(mappedData, size);
+    if (ashmem_set_prot_region(fd.get(), PROT_READ) != 0) {
+        PLOG(ERROR) << "Unable to make shared memory read only";
+        return Status::INTERNAL_ERROR;
+    }
+    desc->dataFds.push_back(std::move(fd));
+    return Status::SUCCESS;
+}
+
+}  // namespace aidl_client
+}  // namespace client_interface
+}  // namespace runner
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
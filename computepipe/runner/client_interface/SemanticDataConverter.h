@@ -0,0 +1,51 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef COMPUTEPIPE_RUNNER_CLIENT_INTERFACE_SEMANTICDATACONVERTER_H_
+#define COMPUTEPIPE_RUNNER_CLIENT_INTERFACE_SEMANTICDATACONVERTER_H_
+
+#include <aidl/android/automotive/computepipe/runner/PacketDescriptor.h>
+
+#include <cstdint>
+
+#include "types/Status.h"
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace runner {
+namespace client_interface {
+namespace aidl_client {
+
+// Semantic data up to this size is delivered in the packet descriptor. Larger
+// data is delivered through shared memory, to be copied only once.
+constexpr uint32_t kMaxInlineSemanticDataSize = 1024;
+
+// Copies semantic data into the data of the descriptor.
+Status ToInlineData(const char* data, uint32_t size,
+                    aidl::android::automotive::computepipe::runner::PacketDescriptor* desc);
+
+// Copies semantic data to a read only shared memory region, referenced by the
+// data fds of the descriptor.
+Status ToSharedMemory(const char* data, uint32_t size,
+                      aidl::android::automotive::computepipe::runner::PacketDescriptor* desc);
+
+}  // namespace aidl_client
+}  // namespace client_interface
+}  // namespace runner
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
+
+#endif  // COMPUTEPIPE_RUNNER_CLIENT_INTERFACE_SEMANTICDATACONVERTER_H_
@@ -220,8 +220,7 @@ void DefaultEngine::DispatchSerializedData(int streamId, int64_t timestamp, std:
         LOG(ERROR) << "Engine::Received bad stream id from prebuilt graph";
         return;
     }
-    std::string data(output);
-    mStreamManagers[streamId]->queuePacket(data.c_str(), data.size(), timestamp);
+    mStreamManagers[streamId]->queuePacket(std::move(output), timestamp);
 }
 
 void DefaultEngine::DispatchGraphTerminationMessage(Status s, std::string&& msg) {
@@ -29,6 +29,18 @@ namespace automotive {
 namespace computepipe {
 namespace graph {
 
+namespace {
+
+// Keys of the tasks run by the executor of a stream set observer. Closing a
+// stream, stopping the observation and reporting the graph termination each
+// run on their own worker, as a stop may wait for the streams to close.
+constexpr int kStreamClosedKey = 0;
+constexpr int kStopObservingKey = 1;
+constexpr int kGraphTerminationKey = 2;
+constexpr uint32_t kExecutorWorkerCount = 3;
+
+}  // namespace
+
 SingleStreamObserver::SingleStreamObserver(int streamId, EndOfStreamReporter* endOfStreamReporter,
                                            StreamGraphInterface* streamGraphInterface) :
       mStreamId(streamId),
@@ -98,10 +110,7 @@ Status SingleStreamObserver::startObservingStream() {
         if (mEndOfStreamReporter) {
             std::lock_guard lock(mStopObservationLock);
             mStopped = true;
-            std::thread t =
-                    std::thread([this]() { mEndOfStreamReporter->reportStreamClosed(mStreamId); });
-
-            t.detach();
+            mEndOfStreamReporter->reportStreamClosed(mStreamId);
         }
 
         proto::OutputStreamResponse streamResponse;
@@ -125,7 +134,9 @@ SingleStreamObserver::~SingleStreamObserver() {
 
 StreamSetObserver::StreamSetObserver(const runner::ClientConfig& clientConfig,
                                      StreamGraphInterface* streamGraphInterface) :
-      mClientConfig(clientConfig), mStreamGraphInterface(streamGraphInterface) {}
+      mClientConfig(clientConfig),
+      mStreamGraphInterface(streamGraphInterface),
+      mExecutor(kExecutorWorkerCount) {}
 
 Status StreamSetObserver::startObservingStreams() {
     std::lock_guard lock(mLock);
@@ -142,8 +153,7 @@ Status StreamSetObserver::startObservingStreams() {
                 std::make_unique<SingleStreamObserver>(it.first, this, mStreamGraphInterface);
         Status status = streamObserver->startObservingStream();
         if (status != Status::SUCCESS) {
-            std::thread t([this]() { stopObservingStreams(true); });
-            t.detach();
+            mExecutor.post(kStopObservingKey, [this]() { stopObservingStreams(true); });
             return status;
         }
         mStreamObservers.emplace(std::make_pair(it.first, std::move(streamObserver)));
@@ -157,11 +167,8 @@ void StreamSetObserver::stopObservingStreams(bool stopImmediately) {
     std::unique_lock lock(mLock);
     if (mStopped) {
         // Separate thread is necessary here to avoid recursive locking.
-        if (mGraphTerminationThread.joinable()) {
-            mGraphTerminationThread.join();
-        }
-        mGraphTerminationThread = std::thread([this]() {
-            this->mStreamGraphInterface->dispatchGraphTerminationMessage(Status::SUCCESS, "");
+        mExecutor.post(kGraphTerminationKey, [streamGraphInterface(mStreamGraphInterface)]() {
+            streamGraphInterface->dispatchGraphTerminationMessage(Status::SUCCESS, "");
         });
         return;
     }
@@ -177,6 +184,11 @@ void StreamSetObserver::stopObservingStreams(bool stopImmediately) {
 }
 
 void StreamSetObserver::reportStreamClosed(int streamId) {
+    // Removing the stream observer waits for the observation thread.
+    mExecutor.post(kStreamClosedKey, [this, streamId]() { handleStreamClosed(streamId); });
+}
+
+void StreamSetObserver::handleStreamClosed(int streamId) {
     std::lock_guard lock(mLock);
     auto streamObserver = mStreamObservers.find(streamId);
     if (streamObserver == mStreamObservers.end()) {
@@ -186,17 +198,22 @@ void StreamSetObserver::reportStreamClosed(int streamId) {
     if (mStreamObservers.empty()) {
         mStopped = true;
         mStoppedCv.notify_one();
-        mGraphTerminationThread = std::thread([streamGraphInterface(mStreamGraphInterface)]() {
+        mExecutor.post(kGraphTerminationKey, [streamGraphInterface(mStreamGraphInterface)]() {
             streamGraphInterface->dispatchGraphTerminationMessage(Status::SUCCESS, "");
         });
     }
 }
 
 StreamSetObserver::~StreamSetObserver() {
-    std::unique_lock lock(mLock);
-    if (mGraphTerminationThread.joinable()) {
-        mGraphTerminationThread.join();
+    std::map<int, std::unique_ptr<SingleStreamObserver>> streamObservers;
+    {
+        std::lock_guard lock(mLock);
+        streamObservers.swap(mStreamObservers);
+        mStopped = true;
     }
+    mStoppedCv.notify_all();
+    // Waits for the observation threads, which may still report closed streams.
+    streamObservers.clear();
 }
 
 }  // namespace graph
@@ -22,6 +22,7 @@
 #include <string>
 #include <thread>
 
+#include "DispatchExecutor.h"
 #include "GrpcPrebuiltGraphService.grpc.pb.h"
 #include "GrpcPrebuiltGraphService.pb.h"
 #include "InputFrame.h"
@@ -39,6 +40,8 @@ class EndOfStreamReporter {
   public:
     virtual ~EndOfStreamReporter() = default;
 
+    // Called from the observation thread of the stream, so it must not wait
+    // for that thread.
     virtual void reportStreamClosed(int streamId) = 0;
 };
 
@@ -89,13 +92,18 @@ class StreamSetObserver : public EndOfStreamReporter {
 
     void reportStreamClosed(int streamId) override;
   private:
+    void handleStreamClosed(int streamId);
+
     const runner::ClientConfig& mClientConfig;
     StreamGraphInterface* mStreamGraphInterface;
     std::map<int, std::unique_ptr<SingleStreamObserver>> mStreamObservers;
     std::mutex mLock;
     std::condition_variable mStoppedCv;
-    std::thread mGraphTerminationThread;
     bool mStopped = true;
+    // Runs the callbacks that cannot be run under mLock. Declared last so that
+    // it is destroyed, waiting for the running callbacks, before the members
+    // they use.
+    runner::DispatchExecutor mExecutor;
 };
 
 }  // namespace graph
@@ -0,0 +1,97 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef COMPUTEPIPE_RUNNER_DISPATCH_EXECUTOR_H
+#define COMPUTEPIPE_RUNNER_DISPATCH_EXECUTOR_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace runner {
+
+/**
+ * Runs callbacks that must not be run on the calling thread, e.g. to avoid
+ * lock cycles, on a fixed set of worker threads.
+ *
+ * Tasks are posted with a key. Tasks of the same key run one at a time, in the
+ * order they were posted, while tasks of different keys may run concurrently.
+ */
+class DispatchExecutor {
+  public:
+    explicit DispatchExecutor(uint32_t workerCount);
+
+    /**
+     * Drops the tasks that have not started, and waits for the running ones.
+     */
+    ~DispatchExecutor();
+
+    DispatchExecutor(const DispatchExecutor&) = delete;
+    DispatchExecutor& operator=(const DispatchExecutor&) = delete;
+
+    /**
+     * Queues |task| after the tasks previously posted with |key|. Returns
+     * false, dropping the task, if |maxPendingTasks| tasks of |key| are already
+     * queued or running. 0 means no limit.
+     */
+    bool post(int key, std::function<void()> task, uint32_t maxPendingTasks = 0);
+
+    /**
+     * Waits until the tasks posted with |key| so far have run. Must not be
+     * called from a task of |key|.
+     */
+    void drain(int key);
+
+  private:
+    struct Task {
+        int key;
+        std::function<void()> run;
+    };
+
+    // State shared with the workers, which keep it alive in case the executor
+    // is destroyed by a task, e.g. when it releases the last reference to the
+    // executor owner.
+    struct State {
+        std::mutex lock;
+        std::condition_variable taskReady;
+        std::condition_variable keyDrained;
+        std::deque<Task> tasks;
+        // Number of queued and running tasks, per key.
+        std::map<int, uint32_t> pendingCounts;
+        std::set<int> runningKeys;
+        bool isStopping = false;
+    };
+
+    static void runTasks(std::shared_ptr<State> state);
+
+    std::shared_ptr<State> mState;
+    std::vector<std::thread> mWorkers;
+};
+
+}  // namespace runner
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
+
+#endif  // COMPUTEPIPE_RUNNER_DISPATCH_EXECUTOR_H
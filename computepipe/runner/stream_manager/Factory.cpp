@@ -26,6 +26,9 @@ namespace stream_manager {
 
 namespace {
 
+// Packets of different streams are dispatched concurrently by this many threads.
+constexpr uint32_t kDefaultDispatchWorkerCount = 2;
+
 /**
  * Build an instance of the Semantic Manager and initialize it
  */
@@ -43,9 +46,9 @@ std::unique_ptr<SemanticManager> buildSemanticManager(const proto::OutputConfig&
 
 std::unique_ptr<PixelStreamManager> buildPixelStreamManager(
     const proto::OutputConfig& config, std::shared_ptr<StreamEngineInterface> engine,
-    uint32_t maxPackets) {
-    std::unique_ptr<PixelStreamManager> pixelStreamManager =
-        std::make_unique<PixelStreamManager>(config.stream_name(), config.stream_id());
+    uint32_t maxPackets, std::shared_ptr<DispatchExecutor> dispatchExecutor) {
+    std::unique_ptr<PixelStreamManager> pixelStreamManager = std::make_unique<PixelStreamManager>(
+        config.stream_name(), config.stream_id(), std::move(dispatchExecutor));
     pixelStreamManager->setEngineInterface(engine);
     if (pixelStreamManager->setMaxInFlightPackets(maxPackets) != Status::SUCCESS) {
         return nullptr;
@@ -55,6 +58,14 @@ std::unique_ptr<PixelStreamManager> buildPixelStreamManager(
 
 }  // namespace
 
+StreamManagerFactory::StreamManagerFactory()
+    : StreamManagerFactory(kDefaultDispatchWorkerCount) {
+}
+
+StreamManagerFactory::StreamManagerFactory(uint32_t dispatchWorkerCount)
+    : mDispatchWorkerCount(dispatchWorkerCount) {
+}
+
 std::unique_ptr<StreamManager> StreamManagerFactory::getStreamManager(
     const proto::OutputConfig& config, std::shared_ptr<StreamEngineInterface> engine,
     uint32_t maxPackets) {
@@ -65,7 +76,10 @@ std::unique_ptr<StreamManager> StreamManagerFactory::getStreamManager(
         case proto::PacketType::SEMANTIC_DATA:
             return buildSemanticManager(config, engine, maxPackets);
         case proto::PacketType::PIXEL_DATA:
-            return buildPixelStreamManager(config, engine, maxPackets);
+            if (mDispatchExecutor == nullptr) {
+                mDispatchExecutor = std::make_shared<DispatchExecutor>(mDispatchWorkerCount);
+            }
+            return buildPixelStreamManager(config, engine, maxPackets, mDispatchExecutor);
         default:
             return nullptr;
     }
@@ -18,7 +18,6 @@
 
 #include <algorithm>
 #include <mutex>
-#include <thread>
 
 #include "PixelFormatUtils.h"
 
@@ -188,6 +187,11 @@ Status PixelStreamManager::queuePacket(const char* /*data*/, const uint32_t /*si
     return Status::ILLEGAL_STATE;
 }
 
+Status PixelStreamManager::queuePacket(std::string&& /*data*/, uint64_t /*timestamp*/) {
+    LOG(ERROR) << "Trying to queue a semantic packet to a pixel stream manager";
+    return Status::ILLEGAL_STATE;
+}
+
 Status PixelStreamManager::queuePacket(const InputFrame& frame, uint64_t timestamp) {
     std::lock_guard lock(mLock);
 
@@ -235,15 +239,24 @@ Status PixelStreamManager::queuePacket(const InputFrame& frame, uint64_t timesta
     }
 
     // Dispatch packet to the engine asynchronously in order to avoid circularly
-    // waiting for each others' locks.
-    std::thread t([this, memHandle]() {
-        Status status = mEngine->dispatchPacket(memHandle);
-        if (status != Status::SUCCESS) {
-            mEngine->notifyError(std::string(__func__) + ":" + std::to_string(__LINE__) +
-                                 " Failed to dispatch packet");
-        }
-    });
-    t.detach();
+    // waiting for each others' locks. The task does not refer to this manager,
+    // so it may still run after the manager is destroyed.
+    std::shared_ptr<StreamEngineInterface> engine = mEngine;
+    bool isPosted = mDispatchExecutor->post(
+        mStreamId,
+        [engine, memHandle]() {
+            Status status = engine->dispatchPacket(memHandle);
+            if (status != Status::SUCCESS) {
+                engine->notifyError(std::string(__func__) + ":" + std::to_string(__LINE__) +
+                                    " Failed to dispatch packet");
+            }
+        },
+        mMaxInFlightPackets);
+    if (!isPosted) {
+        LOG(INFO) << "Too many frames pending dispatch. Skipping frame at timestamp " << timestamp;
+        mBuffersInUse.erase(memHandle->getBufferId());
+        mBuffersReady.push_back(memHandle);
+    }
     return Status::SUCCESS;
 }
 
@@ -273,7 +286,7 @@ Status PixelStreamManager::handleStopWithFlushPhase(const RunnerEvent& e) {
 }
 
 Status PixelStreamManager::handleStopImmediatePhase(const RunnerEvent& e) {
-    std::lock_guard<std::mutex> lock(mStateLock);
+    std::unique_lock<std::mutex> lock(mStateLock);
     if (mState == CONFIG_DONE || mState == RESET) {
         return ILLEGAL_STATE;
     }
@@ -284,11 +297,20 @@ Status PixelStreamManager::handleStopImmediatePhase(const RunnerEvent& e) {
     /* We are being asked to stop */
     if (mState == RUNNING && e.isPhaseEntry()) {
         mState = STOPPED;
-        std::thread t([this]() {
-            freeAllPackets();
-            mEngine->notifyEndOfStream();
-        });
-        t.detach();
+        // mLock is taken before mStateLock by queuePacket.
+        lock.unlock();
+        freeAllPackets();
+
+        // The end of stream is reported once the packets queued before are
+        // dispatched.
+        std::shared_ptr<StreamEngineInterface> engine;
+        {
+            std::lock_guard<std::mutex> engineLock(mLock);
+            engine = mEngine;
+        }
+        if (!mDispatchExecutor->post(mStreamId, [engine]() { engine->notifyEndOfStream(); })) {
+            LOG(ERROR) << "Unable to report the end of stream " << mStreamId;
+        }
         return SUCCESS;
     }
     /* Other Components have stopped, we can transition back to CONFIG_DONE */
@@ -321,8 +343,11 @@ std::shared_ptr<MemHandle> PixelStreamManager::clonePacket(std::shared_ptr<MemHa
     return handle;
 }
 
-PixelStreamManager::PixelStreamManager(std::string name, int streamId)
-    : StreamManager(name, proto::PacketType::PIXEL_DATA), mStreamId(streamId) {
+PixelStreamManager::PixelStreamManager(std::string name, int streamId,
+                                       std::shared_ptr<DispatchExecutor> dispatchExecutor)
+    : StreamManager(name, proto::PacketType::PIXEL_DATA),
+      mStreamId(streamId),
+      mDispatchExecutor(std::move(dispatchExecutor)) {
 }
 
 }  // namespace stream_manager
@@ -21,6 +21,7 @@
 #include <mutex>
 #include <vector>
 
+#include "DispatchExecutor.h"
 #include "InputFrame.h"
 #include "MemHandle.h"
 #include "RunnerComponent.h"
@@ -77,6 +78,8 @@ class PixelStreamManager : public StreamManager, StreamManagerInit {
     Status freePacket(int bufferId) override;
     // Queue packet produced by graph stream
     Status queuePacket(const char* data, const uint32_t size, uint64_t timestamp) override;
+    // Semantic packets are not supported by a pixel stream manager
+    Status queuePacket(std::string&& data, uint64_t timestamp) override;
     // Queues pixel packet produced by graph stream
     Status queuePacket(const InputFrame& frame, uint64_t timestamp) override;
     /* Make a copy of the packet. */
@@ -86,7 +89,10 @@ class PixelStreamManager : public StreamManager, StreamManagerInit {
     Status handleStopWithFlushPhase(const RunnerEvent& e) override;
     Status handleStopImmediatePhase(const RunnerEvent& e) override;
 
-    explicit PixelStreamManager(std::string name, int streamId);
+    // Packets are dispatched to the engine through |dispatchExecutor|, keyed
+    // by the stream id.
+    explicit PixelStreamManager(std::string name, int streamId,
+                                std::shared_ptr<DispatchExecutor> dispatchExecutor);
     ~PixelStreamManager() = default;
 
   private:
@@ -96,6 +102,7 @@ class PixelStreamManager : public StreamManager, StreamManagerInit {
     int mStreamId;
     uint32_t mMaxInFlightPackets;
     std::shared_ptr<StreamEngineInterface> mEngine;
+    std::shared_ptr<DispatchExecutor> mDispatchExecutor;
 
     struct BufferMetadata {
         int outstandingRefCount;
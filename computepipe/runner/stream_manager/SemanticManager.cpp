@@ -2,7 +2,7 @@
 
 #include <android-base/logging.h>
 
-#include <cstdlib>
+#include <utility>
 #include <thread>
 
 #include "InputFrame.h"
@@ -23,11 +23,11 @@ uint64_t SemanticHandle::getTimeStamp() const {
 }
 
 uint32_t SemanticHandle::getSize() const {
-    return mSize;
+    return mData.size();
 }
 
 const char* SemanticHandle::getData() const {
-    return mData;
+    return mData.c_str();
 }
 
 AHardwareBuffer* SemanticHandle::getHardwareBuffer() const {
@@ -44,28 +44,18 @@ int SemanticHandle::getBufferId() const {
     return -1;
 }
 
-Status SemanticHandle::setMemInfo(int streamId, const char* data, uint32_t size, uint64_t timestamp,
+Status SemanticHandle::setMemInfo(int streamId, std::string&& data, uint64_t timestamp,
                                   const proto::PacketType& type) {
-    if (data == nullptr || size == 0 || size > kMaxSemanticDataSize) {
+    if (data.empty() || data.size() > kMaxSemanticDataSize) {
         return INVALID_ARGUMENT;
     }
     mStreamId = streamId;
-    mData = (char*)malloc(size);
-    if (!mData) {
-        return NO_MEMORY;
-    }
-    memcpy(mData, data, size);
+    mData = std::move(data);
     mType = type;
     mTimestamp = timestamp;
-    mSize = size;
     return SUCCESS;
 }
 
-/* Destroy local copy */
-SemanticHandle::~SemanticHandle() {
-    free(mData);
-}
-
 void SemanticManager::setEngineInterface(std::shared_ptr<StreamEngineInterface> engine) {
     mEngine = engine;
     std::lock_guard<std::mutex> lock(mStateLock);
@@ -144,6 +134,14 @@ Status SemanticManager::freePacket(int /* bufferId */) {
 }
 
 Status SemanticManager::queuePacket(const char* data, const uint32_t size, uint64_t timestamp) {
+    // Checked before the copy, which must not read past the data.
+    if (data == nullptr || size > SemanticHandle::kMaxSemanticDataSize) {
+        return INVALID_ARGUMENT;
+    }
+    return queuePacket(std::string(data, size), timestamp);
+}
+
+Status SemanticManager::queuePacket(std::string&& data, uint64_t timestamp) {
     std::lock_guard<std::mutex> lock(mStateLock);
     // We drop the packet since we have received the stop notifications.
     if (mState != RUNNING) {
@@ -154,7 +152,7 @@ Status SemanticManager::queuePacket(const char* data, const uint32_t size, uint6
         return INTERNAL_ERROR;
     }
     auto memHandle = std::make_shared<SemanticHandle>();
-    auto status = memHandle->setMemInfo(mStreamId, data, size, timestamp, mType);
+    auto status = memHandle->setMemInfo(mStreamId, std::move(data), timestamp, mType);
     if (status != SUCCESS) {
         return status;
     }
@@ -16,6 +16,7 @@
 #define COMPUTEPIPE_RUNNER_STREAM_MANAGER_SEMANTIC_MANAGER_H
 
 #include <mutex>
+#include <string>
 
 #include "InputFrame.h"
 #include "OutputConfig.pb.h"
@@ -31,7 +32,7 @@ namespace stream_manager {
 
 class SemanticHandle : public MemHandle {
   public:
-    static constexpr uint32_t kMaxSemanticDataSize = 1024;
+    static constexpr uint32_t kMaxSemanticDataSize = 16 * 1024 * 1024;
     /**
      * Override mem handle methods
      */
@@ -42,15 +43,12 @@ class SemanticHandle : public MemHandle {
     uint32_t getSize() const override;
     const char* getData() const override;
     AHardwareBuffer* getHardwareBuffer() const override;
-    /* set info for the memory. Make a copy */
-    Status setMemInfo(int streamId, const char* data, uint32_t size, uint64_t timestamp,
+    /* set info for the memory. Take ownership of data without copying it */
+    Status setMemInfo(int streamId, std::string&& data, uint64_t timestamp,
                       const proto::PacketType& type);
-    /* Destroy local copy */
-    ~SemanticHandle();
 
   private:
-    char* mData = nullptr;
-    uint32_t mSize;
+    std::string mData;
     uint64_t mTimestamp;
     proto::PacketType mType;
     int mStreamId;
@@ -65,6 +63,8 @@ class SemanticManager : public StreamManager, StreamManagerInit {
     Status freePacket(int bufferId) override;
     /* Queue packet produced by graph stream */
     Status queuePacket(const char* data, const uint32_t size, uint64_t timestamp) override;
+    /* Queue packet produced by graph stream without copying its data */
+    Status queuePacket(std::string&& data, uint64_t timestamp) override;
     /* Queues an image packet produced by graph stream */
     Status queuePacket(const InputFrame& inputData, uint64_t timestamp) override;
     /* Make a copy of the packet. */
@@ -19,6 +19,7 @@
 #include <memory>
 #include <string>
 
+#include "DispatchExecutor.h"
 #include "InputFrame.h"
 #include "MemHandle.h"
 #include "OutputConfig.pb.h"
@@ -68,6 +69,8 @@ class StreamManager : public RunnerComponentInterface {
     virtual Status freePacket(int bufferId) = 0;
     /* Queue's packet produced by graph stream */
     virtual Status queuePacket(const char* data, const uint32_t size, uint64_t timestamp) = 0;
+    /* Queues a packet produced by graph stream, taking ownership of its data */
+    virtual Status queuePacket(std::string&& data, uint64_t timestamp) = 0;
     /* Queues a pixel stream packet produced by graph stream */
     virtual Status queuePacket(const InputFrame& pixelData, uint64_t timestamp) = 0;
     /* Destructor */
@@ -93,7 +96,17 @@ class StreamManagerFactory {
     StreamManagerFactory(const StreamManagerFactory&&) = delete;
     StreamManagerFactory& operator=(const StreamManagerFactory&&) = delete;
     StreamManagerFactory& operator=(const StreamManagerFactory&) = delete;
-    StreamManagerFactory() = default;
+    StreamManagerFactory();
+    /**
+     * The packets of the pixel streams built by the factory are dispatched to
+     * the engine by |dispatchWorkerCount| threads, in order within a stream.
+     */
+    explicit StreamManagerFactory(uint32_t dispatchWorkerCount);
+
+  private:
+    uint32_t mDispatchWorkerCount;
+    // Shared by the pixel stream managers, created with the first of them.
+    std::shared_ptr<DispatchExecutor> mDispatchExecutor;
 };
 
 }  // namespace stream_manager
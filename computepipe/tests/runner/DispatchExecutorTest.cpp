@@ -0,0 +1,143 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "DispatchExecutor.h"
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace runner {
+namespace {
+
+TEST(DispatchExecutorTest, TasksOfAKeyRunInPostingOrder) {
+    constexpr int kKeyCount = 4;
+    constexpr int kTaskCount = 1000;
+    DispatchExecutor executor(3);
+
+    std::mutex lock;
+    std::map<int, std::vector<int>> runOrders;
+    std::atomic<int> runningTasks[kKeyCount] = {};
+    std::atomic<bool> isOverlapping = false;
+    for (int i = 0; i < kTaskCount; i++) {
+        for (int key = 0; key < kKeyCount; key++) {
+            ASSERT_TRUE(executor.post(key, [&, key, i]() {
+                if (runningTasks[key]++ != 0) {
+                    isOverlapping = true;
+                }
+                {
+                    std::lock_guard guard(lock);
+                    runOrders[key].push_back(i);
+                }
+                runningTasks[key]--;
+            }));
+        }
+    }
+
+    for (int key = 0; key < kKeyCount; key++) {
+        executor.drain(key);
+        std::lock_guard guard(lock);
+        ASSERT_EQ(runOrders[key].size(), kTaskCount);
+        for (int i = 0; i < kTaskCount; i++) {
+            EXPECT_EQ(runOrders[key][i], i);
+        }
+    }
+    EXPECT_FALSE(isOverlapping);
+}
+
+TEST(DispatchExecutorTest, TasksOfDifferentKeysRunConcurrently) {
+    DispatchExecutor executor(2);
+    std::promise<void> released;
+    std::shared_future<void> isReleased = released.get_future().share();
+
+    // The first key blocks until a task of the second key runs.
+    ASSERT_TRUE(executor.post(0, [isReleased]() { isReleased.wait(); }));
+    ASSERT_TRUE(executor.post(1, [&released]() { released.set_value(); }));
+    EXPECT_EQ(isReleased.wait_for(std::chrono::seconds(1)), std::future_status::ready);
+    executor.drain(0);
+}
+
+TEST(DispatchExecutorTest, PostFailsWhenTooManyTasksArePending) {
+    DispatchExecutor executor(1);
+    std::promise<void> released;
+    std::shared_future<void> isReleased = released.get_future().share();
+
+    ASSERT_TRUE(executor.post(0, [isReleased]() { isReleased.wait(); }, 2));
+    ASSERT_TRUE(executor.post(0, []() {}, 2));
+    EXPECT_FALSE(executor.post(0, []() {}, 2));
+    // The limit applies per key.
+    EXPECT_TRUE(executor.post(1, []() {}, 2));
+
+    released.set_value();
+    executor.drain(0);
+    EXPECT_TRUE(executor.post(0, []() {}, 2));
+}
+
+TEST(DispatchExecutorTest, DestructionDropsQueuedTasks) {
+    std::atomic<int> runCount = 0;
+    std::promise<void> started;
+    std::promise<void> released;
+    std::thread releaser;
+    {
+        DispatchExecutor executor(1);
+        ASSERT_TRUE(executor.post(0, [&]() {
+            started.set_value();
+            released.get_future().wait();
+            runCount++;
+        }));
+        for (int i = 0; i < 10; i++) {
+            ASSERT_TRUE(executor.post(0, [&runCount]() { runCount++; }));
+        }
+        started.get_future().wait();
+        releaser = std::thread([&released]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            released.set_value();
+        });
+    }
+    releaser.join();
+    // Only the running task completed.
+    EXPECT_EQ(runCount, 1);
+}
+
+TEST(DispatchExecutorTest, TaskCanDestroyTheExecutor) {
+    auto executor = std::make_unique<DispatchExecutor>(2);
+    std::promise<void> posted;
+    std::shared_future<void> isPosted = posted.get_future().share();
+    std::promise<void> destroyed;
+    ASSERT_TRUE(executor->post(0, [&executor, isPosted, &destroyed]() {
+        isPosted.wait();
+        executor.reset();
+        destroyed.set_value();
+    }));
+    posted.set_value();
+    EXPECT_EQ(destroyed.get_future().wait_for(std::chrono::seconds(1)),
+              std::future_status::ready);
+}
+
+}  // namespace
+}  // namespace runner
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
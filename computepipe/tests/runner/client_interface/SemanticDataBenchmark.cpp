@@ -0,0 +1,62 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <aidl/android/automotive/computepipe/runner/PacketDescriptor.h>
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+#include "runner/client_interface/SemanticDataConverter.h"
+#include "types/Status.h"
+
+using ::aidl::android::automotive::computepipe::runner::PacketDescriptor;
+
+namespace android {
+namespace automotive {
+namespace computepipe {
+namespace runner {
+namespace client_interface {
+namespace aidl_client {
+namespace {
+
+// Both paths are measured at every size, although semantic data goes through
+// shared memory only past kMaxInlineSemanticDataSize. The cost of sending the
+// descriptor to the client is not included: inline data is copied once more
+// into the binder transaction, while shared memory only passes its fd.
+template <Status (*Convert)(const char*, uint32_t, PacketDescriptor*)>
+void BM_SemanticData(benchmark::State& state) {
+    const std::string data(state.range(0), 'a');
+    for (auto _ : state) {
+        PacketDescriptor desc;
+        if (Convert(data.data(), data.size(), &desc) != Status::SUCCESS) {
+            state.SkipWithError("Unable to convert the semantic data");
+            break;
+        }
+        benchmark::DoNotOptimize(desc);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK_TEMPLATE(BM_SemanticData, ToInlineData)->Arg(1024)->Arg(100 * 1024)->Arg(2 << 20);
+BENCHMARK_TEMPLATE(BM_SemanticData, ToSharedMemory)->Arg(1024)->Arg(100 * 1024)->Arg(2 << 20);
+
+}  // namespace
+}  // namespace aidl_client
+}  // namespace client_interface
+}  // namespace runner
+}  // namespace computepipe
+}  // namespace automotive
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -19,6 +19,10 @@
 #include <vndk/hardware_buffer.h>
 #include <android-base/logging.h>
 
+#include <chrono>
+#include <future>
+#include <mutex>
+
 #include "EventGenerator.h"
 #include "InputFrame.h"
 #include "MockEngine.h"
@@ -384,6 +388,80 @@ TEST(PixelStreamManagerTest, MultipleFreePacketReleasesPacketAfterClone) {
     EXPECT_THAT(memHandle->getTimeStamp(), 30);
 }
 
+TEST(PixelStreamManagerTest, PacketsAreDispatchedInQueueingOrder) {
+    int maxInFlightPackets = 4;
+    auto [mockEngine, manager] = CreateStreamManagerAndEngine(maxInFlightPackets);
+    StreamManager* streamManager = manager.get();
+
+    DefaultEvent e = DefaultEvent::generateEntryEvent(DefaultEvent::Phase::RUN);
+    ASSERT_EQ(manager->handleExecutionPhase(e), Status::SUCCESS);
+    std::vector<uint8_t> data(16 * 16 * 3, 100);
+    InputFrame frame(16, 16, PixelFormat::RGB, 16 * 3, &data[0]);
+
+    std::mutex timestampsLock;
+    std::vector<uint64_t> dispatchedTimestamps;
+    EXPECT_CALL((*mockEngine), dispatchPacket)
+        .WillRepeatedly([&](const std::shared_ptr<MemHandle>& memHandle) {
+            {
+                std::lock_guard lock(timestampsLock);
+                dispatchedTimestamps.push_back(memHandle->getTimeStamp());
+            }
+            streamManager->freePacket(memHandle->getBufferId());
+            return Status::SUCCESS;
+        });
+    std::promise<void> endOfStream;
+    EXPECT_CALL((*mockEngine), notifyEndOfStream).WillOnce([&endOfStream]() {
+        endOfStream.set_value();
+    });
+
+    for (uint64_t timestamp = 1; timestamp <= 500; timestamp++) {
+        EXPECT_EQ(manager->queuePacket(frame, timestamp), Status::SUCCESS);
+    }
+    EXPECT_EQ(manager->handleStopImmediatePhase(e), Status::SUCCESS);
+    ASSERT_EQ(endOfStream.get_future().wait_for(std::chrono::seconds(5)),
+              std::future_status::ready);
+
+    // Packets may be skipped, but never reordered or dispatched after the end
+    // of stream.
+    std::lock_guard lock(timestampsLock);
+    ASSERT_FALSE(dispatchedTimestamps.empty());
+    for (size_t i = 1; i < dispatchedTimestamps.size(); i++) {
+        EXPECT_LT(dispatchedTimestamps[i - 1], dispatchedTimestamps[i]);
+    }
+}
+
+TEST(PixelStreamManagerTest, ManagerCanBeDestroyedRightAfterStoppage) {
+    int maxInFlightPackets = 8;
+    // The factory outlives the manager, as in the engine.
+    StreamManagerFactory factory;
+    proto::OutputConfig outputConfig;
+    outputConfig.set_type(proto::PacketType::PIXEL_DATA);
+    outputConfig.set_stream_name("pixel_stream");
+    std::shared_ptr<MockEngine> mockEngine = std::make_shared<MockEngine>();
+    std::unique_ptr<StreamManager> manager =
+        factory.getStreamManager(outputConfig, mockEngine, maxInFlightPackets);
+
+    DefaultEvent e = DefaultEvent::generateEntryEvent(DefaultEvent::Phase::RUN);
+    ASSERT_EQ(manager->handleExecutionPhase(e), Status::SUCCESS);
+    std::vector<uint8_t> data(16 * 16 * 3, 100);
+    InputFrame frame(16, 16, PixelFormat::RGB, 16 * 3, &data[0]);
+
+    EXPECT_CALL((*mockEngine), dispatchPacket).WillRepeatedly(Return(Status::SUCCESS));
+    std::promise<void> endOfStream;
+    EXPECT_CALL((*mockEngine), notifyEndOfStream).WillOnce([&endOfStream]() {
+        endOfStream.set_value();
+    });
+
+    for (uint64_t timestamp = 1; timestamp <= maxInFlightPackets; timestamp++) {
+        EXPECT_EQ(manager->queuePacket(frame, timestamp), Status::SUCCESS);
+    }
+    EXPECT_EQ(manager->handleStopImmediatePhase(e), Status::SUCCESS);
+    // Pending dispatches do not refer to the destroyed manager, and the end of
+    // stream is still reported.
+    manager.reset();
+    EXPECT_EQ(endOfStream.get_future().wait_for(std::chrono::seconds(5)),
+              std::future_status::ready);
+}
 
 }  // namespace
 }  // namespace stream_manager
@@ -21,6 +21,7 @@
 #include "MockEngine.h"
 #include "OutputConfig.pb.h"
 #include "RunnerComponent.h"
+#include "SemanticManager.h"
 #include "StreamEngineInterface.h"
 #include "StreamManager.h"
 #include "gmock/gmock-matchers.h"
@@ -35,7 +36,7 @@ using testing::Return;
 
 class SemanticManagerTest : public ::testing::Test {
   protected:
-    static constexpr uint32_t kMaxSemanticDataSize = 1024;
+    static constexpr uint32_t kMaxSemanticDataSize = SemanticHandle::kMaxSemanticDataSize;
     /**
      * Setup for the test fixture to initialize the semantic manager
      * After this, the semantic manager should be in RESET state.
@@ -81,3 +82,27 @@ TEST_F(SemanticManagerTest, PacketQueueTest) {
     manager->queuePacket(fakeData.c_str(), size, 0);
     EXPECT_STREQ(mCurrentPacket->getData(), fakeData.c_str());
 }
+
+/**
+ * Checks that a moved packet is dispatched without copying its data.
+ * Checks moved packets with bad arguments.
+ */
+TEST_F(SemanticManagerTest, MovedPacketQueueTest) {
+    DefaultEvent e = DefaultEvent::generateEntryEvent(DefaultEvent::Phase::RUN);
+    std::shared_ptr<MockEngine> mockEngine = std::make_shared<MockEngine>();
+    std::unique_ptr<StreamManager> manager = SetupStreamManager(mockEngine);
+    ASSERT_EQ(manager->handleExecutionPhase(e), Status::SUCCESS);
+    EXPECT_EQ(manager->queuePacket(std::string(), 0), Status::INVALID_ARGUMENT);
+    EXPECT_EQ(manager->queuePacket(std::string(kMaxSemanticDataSize + 1, 'a'), 0),
+              Status::INVALID_ARGUMENT);
+    EXPECT_CALL((*mockEngine), dispatchPacket)
+        .WillOnce(testing::DoAll(testing::SaveArg<0>(&mCurrentPacket), (Return(Status::SUCCESS))));
+
+    std::string fakeData(100 * 1024, 'a');
+    const char* fakeDataPtr = fakeData.data();
+    EXPECT_EQ(manager->queuePacket(std::move(fakeData), 10), Status::SUCCESS);
+    ASSERT_NE(mCurrentPacket, nullptr);
+    EXPECT_EQ(mCurrentPacket->getData(), fakeDataPtr);
+    EXPECT_EQ(mCurrentPacket->getSize(), 100 * 1024);
+    EXPECT_EQ(mCurrentPacket->getTimeStamp(), 10);
+}
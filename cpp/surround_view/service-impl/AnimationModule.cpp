@@ -19,6 +19,7 @@
 
 #include <android-base/logging.h>
 #include <algorithm>
+#include <set>
 
 namespace android {
 namespace hardware {
@@ -53,6 +54,18 @@ inline uint64_t getCombinedId(const VehiclePropValue& vhalValueFloat) {
     return static_cast<uint64_t>(vhalValueFloat.prop) << 32 | vhalValueFloat.areaId;
 }
 
+// Returns true if |op| changes its part over time with the current vhal value.
+template <typename AnimationOp>
+bool isInProgress(const AnimationOp& op, bool isOff, float progress) {
+    if (isOff) {
+        return progress > 0;
+    }
+    if (op.type == ROTATION_SPEED || op.type == ADJUST_GAMMA_REPEAT) {
+        return true;
+    }
+    return op.animationTime != 0 && progress < 1;
+}
+
 float getVhalValueFloat(const VehiclePropValue& vhalValue) {
     int32_t type = vhalValue.prop & 0x00FF0000;
     switch (type) {
@@ -73,116 +86,253 @@ float getVhalValueFloat(const VehiclePropValue& vhalValue) {
 AnimationModule::AnimationModule(const std::map<std::string, CarPart>& partsMap,
                                  const std::map<std::string, CarTexture>& texturesMap,
                                  const std::vector<AnimationInfo>& animations) :
-      mIsCalled(false), mPartsMap(partsMap), mTexturesMap(texturesMap), mAnimations(animations) {
-    mapVhalToParts();
-    initCarPartStatus();
+      mIsCalled(false),
+      mIsAnimating(false),
+      mIsFullUpdateRequested(false),
+      mTexturesMap(texturesMap) {
+    initCarPartStatus(partsMap, animations);
+    mapVhalToParts(animations);
 }
 
-void AnimationModule::mapVhalToParts() {
-    for (const auto& animationInfo : mAnimations) {
-        auto partId = animationInfo.partId;
-        for (const auto& gammaOp : animationInfo.gammaOpsMap) {
-            if (mVhalToPartsMap.find(gammaOp.first) != mVhalToPartsMap.end()) {
-                mVhalToPartsMap.at(gammaOp.first).insert(partId);
-            } else {
-                mVhalToPartsMap.emplace(
-                        std::make_pair(gammaOp.first, std::set<std::string>{partId}));
-            }
+void AnimationModule::initCarPartStatus(const std::map<std::string, CarPart>& partsMap,
+                                        const std::vector<AnimationInfo>& animations) {
+    // Get child parts list from the animations.
+    std::map<std::string, std::vector<std::string>> childIdsMap;
+    for (const auto& animationInfo : animations) {
+        childIdsMap.emplace(std::make_pair(animationInfo.partId, animationInfo.childIds));
+    }
+
+    std::map<std::string, std::string> parentIdsMap;
+    for (const auto& childIds : childIdsMap) {
+        if (partsMap.find(childIds.first) == partsMap.end()) {
+            continue;
         }
-        for (const auto& textureOp : animationInfo.textureOpsMap) {
-            if (mVhalToPartsMap.find(textureOp.first) != mVhalToPartsMap.end()) {
-                mVhalToPartsMap.at(textureOp.first).insert(partId);
-            } else {
-                mVhalToPartsMap.emplace(
-                        std::make_pair(textureOp.first, std::set<std::string>{partId}));
+        for (const auto& childId : childIds.second) {
+            if (partsMap.find(childId) == partsMap.end()) {
+                LOG(WARNING) << "Child part " << childId << " of " << childIds.first
+                             << " not found. Ignored.";
+                continue;
+            }
+            const auto parentId = parentIdsMap.emplace(std::make_pair(childId, childIds.first));
+            if (!parentId.second) {
+                LOG(WARNING) << "Part " << childId << " has multiple parents. Using "
+                             << parentId.first->second << " as its parent.";
             }
         }
-        for (const auto& rotationOp : animationInfo.rotationOpsMap) {
-            if (mVhalToPartsMap.find(rotationOp.first) != mVhalToPartsMap.end()) {
-                mVhalToPartsMap.at(rotationOp.first).insert(partId);
-            } else {
-                mVhalToPartsMap.emplace(
-                        std::make_pair(rotationOp.first, std::set<std::string>{partId}));
+    }
+
+    // Add the parts without parent along with their descendants, then the
+    // parts left, which are in a cycle.
+    for (const auto& part : partsMap) {
+        if (parentIdsMap.find(part.first) == parentIdsMap.end()) {
+            addCarPartSubtree(part.first, -1, childIdsMap, parentIdsMap);
+        }
+    }
+    if (mCarPartsStatus.size() < partsMap.size()) {
+        std::set<std::string> addedPartIds;
+        for (const auto& carPartStatus : mCarPartsStatus) {
+            addedPartIds.insert(carPartStatus.partId);
+        }
+        for (const auto& part : partsMap) {
+            if (addedPartIds.find(part.first) == addedPartIds.end()) {
+                LOG(WARNING) << "Part " << part.first << " is in a parent cycle.";
+                parentIdsMap.erase(part.first);
+                const size_t firstIndex = mCarPartsStatus.size();
+                addCarPartSubtree(part.first, -1, childIdsMap, parentIdsMap);
+                for (size_t i = firstIndex; i < mCarPartsStatus.size(); ++i) {
+                    addedPartIds.insert(mCarPartsStatus[i].partId);
+                }
             }
         }
-        for (const auto& translationOp : animationInfo.translationOpsMap) {
-            if (mVhalToPartsMap.find(translationOp.first) != mVhalToPartsMap.end()) {
-                mVhalToPartsMap.at(translationOp.first).insert(partId);
-            } else {
-                mVhalToPartsMap.emplace(
-                        std::make_pair(translationOp.first, std::set<std::string>{partId}));
+    }
+
+    const size_t partsCount = mCarPartsStatus.size();
+    mLocalModels.assign(partsCount, gMat4Identity);
+    mCurrentModels.assign(partsCount, gMat4Identity);
+    mIsPartUpdated.assign(partsCount, false);
+    mAnimationParams.reserve(partsCount);
+    for (const auto& carPartStatus : mCarPartsStatus) {
+        mAnimationParams.push_back(AnimationParam(carPartStatus.partId));
+    }
+}
+
+void AnimationModule::addCarPartSubtree(
+        const std::string& partId, int parentIndex,
+        const std::map<std::string, std::vector<std::string>>& childIdsMap,
+        const std::map<std::string, std::string>& parentIdsMap) {
+    const int partIndex = mCarPartsStatus.size();
+    mCarPartsStatus.push_back(CarPartStatus{
+            .partId = partId,
+            .parentIndex = parentIndex,
+            .subtreeEnd = partIndex + 1,
+            .gamma = 1,
+            .textureId = "",
+    });
+
+    const auto childIds = childIdsMap.find(partId);
+    if (childIds != childIdsMap.end()) {
+        for (const auto& childId : childIds->second) {
+            const auto parentId = parentIdsMap.find(childId);
+            if (parentId != parentIdsMap.end() && parentId->second == partId) {
+                addCarPartSubtree(childId, partIndex, childIdsMap, parentIdsMap);
             }
         }
-        mPartsToAnimationMap.emplace(std::make_pair(partId, animationInfo));
     }
+    mCarPartsStatus[partIndex].subtreeEnd = mCarPartsStatus.size();
 }
 
-void AnimationModule::initCarPartStatus() {
-    for (const auto& part : mPartsMap) {
-        // Get child parts list from mPartsToAnimationMap.
-        std::vector<std::string> childIds;
-        if (mPartsToAnimationMap.find(part.first) != mPartsToAnimationMap.end()) {
-            childIds = mPartsToAnimationMap.at(part.first).childIds;
+void AnimationModule::mapVhalToParts(const std::vector<AnimationInfo>& animations) {
+    std::map<std::string, int> partIndicesMap;
+    for (size_t i = 0; i < mCarPartsStatus.size(); ++i) {
+        partIndicesMap.emplace(std::make_pair(mCarPartsStatus[i].partId, i));
+    }
+
+    // Operations of each vhal property, ordered by part id, then by type.
+    std::map<uint64_t, std::map<std::string, std::vector<PartOp>>> vhalToPartOpsMap;
+    std::set<std::string> animatedPartIds;
+    for (const auto& animationInfo : animations) {
+        const auto& partId = animationInfo.partId;
+        const auto partIndex = partIndicesMap.find(partId);
+        if (partIndex == partIndicesMap.end()) {
+            LOG(WARNING) << "Animated part " << partId << " not found. Ignored.";
+            continue;
+        }
+        if (!animatedPartIds.insert(partId).second) {
+            LOG(WARNING) << "Duplicate animation for part " << partId << ". Ignored.";
+            continue;
         }
 
-        mCarPartsStatusMap.emplace(std::make_pair(part.first,
-                                                  CarPartStatus{
-                                                          .partId = part.first,
-                                                          .childIds = childIds,
-                                                          .parentModel = gMat4Identity,
-                                                          .localModel = gMat4Identity,
-                                                          .currentModel = gMat4Identity,
-                                                          .gamma = 1,
-                                                  }));
+        for (const auto& gammaOps : animationInfo.gammaOpsMap) {
+            for (const auto& gammaOp : gammaOps.second) {
+                vhalToPartOpsMap[gammaOps.first][partId].push_back(
+                        PartOp{GAMMA_OP, partIndex->second, -1,
+                               static_cast<int>(mGammaOps.size())});
+                mGammaOps.push_back(gammaOp);
+            }
+        }
+        for (const auto& textureOps : animationInfo.textureOpsMap) {
+            for (const auto& textureOp : textureOps.second) {
+                vhalToPartOpsMap[textureOps.first][partId].push_back(
+                        PartOp{TEXTURE_OP, partIndex->second, -1,
+                               static_cast<int>(mTextureOps.size())});
+                mTextureOps.push_back(textureOp);
+            }
+        }
+        for (const auto& rotationOps : animationInfo.rotationOpsMap) {
+            for (const auto& rotationOp : rotationOps.second) {
+                vhalToPartOpsMap[rotationOps.first][partId].push_back(
+                        PartOp{ROTATION_OP, partIndex->second, -1,
+                               static_cast<int>(mRotationOps.size())});
+                mRotationOps.push_back(rotationOp);
+            }
+        }
+        for (const auto& translationOps : animationInfo.translationOpsMap) {
+            for (const auto& translationOp : translationOps.second) {
+                vhalToPartOpsMap[translationOps.first][partId].push_back(
+                        PartOp{TRANSLATION_OP, partIndex->second, -1,
+                               static_cast<int>(mTranslationOps.size())});
+                mTranslationOps.push_back(translationOp);
+            }
+        }
     }
 
-    for (const auto& eachVhalToParts : mVhalToPartsMap) {
-        for (const auto& part : eachVhalToParts.second) {
-            if (mCarPartsStatusMap.at(part).vhalProgressMap.find(eachVhalToParts.first) !=
-                mCarPartsStatusMap.at(part).vhalProgressMap.end()) {
-                mCarPartsStatusMap.at(part).vhalProgressMap.at(eachVhalToParts.first) = 0.0f;
-            } else {
-                mCarPartsStatusMap.at(part).vhalProgressMap.emplace(
-                        std::make_pair(eachVhalToParts.first, 0.0f));
+    for (const auto& vhalToPartOps : vhalToPartOpsMap) {
+        VhalStatus vhalStatus = {
+                .vhalProperty = vhalToPartOps.first,
+                .vhalValueFloat = 0.0f,
+                .isReceived = false,
+                .progressIndices = {},
+                .ops = {},
+        };
+        for (const auto& partOps : vhalToPartOps.second) {
+            const int progressIndex = mVhalProgresses.size();
+            mVhalProgresses.push_back(VhalProgress{
+                    .progress = 0.0f,
+                    .isOff = true,
+            });
+            vhalStatus.progressIndices.push_back(progressIndex);
+            for (auto partOp : partOps.second) {
+                partOp.progressIndex = progressIndex;
+                vhalStatus.ops.push_back(partOp);
             }
-            if (mCarPartsStatusMap.at(part).vhalOffMap.find(eachVhalToParts.first) !=
-                mCarPartsStatusMap.at(part).vhalOffMap.end()) {
-                mCarPartsStatusMap.at(part).vhalOffMap.at(eachVhalToParts.first) = true;
+        }
+        mVhalStatuses.push_back(std::move(vhalStatus));
+    }
+}
+
+AnimationModule::VhalStatus* AnimationModule::findVhalStatus(uint64_t vhalProperty) {
+    const auto vhalStatus = std::lower_bound(mVhalStatuses.begin(), mVhalStatuses.end(),
+                                             vhalProperty,
+                                             [](const VhalStatus& status, uint64_t property) {
+                                                 return status.vhalProperty < property;
+                                             });
+    if (vhalStatus == mVhalStatuses.end() || vhalStatus->vhalProperty != vhalProperty) {
+        return nullptr;
+    }
+    return &(*vhalStatus);
+}
+
+AnimationParam& AnimationModule::markPartUpdated(int partIndex) {
+    AnimationParam& animationParam = mAnimationParams[partIndex];
+    if (!mIsPartUpdated[partIndex]) {
+        mIsPartUpdated[partIndex] = true;
+        mUpdatedParts.push_back(partIndex);
+        animationParam.is_model_update = false;
+        animationParam.is_gamma_update = false;
+        animationParam.is_texture_update = false;
+    }
+    return animationParam;
+}
+
+// Parts are stored in depth first order, so the descendants of a changed part
+// are the parts following it up to its subtree end, and each part comes after
+// its parent. Models are then updated in one pass over contiguous matrices.
+void AnimationModule::updateChangedModels() {
+    std::sort(mChangedParts.begin(), mChangedParts.end());
+    int updatedEnd = 0;
+    for (const int changedPart : mChangedParts) {
+        if (changedPart < updatedEnd) {
+            // Already updated along with an ancestor, or a duplicate.
+            continue;
+        }
+        updatedEnd = mCarPartsStatus[changedPart].subtreeEnd;
+        for (int i = changedPart; i < updatedEnd; ++i) {
+            const int parentIndex = mCarPartsStatus[i].parentIndex;
+            if (parentIndex < 0) {
+                mCurrentModels[i] = mLocalModels[i];
             } else {
-                mCarPartsStatusMap.at(part).vhalOffMap.emplace(
-                        std::make_pair(eachVhalToParts.first, true));
+                appendMat(mLocalModels[i], mCurrentModels[parentIndex], &mCurrentModels[i]);
             }
+            markPartUpdated(i).SetModelMatrix(mCurrentModels[i]);
         }
     }
+    mChangedParts.clear();
 }
 
-// This implementation assumes the tree level is small. If tree level is large,
-// we may need to traverse the tree once and process each node(part) during
-// the reaversal.
-void AnimationModule::updateChildrenParts(const std::string& partId, const Mat4x4& parentModel) {
-    for (auto& childPart : mCarPartsStatusMap.at(partId).childIds) {
-        mCarPartsStatusMap.at(childPart).parentModel = parentModel;
-        mCarPartsStatusMap.at(childPart).currentModel =
-                appendMat(mCarPartsStatusMap.at(childPart).localModel,
-                          mCarPartsStatusMap.at(childPart).parentModel);
-        if (mUpdatedPartsMap.find(childPart) == mUpdatedPartsMap.end()) {
-            AnimationParam animationParam(childPart);
-            animationParam.SetModelMatrix(mCarPartsStatusMap.at(childPart).currentModel);
-            mUpdatedPartsMap.emplace(std::make_pair(childPart, animationParam));
-        } else {  // existing part in the map
-            mUpdatedPartsMap.at(childPart).SetModelMatrix(
-                    mCarPartsStatusMap.at(childPart).currentModel);
-        }
-        updateChildrenParts(childPart, mCarPartsStatusMap.at(childPart).currentModel);
+bool AnimationModule::isOpInProgress(const PartOp& partOp) const {
+    const VhalProgress& vhalProgress = mVhalProgresses[partOp.progressIndex];
+    switch (partOp.type) {
+        case GAMMA_OP:
+            return isInProgress(mGammaOps[partOp.opIndex], vhalProgress.isOff,
+                                vhalProgress.progress);
+        case ROTATION_OP:
+            return isInProgress(mRotationOps[partOp.opIndex], vhalProgress.isOff,
+                                vhalProgress.progress);
+        case TRANSLATION_OP:
+            return isInProgress(mTranslationOps[partOp.opIndex], vhalProgress.isOff,
+                                vhalProgress.progress);
+        default:
+            return false;
     }
 }
 
-void AnimationModule::performGammaOp(const std::string& partId, uint64_t vhalProperty,
-                                     const GammaOp& gammaOp) {
-    CarPartStatus& currentCarPartStatus = mCarPartsStatusMap.at(partId);
-    float& currentProgress = currentCarPartStatus.vhalProgressMap.at(vhalProperty);
-    if (currentCarPartStatus.vhalOffMap.at(vhalProperty)) {  // process off signal
-        if (currentProgress > 0) {                           // part not rest
+void AnimationModule::performGammaOp(const PartOp& partOp, const VhalStatus& vhalStatus) {
+    const GammaOp& gammaOp = mGammaOps[partOp.opIndex];
+    CarPartStatus& currentCarPartStatus = mCarPartsStatus[partOp.partIndex];
+    VhalProgress& vhalProgress = mVhalProgresses[partOp.progressIndex];
+    float& currentProgress = vhalProgress.progress;
+    if (vhalProgress.isOff) {       // process off signal
+        if (currentProgress > 0) {  // part not rest
             if (0 == gammaOp.animationTime) {
                 currentCarPartStatus.gamma = gammaOp.gammaRange.start;
                 currentProgress = 0.0f;
@@ -203,14 +353,13 @@ void AnimationModule::performGammaOp(const std::string& partId, uint64_t vhalPro
         }
     } else {                               // regular signal process
         if (0 == gammaOp.animationTime) {  // continuous value
-            currentCarPartStatus.gamma =
-                    getRationalNumber(gammaOp.gammaRange, gammaOp.vhalRange,
-                                      mVhalStatusMap.at(vhalProperty).vhalValueFloat);
-            currentProgress = mVhalStatusMap.at(vhalProperty).vhalValueFloat;
+            currentCarPartStatus.gamma = getRationalNumber(gammaOp.gammaRange, gammaOp.vhalRange,
+                                                           vhalStatus.vhalValueFloat);
+            currentProgress = vhalStatus.vhalValueFloat;
         } else {  // non-continuous value
             const float progressDelta = (mCurrentCallTime - mLastCallTime) / gammaOp.animationTime;
             if (gammaOp.type == ADJUST_GAMMA_ONCE) {
-                if (progressDelta + currentCarPartStatus.vhalProgressMap.at(vhalProperty) > 1) {
+                if (progressDelta + currentProgress > 1) {
                     currentCarPartStatus.gamma = gammaOp.gammaRange.end;
                     currentProgress = 1.0f;
                 } else {
@@ -219,23 +368,16 @@ void AnimationModule::performGammaOp(const std::string& partId, uint64_t vhalPro
                     currentProgress += progressDelta;
                 }
             } else if (gammaOp.type == ADJUST_GAMMA_REPEAT) {
-                if (progressDelta + currentCarPartStatus.vhalProgressMap.at(vhalProperty) > 1) {
-                    if (progressDelta + currentCarPartStatus.vhalProgressMap.at(vhalProperty) - 1 >
-                        1) {
-                        currentCarPartStatus.gamma =
-                                currentCarPartStatus.vhalProgressMap.at(vhalProperty) > 0.5
+                if (progressDelta + currentProgress > 1) {
+                    if (progressDelta + currentProgress - 1 > 1) {
+                        currentCarPartStatus.gamma = currentProgress > 0.5
                                 ? gammaOp.gammaRange.start
                                 : gammaOp.gammaRange.end;
-                        currentProgress =
-                                currentCarPartStatus.vhalProgressMap.at(vhalProperty) > 0.5 ? 0.0f
-                                                                                            : 1.0f;
+                        currentProgress = currentProgress > 0.5 ? 0.0f : 1.0f;
                     } else {
                         currentCarPartStatus.gamma =
                                 getRationalNumber(gammaOp.gammaRange,
-                                                  progressDelta +
-                                                          currentCarPartStatus.vhalProgressMap.at(
-                                                                  vhalProperty) -
-                                                          1);
+                                                  progressDelta + currentProgress - 1);
                         currentProgress += progressDelta - 1;
                     }
                 } else {
@@ -249,25 +391,19 @@ void AnimationModule::performGammaOp(const std::string& partId, uint64_t vhalPro
         }
     }
 
-    if (mUpdatedPartsMap.find(partId) == mUpdatedPartsMap.end()) {
-        AnimationParam animationParam(partId);
-        animationParam.SetGamma(currentCarPartStatus.gamma);
-        mUpdatedPartsMap.emplace(std::make_pair(partId, animationParam));
-    } else {  // existing part in the map
-        mUpdatedPartsMap.at(partId).SetGamma(currentCarPartStatus.gamma);
-    }
+    markPartUpdated(partOp.partIndex).SetGamma(currentCarPartStatus.gamma);
 }
 
-void AnimationModule::performTranslationOp(const std::string& partId, uint64_t vhalProperty,
-                                           const TranslationOp& translationOp) {
-    CarPartStatus& currentCarPartStatus = mCarPartsStatusMap.at(partId);
-    float& currentProgress = currentCarPartStatus.vhalProgressMap.at(vhalProperty);
-    if (currentCarPartStatus.vhalOffMap.at(vhalProperty)) {  // process off signal
+void AnimationModule::performTranslationOp(const PartOp& partOp, const VhalStatus& vhalStatus) {
+    const TranslationOp& translationOp = mTranslationOps[partOp.opIndex];
+    Mat4x4& localModel = mLocalModels[partOp.partIndex];
+    VhalProgress& vhalProgress = mVhalProgresses[partOp.progressIndex];
+    float& currentProgress = vhalProgress.progress;
+    if (vhalProgress.isOff) {  // process off signal
         if (currentProgress > 0) {
             // part not rest
             if (0 == translationOp.animationTime) {
-                currentCarPartStatus.localModel = gMat4Identity;
-                currentCarPartStatus.currentModel = currentCarPartStatus.parentModel;
+                localModel = gMat4Identity;
                 currentProgress = 0.0f;
             } else {
                 const float progressDelta =
@@ -275,10 +411,7 @@ void AnimationModule::performTranslationOp(const std::string& partId, uint64_t v
                 float translationUnit =
                         getRationalNumber(translationOp.translationRange,
                                           std::max(currentProgress - progressDelta, 0.0f));
-                currentCarPartStatus.localModel =
-                        translationMatrixToMat4x4(translationOp.direction * translationUnit);
-                currentCarPartStatus.currentModel = appendMatrix(currentCarPartStatus.localModel,
-                                                                 currentCarPartStatus.parentModel);
+                localModel = translationMatrixToMat4x4(translationOp.direction * translationUnit);
                 currentProgress = std::max(currentProgress - progressDelta, 0.0f);
             }
         } else {
@@ -289,32 +422,22 @@ void AnimationModule::performTranslationOp(const std::string& partId, uint64_t v
             if (0 == translationOp.animationTime) {
                 float translationUnit =
                         getRationalNumber(translationOp.translationRange, translationOp.vhalRange,
-                                          mVhalStatusMap.at(vhalProperty).vhalValueFloat);
-                currentCarPartStatus.localModel =
-                        translationMatrixToMat4x4(translationOp.direction * translationUnit);
-                currentCarPartStatus.currentModel = appendMatrix(currentCarPartStatus.localModel,
-                                                                 currentCarPartStatus.parentModel);
-                currentProgress = mVhalStatusMap.at(vhalProperty).vhalValueFloat;
+                                          vhalStatus.vhalValueFloat);
+                localModel = translationMatrixToMat4x4(translationOp.direction * translationUnit);
+                currentProgress = vhalStatus.vhalValueFloat;
             } else {
                 float progressDelta =
                         (mCurrentCallTime - mLastCallTime) / translationOp.animationTime;
-                if (progressDelta + currentCarPartStatus.vhalProgressMap.at(vhalProperty) > 1) {
+                if (progressDelta + currentProgress > 1) {
                     float translationUnit = translationOp.translationRange.end;
-
-                    currentCarPartStatus.localModel =
+                    localModel =
                             translationMatrixToMat4x4(translationOp.direction * translationUnit);
-                    currentCarPartStatus.currentModel =
-                            appendMatrix(currentCarPartStatus.localModel,
-                                         currentCarPartStatus.parentModel);
                     currentProgress = 1.0f;
                 } else {
                     float translationUnit = getRationalNumber(translationOp.translationRange,
                                                               progressDelta + currentProgress);
-                    currentCarPartStatus.localModel =
+                    localModel =
                             translationMatrixToMat4x4(translationOp.direction * translationUnit);
-                    currentCarPartStatus.currentModel =
-                            appendMatrix(currentCarPartStatus.localModel,
-                                         currentCarPartStatus.parentModel);
                     currentProgress += progressDelta;
                 }
             }
@@ -322,43 +445,31 @@ void AnimationModule::performTranslationOp(const std::string& partId, uint64_t v
             LOG(ERROR) << "Error type of translation op: " << translationOp.type;
         }
     }
-    if (mUpdatedPartsMap.find(partId) == mUpdatedPartsMap.end()) {
-        AnimationParam animationParam(partId);
-        animationParam.SetModelMatrix(currentCarPartStatus.currentModel);
-        mUpdatedPartsMap.emplace(std::make_pair(partId, animationParam));
-    } else {  // existing part in the map
-        mUpdatedPartsMap.at(partId).SetModelMatrix(currentCarPartStatus.currentModel);
-    }
-    updateChildrenParts(partId, currentCarPartStatus.currentModel);
+    mChangedParts.push_back(partOp.partIndex);
 }
 
-void AnimationModule::performRotationOp(const std::string& partId, uint64_t vhalProperty,
-                                        const RotationOp& rotationOp) {
-    CarPartStatus& currentCarPartStatus = mCarPartsStatusMap.at(partId);
-    float& currentProgress = currentCarPartStatus.vhalProgressMap.at(vhalProperty);
-    if (currentCarPartStatus.vhalOffMap.at(vhalProperty)) {
+void AnimationModule::performRotationOp(const PartOp& partOp, const VhalStatus& vhalStatus) {
+    const RotationOp& rotationOp = mRotationOps[partOp.opIndex];
+    Mat4x4& localModel = mLocalModels[partOp.partIndex];
+    VhalProgress& vhalProgress = mVhalProgresses[partOp.progressIndex];
+    float& currentProgress = vhalProgress.progress;
+    if (vhalProgress.isOff) {
         // process off signal
         if (currentProgress > 0) {  // part not rest
             if (0 == rotationOp.animationTime) {
-                currentCarPartStatus.localModel = gMat4Identity;
-                currentCarPartStatus.currentModel = currentCarPartStatus.parentModel;
+                localModel = gMat4Identity;
                 currentProgress = 0.0f;
             } else {
                 const float progressDelta =
                         (mCurrentCallTime - mLastCallTime) / rotationOp.animationTime;
                 if (progressDelta > currentProgress) {
-                    currentCarPartStatus.localModel = gMat4Identity;
-                    currentCarPartStatus.currentModel = currentCarPartStatus.parentModel;
+                    localModel = gMat4Identity;
                     currentProgress = 0.0f;
                 } else {
                     float anlgeInDegree = getRationalNumber(rotationOp.rotationRange,
                                                             currentProgress - progressDelta);
-                    currentCarPartStatus.localModel =
-                            rotationAboutPoint(anlgeInDegree, rotationOp.axis.rotationPoint,
-                                               rotationOp.axis.axisVector);
-                    currentCarPartStatus.currentModel =
-                            appendMatrix(currentCarPartStatus.localModel,
-                                         currentCarPartStatus.parentModel);
+                    localModel = rotationAboutPoint(anlgeInDegree, rotationOp.axis.rotationPoint,
+                                                    rotationOp.axis.axisVector);
                     currentProgress -= progressDelta;
                 }
             }
@@ -368,63 +479,45 @@ void AnimationModule::performRotationOp(const std::string& partId, uint64_t vhal
     } else {  // regular signal process
         if (rotationOp.type == ROTATION_ANGLE) {
             if (0 == rotationOp.animationTime) {
-                float angleInDegree =
-                        getRationalNumber(rotationOp.rotationRange, rotationOp.vhalRange,
-                                          mVhalStatusMap.at(vhalProperty).vhalValueFloat);
-                currentCarPartStatus.localModel =
-                        rotationAboutPoint(angleInDegree, rotationOp.axis.rotationPoint,
-                                           rotationOp.axis.axisVector);
-                currentCarPartStatus.currentModel = appendMatrix(currentCarPartStatus.localModel,
-                                                                 currentCarPartStatus.parentModel);
-                currentProgress = mVhalStatusMap.at(vhalProperty).vhalValueFloat;
+                float angleInDegree = getRationalNumber(rotationOp.rotationRange,
+                                                        rotationOp.vhalRange,
+                                                        vhalStatus.vhalValueFloat);
+                localModel = rotationAboutPoint(angleInDegree, rotationOp.axis.rotationPoint,
+                                                rotationOp.axis.axisVector);
+                currentProgress = vhalStatus.vhalValueFloat;
             } else {
                 float progressDelta = (mCurrentCallTime - mLastCallTime) / rotationOp.animationTime;
                 if (progressDelta + currentProgress > 1) {
                     float angleInDegree = rotationOp.rotationRange.end;
-                    currentCarPartStatus.localModel =
-                            rotationAboutPoint(angleInDegree, rotationOp.axis.rotationPoint,
-                                               rotationOp.axis.axisVector);
-                    currentCarPartStatus.currentModel =
-                            appendMatrix(currentCarPartStatus.localModel,
-                                         currentCarPartStatus.parentModel);
+                    localModel = rotationAboutPoint(angleInDegree, rotationOp.axis.rotationPoint,
+                                                    rotationOp.axis.axisVector);
                     currentProgress = 1.0f;
                 } else {
                     float anlgeInDegree = getRationalNumber(rotationOp.rotationRange,
                                                             currentProgress + progressDelta);
-                    currentCarPartStatus.localModel =
-                            rotationAboutPoint(anlgeInDegree, rotationOp.axis.rotationPoint,
-                                               rotationOp.axis.axisVector);
-                    currentCarPartStatus.currentModel =
-                            appendMatrix(currentCarPartStatus.localModel,
-                                         currentCarPartStatus.parentModel);
+                    localModel = rotationAboutPoint(anlgeInDegree, rotationOp.axis.rotationPoint,
+                                                    rotationOp.axis.axisVector);
                     currentProgress += progressDelta;
                 }
             }
         } else if (rotationOp.type == ROTATION_SPEED) {
             float angleDelta = (mCurrentCallTime - mLastCallTime) *
                     getRationalNumber(rotationOp.rotationRange, rotationOp.vhalRange,
-                                      mVhalStatusMap.at(vhalProperty)
-                                              .vhalValueFloat);  // here vhalValueFloat unit is
-                                                                 // radian/ms.
-            currentCarPartStatus.localModel =
-                    appendMat(rotationAboutPoint(angleDelta, rotationOp.axis.rotationPoint,
-                                                 rotationOp.axis.axisVector),
-                              currentCarPartStatus.localModel);
-            currentCarPartStatus.currentModel =
-                    appendMatrix(currentCarPartStatus.localModel, currentCarPartStatus.parentModel);
+                                      vhalStatus.vhalValueFloat);  // here vhalValueFloat unit is
+                                                                   // radian/ms.
+            localModel = appendMat(rotationAboutPoint(angleDelta, rotationOp.axis.rotationPoint,
+                                                      rotationOp.axis.axisVector),
+                                   localModel);
             currentProgress = 1.0f;
         } else {
             LOG(ERROR) << "Error type of rotation op: " << rotationOp.type;
         }
     }
-    if (mUpdatedPartsMap.find(partId) == mUpdatedPartsMap.end()) {
-        AnimationParam animationParam(partId);
-        animationParam.SetModelMatrix(currentCarPartStatus.currentModel);
-        mUpdatedPartsMap.emplace(std::make_pair(partId, animationParam));
-    } else {  // existing part in the map
-        mUpdatedPartsMap.at(partId).SetModelMatrix(currentCarPartStatus.currentModel);
-    }
-    updateChildrenParts(partId, currentCarPartStatus.currentModel);
+    mChangedParts.push_back(partOp.partIndex);
+}
+
+void AnimationModule::requestFullUpdate() {
+    mIsFullUpdateRequested = true;
 }
 
 std::vector<AnimationParam> AnimationModule::getUpdatedAnimationParams(
@@ -438,74 +531,80 @@ std::vector<AnimationParam> AnimationModule::getUpdatedAnimationParams(
     // get current time
     mCurrentCallTime = (float)elapsedRealtimeNano() / 1e6;
 
-    // reset mUpdatedPartsMap
-    mUpdatedPartsMap.clear();
+    // reset the parts updated by the last call
+    for (const int partIndex : mUpdatedParts) {
+        mIsPartUpdated[partIndex] = false;
+    }
+    mUpdatedParts.clear();
 
+    bool isPropertyChanged = false;
     for (const auto& vhalSignal : vehiclePropValue) {
         // existing vhal signal
-        const uint64_t combinedId = getCombinedId(vhalSignal);
-        if (mVhalToPartsMap.find(combinedId) != mVhalToPartsMap.end()) {
+        VhalStatus* vhalStatus = findVhalStatus(getCombinedId(vhalSignal));
+        if (vhalStatus != nullptr) {
             const float valueFloat = getVhalValueFloat(vhalSignal);
-            if (mVhalStatusMap.find(combinedId) != mVhalStatusMap.end()) {
-                mVhalStatusMap.at(combinedId).vhalValueFloat = valueFloat;
-            } else {
-                mVhalStatusMap.emplace(std::make_pair(combinedId,
-                                                      VhalStatus{
-                                                              .vhalValueFloat = valueFloat,
-                                                      }));
+            if (vhalStatus->isReceived && vhalStatus->vhalValueFloat == valueFloat) {
+                continue;
             }
+            isPropertyChanged = true;
+            vhalStatus->vhalValueFloat = valueFloat;
+            vhalStatus->isReceived = true;
             bool offStatus = 0 == valueFloat;
-            for (const auto& eachPart : mVhalToPartsMap.at(combinedId)) {
-                mCarPartsStatusMap.at(eachPart).vhalOffMap.at(combinedId) = offStatus;
+            for (const int progressIndex : vhalStatus->progressIndices) {
+                mVhalProgresses[progressIndex].isOff = offStatus;
             }
         }
     }
 
-    for (auto& vhalStatus : mVhalStatusMap) {
-        // VHAL signal not found in animation
-        uint64_t vhalProperty = vhalStatus.first;
-        if (mVhalToPartsMap.find(vhalProperty) == mVhalToPartsMap.end()) {
-            LOG(WARNING) << "VHAL " << vhalProperty << " not processed.";
-        } else {  // VHAL signal found
-            const auto& partsSet = mVhalToPartsMap.at(vhalProperty);
-            for (const auto& partId : partsSet) {
-                const auto& animationInfo = mPartsToAnimationMap.at(partId);
-                if (animationInfo.gammaOpsMap.find(vhalProperty) !=
-                    animationInfo.gammaOpsMap.end()) {
-                    LOG(INFO) << "Processing VHAL " << vhalProperty << " for gamma op.";
+    // Nothing to update, parts keep their last animation params.
+    if (!isPropertyChanged && !mIsAnimating && !mIsFullUpdateRequested) {
+        return {};
+    }
+
+    mIsAnimating = false;
+    for (const auto& vhalStatus : mVhalStatuses) {
+        if (!vhalStatus.isReceived) {
+            continue;
+        }
+        for (const auto& partOp : vhalStatus.ops) {
+            switch (partOp.type) {
+                case GAMMA_OP:
                     // TODO(b/158244276): add priority check.
-                    for (const auto& gammaOp : animationInfo.gammaOpsMap.at(vhalProperty)) {
-                        performGammaOp(partId, vhalProperty, gammaOp);
-                    }
-                }
-                if (animationInfo.textureOpsMap.find(vhalProperty) !=
-                    animationInfo.textureOpsMap.end()) {
-                    LOG(INFO) << "Processing VHAL " << vhalProperty << " for texture op.";
-                    LOG(INFO) << "Texture op currently not supported. Skipped.";
+                    performGammaOp(partOp, vhalStatus);
+                    break;
+                case TEXTURE_OP:
                     // TODO(b158244721): do texture op.
-                }
-                if (animationInfo.rotationOpsMap.find(vhalProperty) !=
-                    animationInfo.rotationOpsMap.end()) {
-                    LOG(INFO) << "Processing VHAL " << vhalProperty << " for rotation op.";
-                    for (const auto& rotationOp : animationInfo.rotationOpsMap.at(vhalProperty)) {
-                        performRotationOp(partId, vhalProperty, rotationOp);
-                    }
-                }
-                if (animationInfo.translationOpsMap.find(vhalProperty) !=
-                    animationInfo.translationOpsMap.end()) {
-                    LOG(INFO) << "Processing VHAL " << vhalProperty << " for translation op.";
-                    for (const auto& translationOp :
-                         animationInfo.translationOpsMap.at(vhalProperty)) {
-                        performTranslationOp(partId, vhalProperty, translationOp);
-                    }
-                }
+                    LOG(DEBUG) << "Texture op currently not supported. Skipped.";
+                    break;
+                case ROTATION_OP:
+                    performRotationOp(partOp, vhalStatus);
+                    break;
+                case TRANSLATION_OP:
+                    performTranslationOp(partOp, vhalStatus);
+                    break;
+            }
+            if (!mIsAnimating) {
+                mIsAnimating = isOpInProgress(partOp);
             }
         }
     }
 
+    updateChangedModels();
+
+    if (mIsFullUpdateRequested) {
+        mIsFullUpdateRequested = false;
+        for (size_t i = 0; i < mCarPartsStatus.size(); ++i) {
+            AnimationParam& animationParam = markPartUpdated(i);
+            animationParam.SetModelMatrix(mCurrentModels[i]);
+            animationParam.SetGamma(mCarPartsStatus[i].gamma);
+        }
+    }
+
+    std::sort(mUpdatedParts.begin(), mUpdatedParts.end());
     std::vector<AnimationParam> output;
-    for (auto& updatedPart : mUpdatedPartsMap) {
-        output.push_back(updatedPart.second);
+    output.reserve(mUpdatedParts.size());
+    for (const int partIndex : mUpdatedParts) {
+        output.push_back(mAnimationParams[partIndex]);
     }
     return output;
 }
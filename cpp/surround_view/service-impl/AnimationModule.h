@@ -23,7 +23,7 @@
 #include <utils/SystemClock.h>
 #include <cstdint>
 #include <map>
-#include <set>
+#include <string>
 #include <vector>
 
 #include <android/hardware/automotive/vehicle/2.0/IVehicle.h>
@@ -52,74 +52,121 @@ public:
                     const std::vector<AnimationInfo>& animations);
 
     // Gets Animation parameters with input of VehiclePropValue.
+    // Parts keep their last animation params, so none is returned when no
+    // vhal value changed since the last call and no animation is in progress.
     std::vector<AnimationParam> getUpdatedAnimationParams(
             const std::vector<VehiclePropValue>& vehiclePropValue);
 
+    // Makes the next getUpdatedAnimationParams() call return the params of
+    // every part. Called when a core lib is set up, since it has none of the
+    // params returned before.
+    void requestFullUpdate();
+
 private:
     // Internal car part status.
     struct CarPartStatus {
         // Car part id.
         std::string partId;
 
-        // Car part children ids.
-        std::vector<std::string> childIds;
-
-        // Parent model matrix.
-        Mat4x4 parentModel;
+        // Index of the parent part, -1 if the part has no parent.
+        int parentIndex;
 
-        // Local model in local coordinate.
-        Mat4x4 localModel;
-
-        // Current status model matrix in global coordinate with
-        // animations combined.
-        // current_model = local_model * parent_model;
-        Mat4x4 currentModel;
+        // Index past the last descendant of the part. Parts are stored in
+        // depth first order, so the descendants of a part directly follow it.
+        int subtreeEnd;
 
         // Gamma parameters.
         float gamma;
 
         // Texture id.
         std::string textureId;
+    };
 
-        // Internal vhal percentage. Each car part maintain its own copy
-        // the vhal percentage.
-        // Key value is vhal property (combined with area id).
-        std::map<uint64_t, float> vhalProgressMap;
+    // Internal vhal progress of a car part. Each car part maintains its own
+    // copy of the vhal percentage for each vhal property animating it.
+    struct VhalProgress {
+        float progress;
 
-        // Vhal off map. Key value is vhal property (combined with area id).
         // Assume off status when vhal value is 0.
-        std::map<uint64_t, bool> vhalOffMap;
+        bool isOff;
+    };
+
+    enum OpType {
+        GAMMA_OP,
+        TEXTURE_OP,
+        ROTATION_OP,
+        TRANSLATION_OP,
+    };
+
+    // Operation performed on a car part for a vhal property.
+    struct PartOp {
+        OpType type;
+
+        // Index of the car part.
+        int partIndex;
+
+        // Index of the vhal progress of the car part in mVhalProgresses.
+        int progressIndex;
+
+        // Index of the operation in mGammaOps, mTextureOps, mRotationOps or
+        // mTranslationOps, depending on its type.
+        int opIndex;
     };
 
     // Internal Vhal status.
     struct VhalStatus {
+        // Vhal property (combined with area id).
+        uint64_t vhalProperty;
+
         float vhalValueFloat;
+
+        // Whether a value of the vhal property was received.
+        bool isReceived;
+
+        // Vhal progresses of the parts animated by the vhal property.
+        std::vector<int> progressIndices;
+
+        // Operations triggered by the vhal property, in processing order.
+        std::vector<PartOp> ops;
     };
 
+    // Help function to init car part status for constructor. Resolves the
+    // part hierarchy into part indices.
+    void initCarPartStatus(const std::map<std::string, CarPart>& partsMap,
+                           const std::vector<AnimationInfo>& animations);
+
+    // Help function for initCarPartStatus(). Adds a part and its descendants
+    // in depth first order.
+    void addCarPartSubtree(const std::string& partId, int parentIndex,
+                           const std::map<std::string, std::vector<std::string>>& childIdsMap,
+                           const std::map<std::string, std::string>& parentIdsMap);
+
     // Help function to get vhal to parts map.
-    void mapVhalToParts();
+    void mapVhalToParts(const std::vector<AnimationInfo>& animations);
+
+    // Returns the status of a vhal property, nullptr if it animates no part.
+    VhalStatus* findVhalStatus(uint64_t vhalProperty);
 
-    // Help function to init car part status for constructor.
-    void initCarPartStatus();
+    // Adds the part to the parts updated by the current call if needed, and
+    // returns its animation param.
+    AnimationParam& markPartUpdated(int partIndex);
 
-    // Iteratively update children parts status if partent status is changed.
-    void updateChildrenParts(const std::string& partId, const Mat4x4& parentModel);
+    // Updates the model matrices of the parts whose local model changed, and
+    // of their descendants.
+    void updateChangedModels();
+
+    // Returns true if the operation keeps updating its part without a new
+    // vhal value, e.g. a part moving over its animation time.
+    bool isOpInProgress(const PartOp& partOp) const;
 
     // Perform gamma opertion for the part with given vhal property.
-    void performGammaOp(const std::string& partId, uint64_t vhalProperty, const GammaOp& gammaOp);
+    void performGammaOp(const PartOp& partOp, const VhalStatus& vhalStatus);
 
     // Perform translation opertion for the part with given vhal property.
-    void performTranslationOp(const std::string& partId, uint64_t vhalProperty,
-                              const TranslationOp& translationOp);
-
-    // Perform texture opertion for the part with given vhal property.
-    // Not implemented yet.
-    void performTextureOp(const std::string& partId, uint64_t vhalProperty,
-                          const TextureOp& textureOp);
+    void performTranslationOp(const PartOp& partOp, const VhalStatus& vhalStatus);
 
     // Perform rotation opertion for the part with given vhal property.
-    void performRotationOp(const std::string& partId, uint64_t vhalProperty,
-                           const RotationOp& rotationOp);
+    void performRotationOp(const PartOp& partOp, const VhalStatus& vhalStatus);
 
     // Last call time of GetUpdatedAnimationParams() in millisecond.
     float mLastCallTime;
@@ -130,21 +177,48 @@ private:
     // Flag indicating if GetUpdatedAnimationParams() was called before.
     bool mIsCalled;
 
-    std::map<std::string, CarPart> mPartsMap;
+    // Flag indicating if an animation was in progress after the last call.
+    bool mIsAnimating;
+
+    // Flag indicating if the next call returns the params of every part.
+    bool mIsFullUpdateRequested;
 
     std::map<std::string, CarTexture> mTexturesMap;
 
-    std::vector<AnimationInfo> mAnimations;
+    // Car part status, indexed by part index.
+    std::vector<CarPartStatus> mCarPartsStatus;
+
+    // Local model of each part in its parent's coordinate, by part index.
+    std::vector<Mat4x4> mLocalModels;
+
+    // Current model of each part in global coordinate with animations
+    // combined, by part index.
+    // current_model = local_model * parent_current_model;
+    std::vector<Mat4x4> mCurrentModels;
+
+    std::vector<GammaOp> mGammaOps;
+
+    std::vector<TextureOp> mTextureOps;
+
+    std::vector<RotationOp> mRotationOps;
+
+    std::vector<TranslationOp> mTranslationOps;
+
+    std::vector<VhalProgress> mVhalProgresses;
 
-    std::map<std::string, AnimationInfo> mPartsToAnimationMap;
+    // Sorted by vhal property.
+    std::vector<VhalStatus> mVhalStatuses;
 
-    std::map<uint64_t, VhalStatus> mVhalStatusMap;
+    // Parts whose local model changed during the current call.
+    std::vector<int> mChangedParts;
 
-    std::map<uint64_t, std::set<std::string>> mVhalToPartsMap;
+    // Animation param of each part, by part index.
+    std::vector<AnimationParam> mAnimationParams;
 
-    std::map<std::string, CarPartStatus> mCarPartsStatusMap;
+    // Parts updated by the current call.
+    std::vector<int> mUpdatedParts;
 
-    std::map<std::string, AnimationParam> mUpdatedPartsMap;
+    std::vector<bool> mIsPartUpdated;
 };
 
 }  // namespace implementation
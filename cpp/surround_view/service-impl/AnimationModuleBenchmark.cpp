@@ -0,0 +1,99 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "AnimationModule.h"
+#include "AnimationModuleSamples.h"
+
+#include <android/hardware/automotive/vehicle/2.0/IVehicle.h>
+#include <benchmark/benchmark.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace sv {
+namespace V1_0 {
+namespace implementation {
+namespace {
+
+VehiclePropValue makeDoorValue(int32_t prop) {
+    VehiclePropValue value;
+    value.areaId = (int32_t)VehicleArea::DOOR;
+    value.prop = prop | VehiclePropertyGroup::SYSTEM | VehiclePropertyType::INT32 |
+            VehicleArea::DOOR;
+    value.value.int32Values = std::vector<int32_t>(1, INT32_MAX);
+    return value;
+}
+
+VehiclePropValue makeGlobalValue(int32_t prop) {
+    VehiclePropValue value;
+    value.areaId = (int32_t)VehicleArea::GLOBAL;
+    value.prop = prop | VehiclePropertyGroup::SYSTEM | VehiclePropertyType::INT32 |
+            VehicleArea::GLOBAL;
+    value.value.int32Values = std::vector<int32_t>(1, INT32_MAX);
+    return value;
+}
+
+// Moves the frame and so every part of the sample model
+std::vector<VehiclePropValue> allPartsValues() {
+    std::vector<VehiclePropValue> values;
+    for (const int32_t prop : {0x0200, 0x0201}) {
+        values.push_back(makeDoorValue(prop));
+    }
+    for (const int32_t prop : {0x0300, 0x0301, 0x0400, 0x0500}) {
+        values.push_back(makeGlobalValue(prop));
+    }
+    return values;
+}
+
+// Moves a single leaf part
+std::vector<VehiclePropValue> oneDoorValues() {
+    return {makeDoorValue(0x0200)};
+}
+
+// Measures a getUpdatedAnimationParams() call per frame, with the same vhal
+// values on every frame
+void BM_GetUpdatedAnimationParams(benchmark::State& state,
+                                  std::vector<VehiclePropValue> vehiclePropValues) {
+    AnimationModule animationModule(getSampleCarPartsMap(), std::map<std::string, CarTexture>(),
+                                    getSampleAnimationsWithFrameTranslation());
+    size_t numParams = 0;
+    for (auto _ : state) {
+        std::vector<AnimationParam> result =
+                animationModule.getUpdatedAnimationParams(vehiclePropValues);
+        numParams += result.size();
+        benchmark::DoNotOptimize(result.data());
+    }
+    state.counters["params_per_call"] =
+            benchmark::Counter(numParams, benchmark::Counter::kAvgIterations);
+}
+
+BENCHMARK_CAPTURE(BM_GetUpdatedAnimationParams, AllParts, allPartsValues());
+BENCHMARK_CAPTURE(BM_GetUpdatedAnimationParams, OneDoor, oneDoorValues());
+BENCHMARK_CAPTURE(BM_GetUpdatedAnimationParams, NoValues, std::vector<VehiclePropValue>());
+
+}  // namespace
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sv
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -0,0 +1,50 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SURROUND_VIEW_SERVICE_IMPL_ANIMATIONMODULESAMPLES_H_
+#define SURROUND_VIEW_SERVICE_IMPL_ANIMATIONMODULESAMPLES_H_
+
+#include "AnimationModule.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace sv {
+namespace V1_0 {
+namespace implementation {
+
+// A car frame with five child parts: two doors, two blinkers and a sun roof.
+// Shared by the AnimationModule tests and benchmarks.
+std::map<std::string, CarPart> getSampleCarPartsMap();
+
+// Animations of each child part, driven by its own vhal property
+std::vector<AnimationInfo> getSampleAnimations();
+
+// Sample animations where the frame moves all the other parts along with it.
+std::vector<AnimationInfo> getSampleAnimationsWithFrameTranslation();
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sv
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif  // SURROUND_VIEW_SERVICE_IMPL_ANIMATIONMODULESAMPLES_H_
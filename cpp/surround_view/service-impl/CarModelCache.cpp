@@ -0,0 +1,392 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CarModelCache.h"
+
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/unique_fd.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace sv {
+namespace V1_0 {
+namespace implementation {
+
+using android_auto::surround_view::CarMaterial;
+using android_auto::surround_view::CarTextureType;
+using android_auto::surround_view::CarVertex;
+
+namespace {
+
+// Cache file layout, in native byte order:
+//   header:   magic, version
+//   options:  coordinate mapping, scales, offsets, mtl filename
+//   sources:  count, then (filename, checksum) of the obj and mtl files
+//   parts:    count, then (name, material, vertex count, vertices)
+//   checksum of all the bytes above
+constexpr uint32_t kCacheMagic = 0x4d435653;  // "SVCM"
+constexpr uint32_t kCacheVersion = 1;
+
+constexpr uint64_t kChecksumSeed = 0xcbf29ce484222325ULL;
+constexpr uint64_t kChecksumPrime = 0x100000001b3ULL;
+constexpr int kChecksumLanes = 4;
+
+const std::array<float, 16> kMat4Identity = {
+        /*row 0*/ 1, 0, 0, 0,
+        /*row 1*/ 0, 1, 0, 0,
+        /*row 2*/ 0, 0, 1, 0,
+        /*row 3*/ 0, 0, 0, 1};
+
+// Vertices are stored as they are laid out in memory.
+static_assert(std::is_trivially_copyable<CarVertex>::value, "CarVertex must be copyable");
+static_assert(sizeof(CarVertex) == 8 * sizeof(float), "CarVertex must not be padded");
+
+class CacheWriter {
+public:
+    template <typename T>
+    void write(const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "Value must be copyable");
+        writeBytes(&value, sizeof(T));
+    }
+
+    void writeString(const std::string& value) {
+        write(static_cast<uint32_t>(value.size()));
+        writeBytes(value.data(), value.size());
+    }
+
+    void writeBytes(const void* data, size_t size) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        mData.insert(mData.end(), bytes, bytes + size);
+    }
+
+    const std::string& data() const { return mData; }
+
+private:
+    std::string mData;
+};
+
+// Reads values from the cache content. Every read is bounds checked, so a
+// truncated cache fails to read instead of reading past its end.
+class CacheReader {
+public:
+    CacheReader(const uint8_t* data, size_t size) : mData(data), mSize(size) {}
+
+    template <typename T>
+    bool read(T* value) {
+        static_assert(std::is_trivially_copyable<T>::value, "Value must be copyable");
+        return readBytes(value, sizeof(T));
+    }
+
+    bool readString(std::string* value) {
+        uint32_t size;
+        if (!read(&size) || size > mSize - mOffset) {
+            return false;
+        }
+        value->assign(reinterpret_cast<const char*>(mData + mOffset), size);
+        mOffset += size;
+        return true;
+    }
+
+    bool readBytes(void* data, size_t size) {
+        if (size > mSize - mOffset) {
+            return false;
+        }
+        std::memcpy(data, mData + mOffset, size);
+        mOffset += size;
+        return true;
+    }
+
+    bool isAtEnd() const { return mOffset == mSize; }
+
+private:
+    const uint8_t* mData;
+    size_t mSize;
+    size_t mOffset = 0;
+};
+
+void WriteOptions(const ReadObjOptions& option, CacheWriter* writer) {
+    writer->write(option.coordinateMapping);
+    writer->write(option.scales);
+    writer->write(option.offsets);
+    writer->writeString(option.mtlFilename);
+}
+
+bool IsSameOptions(const ReadObjOptions& option, CacheReader* reader) {
+    ReadObjOptions cachedOption;
+    if (!reader->read(&cachedOption.coordinateMapping) || !reader->read(&cachedOption.scales) ||
+        !reader->read(&cachedOption.offsets) || !reader->readString(&cachedOption.mtlFilename)) {
+        return false;
+    }
+    return std::memcmp(cachedOption.coordinateMapping, option.coordinateMapping,
+                       sizeof(option.coordinateMapping)) == 0 &&
+            std::memcmp(cachedOption.scales, option.scales, sizeof(option.scales)) == 0 &&
+            std::memcmp(cachedOption.offsets, option.offsets, sizeof(option.offsets)) == 0 &&
+            cachedOption.mtlFilename == option.mtlFilename;
+}
+
+void WriteCarPart(const std::string& name, const CarPart& carPart, CacheWriter* writer) {
+    writer->writeString(name);
+
+    const CarMaterial& material = carPart.material;
+    writer->write(material.illum);
+    writer->write(material.ka);
+    writer->write(material.kd);
+    writer->write(material.ks);
+    writer->write(material.d);
+    writer->write(material.ns);
+    writer->write(static_cast<uint32_t>(material.textures.size()));
+    for (const auto& texture : material.textures) {
+        writer->write(static_cast<uint32_t>(texture.first));
+        writer->writeString(texture.second);
+    }
+
+    writer->write(static_cast<uint32_t>(carPart.vertices.size()));
+    writer->writeBytes(carPart.vertices.data(), carPart.vertices.size() * sizeof(CarVertex));
+}
+
+bool ReadCarPart(CacheReader* reader, std::map<std::string, CarPart>* carPartsMap) {
+    std::string name;
+    CarMaterial material;
+    uint32_t texturesCount;
+    if (!reader->readString(&name) || !reader->read(&material.illum) ||
+        !reader->read(&material.ka) || !reader->read(&material.kd) ||
+        !reader->read(&material.ks) || !reader->read(&material.d) ||
+        !reader->read(&material.ns) || !reader->read(&texturesCount)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < texturesCount; ++i) {
+        uint32_t type;
+        std::string textureId;
+        if (!reader->read(&type) || !reader->readString(&textureId)) {
+            return false;
+        }
+        material.textures.emplace(static_cast<CarTextureType>(type), textureId);
+    }
+
+    uint32_t verticesCount;
+    if (!reader->read(&verticesCount)) {
+        return false;
+    }
+    std::vector<CarVertex> vertices(verticesCount);
+    if (!reader->readBytes(vertices.data(), verticesCount * sizeof(CarVertex))) {
+        return false;
+    }
+
+    auto result = carPartsMap->emplace(name,
+                                       CarPart(std::vector<CarVertex>(), material, kMat4Identity,
+                                               std::string(), std::vector<std::string>()));
+    if (!result.second) {
+        return false;
+    }
+    result.first->second.vertices = std::move(vertices);
+    return true;
+}
+
+}  // namespace
+
+uint64_t ComputeChecksum(const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+    // Hashes 8 byte words in independent lanes so that the multiplications
+    // are pipelined, then folds the lanes and the remaining bytes.
+    uint64_t lanes[kChecksumLanes];
+    for (int i = 0; i < kChecksumLanes; ++i) {
+        lanes[i] = kChecksumSeed + i;
+    }
+    const size_t blockSize = kChecksumLanes * sizeof(uint64_t);
+    size_t offset = 0;
+    for (; offset + blockSize <= size; offset += blockSize) {
+        uint64_t words[kChecksumLanes];
+        std::memcpy(words, bytes + offset, blockSize);
+        for (int i = 0; i < kChecksumLanes; ++i) {
+            lanes[i] = (lanes[i] ^ words[i]) * kChecksumPrime;
+        }
+    }
+
+    uint64_t checksum = kChecksumSeed ^ size;
+    for (int i = 0; i < kChecksumLanes; ++i) {
+        checksum = (checksum ^ lanes[i]) * kChecksumPrime;
+    }
+    for (; offset < size; ++offset) {
+        checksum = (checksum ^ bytes[offset]) * kChecksumPrime;
+    }
+    return checksum;
+}
+
+bool ComputeFileChecksum(const std::string& filename, uint64_t* checksum) {
+    std::string content;
+    if (!android::base::ReadFileToString(filename, &content)) {
+        return false;
+    }
+    *checksum = ComputeChecksum(content.data(), content.size());
+    return true;
+}
+
+bool ReadCarModelCache(const std::string& cacheFilename, const CarModelSource& objSource,
+                       const ReadObjOptions& option,
+                       std::map<std::string, CarPart>* carPartsMap) {
+    std::string content;
+    if (!android::base::ReadFileToString(cacheFilename, &content)) {
+        LOG(INFO) << "No car model cache found at " << cacheFilename;
+        return false;
+    }
+
+    uint64_t storedChecksum;
+    if (content.size() < sizeof(storedChecksum)) {
+        LOG(WARNING) << "Car model cache " << cacheFilename << " is truncated.";
+        return false;
+    }
+    const size_t size = content.size() - sizeof(storedChecksum);
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(content.data());
+    std::memcpy(&storedChecksum, data + size, sizeof(storedChecksum));
+    if (storedChecksum != ComputeChecksum(data, size)) {
+        LOG(WARNING) << "Car model cache " << cacheFilename << " is corrupted.";
+        return false;
+    }
+
+    CacheReader reader(data, size);
+    uint32_t magic, version;
+    if (!reader.read(&magic) || !reader.read(&version) || magic != kCacheMagic ||
+        version != kCacheVersion) {
+        LOG(INFO) << "Car model cache " << cacheFilename << " has an unsupported version.";
+        return false;
+    }
+
+    if (!IsSameOptions(option, &reader)) {
+        LOG(INFO) << "Car model cache " << cacheFilename << " was written with other options.";
+        return false;
+    }
+
+    uint32_t sourcesCount;
+    if (!reader.read(&sourcesCount) || sourcesCount == 0) {
+        return false;
+    }
+    for (uint32_t i = 0; i < sourcesCount; ++i) {
+        CarModelSource source;
+        if (!reader.readString(&source.filename) || !reader.read(&source.checksum)) {
+            return false;
+        }
+
+        // The obj file is always the first source, and was already read by the
+        // caller.
+        uint64_t checksum;
+        if (i == 0) {
+            checksum = objSource.checksum;
+        } else if (!ComputeFileChecksum(source.filename, &checksum)) {
+            LOG(INFO) << "Car model cache " << cacheFilename << " is outdated, "
+                      << source.filename << " cannot be read.";
+            return false;
+        }
+        if (checksum != source.checksum) {
+            LOG(INFO) << "Car model cache " << cacheFilename << " is outdated, "
+                      << (i == 0 ? objSource.filename : source.filename) << " changed.";
+            return false;
+        }
+    }
+
+    uint32_t partsCount;
+    if (!reader.read(&partsCount)) {
+        return false;
+    }
+    std::map<std::string, CarPart> cachedPartsMap;
+    for (uint32_t i = 0; i < partsCount; ++i) {
+        if (!ReadCarPart(&reader, &cachedPartsMap)) {
+            LOG(WARNING) << "Failed to read car part " << i << " from car model cache "
+                         << cacheFilename;
+            return false;
+        }
+    }
+    if (!reader.isAtEnd()) {
+        LOG(WARNING) << "Car model cache " << cacheFilename << " has trailing data.";
+        return false;
+    }
+
+    carPartsMap->swap(cachedPartsMap);
+    LOG(INFO) << "Read " << partsCount << " car parts from car model cache " << cacheFilename;
+    return true;
+}
+
+bool WriteCarModelCache(const std::string& cacheFilename,
+                        const std::vector<CarModelSource>& sources, const ReadObjOptions& option,
+                        const std::map<std::string, CarPart>& carPartsMap) {
+    CacheWriter writer;
+    writer.write(kCacheMagic);
+    writer.write(kCacheVersion);
+    WriteOptions(option, &writer);
+
+    writer.write(static_cast<uint32_t>(sources.size()));
+    for (const auto& source : sources) {
+        writer.writeString(source.filename);
+        writer.write(source.checksum);
+    }
+
+    writer.write(static_cast<uint32_t>(carPartsMap.size()));
+    for (const auto& carPart : carPartsMap) {
+        WriteCarPart(carPart.first, carPart.second, &writer);
+    }
+    writer.write(ComputeChecksum(writer.data().data(), writer.data().size()));
+
+    // Write to a temporary file first so a reader never sees a partial cache.
+    // The data is synced before the rename, otherwise a power loss may leave
+    // the renamed file empty.
+    const std::string tempFilename = cacheFilename + ".tmp";
+    android::base::unique_fd fd(TEMP_FAILURE_RETRY(
+            open(tempFilename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600)));
+    if (fd.get() < 0) {
+        PLOG(WARNING) << "Failed to create car model cache " << tempFilename;
+        return false;
+    }
+    if (!android::base::WriteStringToFd(writer.data(), fd.get()) || fsync(fd.get()) != 0) {
+        PLOG(WARNING) << "Failed to write car model cache " << tempFilename;
+        std::remove(tempFilename.c_str());
+        return false;
+    }
+    fd.reset();
+
+    if (std::rename(tempFilename.c_str(), cacheFilename.c_str()) != 0) {
+        PLOG(WARNING) << "Failed to rename car model cache to " << cacheFilename;
+        std::remove(tempFilename.c_str());
+        return false;
+    }
+
+    // Makes the rename itself durable.
+    const std::string dirname = android::base::Dirname(cacheFilename);
+    android::base::unique_fd dirFd(
+            TEMP_FAILURE_RETRY(open(dirname.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)));
+    if (dirFd.get() < 0 || fsync(dirFd.get()) != 0) {
+        PLOG(WARNING) << "Failed to sync directory " << dirname;
+    }
+
+    LOG(INFO) << "Wrote " << carPartsMap.size() << " car parts to car model cache "
+              << cacheFilename;
+    return true;
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sv
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
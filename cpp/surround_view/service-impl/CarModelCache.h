@@ -0,0 +1,71 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SURROUND_VIEW_SERVICE_IMPL_CARMODELCACHE_H_
+#define SURROUND_VIEW_SERVICE_IMPL_CARMODELCACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ObjReader.h"
+#include "core_lib.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace sv {
+namespace V1_0 {
+namespace implementation {
+
+// A file the car model was read from, along with the checksum of its content.
+struct CarModelSource {
+    std::string filename;
+    uint64_t checksum = 0;
+};
+
+// Returns a 64 bit checksum of |size| bytes at |data|. It detects changed
+// files, it is not meant to resist tampering.
+uint64_t ComputeChecksum(const void* data, size_t size);
+
+// Computes the checksum of the content of |filename|.
+bool ComputeFileChecksum(const std::string& filename, uint64_t* checksum);
+
+// Reads the car parts from the binary car model cache |cacheFilename|.
+// |objSource| is the obj file the car model is read from. The cache is only
+// used if it was written for the same obj file content and the same |option|,
+// and if none of the mtl files used by the obj file changed since.
+// |carPartsMap| is left untouched if the cache is not used.
+bool ReadCarModelCache(const std::string& cacheFilename, const CarModelSource& objSource,
+                       const ReadObjOptions& option,
+                       std::map<std::string, CarPart>* carPartsMap);
+
+// Writes the car parts to the binary car model cache |cacheFilename|.
+// |sources| are the obj file followed by the mtl files it uses.
+bool WriteCarModelCache(const std::string& cacheFilename,
+                        const std::vector<CarModelSource>& sources, const ReadObjOptions& option,
+                        const std::map<std::string, CarPart>& carPartsMap);
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sv
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+#endif  // SURROUND_VIEW_SERVICE_IMPL_CARMODELCACHE_H_
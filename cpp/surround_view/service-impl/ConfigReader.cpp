@@ -40,6 +40,25 @@ using android_auto::surround_view::SurroundView3dParams;
 
 namespace {
 
+// Used when the config file does not specify FramesQueueDepth in Sv2dParams
+// or Sv3dParams.
+const int kDefaultFramesQueueDepth = 2;
+
+// Reads the optional FramesQueueDepth element.
+bool ReadFramesQueueDepth(const XMLElement* parent, int* value) {
+    *value = kDefaultFramesQueueDepth;
+    if (parent->FirstChildElement("FramesQueueDepth") == nullptr) {
+        return true;
+    }
+
+    RETURN_IF_FALSE(ReadValue(parent, "FramesQueueDepth", value));
+    if (*value < 1) {
+        LOG(ERROR) << "FramesQueueDepth must be at least 1: " << *value;
+        return false;
+    }
+    return true;
+}
+
 // Macro returning IoStatus::ERROR_CONFIG_FILE_FORMAT if condition evaluates to false.
 #define RETURN_ERROR_STATUS_IF_FALSE(cond)             \
     do {                                               \
@@ -136,6 +155,9 @@ bool ReadSvConfig2d(const XMLElement* parent, SvConfig2d* sv2dConfig) {
         // GPU Acceleration enabled or not
         RETURN_IF_FALSE(ReadValue(param2dElem, "GpuAccelerationEnabled",
                                   &sv2dParams->gpu_acceleration_enabled));
+
+        // Frames queue depth (optional)
+        RETURN_IF_FALSE(ReadFramesQueueDepth(param2dElem, &sv2dConfig->framesQueueDepth));
     }
     return true;
 }
@@ -153,6 +175,11 @@ bool ReadSvConfig3d(const XMLElement* parent, SvConfig3d* sv3dConfig) {
 
     RETURN_IF_FALSE(ReadValue(parent, "CarModelObjFile", &sv3dConfig->carModelObjFile));
 
+    // Car model cache file (optional)
+    if (parent->FirstChildElement("CarModelCacheFile") != nullptr) {
+        RETURN_IF_FALSE(ReadValue(parent, "CarModelCacheFile", &sv3dConfig->carModelCacheFile));
+    }
+
     SurroundView3dParams* sv3dParams = &sv3dConfig->sv3dParams;
     const XMLElement* param3dElem = nullptr;
     RETURN_IF_FALSE(GetElement(parent, "Sv3dParams", &param3dElem));
@@ -192,6 +219,9 @@ bool ReadSvConfig3d(const XMLElement* parent, SvConfig3d* sv3dConfig) {
             RETURN_IF_FALSE(ReadValue(highQualityDetailsElem, "Reflections",
                                       &sv3dParams->high_details_reflections));
         }
+
+        // Frames queue depth (optional)
+        RETURN_IF_FALSE(ReadFramesQueueDepth(param3dElem, &sv3dConfig->framesQueueDepth));
     }
     return true;
 }
@@ -224,6 +254,25 @@ bool ReadCameraConfig(const XMLElement* parent, CameraConfig* cameraConfig) {
             RETURN_IF_FALSE(ReadValue(masksElem, "Rear", &cameraConfig->maskFilenames[2]));
             RETURN_IF_FALSE(ReadValue(masksElem, "Left", &cameraConfig->maskFilenames[3]));
         }
+
+        // Zero copy input (Optional).
+        cameraConfig->zeroCopyInputEnabled = false;
+        if (cameraConfigElem->FirstChildElement("ZeroCopyInputEnabled") != nullptr) {
+            RETURN_IF_FALSE(ReadValue(cameraConfigElem, "ZeroCopyInputEnabled",
+                                      &cameraConfig->zeroCopyInputEnabled));
+        }
+
+        // Projection lookup table grid step (Optional).
+        cameraConfig->projectionLutGridStep = 0;
+        if (cameraConfigElem->FirstChildElement("ProjectionLutGridStep") != nullptr) {
+            RETURN_IF_FALSE(ReadValue(cameraConfigElem, "ProjectionLutGridStep",
+                                      &cameraConfig->projectionLutGridStep));
+            if (cameraConfig->projectionLutGridStep < 0) {
+                LOG(ERROR) << "ProjectionLutGridStep must not be negative: "
+                           << cameraConfig->projectionLutGridStep;
+                return false;
+            }
+        }
     }
     return true;
 }
@@ -56,6 +56,8 @@ TEST(ConfigReaderTests, ReadConfigSuccess) {
     EXPECT_EQ(svConfig.cameraConfig.maskFilenames[1], "/vendor/etc/automotive/sv/mask_right.png");
     EXPECT_EQ(svConfig.cameraConfig.maskFilenames[2], "/vendor/etc/automotive/sv/mask_rear.png");
     EXPECT_EQ(svConfig.cameraConfig.maskFilenames[3], "/vendor/etc/automotive/sv/mask_left.png");
+    EXPECT_EQ(svConfig.cameraConfig.zeroCopyInputEnabled, true);
+    EXPECT_EQ(svConfig.cameraConfig.projectionLutGridStep, 8);
 
     // Surround view 2D
     EXPECT_EQ(svConfig.sv2dConfig.sv2dEnabled, true);
@@ -66,6 +68,7 @@ TEST(ConfigReaderTests, ReadConfigSuccess) {
     EXPECT_EQ(svConfig.sv2dConfig.sv2dParams.physical_center.x, 0.0);
     EXPECT_EQ(svConfig.sv2dConfig.sv2dParams.physical_center.y, 0.0);
     EXPECT_EQ(svConfig.sv2dConfig.sv2dParams.gpu_acceleration_enabled, false);
+    EXPECT_EQ(svConfig.sv2dConfig.framesQueueDepth, 3);
     EXPECT_EQ(svConfig.sv2dConfig.carBoundingBox.width, 2.0);
     EXPECT_EQ(svConfig.sv2dConfig.carBoundingBox.height, 3.0);
     EXPECT_EQ(svConfig.sv2dConfig.carBoundingBox.x, 1.0);
@@ -79,6 +82,8 @@ TEST(ConfigReaderTests, ReadConfigSuccess) {
     EXPECT_EQ(svConfig.sv3dConfig.sv3dEnabled, true);
     EXPECT_NE(svConfig.sv3dConfig.carModelConfigFile, "");
     EXPECT_NE(svConfig.sv3dConfig.carModelObjFile, "");
+    EXPECT_EQ(svConfig.sv3dConfig.carModelCacheFile,
+              "/data/vendor/automotive/sv/sample_car.cache");
     EXPECT_EQ(svConfig.sv3dConfig.sv3dParams.plane_radius, 8.0);
     EXPECT_EQ(svConfig.sv3dConfig.sv3dParams.plane_divisions, 50);
     EXPECT_EQ(svConfig.sv3dConfig.sv3dParams.curve_height, 6.0);
@@ -87,6 +92,7 @@ TEST(ConfigReaderTests, ReadConfigSuccess) {
     EXPECT_EQ(svConfig.sv3dConfig.sv3dParams.curve_coefficient, 3.0);
     EXPECT_EQ(svConfig.sv3dConfig.sv3dParams.high_details_shadows, true);
     EXPECT_EQ(svConfig.sv3dConfig.sv3dParams.high_details_reflections, true);
+    EXPECT_EQ(svConfig.sv3dConfig.framesQueueDepth, 3);
 }
 
 }  // namespace
@@ -49,8 +49,10 @@ IOStatus IOModule::initialize() {
     mIOModuleConfig.sv3dConfig = svConfig.sv3dConfig;
 
     if (mIOModuleConfig.sv3dConfig.sv3dEnabled) {
-        // Read obj and mtl files.
-        if (!ReadObjFromFile(svConfig.sv3dConfig.carModelObjFile,
+        // Read obj and mtl files, or their cached car parts.
+        ReadObjOptions readObjOptions;
+        readObjOptions.cacheFilename = svConfig.sv3dConfig.carModelCacheFile;
+        if (!ReadObjFromFile(svConfig.sv3dConfig.carModelObjFile, readObjOptions,
                              &mIOModuleConfig.carModelConfig.carModel.partsMap)) {
             LOG(ERROR) << "ReadObjFromFile() failed.";
             return IOStatus::ERROR_READ_CAR_MODEL;
@@ -39,6 +39,15 @@ struct CameraConfig {
 
     // In order: front, right, rear, left.
     std::vector<std::string> maskFilenames;
+
+    // If true, the CPU solutions read the EVS buffers in place while
+    // stitching, instead of copying them first. The EVS frames are then held
+    // until the stitching is done.
+    bool zeroCopyInputEnabled;
+
+    // Spacing in pixels of the grid the camera point projections are
+    // precomputed on. The projections are computed per point if 0.
+    int projectionLutGridStep;
 };
 
 struct SvConfig2d {
@@ -51,6 +60,10 @@ struct SvConfig2d {
     // Car model bounding box for 2d surround view.
     // To be moved into sv 2d params.
     android_auto::surround_view::BoundingBox carBoundingBox;
+
+    // Number of frame sets that may be in flight between the EVS cameras and
+    // the client at once.
+    int framesQueueDepth;
 };
 
 struct SvConfig3d {
@@ -66,8 +79,17 @@ struct SvConfig3d {
     // Car model obj file.
     std::string carModelObjFile;
 
+    // Binary cache of the car model read from the obj file. Optional, the
+    // obj file is parsed on every start if empty. Its directory must be
+    // writable by the service for the cache to be written.
+    std::string carModelCacheFile;
+
     // Surround view 3d params.
     android_auto::surround_view::SurroundView3dParams sv3dParams;
+
+    // Number of frame sets that may be in flight between the EVS cameras and
+    // the client at once.
+    int framesQueueDepth;
 };
 
 // Main struct in which surround view config is parsed into.
@@ -0,0 +1,137 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define ATRACE_TAG ATRACE_TAG_CAMERA
+
+#include "InputBufferCache.h"
+
+#include <android-base/logging.h>
+#include <utils/Trace.h>
+
+#include <algorithm>
+
+using ::std::list;
+using ::std::scoped_lock;
+using ::std::mutex;
+using ::std::string;
+
+using BufferDesc_1_1 = ::android::hardware::automotive::evs::V1_1::BufferDesc;
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace sv {
+namespace V1_0 {
+namespace implementation {
+
+namespace {
+
+bool isSameDescription(const AHardwareBuffer_Desc& a, const AHardwareBuffer_Desc& b) {
+    return a.width == b.width && a.height == b.height && a.layers == b.layers &&
+            a.format == b.format && a.usage == b.usage && a.stride == b.stride;
+}
+
+}  // namespace
+
+InputBufferCache::InputBufferCache(size_t maxBuffersPerDevice)
+    : mMaxBuffersPerDevice(std::max<size_t>(maxBuffersPerDevice, 1)) {}
+
+sp<GraphicBuffer> InputBufferCache::getGraphicBuffer(const BufferDesc_1_1& buffer) {
+    const AHardwareBuffer_Desc* pDesc =
+            reinterpret_cast<const AHardwareBuffer_Desc*>(&buffer.buffer.description);
+
+    scoped_lock<mutex> lock(mLock);
+    list<Entry>& entries = mEntries[string(buffer.deviceId)];
+    const auto it = std::find_if(entries.begin(), entries.end(), [&buffer](const Entry& entry) {
+        return entry.bufferId == buffer.bufferId;
+    });
+    if (it != entries.end()) {
+        if (isSameDescription(it->description, *pDesc)) {
+            // Makes it the most recently used buffer
+            entries.splice(entries.begin(), entries, it);
+            return it->graphicBuffer;
+        }
+
+        LOG(DEBUG) << "Buffer " << buffer.bufferId << " of camera " << buffer.deviceId
+                   << " has changed. Re-importing it.";
+        entries.erase(it);
+    }
+
+    ATRACE_BEGIN("Import Graphic Buffer");
+    // create a GraphicBuffer from the existing handle
+    sp<GraphicBuffer> graphicBuffer = new GraphicBuffer(
+            buffer.buffer.nativeHandle, GraphicBuffer::CLONE_HANDLE, pDesc->width,
+            pDesc->height, pDesc->format, pDesc->layers, pDesc->usage, pDesc->stride);
+    ATRACE_END();
+
+    if (graphicBuffer == nullptr || graphicBuffer->initCheck() != OK) {
+        LOG(ERROR) << "Failed to import buffer " << buffer.bufferId << " of camera "
+                   << buffer.deviceId;
+        return nullptr;
+    }
+
+    LOG(DEBUG) << "Imported buffer " << buffer.bufferId << " of camera " << buffer.deviceId
+               << " width: " << pDesc->width
+               << " height: " << pDesc->height
+               << " format: " << pDesc->format
+               << " stride: " << pDesc->stride;
+
+    // The least recently used buffer is released once the callers holding it
+    // are done with it.
+    entries.push_front(Entry{buffer.bufferId, *pDesc, graphicBuffer});
+    if (entries.size() > mMaxBuffersPerDevice) {
+        entries.pop_back();
+    }
+    mImportCount++;
+    ATRACE_INT64("SV input buffer imports", static_cast<int64_t>(mImportCount));
+
+    return graphicBuffer;
+}
+
+void InputBufferCache::setMaxBuffersPerDevice(size_t count) {
+    scoped_lock<mutex> lock(mLock);
+    mMaxBuffersPerDevice = std::max<size_t>(count, 1);
+    for (auto& device : mEntries) {
+        while (device.second.size() > mMaxBuffersPerDevice) {
+            device.second.pop_back();
+        }
+    }
+}
+
+void InputBufferCache::clear() {
+    scoped_lock<mutex> lock(mLock);
+    mEntries.clear();
+}
+
+size_t InputBufferCache::size() const {
+    scoped_lock<mutex> lock(mLock);
+    size_t count = 0;
+    for (const auto& device : mEntries) {
+        count += device.second.size();
+    }
+    return count;
+}
+
+uint64_t InputBufferCache::getImportCount() const {
+    scoped_lock<mutex> lock(mLock);
+    return mImportCount;
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sv
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android-base/thread_annotations.h>
+#include <android/hardware/automotive/evs/1.1/types.h>
+#include <android/hardware_buffer.h>
+
+#include <ui/GraphicBuffer.h>
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace sv {
+namespace V1_0 {
+namespace implementation {
+
+// Imports the graphic buffers delivered by the EVS cameras once, and hands
+// back the imported buffers whenever the same buffers are delivered again.
+// Buffers are told apart by their device and buffer id; a buffer that comes
+// back under a known id with another descriptor is imported again. Each device
+// keeps as many buffers as it has in flight; the least recently used one is
+// dropped when another one is imported.
+class InputBufferCache {
+public:
+    explicit InputBufferCache(size_t maxBuffersPerDevice = kDefaultMaxBuffersPerDevice);
+
+    // Returns the GraphicBuffer for an EVS buffer. The buffer is imported if it
+    // was not seen before, or if its descriptor changed since it was imported.
+    // Returns nullptr if the import fails.
+    sp<GraphicBuffer> getGraphicBuffer(
+            const ::android::hardware::automotive::evs::V1_1::BufferDesc& buffer);
+
+    // Sets the number of buffers kept per device, which is the number of
+    // frames a camera has in flight. Drops the least recently used buffers
+    // beyond it.
+    void setMaxBuffersPerDevice(size_t count);
+
+    // Drops all the imported buffers. Called when the EVS stream is restarted,
+    // since the cameras may then deliver other buffers.
+    void clear();
+
+    size_t size() const;
+
+    // Number of imports done by the cache since it was created.
+    uint64_t getImportCount() const;
+
+    static constexpr size_t kDefaultMaxBuffersPerDevice = 4;
+
+private:
+    struct Entry {
+        uint32_t bufferId;
+        AHardwareBuffer_Desc description;
+        sp<GraphicBuffer> graphicBuffer;
+    };
+
+    mutable std::mutex mLock;
+    size_t mMaxBuffersPerDevice GUARDED_BY(mLock);
+
+    // The buffers of each device, most recently used first.
+    std::map<std::string, std::list<Entry>> mEntries GUARDED_BY(mLock);
+    uint64_t mImportCount GUARDED_BY(mLock) = 0;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sv
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
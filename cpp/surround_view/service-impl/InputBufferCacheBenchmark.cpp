@@ -0,0 +1,120 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "InputBufferCache.h"
+
+#include <benchmark/benchmark.h>
+#include <system/graphics-base.h>
+#include <ui/GraphicBuffer.h>
+
+#include <string>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace sv {
+namespace V1_0 {
+namespace implementation {
+namespace {
+
+using BufferDesc_1_1 = ::android::hardware::automotive::evs::V1_1::BufferDesc;
+
+// The sample config has four 1280 x 720 cameras
+const int kNumDevices = 4;
+const int kWidth = 1280;
+const int kHeight = 720;
+
+// The buffers the cameras hand out in turn, one frame of every camera after
+// the other
+struct Frames {
+    std::vector<sp<GraphicBuffer>> graphicBuffers;
+    std::vector<BufferDesc_1_1> buffers;
+};
+
+bool allocateFrames(int buffersPerDevice, Frames& frames) {
+    for (int i = 0; i < buffersPerDevice; i++) {
+        for (int device = 0; device < kNumDevices; device++) {
+            sp<GraphicBuffer> graphicBuffer =
+                    new GraphicBuffer(kWidth, kHeight, HAL_PIXEL_FORMAT_RGBA_8888, 1,
+                                      GRALLOC_USAGE_HW_TEXTURE, "InputBufferCacheBenchmark");
+            if (graphicBuffer->initCheck() != OK) {
+                return false;
+            }
+
+            BufferDesc_1_1 buffer = {};
+            buffer.buffer.nativeHandle = graphicBuffer->getNativeBuffer()->handle;
+            AHardwareBuffer_Desc* pDesc =
+                    reinterpret_cast<AHardwareBuffer_Desc*>(&buffer.buffer.description);
+            pDesc->width = graphicBuffer->getWidth();
+            pDesc->height = graphicBuffer->getHeight();
+            pDesc->layers = 1;
+            pDesc->usage = GRALLOC_USAGE_HW_TEXTURE;
+            pDesc->stride = graphicBuffer->getStride();
+            pDesc->format = HAL_PIXEL_FORMAT_RGBA_8888;
+            buffer.deviceId = "/dev/video" + std::to_string(device);
+            buffer.bufferId = i;
+
+            frames.graphicBuffers.push_back(graphicBuffer);
+            frames.buffers.push_back(buffer);
+        }
+    }
+    return true;
+}
+
+// Looks up the buffers of every camera for each frame. The cache keeps
+// state.range(1) buffers per device, so it imports every buffer again once
+// the cameras have more in flight than that.
+void BM_GetGraphicBuffer(benchmark::State& state) {
+    const int buffersPerDevice = state.range(0);
+    Frames frames;
+    if (!allocateFrames(buffersPerDevice, frames)) {
+        state.SkipWithError("Failed to allocate the camera buffers");
+        return;
+    }
+
+    InputBufferCache cache(state.range(1));
+    size_t next = 0;
+    for (auto _ : state) {
+        for (int device = 0; device < kNumDevices; device++) {
+            sp<GraphicBuffer> graphicBuffer = cache.getGraphicBuffer(frames.buffers[next]);
+            if (graphicBuffer == nullptr) {
+                state.SkipWithError("Failed to import a buffer");
+                return;
+            }
+            next = (next + 1) % frames.buffers.size();
+        }
+    }
+    state.counters["imports_per_frame"] =
+            benchmark::Counter(cache.getImportCount(), benchmark::Counter::kAvgIterations);
+}
+
+// The default cache size, and a cache too small for the buffers in flight
+BENCHMARK(BM_GetGraphicBuffer)
+        ->Args({InputBufferCache::kDefaultMaxBuffersPerDevice,
+                InputBufferCache::kDefaultMaxBuffersPerDevice})
+        ->Args({InputBufferCache::kDefaultMaxBuffersPerDevice,
+                InputBufferCache::kDefaultMaxBuffersPerDevice - 1});
+
+}  // namespace
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sv
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -0,0 +1,165 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "InputBufferCacheTests"
+
+#include "InputBufferCache.h"
+
+#include <android-base/logging.h>
+#include <system/graphics-base.h>
+#include <ui/GraphicBuffer.h>
+
+#include <gtest/gtest.h>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace sv {
+namespace V1_0 {
+namespace implementation {
+namespace {
+
+using BufferDesc_1_1 = ::android::hardware::automotive::evs::V1_1::BufferDesc;
+
+const int kWidth = 64;
+const int kHeight = 32;
+const char* kDeviceId = "/dev/video0";
+
+sp<GraphicBuffer> allocateBuffer(int width, int height) {
+    sp<GraphicBuffer> graphicBuffer =
+            new GraphicBuffer(width, height, HAL_PIXEL_FORMAT_RGBA_8888, 1,
+                              GRALLOC_USAGE_HW_TEXTURE, "InputBufferCacheTests");
+    EXPECT_EQ(graphicBuffer->initCheck(), OK);
+    return graphicBuffer;
+}
+
+BufferDesc_1_1 describeBuffer(const sp<GraphicBuffer>& graphicBuffer, uint32_t bufferId) {
+    BufferDesc_1_1 buffer = {};
+    buffer.buffer.nativeHandle = graphicBuffer->getNativeBuffer()->handle;
+    AHardwareBuffer_Desc* pDesc =
+            reinterpret_cast<AHardwareBuffer_Desc*>(&buffer.buffer.description);
+    pDesc->width = graphicBuffer->getWidth();
+    pDesc->height = graphicBuffer->getHeight();
+    pDesc->layers = 1;
+    pDesc->usage = GRALLOC_USAGE_HW_TEXTURE;
+    pDesc->stride = graphicBuffer->getStride();
+    pDesc->format = HAL_PIXEL_FORMAT_RGBA_8888;
+    buffer.deviceId = kDeviceId;
+    buffer.bufferId = bufferId;
+    return buffer;
+}
+
+TEST(InputBufferCacheTests, reusesImportedBuffer) {
+    InputBufferCache cache;
+    sp<GraphicBuffer> graphicBuffer = allocateBuffer(kWidth, kHeight);
+    const BufferDesc_1_1 buffer = describeBuffer(graphicBuffer, 0);
+
+    sp<GraphicBuffer> imported = cache.getGraphicBuffer(buffer);
+    ASSERT_NE(imported, nullptr);
+    EXPECT_EQ(cache.getGraphicBuffer(buffer), imported);
+    EXPECT_EQ(cache.size(), 1);
+    EXPECT_EQ(cache.getImportCount(), 1);
+}
+
+TEST(InputBufferCacheTests, importsEachBuffer) {
+    InputBufferCache cache;
+    sp<GraphicBuffer> graphicBuffer0 = allocateBuffer(kWidth, kHeight);
+    sp<GraphicBuffer> graphicBuffer1 = allocateBuffer(kWidth, kHeight);
+
+    for (int i = 0; i < 3; i++) {
+        EXPECT_NE(cache.getGraphicBuffer(describeBuffer(graphicBuffer0, 0)), nullptr);
+        EXPECT_NE(cache.getGraphicBuffer(describeBuffer(graphicBuffer1, 1)), nullptr);
+    }
+    EXPECT_EQ(cache.size(), 2);
+    EXPECT_EQ(cache.getImportCount(), 2);
+}
+
+TEST(InputBufferCacheTests, importsOtherBufferWithSameId) {
+    InputBufferCache cache;
+    sp<GraphicBuffer> graphicBuffer = allocateBuffer(kWidth, kHeight);
+    sp<GraphicBuffer> resizedBuffer = allocateBuffer(kWidth * 2, kHeight * 2);
+
+    sp<GraphicBuffer> imported = cache.getGraphicBuffer(describeBuffer(graphicBuffer, 0));
+    ASSERT_NE(imported, nullptr);
+
+    sp<GraphicBuffer> reimported = cache.getGraphicBuffer(describeBuffer(resizedBuffer, 0));
+    ASSERT_NE(reimported, nullptr);
+    EXPECT_NE(reimported, imported);
+    EXPECT_EQ(reimported->getWidth(), kWidth * 2);
+    EXPECT_EQ(cache.getImportCount(), 2);
+}
+
+// Buffer ids are only unique per device.
+TEST(InputBufferCacheTests, importsSameIdOfEachDevice) {
+    InputBufferCache cache;
+    sp<GraphicBuffer> graphicBuffer0 = allocateBuffer(kWidth, kHeight);
+    sp<GraphicBuffer> graphicBuffer1 = allocateBuffer(kWidth, kHeight);
+    BufferDesc_1_1 otherBuffer = describeBuffer(graphicBuffer1, 0);
+    otherBuffer.deviceId = "/dev/video1";
+
+    sp<GraphicBuffer> imported = cache.getGraphicBuffer(describeBuffer(graphicBuffer0, 0));
+    sp<GraphicBuffer> otherImported = cache.getGraphicBuffer(otherBuffer);
+    ASSERT_NE(imported, nullptr);
+    ASSERT_NE(otherImported, nullptr);
+    EXPECT_NE(imported, otherImported);
+    EXPECT_EQ(cache.getGraphicBuffer(otherBuffer), otherImported);
+    EXPECT_EQ(cache.size(), 2);
+    EXPECT_EQ(cache.getImportCount(), 2);
+}
+
+TEST(InputBufferCacheTests, dropsLeastRecentlyUsedBuffer) {
+    InputBufferCache cache(2);
+    sp<GraphicBuffer> graphicBuffers[] = {allocateBuffer(kWidth, kHeight),
+                                          allocateBuffer(kWidth, kHeight),
+                                          allocateBuffer(kWidth, kHeight)};
+
+    EXPECT_NE(cache.getGraphicBuffer(describeBuffer(graphicBuffers[0], 0)), nullptr);
+    EXPECT_NE(cache.getGraphicBuffer(describeBuffer(graphicBuffers[1], 1)), nullptr);
+    EXPECT_NE(cache.getGraphicBuffer(describeBuffer(graphicBuffers[0], 0)), nullptr);
+    EXPECT_NE(cache.getGraphicBuffer(describeBuffer(graphicBuffers[2], 2)), nullptr);
+    EXPECT_EQ(cache.size(), 2);
+    EXPECT_EQ(cache.getImportCount(), 3);
+
+    // The second buffer was dropped, the first one is still there.
+    EXPECT_NE(cache.getGraphicBuffer(describeBuffer(graphicBuffers[0], 0)), nullptr);
+    EXPECT_EQ(cache.getImportCount(), 3);
+    EXPECT_NE(cache.getGraphicBuffer(describeBuffer(graphicBuffers[1], 1)), nullptr);
+    EXPECT_EQ(cache.getImportCount(), 4);
+
+    cache.setMaxBuffersPerDevice(1);
+    EXPECT_EQ(cache.size(), 1);
+}
+
+TEST(InputBufferCacheTests, clearDropsImportedBuffers) {
+    InputBufferCache cache;
+    sp<GraphicBuffer> graphicBuffer = allocateBuffer(kWidth, kHeight);
+    const BufferDesc_1_1 buffer = describeBuffer(graphicBuffer, 0);
+
+    EXPECT_NE(cache.getGraphicBuffer(buffer), nullptr);
+    cache.clear();
+    EXPECT_EQ(cache.size(), 0);
+
+    EXPECT_NE(cache.getGraphicBuffer(buffer), nullptr);
+    EXPECT_EQ(cache.getImportCount(), 2);
+}
+
+}  // namespace
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sv
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
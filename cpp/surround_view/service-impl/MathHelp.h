@@ -97,6 +97,19 @@ inline Mat4x4 appendMat(const Mat4x4& matL, const Mat4x4& matR) {
     return toMat4x4(toMatrix4x4F(matL) * toMatrix4x4F(matR));
 }
 
+// Same as appendMat(), computed directly on the row-major matrices so that
+// it can run over arrays of matrices without conversions. |result| must not
+// be one of the operands.
+inline void appendMat(const Mat4x4& matL, const Mat4x4& matR, Mat4x4* result) {
+    for (int i = 0; i < 4; i++) {
+        const float* rowR = &matR[i * 4];
+        for (int j = 0; j < 4; j++) {
+            (*result)[i * 4 + j] = rowR[0] * matL[j] + rowR[1] * matL[4 + j] +
+                    rowR[2] * matL[8 + j] + rowR[3] * matL[12 + j];
+        }
+    }
+}
+
 // Rotate about a point about a unit vector.
 inline Mat4x4 rotationAboutPoint(float angleInDegrees, const VectorT& point, const VectorT& axis) {
     VectorT pointInv = point;
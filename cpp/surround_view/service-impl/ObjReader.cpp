@@ -16,15 +16,29 @@
 
 #include "ObjReader.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
 #include <array>
-#include <cstdio>
-#include <filesystem>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <thread>
 #include <vector>
 
+#include "CarModelCache.h"
 #include "MtlReader.h"
 #include "core_lib.h"
 
 #include <android-base/logging.h>
+#include <android-base/mapped_file.h>
+#include <android-base/unique_fd.h>
 
 namespace android {
 namespace hardware {
@@ -33,6 +47,8 @@ namespace sv {
 namespace V1_0 {
 namespace implementation {
 
+using android::base::MappedFile;
+using android::base::unique_fd;
 using android_auto::surround_view::CarMaterial;
 using android_auto::surround_view::CarVertex;
 
@@ -40,7 +56,10 @@ namespace {
 
 constexpr int kNumberOfVerticesPerFace = 3;
 constexpr int kNumberOfAxes = 3;
-constexpr int kCharBufferSize = 128;
+constexpr int kMaxNumberLength = 64;
+
+// Smallest part of an obj file that is worth parsing on its own thread.
+constexpr size_t kMinChunkSize = 64 * 1024;
 
 const std::array<float, 16> kMat4Identity = {
         /*row 0*/ 1, 0, 0, 0,
@@ -48,6 +67,63 @@ const std::array<float, 16> kMat4Identity = {
         /*row 2*/ 0, 0, 1, 0,
         /*row 3*/ 0, 0, 0, 1};
 
+using Float3 = std::array<float, kNumberOfAxes>;
+
+// Indices of a face vertex as written in the obj file, starting at 1.
+// textureId is -1 if the face has no texture coordinates.
+struct FaceVertex {
+    int vertexId;
+    int textureId;
+    int normalId;
+};
+
+// Obj file statements that depend on the statements before them, so they
+// are applied in file order once all the chunks are parsed.
+struct ObjStatement {
+    enum Type {
+        GROUP,
+        USE_MTL,
+        MTL_LIB,
+        FACE,
+        // Any other line, only recorded if it comes before the first group.
+        OTHER,
+    };
+
+    Type type;
+
+    // Name of the group, material or mtl file.
+    std::string name;
+
+    // Range of the face vertices in ObjChunk::faceVertices.
+    size_t firstFaceVertex = 0;
+    size_t faceVerticesCount = 0;
+};
+
+// Whole lines of the obj file and what they were parsed into.
+struct ObjChunk {
+    const char* begin = nullptr;
+    const char* end = nullptr;
+
+    std::vector<Float3> vertices;
+    std::vector<Float3> textures;
+    std::vector<Float3> normals;
+    std::vector<FaceVertex> faceVertices;
+    std::vector<ObjStatement> statements;
+};
+
+// A face and the chunk it was parsed from.
+struct FaceRef {
+    const ObjChunk* chunk;
+    const ObjStatement* statement;
+};
+
+// Faces to be added to a car part.
+struct GroupFaces {
+    CarPart* carPart = nullptr;
+    std::vector<FaceRef> faces;
+    size_t verticesCount = 0;
+};
+
 // Copies face vertices parsed from obj to car vertices.
 void CopyFaceToCarVertex(const std::vector<std::array<float, kNumberOfAxes>>& currentVertices,
                          const std::vector<std::array<float, kNumberOfAxes>>& currentTextures,
@@ -67,233 +143,442 @@ void CopyFaceToCarVertex(const std::vector<std::array<float, kNumberOfAxes>>& cu
                 currentNormals[normalId - 1].size() * sizeof(float));
 }
 
-}  // namespace
+bool IsBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
 
-bool ReadObjFromFile(const std::string& objFilename, std::map<std::string, CarPart>* carPartsMap) {
-    return ReadObjFromFile(objFilename, ReadObjOptions(), carPartsMap);
+// Returns the next blank separated token of a line and moves |*pos| past it.
+// Returns an empty token at the end of the line.
+std::string_view NextToken(const char** pos, const char* lineEnd) {
+    const char* p = *pos;
+    while (p < lineEnd && IsBlank(*p)) {
+        ++p;
+    }
+    const char* tokenBegin = p;
+    while (p < lineEnd && !IsBlank(*p)) {
+        ++p;
+    }
+    *pos = p;
+    return std::string_view(tokenBegin, p - tokenBegin);
 }
 
-bool ReadObjFromFile(const std::string& objFilename, const ReadObjOptions& option,
-                     std::map<std::string, CarPart>* carPartsMap) {
-    FILE* file = fopen(objFilename.c_str(), "r");
-    if (!file) {
-        LOG(ERROR) << "Failed to open obj file: " << objFilename;
+bool ParseInt(std::string_view token, int* value) {
+    const char* end = token.data() + token.size();
+    const auto result = std::from_chars(token.data(), end, *value);
+    return result.ec == std::errc() && result.ptr == end;
+}
+
+// The libc++ std::from_chars has no floating point overloads, so floats are
+// parsed with strtof from a null terminated copy of the token.
+bool ParseFloat(std::string_view token, float* value) {
+    char buffer[kMaxNumberLength];
+    if (token.empty() || token.size() >= sizeof(buffer)) {
         return false;
     }
+    std::memcpy(buffer, token.data(), token.size());
+    buffer[token.size()] = '\0';
+
+    char* end = nullptr;
+    *value = strtof(buffer, &end);
+    return end == buffer + token.size();
+}
 
+// Parses up to three floats of a line into |values|, in the order given by
+// |mapping|. Returns the number of floats parsed.
+int ParseFloat3(const char* pos, const char* lineEnd, const int* mapping, Float3* values) {
+    *values = {0, 0, 0};
     for (int i = 0; i < kNumberOfAxes; ++i) {
-        if (option.coordinateMapping[i] >= kNumberOfAxes || option.coordinateMapping[i] < 0) {
-            fclose(file);
-            LOG(ERROR) << "coordinateMapping index must be less than 3 and greater or equal "
-                          "to 0.";
-            return false;
+        if (!ParseFloat(NextToken(&pos, lineEnd), &(*values)[mapping[i]])) {
+            return i;
         }
     }
+    return kNumberOfAxes;
+}
 
-    std::vector<std::array<float, kNumberOfAxes>> currentVertices;
-    std::vector<std::array<float, kNumberOfAxes>> currentNormals;
-    std::vector<std::array<float, kNumberOfAxes>> currentTextures;
-    std::map<std::string, MtlConfigParams> mtlConfigParamsMap;
-    std::string currentGroupName;
-    MtlConfigParams currentMtlConfig;
+// Face vertices supported formats:
+// With texture:     pos/texture/normal
+// Without texture:  pos//normal
+bool ParseFaceVertex(std::string_view token, FaceVertex* faceVertex) {
+    const size_t firstSlash = token.find('/');
+    if (firstSlash == std::string_view::npos) {
+        return false;
+    }
+    const size_t secondSlash = token.find('/', firstSlash + 1);
+    if (secondSlash == std::string_view::npos) {
+        return false;
+    }
 
-    while (true) {
-        char lineHeader[kCharBufferSize];
-        // read the first word of the line
-        int res = fscanf(file, "%s", lineHeader);
+    faceVertex->textureId = -1;
+    if (secondSlash > firstSlash + 1 &&
+        !ParseInt(token.substr(firstSlash + 1, secondSlash - firstSlash - 1),
+                  &faceVertex->textureId)) {
+        return false;
+    }
+    return ParseInt(token.substr(0, firstSlash), &faceVertex->vertexId) &&
+            ParseInt(token.substr(secondSlash + 1), &faceVertex->normalId);
+}
 
-        if (res == EOF) {
-            break;  // EOF = End Of File. Quit the loop.
+void ParseChunk(const ReadObjOptions& option, ObjChunk* chunk) {
+    static const int kIdentityMapping[kNumberOfAxes] = {0, 1, 2};
+
+    bool groupFound = false;
+    bool contentFound = false;
+    const char* lineBegin = chunk->begin;
+    while (lineBegin < chunk->end) {
+        const char* lineEnd =
+                static_cast<const char*>(memchr(lineBegin, '\n', chunk->end - lineBegin));
+        if (lineEnd == nullptr) {
+            lineEnd = chunk->end;
         }
-        if (strcmp(lineHeader, "#") == 0) {
-            fgets(lineHeader, sizeof(lineHeader), file);
+        const char* pos = lineBegin;
+        lineBegin = lineEnd + 1;
+
+        const std::string_view lineHeader = NextToken(&pos, lineEnd);
+        if (lineHeader.empty() || lineHeader[0] == '#') {
             continue;
         }
 
         // TODO(b/156558814): add object type support.
         // TODO(b/156559272): add document for supported format.
         // Only single group per line is supported.
-        if (strcmp(lineHeader, "g") == 0) {
-            res = fscanf(file, "%s", lineHeader);
-            currentGroupName = lineHeader;
-            currentMtlConfig = MtlConfigParams();
-
-            if (carPartsMap->find(currentGroupName) != carPartsMap->end()) {
-                LOG(WARNING) << "Duplicate group name: " << currentGroupName
-                             << ". using car part name as: " << currentGroupName << "_dup";
-                currentGroupName.append("_dup");
-            }
-            carPartsMap->emplace(
-                    std::make_pair(currentGroupName,
-                                   CarPart((std::vector<CarVertex>()), CarMaterial(), kMat4Identity,
-                                           std::string(), std::vector<std::string>())));
+        if (lineHeader == "g") {
+            groupFound = true;
+            chunk->statements.push_back(
+                    {ObjStatement::GROUP, std::string(NextToken(&pos, lineEnd))});
             continue;
         }
 
-        // no "g" case, assign it as default.
-        if (currentGroupName.empty()) {
-            currentGroupName = "default";
-            currentMtlConfig = MtlConfigParams();
-            carPartsMap->emplace(
-                    std::make_pair(currentGroupName,
-                                   CarPart((std::vector<CarVertex>()), CarMaterial(), kMat4Identity,
-                                           std::string(), std::vector<std::string>())));
+        // Lines before the first group of the file create the default group.
+        if (!groupFound && !contentFound) {
+            contentFound = true;
+            chunk->statements.push_back({ObjStatement::OTHER, std::string()});
         }
 
-        if (strcmp(lineHeader, "usemtl") == 0) {
-            res = fscanf(file, "%s", lineHeader);
+        if (lineHeader == "v") {
+            Float3 pos3;
+            if (ParseFloat3(pos, lineEnd, option.coordinateMapping, &pos3) != kNumberOfAxes) {
+                LOG(WARNING) << "Vertex position format not supported.";
+            }
+            for (int i = 0; i < kNumberOfAxes; ++i) {
+                pos3[i] *= option.scales[i];
+                pos3[i] += option.offsets[i];
+            }
+            chunk->vertices.push_back(pos3);
+        } else if (lineHeader == "vt") {
+            Float3 texture;
+            if (ParseFloat3(pos, lineEnd, kIdentityMapping, &texture) < 2) {
+                LOG(WARNING) << "Texture coordinate format not supported.";
+            }
+            chunk->textures.push_back(texture);
+        } else if (lineHeader == "vn") {
+            Float3 normal;
+            if (ParseFloat3(pos, lineEnd, option.coordinateMapping, &normal) != kNumberOfAxes) {
+                LOG(WARNING) << "Vertex normal format not supported.";
+            }
+            chunk->normals.push_back(normal);
+        } else if (lineHeader == "f") {
+            const size_t firstFaceVertex = chunk->faceVertices.size();
+            FaceVertex faceVertex;
+            for (std::string_view token = NextToken(&pos, lineEnd); !token.empty();
+                 token = NextToken(&pos, lineEnd)) {
+                if (!ParseFaceVertex(token, &faceVertex)) {
+                    LOG(WARNING) << "Face format not supported: " << token;
+                    break;
+                }
+                chunk->faceVertices.push_back(faceVertex);
+            }
 
-            // If material name not found.
-            if (mtlConfigParamsMap.find(lineHeader) == mtlConfigParamsMap.end()) {
-                carPartsMap->at(currentGroupName).material = CarMaterial();
-                LOG(ERROR) << "Material not found: $0" << lineHeader;
-                return false;
+            const size_t faceVerticesCount = chunk->faceVertices.size() - firstFaceVertex;
+            if (faceVerticesCount < kNumberOfVerticesPerFace) {
+                LOG(WARNING) << "Face with " << faceVerticesCount << " vertices. Skipped.";
+                chunk->faceVertices.resize(firstFaceVertex);
+                continue;
             }
+            chunk->statements.push_back(
+                    {ObjStatement::FACE, std::string(), firstFaceVertex, faceVerticesCount});
+        } else if (lineHeader == "usemtl") {
+            chunk->statements.push_back(
+                    {ObjStatement::USE_MTL, std::string(NextToken(&pos, lineEnd))});
+        } else if (lineHeader == "mtllib") {
+            chunk->statements.push_back(
+                    {ObjStatement::MTL_LIB, std::string(NextToken(&pos, lineEnd))});
+        }
+    }
+}
 
-            currentMtlConfig = mtlConfigParamsMap[lineHeader];
+// Splits the obj file into chunks of whole lines, one per parsing thread.
+std::vector<ObjChunk> SplitIntoChunks(const char* data, size_t size) {
+    const size_t maxChunksCount = std::max(1u, std::thread::hardware_concurrency());
+    const size_t chunksCount = std::clamp<size_t>(size / kMinChunkSize, 1, maxChunksCount);
+
+    std::vector<ObjChunk> chunks;
+    chunks.reserve(chunksCount);
+    const char* end = data + size;
+    const char* begin = data;
+    for (size_t i = 0; i < chunksCount && begin < end; ++i) {
+        const char* chunkEnd = end;
+        if (i + 1 < chunksCount) {
+            chunkEnd = std::max(begin, data + size * (i + 1) / chunksCount);
+            const char* lineEnd =
+                    static_cast<const char*>(memchr(chunkEnd, '\n', end - chunkEnd));
+            chunkEnd = lineEnd != nullptr ? lineEnd + 1 : end;
+        }
+        chunks.emplace_back();
+        chunks.back().begin = begin;
+        chunks.back().end = chunkEnd;
+        begin = chunkEnd;
+    }
+    return chunks;
+}
 
-            carPartsMap->at(currentGroupName).material.ka = {currentMtlConfig.ka[0],
-                                                             currentMtlConfig.ka[1],
-                                                             currentMtlConfig.ka[2]};
+// Concatenates the vertex attributes of all the chunks, so faces can refer to
+// them by their index in the file.
+std::vector<Float3> MergeAttributes(const std::vector<ObjChunk>& chunks,
+                                    std::vector<Float3> ObjChunk::*attributes) {
+    size_t count = 0;
+    for (const ObjChunk& chunk : chunks) {
+        count += (chunk.*attributes).size();
+    }
+    std::vector<Float3> merged;
+    merged.reserve(count);
+    for (const ObjChunk& chunk : chunks) {
+        merged.insert(merged.end(), (chunk.*attributes).begin(), (chunk.*attributes).end());
+    }
+    return merged;
+}
 
-            carPartsMap->at(currentGroupName).material.kd = {currentMtlConfig.kd[0],
-                                                             currentMtlConfig.kd[1],
-                                                             currentMtlConfig.kd[2]};
+GroupFaces* AddCarPart(const std::string& groupName, std::map<std::string, CarPart>* carPartsMap,
+                       std::map<std::string, GroupFaces>* groupFacesMap) {
+    auto carPart = carPartsMap->emplace(
+            std::make_pair(groupName,
+                           CarPart((std::vector<CarVertex>()), CarMaterial(), kMat4Identity,
+                                   std::string(), std::vector<std::string>())));
+    GroupFaces* groupFaces = &(*groupFacesMap)[groupName];
+    groupFaces->carPart = &carPart.first->second;
+    return groupFaces;
+}
 
-            carPartsMap->at(currentGroupName).material.ks = {currentMtlConfig.ks[0],
-                                                             currentMtlConfig.ks[1],
-                                                             currentMtlConfig.ks[2]};
+bool IsValidFaceVertex(const FaceVertex& faceVertex, const std::vector<Float3>& vertices,
+                       const std::vector<Float3>& textures, const std::vector<Float3>& normals) {
+    return faceVertex.vertexId >= 1 && faceVertex.vertexId <= static_cast<int>(vertices.size()) &&
+            faceVertex.normalId >= 1 && faceVertex.normalId <= static_cast<int>(normals.size()) &&
+            (faceVertex.textureId == -1 ||
+             (faceVertex.textureId >= 1 &&
+              faceVertex.textureId <= static_cast<int>(textures.size())));
+}
 
-            carPartsMap->at(currentGroupName).material.d = currentMtlConfig.d;
+// Appends the triangles of the faces of a group to its car part.
+void AssembleFaces(const std::vector<Float3>& vertices, const std::vector<Float3>& textures,
+                   const std::vector<Float3>& normals, GroupFaces* groupFaces) {
+    std::vector<CarVertex>& partVertices = groupFaces->carPart->vertices;
+    partVertices.reserve(partVertices.size() + groupFaces->verticesCount);
+
+    for (const FaceRef& face : groupFaces->faces) {
+        const FaceVertex* faceVertices =
+                face.chunk->faceVertices.data() + face.statement->firstFaceVertex;
+        std::array<CarVertex, kNumberOfVerticesPerFace> carVertices;
+        for (size_t i = 0; i < face.statement->faceVerticesCount; ++i) {
+            const FaceVertex& faceVertex = faceVertices[i];
+            if (!IsValidFaceVertex(faceVertex, vertices, textures, normals)) {
+                LOG(WARNING) << "Face index error. Skipped.";
+                break;
+            }
 
-            carPartsMap->at(currentGroupName).material.textures.clear();
+            // Add a triangle that the first two vertices make with every
+            // subsequent face vertex 3 and onwards. Note this assumes the face
+            // is a convex polygon.
+            const size_t index = std::min<size_t>(i, kNumberOfVerticesPerFace - 1);
+            CopyFaceToCarVertex(vertices, textures, normals, faceVertex.vertexId,
+                                faceVertex.textureId, faceVertex.normalId, &carVertices[index]);
+            if (index == kNumberOfVerticesPerFace - 1) {
+                partVertices.insert(partVertices.end(), carVertices.begin(), carVertices.end());
+                carVertices[1] = carVertices[2];
+            }
+        }
+    }
+}
 
-            continue;
+// Assembles the faces of the groups, with a group per thread at a time.
+void AssembleGroups(const std::vector<Float3>& vertices, const std::vector<Float3>& textures,
+                    const std::vector<Float3>& normals,
+                    std::map<std::string, GroupFaces>* groupFacesMap) {
+    std::vector<GroupFaces*> groups;
+    for (auto& groupFaces : *groupFacesMap) {
+        if (!groupFaces.second.faces.empty()) {
+            groups.push_back(&groupFaces.second);
         }
+    }
 
-        if (strcmp(lineHeader, "mtllib") == 0) {
-            res = fscanf(file, "%s", lineHeader);
-            mtlConfigParamsMap.clear();
-            std::string mtlFilename;
-            if (option.mtlFilename.empty()) {
-                mtlFilename = objFilename.substr(0, objFilename.find_last_of("/"));
-                mtlFilename.append("/");
-                mtlFilename.append(lineHeader);
-            } else {
-                mtlFilename = option.mtlFilename;
-            }
-            if (!ReadMtlFromFile(mtlFilename, &mtlConfigParamsMap)) {
-                LOG(ERROR) << "Parse MTL file " << mtlFilename << " failed.";
-                return false;
-            }
-            continue;
+    std::atomic<size_t> nextGroup(0);
+    auto assemble = [&]() {
+        for (size_t i = nextGroup++; i < groups.size(); i = nextGroup++) {
+            AssembleFaces(vertices, textures, normals, groups[i]);
         }
+    };
 
-        if (strcmp(lineHeader, "v") == 0) {
-            std::array<float, kNumberOfAxes> pos;
-            fscanf(file, "%f %f %f\n", &pos[option.coordinateMapping[0]],
-                   &pos[option.coordinateMapping[1]], &pos[option.coordinateMapping[2]]);
-            for (int i = 0; i < kNumberOfAxes; ++i) {
-                pos[i] *= option.scales[i];
-                pos[i] += option.offsets[i];
-            }
-            currentVertices.push_back(pos);
-        } else if (strcmp(lineHeader, "vt") == 0) {
-            std::array<float, kNumberOfAxes> texture;
-            fscanf(file, "%f %f %f\n", &texture[0], &texture[1], &texture[2]);
-            currentTextures.push_back(texture);
-        } else if (strcmp(lineHeader, "vn") == 0) {
-            std::array<float, kNumberOfAxes> normal;
-            fscanf(file, "%f %f %f\n", &normal[option.coordinateMapping[0]],
-                   &normal[option.coordinateMapping[1]], &normal[option.coordinateMapping[2]]);
-            currentNormals.push_back(normal);
-        } else if (strcmp(lineHeader, "f") == 0) {
-            int vertexId[kNumberOfVerticesPerFace];
-            int textureId[kNumberOfVerticesPerFace] = {-1, -1, -1};
-            int normalId[kNumberOfVerticesPerFace];
-
-            // Face vertices supported formats:
-            // With texture:     pos/texture/normal
-            // Without texture:  pos//normal
-
-            // Scan first vertex position.
-            int matches = fscanf(file, "%d/", &vertexId[0]);
-
-            if (matches != 1) {
-                LOG(WARNING) << "Face index error. Skipped.";
-                fgets(lineHeader, sizeof(lineHeader), file);
-                continue;
-            }
+    const size_t threadsCount =
+            std::min<size_t>(groups.size(), std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < threadsCount; ++i) {
+        threads.emplace_back(assemble);
+    }
+    assemble();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
 
-            // Try scanning first two face 2 vertices with texture format present.
-            bool isTexturePresent = true;
-            matches = fscanf(file, "%d/%d %d/%d/%d", &textureId[0], &normalId[0], &vertexId[1],
-                             &textureId[1], &normalId[1]);
-
-            // If 5 matches not found, try scanning first 2 face vertices without
-            // texture format.
-            if (matches != 5) {
-                matches = fscanf(file, "/%d %d//%d", &normalId[0], &vertexId[1], &normalId[1]);
-
-                // If 3 matches not found return with error.
-                if (matches != 3) {
-                    LOG(WARNING) << "Face format not supported. Skipped.";
-                    fgets(lineHeader, sizeof(lineHeader), file);
-                    continue;
-                }
+}  // namespace
 
-                isTexturePresent = false;
-            }
+bool ReadObjFromFile(const std::string& objFilename, std::map<std::string, CarPart>* carPartsMap) {
+    return ReadObjFromFile(objFilename, ReadObjOptions(), carPartsMap);
+}
 
-            // Copy first two face vertices to car vertices.
-            std::array<CarVertex, kNumberOfVerticesPerFace> carVertices;
-            CopyFaceToCarVertex(currentVertices, currentTextures, currentNormals, vertexId[0],
-                                textureId[0], normalId[0], &carVertices[0]);
-            CopyFaceToCarVertex(currentVertices, currentTextures, currentNormals, vertexId[1],
-                                textureId[1], normalId[1], &carVertices[1]);
-
-            // Add a triangle that the first two vertices make with every subsequent
-            // face vertex 3 and onwards. Note this assumes the face is a convex
-            // polygon.
-            do {
-                if (isTexturePresent) {
-                    matches = fscanf(file, " %d/%d/%d", &vertexId[2], &textureId[2], &normalId[2]);
-                    // Warn if un-expected number of matches.
-                    if (matches != 3 && matches != 0) {
-                        LOG(WARNING) << "Face matches, expected 3, read: " << matches;
-                        break;
-                    }
-                } else {
-                    // Warn if un-expected number of matches.
-                    matches = fscanf(file, " %d//%d", &vertexId[2], &normalId[2]);
-                    if (matches != 2 && matches != 0) {
-                        LOG(WARNING) << "Face matches, expected 2, read: " << matches;
-                        break;
-                    }
-                }
+bool ReadObjFromFile(const std::string& objFilename, const ReadObjOptions& option,
+                     std::map<std::string, CarPart>* carPartsMap) {
+    for (int i = 0; i < kNumberOfAxes; ++i) {
+        if (option.coordinateMapping[i] >= kNumberOfAxes || option.coordinateMapping[i] < 0) {
+            LOG(ERROR) << "coordinateMapping index must be less than 3 and greater or equal "
+                          "to 0.";
+            return false;
+        }
+    }
 
-                if (matches == 0) {
-                    break;
+    unique_fd fd(TEMP_FAILURE_RETRY(open(objFilename.c_str(), O_RDONLY | O_CLOEXEC)));
+    struct stat fileStat;
+    if (fd == -1 || fstat(fd, &fileStat) != 0) {
+        LOG(ERROR) << "Failed to open obj file: " << objFilename;
+        return false;
+    }
+
+    std::unique_ptr<MappedFile> mappedFile;
+    if (fileStat.st_size > 0) {
+        mappedFile = MappedFile::FromFd(fd, 0, fileStat.st_size, PROT_READ);
+        if (mappedFile == nullptr) {
+            PLOG(ERROR) << "Failed to map obj file: " << objFilename;
+            return false;
+        }
+    }
+    const char* data = mappedFile != nullptr ? mappedFile->data() : nullptr;
+    const size_t size = mappedFile != nullptr ? mappedFile->size() : 0;
+
+    // The cache holds the car parts of this obj file only, so it is not used
+    // when the obj file is read on top of other car parts.
+    const bool useCache = !option.cacheFilename.empty() && carPartsMap->empty();
+    std::vector<CarModelSource> sources;
+    if (useCache) {
+        sources.push_back({objFilename, ComputeChecksum(data, size)});
+        if (ReadCarModelCache(option.cacheFilename, sources[0], option, carPartsMap)) {
+            return true;
+        }
+    }
+
+    const auto startTime = std::chrono::steady_clock::now();
+
+    std::vector<ObjChunk> chunks = SplitIntoChunks(data, size);
+    {
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < chunks.size(); ++i) {
+            threads.emplace_back(ParseChunk, std::cref(option), &chunks[i]);
+        }
+        if (!chunks.empty()) {
+            ParseChunk(option, &chunks[0]);
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    const std::vector<Float3> vertices = MergeAttributes(chunks, &ObjChunk::vertices);
+    const std::vector<Float3> textures = MergeAttributes(chunks, &ObjChunk::textures);
+    const std::vector<Float3> normals = MergeAttributes(chunks, &ObjChunk::normals);
+
+    std::map<std::string, MtlConfigParams> mtlConfigParamsMap;
+    std::map<std::string, GroupFaces> groupFacesMap;
+    std::string currentGroupName;
+    GroupFaces* currentGroupFaces = nullptr;
+
+    for (const ObjChunk& chunk : chunks) {
+        for (const ObjStatement& statement : chunk.statements) {
+            if (statement.type == ObjStatement::GROUP) {
+                currentGroupName = statement.name;
+                if (carPartsMap->find(currentGroupName) != carPartsMap->end()) {
+                    LOG(WARNING) << "Duplicate group name: " << currentGroupName
+                                 << ". using car part name as: " << currentGroupName << "_dup";
+                    currentGroupName.append("_dup");
                 }
+                currentGroupFaces = AddCarPart(currentGroupName, carPartsMap, &groupFacesMap);
+                continue;
+            }
 
-                CopyFaceToCarVertex(currentVertices, currentTextures, currentNormals, vertexId[2],
-                                    textureId[2], normalId[2], &carVertices[2]);
+            // no "g" case, assign it as default.
+            if (currentGroupName.empty()) {
+                currentGroupName = "default";
+                currentGroupFaces = AddCarPart(currentGroupName, carPartsMap, &groupFacesMap);
+            }
 
-                carPartsMap->at(currentGroupName).vertices.push_back(carVertices[0]);
-                carPartsMap->at(currentGroupName).vertices.push_back(carVertices[1]);
-                carPartsMap->at(currentGroupName).vertices.push_back(carVertices[2]);
+            if (statement.type == ObjStatement::USE_MTL) {
+                CarMaterial& material = currentGroupFaces->carPart->material;
 
-                carVertices[1] = carVertices[2];
-            } while (true);
+                // If material name not found.
+                const auto mtlConfig = mtlConfigParamsMap.find(statement.name);
+                if (mtlConfig == mtlConfigParamsMap.end()) {
+                    material = CarMaterial();
+                    LOG(ERROR) << "Material not found: " << statement.name;
+                    return false;
+                }
 
-        } else {
-            // LOG(WARNING) << "Unknown tag " << lineHeader << ". Skipped";
-            fgets(lineHeader, sizeof(lineHeader), file);
-            continue;
+                const MtlConfigParams& currentMtlConfig = mtlConfig->second;
+                material.ka = {currentMtlConfig.ka[0], currentMtlConfig.ka[1],
+                               currentMtlConfig.ka[2]};
+                material.kd = {currentMtlConfig.kd[0], currentMtlConfig.kd[1],
+                               currentMtlConfig.kd[2]};
+                material.ks = {currentMtlConfig.ks[0], currentMtlConfig.ks[1],
+                               currentMtlConfig.ks[2]};
+                material.d = currentMtlConfig.d;
+                material.textures.clear();
+            } else if (statement.type == ObjStatement::MTL_LIB) {
+                mtlConfigParamsMap.clear();
+                std::string mtlFilename;
+                if (option.mtlFilename.empty()) {
+                    mtlFilename = objFilename.substr(0, objFilename.find_last_of("/"));
+                    mtlFilename.append("/");
+                    mtlFilename.append(statement.name);
+                } else {
+                    mtlFilename = option.mtlFilename;
+                }
+                if (!ReadMtlFromFile(mtlFilename, &mtlConfigParamsMap)) {
+                    LOG(ERROR) << "Parse MTL file " << mtlFilename << " failed.";
+                    return false;
+                }
+                if (useCache) {
+                    CarModelSource source = {mtlFilename};
+                    if (!ComputeFileChecksum(mtlFilename, &source.checksum)) {
+                        LOG(ERROR) << "Failed to read MTL file " << mtlFilename;
+                        return false;
+                    }
+                    sources.push_back(source);
+                }
+            } else if (statement.type == ObjStatement::FACE) {
+                currentGroupFaces->faces.push_back({&chunk, &statement});
+                currentGroupFaces->verticesCount +=
+                        (statement.faceVerticesCount - 2) * kNumberOfVerticesPerFace;
+            }
         }
     }
 
-    fclose(file);
+    AssembleGroups(vertices, textures, normals, &groupFacesMap);
+
+    LOG(INFO) << "Read obj file " << objFilename << " with " << chunks.size()
+              << " threads in "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(
+                         std::chrono::steady_clock::now() - startTime)
+                         .count()
+              << " ms.";
+
+    if (useCache) {
+        WriteCarModelCache(option.cacheFilename, sources, option, *carPartsMap);
+    }
     return true;
 }
 
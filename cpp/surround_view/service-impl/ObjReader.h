@@ -50,6 +50,11 @@ struct ReadObjOptions {
 
     // Optional mtl filename. String name is obj file is used if this is empty.
     std::string mtlFilename;
+
+    // Optional binary cache of the car parts. If set, the car parts are read
+    // from this file when it matches the obj and mtl files, and the file is
+    // rewritten whenever the obj file has to be parsed.
+    std::string cacheFilename;
 };
 
 // Reads obj file to vector of OverlayVertex.
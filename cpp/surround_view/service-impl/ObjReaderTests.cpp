@@ -21,7 +21,9 @@
 #include "MtlReader.h"
 #include "core_lib.h"
 
+#include <android-base/file.h>
 #include <gtest/gtest.h>
+#include <cstdio>
 #include <map>
 #include <string>
 
@@ -39,6 +41,86 @@ TEST(ObjParserTests, ReadObjFileSuccess) {
     EXPECT_NE(carPartsMap.size(), 0);
 }
 
+TEST(ObjParserTests, ReadObjFileTriangulatesFaces) {
+    const std::string objFilename = ::testing::TempDir() + "faces.obj";
+    ASSERT_TRUE(android::base::WriteStringToFile("v 0 0 0\n"
+                                                 "v 1 0 0\n"
+                                                 "v 1 1 0\n"
+                                                 "v 0 1 0\n"
+                                                 "vt 0 0\n"
+                                                 "vn 0 0 1\n"
+                                                 "g quad\n"
+                                                 "f 1/1/1 2/1/1 3/1/1 4/1/1\n"
+                                                 "g triangle\n"
+                                                 "f 1//1 2//1 3//1\n",
+                                                 objFilename));
+
+    std::map<std::string, CarPart> carPartsMap;
+    ASSERT_TRUE(ReadObjFromFile(objFilename, &carPartsMap));
+    ASSERT_NE(carPartsMap.find("quad"), carPartsMap.end());
+    ASSERT_NE(carPartsMap.find("triangle"), carPartsMap.end());
+    EXPECT_EQ(carPartsMap.at("quad").vertices.size(), 6);
+    EXPECT_EQ(carPartsMap.at("triangle").vertices.size(), 3);
+
+    // The second triangle of the quad is made of vertices 1, 3 and 4.
+    const auto& quadVertices = carPartsMap.at("quad").vertices;
+    EXPECT_EQ(quadVertices[3].pos, quadVertices[0].pos);
+    EXPECT_EQ(quadVertices[4].pos, quadVertices[2].pos);
+    EXPECT_EQ(quadVertices[5].pos, (std::array<float, 3>{0, 1, 0}));
+}
+
+TEST(ObjParserTests, ReadObjFileWithCache) {
+    ReadObjOptions option;
+    option.cacheFilename = ::testing::TempDir() + "sample_car.cache";
+    std::remove(option.cacheFilename.c_str());
+
+    std::map<std::string, CarPart> parsedPartsMap;
+    ASSERT_TRUE(ReadObjFromFile("vendor/etc/automotive/sv/sample_car.obj", option,
+                                &parsedPartsMap));
+
+    std::string cache;
+    ASSERT_TRUE(android::base::ReadFileToString(option.cacheFilename, &cache));
+    EXPECT_NE(cache.size(), 0);
+
+    std::map<std::string, CarPart> cachedPartsMap;
+    ASSERT_TRUE(ReadObjFromFile("vendor/etc/automotive/sv/sample_car.obj", option,
+                                &cachedPartsMap));
+    ASSERT_EQ(cachedPartsMap.size(), parsedPartsMap.size());
+    for (const auto& parsedPart : parsedPartsMap) {
+        const auto cachedPart = cachedPartsMap.find(parsedPart.first);
+        ASSERT_NE(cachedPart, cachedPartsMap.end());
+        ASSERT_EQ(cachedPart->second.vertices.size(), parsedPart.second.vertices.size());
+        for (size_t i = 0; i < parsedPart.second.vertices.size(); ++i) {
+            EXPECT_EQ(cachedPart->second.vertices[i].pos, parsedPart.second.vertices[i].pos);
+            EXPECT_EQ(cachedPart->second.vertices[i].normal,
+                      parsedPart.second.vertices[i].normal);
+        }
+        EXPECT_EQ(cachedPart->second.material.kd, parsedPart.second.material.kd);
+    }
+}
+
+TEST(ObjParserTests, ReadObjFileIgnoresCacheOfOtherOptions) {
+    ReadObjOptions option;
+    option.cacheFilename = ::testing::TempDir() + "sample_car_scaled.cache";
+    std::remove(option.cacheFilename.c_str());
+
+    std::map<std::string, CarPart> carPartsMap;
+    ASSERT_TRUE(ReadObjFromFile("vendor/etc/automotive/sv/sample_car.obj", option, &carPartsMap));
+
+    option.scales[0] = 2.0f;
+    std::map<std::string, CarPart> scaledPartsMap;
+    ASSERT_TRUE(ReadObjFromFile("vendor/etc/automotive/sv/sample_car.obj", option,
+                                &scaledPartsMap));
+    ASSERT_NE(carPartsMap.find("door"), carPartsMap.end());
+    ASSERT_NE(scaledPartsMap.find("door"), scaledPartsMap.end());
+    const auto& vertices = carPartsMap.at("door").vertices;
+    const auto& scaledVertices = scaledPartsMap.at("door").vertices;
+    ASSERT_EQ(scaledVertices.size(), vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        EXPECT_EQ(scaledVertices[i].pos[0], vertices[i].pos[0] * 2.0f);
+    }
+}
+
 }  // namespace
 }  // namespace implementation
 }  // namespace V1_0
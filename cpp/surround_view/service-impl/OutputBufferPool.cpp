@@ -0,0 +1,229 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define ATRACE_TAG ATRACE_TAG_CAMERA
+#include "OutputBufferPool.h"
+
+#include <android-base/logging.h>
+#include <system/graphics-base.h>
+#include <utils/Trace.h>
+
+#include <algorithm>
+
+using ::std::mutex;
+using ::std::scoped_lock;
+using ::std::unique_lock;
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace sv {
+namespace V1_0 {
+namespace implementation {
+
+namespace {
+
+// The core lib stitches 2d images in RGB.
+const int kOutputNumChannels = 3;
+
+}  // namespace
+
+OutputBufferPool::OutputBufferPool(int buffersPerResolution, int maxCachedResolutions) :
+      mBuffersPerResolution(buffersPerResolution),
+      mMaxCachedResolutions(std::max(maxCachedResolutions, 1)) {
+    mThread = std::thread([this]() { prepareBuffers(); });
+}
+
+OutputBufferPool::~OutputBufferPool() {
+    {
+        scoped_lock<mutex> lock(mLock);
+        mIsStopping = true;
+    }
+    mSignal.notify_all();
+    mThread.join();
+}
+
+bool OutputBufferPool::allocate(int width, int height, OutputBuffer* buffer) {
+    ATRACE_BEGIN(__PRETTY_FUNCTION__);
+
+    buffer->width = width;
+    buffer->height = height;
+    buffer->memory.reset(new char[height * width * kOutputNumChannels]);
+
+    buffer->texture = new GraphicBuffer(width, height, HAL_PIXEL_FORMAT_RGB_888, 1,
+                                        GRALLOC_USAGE_HW_TEXTURE, "SvTexture");
+    if (buffer->texture->initCheck() != OK) {
+        LOG(ERROR) << "Failed to allocate Graphic Buffer of " << width << "x" << height;
+        ATRACE_END();
+        return false;
+    }
+
+    ATRACE_END();
+    return true;
+}
+
+OutputBufferPool::Entry& OutputBufferPool::useResolution(const Resolution& resolution) {
+    auto it = std::find_if(mEntries.begin(), mEntries.end(),
+                           [&resolution](const auto& entry) {
+                               return entry.first == resolution;
+                           });
+    if (it == mEntries.end()) {
+        mEntries.emplace_front(resolution, Entry());
+    } else if (it != mEntries.begin()) {
+        mEntries.splice(mEntries.begin(), mEntries, it);
+    }
+
+    while (mEntries.size() > static_cast<size_t>(mMaxCachedResolutions)) {
+        LOG(DEBUG) << "Drop the output buffers of " << mEntries.back().first.first << "x"
+                   << mEntries.back().first.second;
+        mEntries.pop_back();
+    }
+
+    return mEntries.front().second;
+}
+
+void OutputBufferPool::prepare(int width, int height) {
+    const Resolution resolution(width, height);
+    {
+        scoped_lock<mutex> lock(mLock);
+        useResolution(resolution);
+        if (std::find(mPendingResolutions.begin(), mPendingResolutions.end(), resolution) !=
+            mPendingResolutions.end()) {
+            return;
+        }
+        mPendingResolutions.push_back(resolution);
+    }
+    mSignal.notify_all();
+}
+
+bool OutputBufferPool::isReady(int width, int height) {
+    const Resolution resolution(width, height);
+
+    scoped_lock<mutex> lock(mLock);
+    for (const auto& entry : mEntries) {
+        if (entry.first == resolution) {
+            return static_cast<int>(entry.second.availableBuffers.size()) +
+                    entry.second.acquiredCount >= mBuffersPerResolution;
+        }
+    }
+    return false;
+}
+
+bool OutputBufferPool::acquire(int width, int height, OutputBuffer* buffer) {
+    {
+        scoped_lock<mutex> lock(mLock);
+        Entry& entry = useResolution(Resolution(width, height));
+        if (!entry.availableBuffers.empty()) {
+            *buffer = std::move(entry.availableBuffers.back());
+            entry.availableBuffers.pop_back();
+            entry.acquiredCount++;
+            return true;
+        }
+    }
+
+    LOG(DEBUG) << "No output buffer of " << width << "x" << height
+               << " available. Allocating one.";
+    if (!allocate(width, height, buffer)) {
+        return false;
+    }
+
+    scoped_lock<mutex> lock(mLock);
+    useResolution(Resolution(width, height)).acquiredCount++;
+    return true;
+}
+
+void OutputBufferPool::release(OutputBuffer&& buffer) {
+    const Resolution resolution(buffer.width, buffer.height);
+
+    scoped_lock<mutex> lock(mLock);
+    for (auto& entry : mEntries) {
+        if (entry.first != resolution) {
+            continue;
+        }
+        if (entry.second.acquiredCount > 0) {
+            entry.second.acquiredCount--;
+        }
+        if (static_cast<int>(entry.second.availableBuffers.size()) +
+                    entry.second.acquiredCount < mBuffersPerResolution) {
+            entry.second.availableBuffers.push_back(std::move(buffer));
+        }
+        return;
+    }
+
+    // The resolution is not cached anymore; the buffer is freed.
+}
+
+void OutputBufferPool::prepareBuffers() {
+    while (true) {
+        Resolution resolution;
+        int missingCount = 0;
+        {
+            unique_lock<mutex> lock(mLock);
+            mSignal.wait(lock, [this]() {
+                return !mPendingResolutions.empty() || mIsStopping;
+            });
+            if (mIsStopping) {
+                break;
+            }
+
+            resolution = mPendingResolutions.front();
+            for (const auto& entry : mEntries) {
+                if (entry.first == resolution) {
+                    missingCount = mBuffersPerResolution -
+                            static_cast<int>(entry.second.availableBuffers.size()) -
+                            entry.second.acquiredCount;
+                    break;
+                }
+            }
+        }
+
+        // Allocate without holding the lock, so the frames keep flowing.
+        std::vector<OutputBuffer> buffers(std::max(missingCount, 0));
+        for (auto& buffer : buffers) {
+            if (!allocate(resolution.first, resolution.second, &buffer)) {
+                buffers.clear();
+                break;
+            }
+        }
+        if (!buffers.empty()) {
+            LOG(INFO) << "Allocated " << buffers.size() << " output buffers of "
+                      << resolution.first << "x" << resolution.second;
+        }
+
+        scoped_lock<mutex> lock(mLock);
+        mPendingResolutions.pop_front();
+        for (auto& entry : mEntries) {
+            if (entry.first != resolution) {
+                continue;
+            }
+            // Buffers may have been allocated by acquire() meanwhile.
+            for (auto& buffer : buffers) {
+                if (static_cast<int>(entry.second.availableBuffers.size()) +
+                            entry.second.acquiredCount >= mBuffersPerResolution) {
+                    break;
+                }
+                entry.second.availableBuffers.push_back(std::move(buffer));
+            }
+            break;
+        }
+    }
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sv
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,117 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <android-base/thread_annotations.h>
+
+#include <ui/GraphicBuffer.h>
+
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace sv {
+namespace V1_0 {
+namespace implementation {
+
+// The output buffers of a frame slot on the CPU solution.
+struct OutputBuffer {
+    int width = 0;
+    int height = 0;
+
+    // The RGB image stitched by the core lib.
+    std::unique_ptr<char[]> memory;
+
+    // The texture the image is copied to and delivered in.
+    sp<GraphicBuffer> texture;
+};
+
+// Pool of the output buffers of the 2d session, per output resolution.
+// Buffers for a new resolution are allocated on a background thread, so the
+// frames keep being stitched at the previous resolution meanwhile. The
+// buffers of the most recently used resolutions are kept when they are
+// released, so switching back to one of them does not allocate.
+class OutputBufferPool {
+public:
+    // |buffersPerResolution| is the number of buffers used at once at a
+    // resolution, |maxCachedResolutions| the number of resolutions whose
+    // buffers are kept.
+    OutputBufferPool(int buffersPerResolution, int maxCachedResolutions);
+    ~OutputBufferPool();
+
+    // Starts allocating the buffers missing for a resolution in the
+    // background.
+    void prepare(int width, int height);
+
+    // Returns true once a full set of buffers exists for a resolution, either
+    // available or acquired.
+    bool isReady(int width, int height);
+
+    // Takes an available buffer of a resolution, or allocates one if there is
+    // none. Returns false if the allocation fails.
+    bool acquire(int width, int height, OutputBuffer* buffer);
+
+    // Gives back a buffer acquired from the pool. It is freed unless its
+    // resolution is among the most recently used ones.
+    void release(OutputBuffer&& buffer);
+
+    // Allocates the buffers of a resolution.
+    static bool allocate(int width, int height, OutputBuffer* buffer);
+
+private:
+    using Resolution = std::pair<int, int>;
+
+    struct Entry {
+        std::vector<OutputBuffer> availableBuffers;
+        int acquiredCount = 0;
+    };
+
+    // Allocates the buffers of the prepared resolutions; runs on mThread.
+    void prepareBuffers();
+
+    // Makes a resolution the most recently used one, and drops the buffers
+    // of the resolutions used before the last mMaxCachedResolutions ones.
+    Entry& useResolution(const Resolution& resolution) REQUIRES(mLock);
+
+    const int mBuffersPerResolution;
+    const int mMaxCachedResolutions;
+
+    std::mutex mLock;
+    std::condition_variable mSignal GUARDED_BY(mLock);
+
+    // Most recently used first.
+    std::list<std::pair<Resolution, Entry>> mEntries GUARDED_BY(mLock);
+    std::deque<Resolution> mPendingResolutions GUARDED_BY(mLock);
+    bool mIsStopping GUARDED_BY(mLock) = false;
+
+    std::thread mThread;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sv
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
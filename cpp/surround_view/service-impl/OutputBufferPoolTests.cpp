@@ -0,0 +1,113 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define LOG_TAG "OutputBufferPoolTests"
+
+#include "OutputBufferPool.h"
+
+#include <android-base/logging.h>
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <thread>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace sv {
+namespace V1_0 {
+namespace implementation {
+namespace {
+
+const int kBuffersPerResolution = 3;
+const int kMaxCachedResolutions = 2;
+
+// Waits for the background allocation of a resolution.
+bool waitUntilReady(OutputBufferPool* pool, int width, int height) {
+    for (int i = 0; i < 100; i++) {
+        if (pool->isReady(width, height)) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+}
+
+TEST(OutputBufferPoolTests, preparesBuffersInBackground) {
+    OutputBufferPool pool(kBuffersPerResolution, kMaxCachedResolutions);
+    EXPECT_FALSE(pool.isReady(64, 32));
+
+    pool.prepare(64, 32);
+    ASSERT_TRUE(waitUntilReady(&pool, 64, 32));
+
+    for (int i = 0; i < kBuffersPerResolution; i++) {
+        OutputBuffer buffer;
+        ASSERT_TRUE(pool.acquire(64, 32, &buffer));
+        EXPECT_EQ(buffer.width, 64);
+        EXPECT_EQ(buffer.height, 32);
+        EXPECT_NE(buffer.memory, nullptr);
+        ASSERT_NE(buffer.texture, nullptr);
+        EXPECT_EQ(buffer.texture->getWidth(), 64);
+    }
+}
+
+TEST(OutputBufferPoolTests, acquireAllocatesUnpreparedBuffers) {
+    OutputBufferPool pool(kBuffersPerResolution, kMaxCachedResolutions);
+
+    OutputBuffer buffer;
+    ASSERT_TRUE(pool.acquire(64, 32, &buffer));
+    EXPECT_NE(buffer.memory, nullptr);
+    EXPECT_NE(buffer.texture, nullptr);
+    EXPECT_FALSE(pool.isReady(64, 32));
+}
+
+TEST(OutputBufferPoolTests, reusesReleasedBuffers) {
+    OutputBufferPool pool(kBuffersPerResolution, kMaxCachedResolutions);
+
+    OutputBuffer buffer;
+    ASSERT_TRUE(pool.acquire(64, 32, &buffer));
+    const sp<GraphicBuffer> texture = buffer.texture;
+    pool.release(std::move(buffer));
+
+    OutputBuffer reusedBuffer;
+    ASSERT_TRUE(pool.acquire(64, 32, &reusedBuffer));
+    EXPECT_EQ(reusedBuffer.texture, texture);
+}
+
+TEST(OutputBufferPoolTests, keepsRecentlyUsedResolutions) {
+    OutputBufferPool pool(kBuffersPerResolution, kMaxCachedResolutions);
+    pool.prepare(64, 32);
+    ASSERT_TRUE(waitUntilReady(&pool, 64, 32));
+
+    // Switching to another resolution keeps the buffers of the first one.
+    pool.prepare(128, 64);
+    ASSERT_TRUE(waitUntilReady(&pool, 128, 64));
+    EXPECT_TRUE(pool.isReady(64, 32));
+
+    // Until a third resolution is used.
+    pool.prepare(256, 128);
+    ASSERT_TRUE(waitUntilReady(&pool, 256, 128));
+    EXPECT_TRUE(pool.isReady(128, 64));
+    EXPECT_FALSE(pool.isReady(64, 32));
+}
+
+}  // namespace
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sv
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
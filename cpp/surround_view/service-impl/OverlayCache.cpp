@@ -0,0 +1,173 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define ATRACE_TAG ATRACE_TAG_CAMERA
+
+#include "OverlayCache.h"
+
+#include <android-base/logging.h>
+#include <android/hidl/memory/1.0/IMemory.h>
+#include <hidlmemory/mapping.h>
+#include <utils/Trace.h>
+
+#include <cstring>
+#include <map>
+#include <set>
+
+using ::android::hidl::memory::V1_0::IMemory;
+using ::android_auto::surround_view::Overlay;
+using ::std::map;
+using ::std::set;
+using ::std::vector;
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace sv {
+namespace V1_0 {
+namespace implementation {
+
+namespace {
+
+const int kVertexSize = 16;
+const int kIdSize = 2;
+
+}  // namespace
+
+bool OverlayCache::update(const OverlaysData& overlaysData) {
+    ATRACE_BEGIN(__PRETTY_FUNCTION__);
+
+    // Check the descriptors, and that the size of shared memory matches them.
+    uint64_t memDescSize = 0;
+    set<uint16_t> overlayIdSet;
+    for (auto& overlayMemDesc : overlaysData.overlaysMemoryDesc) {
+        if (overlayIdSet.find(overlayMemDesc.id) != overlayIdSet.end()) {
+            LOG(ERROR) << "Duplicate id within memory descriptor.";
+            ATRACE_END();
+            return false;
+        }
+        overlayIdSet.insert(overlayMemDesc.id);
+
+        if (overlayMemDesc.verticesCount < 3) {
+            LOG(ERROR) << "Less than 3 vertices.";
+            ATRACE_END();
+            return false;
+        }
+
+        if (overlayMemDesc.overlayPrimitive == OverlayPrimitive::TRIANGLES &&
+            overlayMemDesc.verticesCount % 3 != 0) {
+            LOG(ERROR) << "Triangles primitive does not have vertices "
+                       << "multiple of 3.";
+            ATRACE_END();
+            return false;
+        }
+
+        memDescSize += kIdSize + kVertexSize * static_cast<uint64_t>(overlayMemDesc.verticesCount);
+    }
+    if (overlaysData.overlaysMemory.size() < memDescSize) {
+        LOG(ERROR) << "Allocated shared memory size is less than overlaysMemoryDesc size.";
+        ATRACE_END();
+        return false;
+    }
+
+    // The memory is mapped on every update. Nothing in the handle identifies
+    // the region: fds are duplicated per call and their numbers are reused
+    // once closed, and all ashmem regions share a name and an inode.
+    sp<IMemory> memory;
+    const uint8_t* pData = nullptr;
+    if (!overlaysData.overlaysMemoryDesc.empty()) {
+        memory = mapMemory(overlaysData.overlaysMemory);
+        if (memory == nullptr) {
+            LOG(ERROR) << "mapMemory failed.";
+            ATRACE_END();
+            return false;
+        }
+        pData = static_cast<uint8_t*>(static_cast<void*>(memory->getPointer()));
+        if (pData == nullptr) {
+            LOG(ERROR) << "Shared memory getPointer() failed.";
+            ATRACE_END();
+            return false;
+        }
+    }
+
+    // Current overlays by id.
+    map<uint16_t, int> overlayIndices;
+    for (int i = 0; i < static_cast<int>(mOverlays.size()); i++) {
+        overlayIndices.emplace(mOverlays[i].id, i);
+    }
+
+    // Read the overlays into new vectors first, so the current overlays are
+    // kept if the memory turns out to be invalid.
+    vector<Overlay> overlays(overlaysData.overlaysMemoryDesc.size());
+    vector<int> previousIndices(overlaysData.overlaysMemoryDesc.size(), -1);
+    bool isChanged = overlays.size() != mOverlays.size();
+    uint64_t idOffset = 0;
+    for (size_t i = 0; i < overlaysData.overlaysMemoryDesc.size(); i++) {
+        const auto& overlayMemDesc = overlaysData.overlaysMemoryDesc[i];
+        uint16_t overlayId;
+        memcpy(&overlayId, pData + idOffset, kIdSize);
+        if (overlayId != overlayMemDesc.id) {
+            LOG(ERROR) << "Overlay id mismatch " << overlayId << ", " << overlayMemDesc.id;
+            ATRACE_END();
+            return false;
+        }
+
+        const uint8_t* verticesDataPtr = pData + idOffset + kIdSize;
+        const size_t verticesSize = kVertexSize * overlayMemDesc.verticesCount;
+        idOffset += kIdSize + verticesSize;
+
+        // Keep the overlay if its vertices did not change.
+        const auto previousIndex = overlayIndices.find(overlayMemDesc.id);
+        if (previousIndex != overlayIndices.end()) {
+            const Overlay& previousOverlay = mOverlays[previousIndex->second];
+            if (previousOverlay.vertices.size() == overlayMemDesc.verticesCount &&
+                memcmp(previousOverlay.vertices.data(), verticesDataPtr, verticesSize) == 0) {
+                previousIndices[i] = previousIndex->second;
+                continue;
+            }
+        }
+
+        // Copy over shared memory data to sv core overlays.
+        Overlay& overlay = overlays[i];
+        overlay.id = overlayMemDesc.id;
+        overlay.vertices.resize(overlayMemDesc.verticesCount);
+        memcpy(overlay.vertices.data(), verticesDataPtr, verticesSize);
+        isChanged = true;
+    }
+
+    // The overlays also changed if any was removed or moved.
+    for (size_t i = 0; i < overlays.size(); i++) {
+        if (previousIndices[i] < 0) {
+            continue;
+        }
+        isChanged = isChanged || previousIndices[i] != static_cast<int>(i);
+        overlays[i] = std::move(mOverlays[previousIndices[i]]);
+    }
+
+    mOverlays = std::move(overlays);
+    if (isChanged) {
+        mGeneration++;
+    }
+
+    ATRACE_END();
+    return true;
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sv
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
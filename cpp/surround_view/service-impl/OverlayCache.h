@@ -0,0 +1,61 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "core_lib.h"
+
+#include <android/hardware/automotive/sv/1.0/types.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace sv {
+namespace V1_0 {
+namespace implementation {
+
+// Keeps the overlays set by the client of a 3d session. The client usually
+// changes a few of the overlays only, so the overlays whose content did not
+// change are kept as they are.
+class OverlayCache {
+public:
+    // Validates the overlays described by |overlaysData| and reads the ones
+    // that changed. Returns false, keeping the previous overlays, if the
+    // overlays are not valid.
+    bool update(const OverlaysData& overlaysData);
+
+    // Incremented whenever the overlays change.
+    uint64_t getGeneration() const { return mGeneration; }
+
+    // The overlays, in the order of the memory descriptors.
+    const std::vector<android_auto::surround_view::Overlay>& getOverlays() const {
+        return mOverlays;
+    }
+
+private:
+    std::vector<android_auto::surround_view::Overlay> mOverlays;
+    uint64_t mGeneration = 0;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sv
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,225 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OverlayCacheTests"
+
+#include "OverlayCache.h"
+
+#include <android-base/logging.h>
+#include <android/hidl/allocator/1.0/IAllocator.h>
+#include <android/hidl/memory/1.0/IMemory.h>
+#include <hidlmemory/mapping.h>
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace sv {
+namespace V1_0 {
+namespace implementation {
+namespace {
+
+using ::android::hidl::allocator::V1_0::IAllocator;
+using ::android::hidl::memory::V1_0::IMemory;
+using ::android_auto::surround_view::OverlayVertex;
+
+const int kVertexByteSize = (3 * sizeof(float)) + 4;
+const int kIdByteSize = 2;
+
+// Two overlays, with 6 and 4 vertices.
+const uint16_t kOverlayIds[] = {0, 1};
+const uint32_t kVerticesCounts[] = {6, 4};
+const OverlayPrimitive kPrimitives[] = {OverlayPrimitive::TRIANGLES,
+                                        OverlayPrimitive::TRIANGLES_STRIP};
+const int kOverlaysCount = 2;
+
+class OverlayCacheTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        for (int i = 0; i < kOverlaysCount; i++) {
+            OverlayMemoryDesc overlayMemDesc;
+            overlayMemDesc.id = kOverlayIds[i];
+            overlayMemDesc.verticesCount = kVerticesCounts[i];
+            overlayMemDesc.overlayPrimitive = kPrimitives[i];
+            mOverlaysMemoryDesc.push_back(overlayMemDesc);
+        }
+
+        allocateOverlaysMemory(&mOverlaysData.overlaysMemory, &mMemory);
+        ASSERT_NE(mMemory.get(), nullptr);
+        mData = static_cast<uint8_t*>(static_cast<void*>(mMemory->getPointer()));
+
+        mOverlaysData.overlaysMemoryDesc = mOverlaysMemoryDesc;
+    }
+
+    // Allocates shared memory for the overlays, with their ids written and
+    // their vertices zeroed.
+    void allocateOverlaysMemory(hidl_memory* overlaysMemory, sp<IMemory>* mappedMemory) {
+        int bytesSize = 0;
+        for (int i = 0; i < kOverlaysCount; i++) {
+            bytesSize += kIdByteSize + kVertexByteSize * kVerticesCounts[i];
+        }
+
+        sp<IAllocator> ashmemAllocator = IAllocator::getService("ashmem");
+        ASSERT_NE(ashmemAllocator.get(), nullptr);
+        bool allocateSuccess = false;
+        Return<void> result =
+                ashmemAllocator->allocate(bytesSize, [&](bool success, const hidl_memory& memory) {
+                    allocateSuccess = success;
+                    *overlaysMemory = memory;
+                });
+        ASSERT_TRUE(result.isOk() && allocateSuccess);
+
+        *mappedMemory = mapMemory(*overlaysMemory);
+        ASSERT_NE(mappedMemory->get(), nullptr);
+        uint8_t* data = static_cast<uint8_t*>(static_cast<void*>((*mappedMemory)->getPointer()));
+
+        (*mappedMemory)->update();
+        memset(data, 0, bytesSize);
+        int offset = 0;
+        for (int i = 0; i < kOverlaysCount; i++) {
+            memcpy(data + offset, &kOverlayIds[i], kIdByteSize);
+            offset += kIdByteSize + kVertexByteSize * kVerticesCounts[i];
+        }
+        (*mappedMemory)->commit();
+    }
+
+    // Returns the vertices of the overlay at |index| in the shared memory
+    // |data|.
+    static OverlayVertex* getVertices(uint8_t* data, int index) {
+        int offset = 0;
+        for (int i = 0; i < index; i++) {
+            offset += kIdByteSize + kVertexByteSize * kVerticesCounts[i];
+        }
+        return reinterpret_cast<OverlayVertex*>(data + offset + kIdByteSize);
+    }
+
+    // Returns the vertices of the overlay at |index| in the shared memory.
+    OverlayVertex* getVertices(int index) { return getVertices(mData, index); }
+
+    std::vector<OverlayMemoryDesc> mOverlaysMemoryDesc;
+    OverlaysData mOverlaysData;
+    sp<IMemory> mMemory;
+    uint8_t* mData = nullptr;
+    OverlayCache mOverlayCache;
+};
+
+TEST_F(OverlayCacheTests, FirstUpdateReadsAllOverlays) {
+    ASSERT_TRUE(mOverlayCache.update(mOverlaysData));
+
+    EXPECT_EQ(mOverlayCache.getGeneration(), 1);
+    ASSERT_EQ(mOverlayCache.getOverlays().size(), kOverlaysCount);
+    for (int i = 0; i < kOverlaysCount; i++) {
+        EXPECT_EQ(mOverlayCache.getOverlays()[i].id, kOverlayIds[i]);
+        EXPECT_EQ(mOverlayCache.getOverlays()[i].vertices.size(), kVerticesCounts[i]);
+    }
+}
+
+TEST_F(OverlayCacheTests, UnchangedOverlaysAreKept) {
+    ASSERT_TRUE(mOverlayCache.update(mOverlaysData));
+    ASSERT_TRUE(mOverlayCache.update(mOverlaysData));
+
+    EXPECT_EQ(mOverlayCache.getGeneration(), 1);
+    EXPECT_EQ(mOverlayCache.getOverlays().size(), kOverlaysCount);
+}
+
+TEST_F(OverlayCacheTests, ChangedOverlayIsReadAgain) {
+    ASSERT_TRUE(mOverlayCache.update(mOverlaysData));
+
+    mMemory->update();
+    getVertices(1)[2].pos[0] = 1.5f;
+    mMemory->commit();
+    ASSERT_TRUE(mOverlayCache.update(mOverlaysData));
+
+    EXPECT_EQ(mOverlayCache.getGeneration(), 2);
+    ASSERT_EQ(mOverlayCache.getOverlays().size(), kOverlaysCount);
+    EXPECT_EQ(mOverlayCache.getOverlays()[1].vertices[2].pos[0], 1.5f);
+}
+
+TEST_F(OverlayCacheTests, OtherMemoryOfSameSizeIsRead) {
+    ASSERT_TRUE(mOverlayCache.update(mOverlaysData));
+
+    // A new region of the same size, which only differs in its content.
+    OverlaysData otherOverlaysData;
+    sp<IMemory> otherMemory;
+    allocateOverlaysMemory(&otherOverlaysData.overlaysMemory, &otherMemory);
+    ASSERT_NE(otherMemory.get(), nullptr);
+    otherOverlaysData.overlaysMemoryDesc = mOverlaysMemoryDesc;
+    ASSERT_EQ(otherOverlaysData.overlaysMemory.size(), mOverlaysData.overlaysMemory.size());
+
+    otherMemory->update();
+    getVertices(static_cast<uint8_t*>(static_cast<void*>(otherMemory->getPointer())), 1)[2]
+            .pos[0] = 1.5f;
+    otherMemory->commit();
+    ASSERT_TRUE(mOverlayCache.update(otherOverlaysData));
+
+    EXPECT_EQ(mOverlayCache.getGeneration(), 2);
+    ASSERT_EQ(mOverlayCache.getOverlays().size(), kOverlaysCount);
+    EXPECT_EQ(mOverlayCache.getOverlays()[1].vertices[2].pos[0], 1.5f);
+
+    // And back to the first region.
+    ASSERT_TRUE(mOverlayCache.update(mOverlaysData));
+
+    EXPECT_EQ(mOverlayCache.getGeneration(), 3);
+    ASSERT_EQ(mOverlayCache.getOverlays().size(), kOverlaysCount);
+    EXPECT_EQ(mOverlayCache.getOverlays()[1].vertices[2].pos[0], 0.0f);
+}
+
+TEST_F(OverlayCacheTests, RemovedOverlayChangesGeneration) {
+    ASSERT_TRUE(mOverlayCache.update(mOverlaysData));
+
+    mOverlaysData.overlaysMemoryDesc = {mOverlaysMemoryDesc[0]};
+    ASSERT_TRUE(mOverlayCache.update(mOverlaysData));
+
+    EXPECT_EQ(mOverlayCache.getGeneration(), 2);
+    ASSERT_EQ(mOverlayCache.getOverlays().size(), 1);
+    EXPECT_EQ(mOverlayCache.getOverlays()[0].id, kOverlayIds[0]);
+}
+
+TEST_F(OverlayCacheTests, InvalidOverlaysKeepPreviousOverlays) {
+    ASSERT_TRUE(mOverlayCache.update(mOverlaysData));
+
+    // The id of the second overlay in memory no longer matches its descriptor.
+    mMemory->update();
+    getVertices(1)[0].pos[0] = 2.0f;
+    const uint16_t wrongId = 7;
+    memcpy(mData + kIdByteSize + kVertexByteSize * kVerticesCounts[0], &wrongId, kIdByteSize);
+    mMemory->commit();
+    EXPECT_FALSE(mOverlayCache.update(mOverlaysData));
+
+    EXPECT_EQ(mOverlayCache.getGeneration(), 1);
+    ASSERT_EQ(mOverlayCache.getOverlays().size(), kOverlaysCount);
+    EXPECT_EQ(mOverlayCache.getOverlays()[1].id, kOverlayIds[1]);
+    EXPECT_EQ(mOverlayCache.getOverlays()[1].vertices[0].pos[0], 0.0f);
+}
+
+TEST_F(OverlayCacheTests, TrianglesWithoutMultipleOf3VerticesFail) {
+    mOverlaysData.overlaysMemoryDesc[0].verticesCount = 4;
+    mOverlaysData.overlaysMemoryDesc[1].verticesCount = 6;
+
+    EXPECT_FALSE(mOverlayCache.update(mOverlaysData));
+    EXPECT_EQ(mOverlayCache.getGeneration(), 0);
+}
+
+}  // namespace
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sv
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -0,0 +1,116 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define ATRACE_TAG ATRACE_TAG_CAMERA
+
+#include "ProjectionLut.h"
+
+#include <android-base/logging.h>
+#include <utils/Trace.h>
+
+#include <algorithm>
+
+using ::android_auto::surround_view::Coordinate2dInteger;
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace sv {
+namespace V1_0 {
+namespace implementation {
+
+ProjectionLut::ProjectionLut(int width, int height, int gridStep, int dimensions)
+      : mWidth(width),
+        mHeight(height),
+        mGridStep(gridStep),
+        mDimensions(dimensions),
+        mColumns((width - 1) / gridStep + 1),
+        mRows((height - 1) / gridStep + 1),
+        mIsReady(false),
+        mIsCancelled(false) {}
+
+bool ProjectionLut::build(const ProjectFunction& project) {
+    ATRACE_BEGIN(__PRETTY_FUNCTION__);
+
+    mValues.assign(mColumns * mRows * mDimensions, 0.0f);
+    mIsValid.assign(mColumns * mRows, 0);
+    for (int row = 0; row < mRows; row++) {
+        if (mIsCancelled.load(std::memory_order_relaxed)) {
+            LOG(DEBUG) << "Projection table build cancelled.";
+            ATRACE_END();
+            return false;
+        }
+        for (int column = 0; column < mColumns; column++) {
+            const int node = row * mColumns + column;
+            const Coordinate2dInteger nodePoint(column * mGridStep, row * mGridStep);
+            mIsValid[node] = project(nodePoint, &mValues[node * mDimensions]) ? 1 : 0;
+        }
+    }
+
+    mIsReady.store(true, std::memory_order_release);
+    ATRACE_END();
+    return true;
+}
+
+void ProjectionLut::cancel() {
+    mIsCancelled.store(true, std::memory_order_relaxed);
+}
+
+bool ProjectionLut::lookup(const Coordinate2dInteger& cameraPoint, float* values) const {
+    if (!isReady() || mColumns < 2 || mRows < 2) {
+        return false;
+    }
+    if (cameraPoint.x < 0 || cameraPoint.x >= mWidth || cameraPoint.y < 0 ||
+        cameraPoint.y >= mHeight) {
+        return false;
+    }
+
+    // The cell whose top left node is at (column, row). Points on the last
+    // node column or row belong to the cell before it.
+    const int column = std::min(cameraPoint.x / mGridStep, mColumns - 2);
+    const int row = std::min(cameraPoint.y / mGridStep, mRows - 2);
+    const float fx = static_cast<float>(cameraPoint.x - column * mGridStep) / mGridStep;
+    const float fy = static_cast<float>(cameraPoint.y - row * mGridStep) / mGridStep;
+    if (fx > 1.0f || fy > 1.0f) {
+        // Past the last node.
+        return false;
+    }
+
+    const int topLeft = row * mColumns + column;
+    const int bottomLeft = topLeft + mColumns;
+    if (!mIsValid[topLeft] || !mIsValid[topLeft + 1] || !mIsValid[bottomLeft] ||
+        !mIsValid[bottomLeft + 1]) {
+        return false;
+    }
+
+    const float* topLeftValues = &mValues[topLeft * mDimensions];
+    const float* topRightValues = topLeftValues + mDimensions;
+    const float* bottomLeftValues = &mValues[bottomLeft * mDimensions];
+    const float* bottomRightValues = bottomLeftValues + mDimensions;
+    for (int i = 0; i < mDimensions; i++) {
+        const float top = topLeftValues[i] + fx * (topRightValues[i] - topLeftValues[i]);
+        const float bottom =
+                bottomLeftValues[i] + fx * (bottomRightValues[i] - bottomLeftValues[i]);
+        values[i] = top + fy * (bottom - top);
+    }
+    return true;
+}
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sv
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
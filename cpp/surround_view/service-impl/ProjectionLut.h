@@ -0,0 +1,90 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "core_lib.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace sv {
+namespace V1_0 {
+namespace implementation {
+
+// Projections of a camera's pixels, precomputed on a grid of the camera image.
+// Projecting a point through the core lib is costly, while clients such as
+// touch handling project thousands of points at once. The projection of a
+// point is interpolated from the nodes of the grid cell containing it.
+class ProjectionLut {
+public:
+    // Projects |cameraPoint| into |values|. Returns false if the point has no
+    // projection.
+    using ProjectFunction =
+            std::function<bool(const android_auto::surround_view::Coordinate2dInteger& cameraPoint,
+                               float* values)>;
+
+    // |width| and |height| are the camera resolution, the grid has a node
+    // every |gridStep| pixels. Each projection has |dimensions| values.
+    ProjectionLut(int width, int height, int gridStep, int dimensions);
+
+    // Projects the grid nodes with |project|. Returns false if cancelled
+    // before the table is complete. May run on any thread.
+    bool build(const ProjectFunction& project);
+
+    // Makes a running or later build() return early.
+    void cancel();
+
+    bool isReady() const { return mIsReady.load(std::memory_order_acquire); }
+
+    // Interpolates the projection of |cameraPoint| from the table. Returns
+    // false if the table is not built, if the point lies past the last grid
+    // node, or if a node of its grid cell has no projection; the point must
+    // then be projected exactly.
+    bool lookup(const android_auto::surround_view::Coordinate2dInteger& cameraPoint,
+                float* values) const;
+
+private:
+    const int mWidth;
+    const int mHeight;
+    const int mGridStep;
+    const int mDimensions;
+
+    // Number of grid nodes along the width and the height.
+    const int mColumns;
+    const int mRows;
+
+    // Projections of the nodes, row by row, mDimensions values per node.
+    std::vector<float> mValues;
+
+    // Whether each node has a projection.
+    std::vector<uint8_t> mIsValid;
+
+    std::atomic<bool> mIsReady;
+    std::atomic<bool> mIsCancelled;
+};
+
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sv
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
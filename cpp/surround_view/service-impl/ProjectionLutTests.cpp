@@ -0,0 +1,130 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "ProjectionLutTests"
+
+#include "ProjectionLut.h"
+
+#include <android-base/logging.h>
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace sv {
+namespace V1_0 {
+namespace implementation {
+namespace {
+
+using ::android_auto::surround_view::Coordinate2dInteger;
+
+const int kWidth = 101;
+const int kHeight = 61;
+const int kGridStep = 8;
+
+// A smooth projection, like the ground projection of a camera below its
+// horizon.
+bool ProjectToGround(const Coordinate2dInteger& cameraPoint, float* values) {
+    const float depth = 1.0f + 0.02f * cameraPoint.y;
+    values[0] = (cameraPoint.x - kWidth / 2.0f) / depth;
+    values[1] = 100.0f / depth;
+    return true;
+}
+
+TEST(ProjectionLutTests, LookupFailsBeforeBuild) {
+    ProjectionLut projectionLut(kWidth, kHeight, kGridStep, 2);
+    float values[2];
+
+    EXPECT_FALSE(projectionLut.isReady());
+    EXPECT_FALSE(projectionLut.lookup(Coordinate2dInteger(0, 0), values));
+}
+
+TEST(ProjectionLutTests, NodesMatchExactProjection) {
+    ProjectionLut projectionLut(kWidth, kHeight, kGridStep, 2);
+    ASSERT_TRUE(projectionLut.build(ProjectToGround));
+    ASSERT_TRUE(projectionLut.isReady());
+
+    for (int y = 0; y < kHeight; y += kGridStep) {
+        for (int x = 0; x < kWidth; x += kGridStep) {
+            const Coordinate2dInteger point(x, y);
+            float values[2], expected[2];
+            ProjectToGround(point, expected);
+            ASSERT_TRUE(projectionLut.lookup(point, values));
+            EXPECT_FLOAT_EQ(values[0], expected[0]);
+            EXPECT_FLOAT_EQ(values[1], expected[1]);
+        }
+    }
+}
+
+TEST(ProjectionLutTests, InterpolationIsAccurate) {
+    ProjectionLut projectionLut(kWidth, kHeight, kGridStep, 2);
+    ASSERT_TRUE(projectionLut.build(ProjectToGround));
+
+    float maxError = 0.0f;
+    for (int y = 0; y < kHeight; y++) {
+        for (int x = 0; x < kWidth; x++) {
+            const Coordinate2dInteger point(x, y);
+            float values[2], expected[2];
+            ProjectToGround(point, expected);
+            if (!projectionLut.lookup(point, values)) {
+                continue;
+            }
+            maxError = std::max(maxError, std::abs(values[0] - expected[0]));
+            maxError = std::max(maxError, std::abs(values[1] - expected[1]));
+        }
+    }
+    EXPECT_LT(maxError, 1.0f);
+}
+
+// Points past the last grid node, and cells with a node without projection,
+// must be projected exactly.
+TEST(ProjectionLutTests, EdgesAndInvalidNodesFallBack) {
+    ProjectionLut projectionLut(kWidth, kHeight, kGridStep, 2);
+    ASSERT_TRUE(projectionLut.build([](const Coordinate2dInteger& cameraPoint, float* values) {
+        return cameraPoint.y != kGridStep && ProjectToGround(cameraPoint, values);
+    }));
+
+    float values[2];
+    // The last node column is at 96 and the last node row at 56.
+    EXPECT_TRUE(projectionLut.lookup(Coordinate2dInteger(96, 56), values));
+    EXPECT_FALSE(projectionLut.lookup(Coordinate2dInteger(97, 20), values));
+    EXPECT_FALSE(projectionLut.lookup(Coordinate2dInteger(20, 57), values));
+    EXPECT_FALSE(projectionLut.lookup(Coordinate2dInteger(kWidth, 0), values));
+
+    // Cells next to the node row without projection.
+    EXPECT_FALSE(projectionLut.lookup(Coordinate2dInteger(20, 4), values));
+    EXPECT_FALSE(projectionLut.lookup(Coordinate2dInteger(20, 12), values));
+    EXPECT_TRUE(projectionLut.lookup(Coordinate2dInteger(20, 20), values));
+}
+
+TEST(ProjectionLutTests, CancelledBuildIsNotReady) {
+    ProjectionLut projectionLut(kWidth, kHeight, kGridStep, 2);
+    projectionLut.cancel();
+
+    EXPECT_FALSE(projectionLut.build(ProjectToGround));
+    EXPECT_FALSE(projectionLut.isReady());
+}
+
+}  // namespace
+}  // namespace implementation
+}  // namespace V1_0
+}  // namespace sv
+}  // namespace automotive
+}  // namespace hardware
+}  // namespace android
@@ -67,6 +67,10 @@ typedef struct {
 static const size_t kStreamCfgSz = sizeof(RawStreamConfig) / sizeof(int32_t);
 static const int kInputNumChannels = 4;
 static const int kOutputNumChannels = 3;
+
+// The output buffers of the current and the previous resolutions are kept, so
+// toggling between two views does not allocate.
+static const int kMaxCachedOutputResolutions = 2;
 static const int kNumFrames = 4;
 static const int kSv2dViewId = 0;
 static const float kUndistortionScales[4] = {1.0f, 1.0f, 1.0f, 1.0f};
@@ -89,91 +93,67 @@ Return<void> SurroundView2dSession::FramesHandler::deliverFrame_1_1(
     ATRACE_BEGIN(__PRETTY_FUNCTION__);
 
     LOG(INFO) << "Received " << buffers.size() << " frames from the camera";
-    mSession->mSequenceId++;
+    const int sequenceId = ++mSession->mSequenceId;
 
+    FramesSlot* slot = nullptr;
     {
         scoped_lock<mutex> lock(mSession->mAccessLock);
-        if (mSession->mProcessingEvsFrames) {
-            LOG(WARNING) << "EVS frames are being processed. Skip frames:"
-                         << mSession->mSequenceId;
+        if (mSession->mStreamState != RUNNING) {
+            LOG(DEBUG) << "The stream is not running. Skip frames:" << sequenceId;
             mCamera->doneWithFrame_1_1(buffers);
+            ATRACE_END();
             return {};
-        } else {
-            // Sets the flag to true immediately so the new coming frames will
-            // be skipped.
-            mSession->mProcessingEvsFrames = true;
         }
-    }
-
-    if (buffers.size() != kNumFrames) {
-        scoped_lock<mutex> lock(mSession->mAccessLock);
-        LOG(ERROR) << "The number of incoming frames is " << buffers.size()
-                   << ", which is different from the number " << kNumFrames
-                   << ", specified in config file";
-        mSession->mProcessingEvsFrames = false;
-        mCamera->doneWithFrame_1_1(buffers);
-        return {};
-    }
 
-    {
-        scoped_lock<mutex> lock(mSession->mAccessLock);
-        vector<int> indices;
-        for (const auto& id
-                : mSession->mIOModuleConfig->cameraConfig.evsCameraIds) {
-            for (int i = 0; i < kNumFrames; i++) {
-                if (buffers[i].deviceId == id) {
-                    indices.emplace_back(i);
-                    break;
-                }
+        for (auto& candidate : mSession->mFramesSlots) {
+            if (candidate.state == FramesSlot::FREE) {
+                slot = &candidate;
+                break;
             }
         }
 
-        if (indices.size() != kNumFrames) {
-            LOG(ERROR) << "The frames are not from the cameras we expected!";
-            mSession->mProcessingEvsFrames = false;
+        if (slot == nullptr) {
+            LOG(WARNING) << "All " << mSession->mFramesSlots.size()
+                         << " frame slots are busy. Skip frames:" << sequenceId;
+            LOG(DEBUG) << "Notify SvEvent::FRAME_DROPPED";
+            mSession->mStream->notify(SvEvent::FRAME_DROPPED);
             mCamera->doneWithFrame_1_1(buffers);
+            ATRACE_END();
             return {};
         }
 
-        if (mSession->mGpuAccelerationEnabled) {
-            for (int i = 0; i < kNumFrames; i++) {
-                LOG(DEBUG) << "Importing graphic buffer from camera ["
-                           << buffers[indices[i]].deviceId << "]";
-                const AHardwareBuffer_Desc* pDesc = reinterpret_cast<const AHardwareBuffer_Desc*>(
-                        &buffers[indices[i]].buffer.description);
-
-                AHardwareBuffer* hardwareBuffer;
-                status_t status = AHardwareBuffer_createFromHandle(
-                        pDesc, buffers[indices[i]].buffer.nativeHandle,
-                        AHARDWAREBUFFER_CREATE_FROM_HANDLE_METHOD_CLONE, &hardwareBuffer);
-
-                if (status != NO_ERROR) {
-                    LOG(ERROR) << "Can't create AHardwareBuffer from handle. Error: " << status;
-                    return {};
-                }
+        // Claims the slot immediately so the frames delivered next will use
+        // another one.
+        slot->state = FramesSlot::CAPTURING;
+    }
 
-                mSession->mInputPointers[i].gpu_data_pointer = static_cast<void*>(hardwareBuffer);
+    // The slot is owned by this thread while it is CAPTURING, so the frames
+    // are copied without holding the lock and the previous frames can be
+    // stitched meanwhile.
+    const bool captured = mSession->captureFrames(buffers, slot);
 
-                // Keep a reference to the EVS graphic buffers, so we can
-                // release them after Surround View stitching is done.
-                mSession->mEvsGraphicBuffers = buffers;
-            }
+    bool queued = false;
+    {
+        scoped_lock<mutex> lock(mSession->mAccessLock);
+        if (captured && mSession->mStitchingDone) {
+            // The stream was stopped while the frames were being captured.
+            mSession->releaseEvsFrames(slot);
+            slot->state = FramesSlot::FREE;
+        } else if (captured) {
+            slot->sequenceId = sequenceId;
+            slot->state = FramesSlot::CAPTURED;
+            mSession->mCapturedSlots.push_back(
+                    static_cast<int>(slot - mSession->mFramesSlots.data()));
+            queued = true;
         } else {
-            for (int i = 0; i < kNumFrames; i++) {
-                LOG(DEBUG) << "Copying buffer from camera [" << buffers[indices[i]].deviceId
-                           << "] to Surround View Service";
-                mSession->copyFromBufferToPointers(buffers[indices[i]],
-                                                   mSession->mInputPointers[i]);
-            }
-
-            // On the CPU version, we do not need to hold the Graphic Buffers
-            // any more since they are copied already.
-            mCamera->doneWithFrame_1_1(buffers);
+            slot->state = FramesSlot::FREE;
         }
     }
 
     // Notify the session that a new set of frames is ready
-    mSession->mFramesSignal.notify_all();
+    if (queued) {
+        mSession->mFramesSignal.notify_all();
+    }
 
     ATRACE_END();
 
@@ -211,55 +191,160 @@ Return<void> SurroundView2dSession::FramesHandler::notify(const EvsEventDesc& ev
     return {};
 }
 
-bool SurroundView2dSession::copyFromBufferToPointers(
-    BufferDesc_1_1 buffer, SurroundViewInputBufferPointers pointers) {
+bool SurroundView2dSession::captureFrames(const hidl_vec<BufferDesc_1_1>& buffers,
+                                          FramesSlot* slot) {
     ATRACE_BEGIN(__PRETTY_FUNCTION__);
 
-    AHardwareBuffer_Desc* pDesc =
-        reinterpret_cast<AHardwareBuffer_Desc *>(&buffer.buffer.description);
+    if (buffers.size() != kNumFrames) {
+        LOG(ERROR) << "The number of incoming frames is " << buffers.size()
+                   << ", which is different from the number " << kNumFrames
+                   << ", specified in config file";
+        mCamera->doneWithFrame_1_1(buffers);
+        ATRACE_END();
+        return false;
+    }
 
-    ATRACE_BEGIN("Create Graphic Buffer");
-    // create a GraphicBuffer from the existing handle
-    sp<GraphicBuffer> inputBuffer = new GraphicBuffer(
-        buffer.buffer.nativeHandle, GraphicBuffer::CLONE_HANDLE, pDesc->width,
-        pDesc->height, pDesc->format, pDesc->layers,
-        GRALLOC_USAGE_HW_TEXTURE, pDesc->stride);
+    vector<int> indices;
+    for (const auto& id : mIOModuleConfig->cameraConfig.evsCameraIds) {
+        for (int i = 0; i < kNumFrames; i++) {
+            if (buffers[i].deviceId == id) {
+                indices.emplace_back(i);
+                break;
+            }
+        }
+    }
 
-    if (inputBuffer == nullptr) {
-        LOG(ERROR) << "Failed to allocate GraphicBuffer to wrap image handle";
-        // Returning "true" in this error condition because we already released the
-        // previous image (if any) and so the texture may change in unpredictable
-        // ways now!
+    if (indices.size() != kNumFrames) {
+        LOG(ERROR) << "The frames are not from the cameras we expected!";
+        mCamera->doneWithFrame_1_1(buffers);
+        ATRACE_END();
         return false;
+    }
+
+    // Keep a reference to the EVS graphic buffers, so we can release them
+    // after Surround View stitching is done.
+    slot->evsGraphicBuffers = buffers;
+
+    if (mGpuAccelerationEnabled) {
+        for (int i = 0; i < kNumFrames; i++) {
+            LOG(DEBUG) << "Importing graphic buffer from camera ["
+                       << buffers[indices[i]].deviceId << "]";
+            sp<GraphicBuffer> inputBuffer =
+                    mInputBufferCache.getGraphicBuffer(buffers[indices[i]]);
+            if (inputBuffer == nullptr) {
+                LOG(ERROR) << "Can't import the graphic buffer from camera ["
+                           << buffers[indices[i]].deviceId << "]";
+                releaseEvsFrames(slot);
+                ATRACE_END();
+                return false;
+            }
+
+            slot->inputPointers[i].gpu_data_pointer =
+                    static_cast<void*>(inputBuffer->toAHardwareBuffer());
+            slot->gpuInputBuffers.emplace_back(inputBuffer);
+        }
     } else {
-        LOG(INFO) << "Managed to allocate GraphicBuffer with "
-                  << " width: " << pDesc->width
-                  << " height: " << pDesc->height
-                  << " format: " << pDesc->format
-                  << " stride: " << pDesc->stride;
+        for (int i = 0; i < kNumFrames; i++) {
+            LOG(DEBUG) << "Mapping buffer from camera [" << buffers[indices[i]].deviceId
+                       << "] to Surround View Service";
+            if (!mapInputBuffer(buffers[indices[i]], slot, i)) {
+                releaseEvsFrames(slot);
+                ATRACE_END();
+                return false;
+            }
+        }
+
+        // We do not need to hold the Graphic Buffers any more if all of them
+        // are copied already.
+        if (slot->lockedInputBuffers.empty()) {
+            releaseEvsFrames(slot);
+        }
     }
+
     ATRACE_END();
 
+    return true;
+}
+
+void SurroundView2dSession::releaseEvsFrames(FramesSlot* slot) {
+    for (auto& inputBuffer : slot->lockedInputBuffers) {
+        inputBuffer->unlock();
+    }
+    slot->lockedInputBuffers.clear();
+
+    for (auto& pointers : slot->inputPointers) {
+        pointers.gpu_data_pointer = nullptr;
+    }
+    slot->gpuInputBuffers.clear();
+
+    if (slot->evsGraphicBuffers.size() > 0) {
+        mCamera->doneWithFrame_1_1(slot->evsGraphicBuffers);
+        slot->evsGraphicBuffers.resize(0);
+    }
+}
+
+bool SurroundView2dSession::mapInputBuffer(const BufferDesc_1_1& buffer, FramesSlot* slot,
+                                           int index) {
+    ATRACE_BEGIN(__PRETTY_FUNCTION__);
+
+    const AHardwareBuffer_Desc* pDesc =
+        reinterpret_cast<const AHardwareBuffer_Desc*>(&buffer.buffer.description);
+    SurroundViewInputBufferPointers& pointers = slot->inputPointers[index];
+    if (static_cast<int>(pDesc->width) != pointers.width ||
+        static_cast<int>(pDesc->height) != pointers.height) {
+        LOG(ERROR) << "Unexpected buffer size " << pDesc->width << "x" << pDesc->height
+                   << " from camera " << buffer.deviceId;
+        ATRACE_END();
+        return false;
+    }
+
+    sp<GraphicBuffer> inputBuffer = mInputBufferCache.getGraphicBuffer(buffer);
+    if (inputBuffer == nullptr) {
+        ATRACE_END();
+        return false;
+    }
+
     ATRACE_BEGIN("Lock input buffer (gpu to cpu)");
     // Lock the input GraphicBuffer and map it to a pointer.  If we failed to
     // lock, return false.
-    void* inputDataPtr;
+    void* inputDataPtr = nullptr;
     inputBuffer->lock(
         GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_NEVER,
         &inputDataPtr);
+    ATRACE_END();
     if (!inputDataPtr) {
         LOG(ERROR) << "Failed to gain read access to GraphicBuffer";
         inputBuffer->unlock();
+        ATRACE_END();
         return false;
-    } else {
-        LOG(INFO) << "Managed to get read access to GraphicBuffer";
     }
-    ATRACE_END();
+
+    // The core lib expects rows without padding, so only such buffers can be
+    // read in place.
+    if (mIOModuleConfig->cameraConfig.zeroCopyInputEnabled && pDesc->stride == pDesc->width) {
+        pointers.cpu_data_pointer = inputDataPtr;
+        slot->lockedInputBuffers.emplace_back(inputBuffer);
+        ATRACE_END();
+        return true;
+    }
 
     ATRACE_BEGIN("Copy input data");
-    // Both source and destination are with 4 channels
-    memcpy(pointers.cpu_data_pointer, inputDataPtr,
-           pDesc->height * pDesc->width * kInputNumChannels);
+    // Both source and destination are with 4 channels, while the source rows
+    // may be padded up to the stride.
+    pointers.cpu_data_pointer = slot->inputMemory[index];
+    const uint8_t* readPtr = static_cast<const uint8_t*>(inputDataPtr);
+    uint8_t* writePtr = static_cast<uint8_t*>(pointers.cpu_data_pointer);
+    const int readStride = pDesc->stride * kInputNumChannels;
+    const int writeStride = pDesc->width * kInputNumChannels;
+    if (readStride == writeStride) {
+        memcpy(writePtr, readPtr, writeStride * pDesc->height);
+    } else {
+        for (int i = 0; i < pDesc->height; i++) {
+            memcpy(writePtr, readPtr, writeStride);
+            writePtr = writePtr + writeStride;
+            readPtr = readPtr + readStride;
+        }
+    }
     LOG(DEBUG) << "Buffer copying finished";
     ATRACE_END();
 
@@ -277,22 +362,77 @@ void SurroundView2dSession::processFrames() {
     ATRACE_BEGIN(__PRETTY_FUNCTION__);
 
     while (true) {
+        FramesSlot* slot = nullptr;
         {
             unique_lock<mutex> lock(mAccessLock);
+            mFramesSignal.wait(lock, [this]() {
+                return !mCapturedSlots.empty() || mStreamState != RUNNING;
+            });
+
+            // The frames captured before the stream was stopped are still
+            // stitched and delivered.
+            if (mCapturedSlots.empty()) {
+                mStitchingDone = true;
+                break;
+            }
+
+            slot = &mFramesSlots[mCapturedSlots.front()];
+            mCapturedSlots.pop_front();
+            slot->state = FramesSlot::STITCHING;
+        }
 
-            if (mStreamState != RUNNING) {
+        const bool stitched = stitchFrames(slot);
+
+        {
+            scoped_lock<mutex> lock(mAccessLock);
+            if (stitched) {
+                slot->state = FramesSlot::STITCHED;
+                mStitchedSlots.push_back(static_cast<int>(slot - mFramesSlots.data()));
+            } else {
+                releaseEvsFrames(slot);
+                slot->state = FramesSlot::FREE;
+            }
+        }
+
+        if (stitched) {
+            mOutputSignal.notify_all();
+        }
+    }
+
+    mOutputSignal.notify_all();
+
+    ATRACE_END();
+}
+
+void SurroundView2dSession::outputFrames() {
+    ATRACE_BEGIN(__PRETTY_FUNCTION__);
+
+    while (true) {
+        FramesSlot* slot = nullptr;
+        {
+            unique_lock<mutex> lock(mAccessLock);
+            mOutputSignal.wait(lock, [this]() {
+                return !mStitchedSlots.empty() || mStitchingDone;
+            });
+
+            if (mStitchedSlots.empty()) {
                 break;
             }
 
-            mFramesSignal.wait(lock, [this]() { return mProcessingEvsFrames; });
+            slot = &mFramesSlots[mStitchedSlots.front()];
+            mStitchedSlots.pop_front();
         }
 
-        handleFrames(mSequenceId);
+        if (!copyToOutputBuffer(slot)) {
+            scoped_lock<mutex> lock(mAccessLock);
+            slot->state = FramesSlot::FREE;
+            continue;
+        }
 
         {
-            // Set the boolean to false to receive the next set of frames.
             scoped_lock<mutex> lock(mAccessLock);
-            mProcessingEvsFrames = false;
+            slot->state = FramesSlot::WITH_CLIENT;
+            mStream->receiveFrames(slot->frames);
         }
     }
 
@@ -314,7 +454,8 @@ SurroundView2dSession::SurroundView2dSession(sp<IEvsEnumerator> pEvs,
                                              IOModuleConfig* pConfig)
     : mEvs(pEvs),
       mIOModuleConfig(pConfig),
-      mStreamState(STOPPED) {}
+      mStreamState(STOPPED),
+      mStitchingDone(false) {}
 
 SurroundView2dSession::~SurroundView2dSession() {
     // In case the client did not call stopStream properly, we should stop the
@@ -322,14 +463,33 @@ SurroundView2dSession::~SurroundView2dSession() {
     // join.
     stopStream();
 
-    // Waiting for the process thread to finish the buffered frames.
+    // Waiting for the worker threads to finish the buffered frames.
     if (mProcessThread.joinable()) {
         mProcessThread.join();
     }
+    if (mOutputThread.joinable()) {
+        mOutputThread.join();
+    }
+
+    // Stops building the projection lookup tables, if still in progress.
+    {
+        scoped_lock<mutex> lock(mSurroundViewLock);
+        mProjectionLutsStopping = true;
+        if (mProjectionLuts != nullptr) {
+            for (auto& projectionLut : mProjectionLuts->luts) {
+                projectionLut->cancel();
+            }
+        }
+    }
+    mProjectionLutsSignal.notify_all();
+    if (mProjectionLutThread.joinable()) {
+        mProjectionLutThread.join();
+    }
 
     mEvs->closeCamera(mCamera);
 
-    // TODO(b/175176576): properly release the mInputPointers and mOutputPointer
+    // TODO(b/175176576): properly release the input and output pointers of
+    // mFramesSlots
 }
 
 // Methods from ::android::hardware::automotive::sv::V1_0::ISurroundViewSession
@@ -357,6 +517,11 @@ Return<SvResult> SurroundView2dSession::startStream(
     mStream = stream;
 
     mSequenceId = 0;
+
+    // The cameras may deliver other buffers in the new stream. Each camera
+    // has at most a set of frames per slot, and one more, in flight.
+    mInputBufferCache.clear();
+    mInputBufferCache.setMaxBuffersPerDevice(mFramesSlots.size() + 1);
     startEvs();
 
     // TODO(b/158131080): the STREAM_STARTED event is not implemented in EVS
@@ -364,14 +529,25 @@ Return<SvResult> SurroundView2dSession::startStream(
     // moved to EVS notify callback.
     LOG(DEBUG) << "Notify SvEvent::STREAM_STARTED";
     mStream->notify(SvEvent::STREAM_STARTED);
-    mProcessingEvsFrames = false;
+    mStitchingDone = false;
 
-    // Start the frame generation thread
+    // Start the frame generation threads
     mStreamState = RUNNING;
 
+    // The threads of a previous stream have finished once it is STOPPED.
+    if (mProcessThread.joinable()) {
+        mProcessThread.join();
+    }
+    if (mOutputThread.joinable()) {
+        mOutputThread.join();
+    }
+
     mProcessThread = thread([this]() {
         processFrames();
     });
+    mOutputThread = thread([this]() {
+        outputFrames();
+    });
 
     return SvResult::OK;
 }
@@ -387,6 +563,9 @@ Return<void> SurroundView2dSession::stopStream() {
         // Stop the EVS stream asynchronizely
         mCamera->stopVideoStream();
         mFramesHandler = nullptr;
+
+        // Wake up processFrames in case no more frames arrive
+        mFramesSignal.notify_all();
     }
 
     return {};
@@ -397,9 +576,16 @@ Return<void> SurroundView2dSession::doneWithFrames(
     LOG(DEBUG) << __FUNCTION__;
     scoped_lock <mutex> lock(mAccessLock);
 
-    mFramesRecord.inUse = false;
+    for (auto& slot : mFramesSlots) {
+        if (slot.state == FramesSlot::WITH_CLIENT &&
+            slot.frames.sequenceId == svFramesDesc.sequenceId) {
+            slot.state = FramesSlot::FREE;
+            return {};
+        }
+    }
 
-    (void)svFramesDesc;
+    LOG(WARNING) << "Frames of an unknown sequenceId " << svFramesDesc.sequenceId
+                 << " are returned. Ignored!";
     return {};
 }
 
@@ -427,6 +613,11 @@ Return<SvResult> SurroundView2dSession::set2dConfig(
     mConfig.blending = sv2dConfig.blending;
     mHeight = mConfig.width * mInfo.height / mInfo.width;
 
+    // Allocate the output buffers of the new resolution ahead of the frames.
+    if (mOutputBufferPool != nullptr) {
+        mOutputBufferPool->prepare(mConfig.width, mHeight);
+    }
+
     if (mStream != nullptr) {
         LOG(DEBUG) << "Notify SvEvent::CONFIG_UPDATED";
         mStream->notify(SvEvent::CONFIG_UPDATED);
@@ -467,6 +658,7 @@ Return<void> SurroundView2dSession::projectCameraPoints(const hidl_vec<Point2dIn
 
     int width = mConfig.width;
     int height = mHeight;
+    scoped_lock<mutex> lock(mSurroundViewLock);
     for (const auto& cameraPoint : points2dCamera) {
         Point2dFloat outPoint = {false, 0.0, 0.0};
         // Check of the camear point is within the camera resolution bounds.
@@ -479,8 +671,21 @@ Return<void> SurroundView2dSession::projectCameraPoints(const hidl_vec<Point2dIn
             continue;
         }
 
-        // Project points using mSurroundView function.
+        // Interpolate the projection from the lookup table when possible. The
+        // tables are replaced along with the output resolution of the core
+        // lib, so they are never of another resolution.
         const Coordinate2dInteger camPoint(cameraPoint.x, cameraPoint.y);
+        float lutPoint[2];
+        if (mProjectionLuts != nullptr &&
+            mProjectionLuts->luts[cameraIndex]->lookup(camPoint, lutPoint)) {
+            outPoint.isValid = true;
+            outPoint.x = lutPoint[0];
+            outPoint.y = lutPoint[1];
+            outPoints.push_back(outPoint);
+            continue;
+        }
+
+        // Project points using mSurroundView function.
         Coordinate2dFloat projPoint2d(0.0, 0.0);
 
         outPoint.isValid =
@@ -496,94 +701,140 @@ Return<void> SurroundView2dSession::projectCameraPoints(const hidl_vec<Point2dIn
     return {};
 }
 
-// TODO(b/175176765): implement a GPU version of this method separately.
-bool SurroundView2dSession::handleFrames(int sequenceId) {
-    LOG(INFO) << __FUNCTION__ << "Handling sequenceId " << sequenceId << ".";
+bool SurroundView2dSession::allocateOutputBuffer(FramesSlot* slot, int width, int height) {
+    if (mGpuAccelerationEnabled) {
+        slot->outputPointer.width = width;
+        slot->outputPointer.height = height;
+        slot->outputBuffer = new GraphicBuffer(width, height, HAL_PIXEL_FORMAT_RGBA_8888, 1,
+                                               GRALLOC_USAGE_HW_TEXTURE, "SvOutputHolder");
+        if (slot->outputBuffer->initCheck() == OK) {
+            LOG(INFO) << "Successfully allocated Graphic Buffer for SvOutputHolder";
+        } else {
+            LOG(ERROR) << "Failed to allocate Graphic Buffer for SvOutputHolder";
+            return false;
+        }
+        slot->outputPointer.gpu_data_pointer =
+                static_cast<void*>(slot->outputBuffer->toAHardwareBuffer());
+    } else {
+        // Give the buffers of the previous resolution back to the pool.
+        if (slot->outputBuffer != nullptr) {
+            OutputBuffer previousBuffer;
+            previousBuffer.width = slot->outputPointer.width;
+            previousBuffer.height = slot->outputPointer.height;
+            previousBuffer.memory.reset(static_cast<char*>(slot->outputPointer.cpu_data_pointer));
+            previousBuffer.texture = slot->outputBuffer;
+            mOutputBufferPool->release(std::move(previousBuffer));
+            slot->outputPointer.cpu_data_pointer = nullptr;
+            slot->outputBuffer = nullptr;
+        }
 
-    ATRACE_BEGIN(__PRETTY_FUNCTION__);
+        OutputBuffer buffer;
+        if (!mOutputBufferPool->acquire(width, height, &buffer)) {
+            LOG(ERROR) << "Failed to allocate the output buffers";
+            return false;
+        }
+        slot->outputPointer.width = width;
+        slot->outputPointer.height = height;
+        slot->outputPointer.format = Format::RGB;
+        slot->outputPointer.cpu_data_pointer = static_cast<void*>(buffer.memory.release());
+        slot->outputBuffer = buffer.texture;
+    }
 
-    // TODO(b/157498592): Now only one sets of EVS input frames and one SV
-    // output frame is supported. Implement buffer queue for both of them.
-    {
-        scoped_lock<mutex> lock(mAccessLock);
+    return true;
+}
 
-        if (mFramesRecord.inUse) {
-            LOG(DEBUG) << "Notify SvEvent::FRAME_DROPPED";
-            mStream->notify(SvEvent::FRAME_DROPPED);
+// TODO(b/175176765): implement a GPU version of this method separately.
+bool SurroundView2dSession::stitchFrames(FramesSlot* slot) {
+    LOG(INFO) << __FUNCTION__ << "Handling sequenceId " << slot->sequenceId << ".";
 
-            // For GPU solution only (the frames were released already for CPU solution).
-            if (mGpuAccelerationEnabled) {
-                mCamera->doneWithFrame_1_1(mEvsGraphicBuffers);
-            }
-            return true;
-        }
-    }
+    ATRACE_BEGIN(__PRETTY_FUNCTION__);
 
     // TODO(b/175177030): modifying the width/length on the fly is not supported by the GPU approach
     // yet.
     if (!mGpuAccelerationEnabled) {
-        if (mOutputWidth != mConfig.width || mOutputHeight != mHeight) {
-            LOG(DEBUG) << "Config changed. Re-allocate memory."
-                       << " Old width: " << mOutputWidth << " Old height: " << mOutputHeight
-                       << " New width: " << mConfig.width << " New height: " << mHeight;
-            delete[] static_cast<char*>(mOutputPointer.cpu_data_pointer);
-            mOutputWidth = mConfig.width;
-            mOutputHeight = mHeight;
-            mOutputPointer.height = mOutputHeight;
-            mOutputPointer.width = mOutputWidth;
-            mOutputPointer.format = Format::RGB;
-            mOutputPointer.cpu_data_pointer =
-                    static_cast<void*>(new char[mOutputHeight * mOutputWidth * kOutputNumChannels]);
-
-            if (!mOutputPointer.cpu_data_pointer) {
-                LOG(ERROR) << "Memory allocation failed. Exiting.";
-                return false;
-            }
-
-            Size2dInteger size = Size2dInteger(mOutputWidth, mOutputHeight);
-            mSurroundView->Update2dOutputResolution(size);
+        int width, height;
+        {
+            scoped_lock<mutex> lock(mAccessLock);
+            width = mConfig.width;
+            height = mHeight;
+        }
 
-            mSvTexture = new GraphicBuffer(mOutputWidth, mOutputHeight, HAL_PIXEL_FORMAT_RGB_888, 1,
-                                           GRALLOC_USAGE_HW_TEXTURE, "SvTexture");
-            if (mSvTexture->initCheck() == OK) {
-                LOG(INFO) << "Successfully allocated Graphic Buffer";
+        // The frames are stitched at the previous resolution until the output
+        // buffers of the new one are allocated in the background.
+        if (mOutputWidth != width || mOutputHeight != height) {
+            if (!mOutputBufferPool->isReady(width, height)) {
+                LOG(DEBUG) << "Output buffers of " << width << "x" << height
+                           << " are not ready yet.";
+                mOutputBufferPool->prepare(width, height);
             } else {
-                LOG(ERROR) << "Failed to allocate Graphic Buffer";
+                LOG(DEBUG) << "Config changed. Update the output resolution."
+                           << " Old width: " << mOutputWidth << " Old height: " << mOutputHeight
+                           << " New width: " << width << " New height: " << height;
+                mOutputWidth = width;
+                mOutputHeight = height;
+
+                Size2dInteger size = Size2dInteger(mOutputWidth, mOutputHeight);
+                scoped_lock<mutex> lock(mSurroundViewLock);
+                mSurroundView->Update2dOutputResolution(size);
+                if (mProjectionLuts != nullptr) {
+                    resetProjectionLuts(mOutputWidth, mOutputHeight);
+                }
+            }
+        }
+
+        // Each slot keeps the buffers of the resolution it was last stitched
+        // at, and swaps them with pooled ones when it is reused.
+        if (slot->outputPointer.width != mOutputWidth ||
+            slot->outputPointer.height != mOutputHeight) {
+            LOG(DEBUG) << "Re-allocate the output buffers of the frame slot.";
+            if (!allocateOutputBuffer(slot, mOutputWidth, mOutputHeight)) {
+                ATRACE_END();
                 return false;
             }
         }
-        LOG(INFO) << "Output Pointer data format: " << mOutputPointer.format;
+        LOG(INFO) << "Output Pointer data format: " << slot->outputPointer.format;
     }
 
     ATRACE_BEGIN("SV core lib method: Get2dSurroundView");
     const string gpuEnabledText = mGpuAccelerationEnabled ? " with GPU acceleration flag enabled"
                                                           : " with GPU acceleration flag disabled";
-    if (mSurroundView->Get2dSurroundView(mInputPointers, &mOutputPointer)) {
+    bool stitched;
+    {
+        scoped_lock<mutex> lock(mSurroundViewLock);
+        stitched = mSurroundView->Get2dSurroundView(slot->inputPointers, &slot->outputPointer);
+    }
+    if (stitched) {
         LOG(INFO) << "Get2dSurroundView succeeded" << gpuEnabledText;
     } else {
         LOG(ERROR) << "Get2dSurroundView failed" << gpuEnabledText;
     }
     ATRACE_END();
 
-    // For GPU solution only (the frames were released already for CPU solution).
-    if (mGpuAccelerationEnabled) {
-        ATRACE_BEGIN("Release the evs frames");
-        mCamera->doneWithFrame_1_1(mEvsGraphicBuffers);
-        ATRACE_END();
-    }
+    // The frames were released already unless the GPU solution imported them
+    // or they are read in place.
+    ATRACE_BEGIN("Release the evs frames");
+    releaseEvsFrames(slot);
+    ATRACE_END();
 
-    ANativeWindowBuffer* buffer;
-    if (mGpuAccelerationEnabled) {
-        buffer = mOutputHolder->getNativeBuffer();
-    } else {
+    ATRACE_END();
+
+    return stitched;
+}
+
+bool SurroundView2dSession::copyToOutputBuffer(FramesSlot* slot) {
+    ATRACE_BEGIN(__PRETTY_FUNCTION__);
+
+    const sp<GraphicBuffer>& outputBuffer = slot->outputBuffer;
+    if (!mGpuAccelerationEnabled) {
         ATRACE_BEGIN("Lock output texture (gpu to cpu)");
         void* textureDataPtr = nullptr;
-        mSvTexture->lock(GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_SW_READ_NEVER,
-                         &textureDataPtr);
+        outputBuffer->lock(GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_SW_READ_NEVER,
+                           &textureDataPtr);
         ATRACE_END();
 
         if (!textureDataPtr) {
             LOG(ERROR) << "Failed to gain write access to GraphicBuffer!";
+            ATRACE_END();
             return false;
         }
 
@@ -593,13 +844,13 @@ bool SurroundView2dSession::handleFrames(int sequenceId) {
         // width is 1080, but the stride is 2048. So we'd better copy the data line
         // by line, instead of single memcpy.
         uint8_t* writePtr = static_cast<uint8_t*>(textureDataPtr);
-        uint8_t* readPtr = static_cast<uint8_t*>(mOutputPointer.cpu_data_pointer);
-        const int readStride = mOutputWidth * kOutputNumChannels;
-        const int writeStride = mSvTexture->getStride() * kOutputNumChannels;
+        uint8_t* readPtr = static_cast<uint8_t*>(slot->outputPointer.cpu_data_pointer);
+        const int readStride = slot->outputPointer.width * kOutputNumChannels;
+        const int writeStride = outputBuffer->getStride() * kOutputNumChannels;
         if (readStride == writeStride) {
-            memcpy(writePtr, readPtr, readStride * mSvTexture->getHeight());
+            memcpy(writePtr, readPtr, readStride * outputBuffer->getHeight());
         } else {
-            for (int i = 0; i < mSvTexture->getHeight(); i++) {
+            for (int i = 0; i < outputBuffer->getHeight(); i++) {
                 memcpy(writePtr, readPtr, readStride);
                 writePtr = writePtr + writeStride;
                 readPtr = readPtr + readStride;
@@ -609,42 +860,29 @@ bool SurroundView2dSession::handleFrames(int sequenceId) {
         ATRACE_END();
 
         ATRACE_BEGIN("Unlock output texture (cpu to gpu)");
-        mSvTexture->unlock();
+        outputBuffer->unlock();
         ATRACE_END();
-
-        buffer = mSvTexture->getNativeBuffer();
-        LOG(DEBUG) << "ANativeWindowBuffer->handle: " << buffer->handle;
     }
 
-    {
-        scoped_lock<mutex> lock(mAccessLock);
-
-        mFramesRecord.frames.svBuffers.resize(1);
-        SvBuffer& svBuffer = mFramesRecord.frames.svBuffers[0];
-        svBuffer.viewId = kSv2dViewId;
-        svBuffer.hardwareBuffer.nativeHandle = buffer->handle;
-        AHardwareBuffer_Desc* pDesc =
-            reinterpret_cast<AHardwareBuffer_Desc*>(
-                &svBuffer.hardwareBuffer.description);
-        if (mGpuAccelerationEnabled) {
-            pDesc->width = mOutputPointer.width;
-            pDesc->height = mOutputPointer.height;
-            pDesc->stride = mOutputHolder->getStride();
-            pDesc->format = HAL_PIXEL_FORMAT_RGBA_8888;
-        } else {
-            pDesc->width = mOutputWidth;
-            pDesc->height = mOutputHeight;
-            pDesc->stride = mSvTexture->getStride();
-            pDesc->format = HAL_PIXEL_FORMAT_RGB_888;
-        }
-        pDesc->layers = 1;
-        pDesc->usage = GRALLOC_USAGE_HW_TEXTURE;
-        mFramesRecord.frames.timestampNs = elapsedRealtimeNano();
-        mFramesRecord.frames.sequenceId = sequenceId;
+    ANativeWindowBuffer* buffer = outputBuffer->getNativeBuffer();
+    LOG(DEBUG) << "ANativeWindowBuffer->handle: " << buffer->handle;
 
-        mFramesRecord.inUse = true;
-        mStream->receiveFrames(mFramesRecord.frames);
-    }
+    slot->frames.svBuffers.resize(1);
+    SvBuffer& svBuffer = slot->frames.svBuffers[0];
+    svBuffer.viewId = kSv2dViewId;
+    svBuffer.hardwareBuffer.nativeHandle = buffer->handle;
+    AHardwareBuffer_Desc* pDesc =
+        reinterpret_cast<AHardwareBuffer_Desc*>(
+            &svBuffer.hardwareBuffer.description);
+    pDesc->width = slot->outputPointer.width;
+    pDesc->height = slot->outputPointer.height;
+    pDesc->stride = outputBuffer->getStride();
+    pDesc->format = mGpuAccelerationEnabled ? HAL_PIXEL_FORMAT_RGBA_8888
+                                            : HAL_PIXEL_FORMAT_RGB_888;
+    pDesc->layers = 1;
+    pDesc->usage = GRALLOC_USAGE_HW_TEXTURE;
+    slot->frames.timestampNs = elapsedRealtimeNano();
+    slot->frames.sequenceId = slot->sequenceId;
 
     ATRACE_END();
 
@@ -695,24 +933,6 @@ bool SurroundView2dSession::initialize() {
     }
     ATRACE_END();
 
-    ATRACE_BEGIN("Allocate cpu buffers");
-    mInputPointers.resize(kNumFrames);
-    for (int i = 0; i < kNumFrames; i++) {
-        mInputPointers[i].width = mCameraParams[i].size.width;
-        mInputPointers[i].height = mCameraParams[i].size.height;
-
-        // Only allocate CPU memory for CPU solution
-        // For GPU solutions, the Graphic Buffers from EVS will be converted and
-        // stored in gpu_data_pointer
-        if (!mGpuAccelerationEnabled) {
-            mInputPointers[i].format = Format::RGBA;
-            mInputPointers[i].cpu_data_pointer =
-                    static_cast<void*>(new char[mInputPointers[i].width * mInputPointers[i].height *
-                                                kInputNumChannels]);
-        }
-    }
-    LOG(INFO) << "Allocated " << kNumFrames << " input pointers";
-
     mOutputWidth = mIOModuleConfig->sv2dConfig.sv2dParams.resolution.width;
     mOutputHeight = mIOModuleConfig->sv2dConfig.sv2dParams.resolution.height;
 
@@ -720,43 +940,40 @@ bool SurroundView2dSession::initialize() {
     mConfig.blending = SvQuality::HIGH;
     mHeight = mOutputHeight;
 
-    mOutputPointer.height = mOutputHeight;
-    mOutputPointer.width = mOutputWidth;
-
-    // Only allocate CPU memory for CPU solution
+    // Every slot holds a complete set of input and output buffers, so up to
+    // framesQueueDepth sets of frames are in flight at once.
+    ATRACE_BEGIN("Allocate frame slots");
     if (!mGpuAccelerationEnabled) {
-        mOutputPointer.format = Format::RGB;
-        mOutputPointer.cpu_data_pointer =
-                static_cast<void*>(new char[mOutputHeight * mOutputWidth * kOutputNumChannels]);
-
-        if (!mOutputPointer.cpu_data_pointer) {
-            LOG(ERROR) << "Memory allocation failed. Exiting.";
-            return false;
-        }
+        mOutputBufferPool = std::make_unique<OutputBufferPool>(
+                mIOModuleConfig->sv2dConfig.framesQueueDepth, kMaxCachedOutputResolutions);
     }
-    ATRACE_END();
-
-    ATRACE_BEGIN("Allocate output texture");
-    if (mGpuAccelerationEnabled) {
-        mOutputHolder = new GraphicBuffer(mOutputWidth, mOutputHeight, HAL_PIXEL_FORMAT_RGBA_8888,
-                                          1, GRALLOC_USAGE_HW_TEXTURE, "SvOutputHolder");
-        if (mOutputHolder->initCheck() == OK) {
-            LOG(INFO) << "Successfully allocated Graphic Buffer for SvOutputHolder";
-        } else {
-            LOG(ERROR) << "Failed to allocate Graphic Buffer for SvOutputHolder";
-            return false;
+    mFramesSlots.resize(mIOModuleConfig->sv2dConfig.framesQueueDepth);
+    for (auto& slot : mFramesSlots) {
+        slot.inputPointers.resize(kNumFrames);
+        for (int i = 0; i < kNumFrames; i++) {
+            slot.inputPointers[i].width = mCameraParams[i].size.width;
+            slot.inputPointers[i].height = mCameraParams[i].size.height;
+
+            // Only allocate CPU memory for CPU solution
+            // For GPU solutions, the Graphic Buffers from EVS will be converted and
+            // stored in gpu_data_pointer
+            if (!mGpuAccelerationEnabled) {
+                slot.inputPointers[i].format = Format::RGBA;
+                slot.inputMemory.emplace_back(
+                        static_cast<void*>(new char[slot.inputPointers[i].width *
+                                                    slot.inputPointers[i].height *
+                                                    kInputNumChannels]));
+                slot.inputPointers[i].cpu_data_pointer = slot.inputMemory[i];
+            }
         }
-        mOutputPointer.gpu_data_pointer = static_cast<void*>(mOutputHolder->toAHardwareBuffer());
-    } else {
-        mSvTexture = new GraphicBuffer(mOutputWidth, mOutputHeight, HAL_PIXEL_FORMAT_RGB_888, 1,
-                                       GRALLOC_USAGE_HW_TEXTURE, "SvTexture");
-        if (mSvTexture->initCheck() == OK) {
-            LOG(INFO) << "Successfully allocated Graphic Buffer";
-        } else {
-            LOG(ERROR) << "Failed to allocate Graphic Buffer";
+
+        if (!allocateOutputBuffer(&slot, mOutputWidth, mOutputHeight)) {
             return false;
         }
     }
+    LOG(INFO) << "Allocated " << mFramesSlots.size() << " frame slots of "
+              << kNumFrames << " input pointers";
+    ATRACE_END();
 
     // Note: sv2dParams is in meters while mInfo must be in milli-meters.
     mInfo.width = mIOModuleConfig->sv2dConfig.sv2dParams.physical_size.width * 1000.0;
@@ -765,6 +982,15 @@ bool SurroundView2dSession::initialize() {
     mInfo.center.x = mIOModuleConfig->sv2dConfig.sv2dParams.physical_center.x * 1000.0;
     mInfo.center.y = mIOModuleConfig->sv2dConfig.sv2dParams.physical_center.y * 1000.0;
 
+    // Points are projected exactly until the lookup tables are built.
+    if (mIOModuleConfig->cameraConfig.projectionLutGridStep > 0) {
+        {
+            scoped_lock<mutex> surroundViewLock(mSurroundViewLock);
+            resetProjectionLuts(mOutputWidth, mOutputHeight);
+        }
+        mProjectionLutThread = thread([this]() { buildProjectionLuts(); });
+    }
+
     mIsInitialized = true;
 
     ATRACE_END();
@@ -772,6 +998,87 @@ bool SurroundView2dSession::initialize() {
     return true;
 }
 
+void SurroundView2dSession::waitForProjectionLuts() {
+    unique_lock<mutex> lock(mSurroundViewLock);
+    mProjectionLutsSignal.wait(lock, [this]() { return mBuiltProjectionLuts == mProjectionLuts; });
+}
+
+void SurroundView2dSession::resetProjectionLuts(int width, int height) {
+    if (mProjectionLuts != nullptr) {
+        if (mProjectionLuts->width == width && mProjectionLuts->height == height) {
+            return;
+        }
+        for (auto& projectionLut : mProjectionLuts->luts) {
+            projectionLut->cancel();
+        }
+    }
+
+    auto projectionLuts = std::make_shared<ProjectionLuts>();
+    projectionLuts->width = width;
+    projectionLuts->height = height;
+    const int gridStep = mIOModuleConfig->cameraConfig.projectionLutGridStep;
+    for (int i = 0; i < kNumFrames; i++) {
+        projectionLuts->luts.push_back(std::make_unique<ProjectionLut>(
+                mCameraParams[i].size.width, mCameraParams[i].size.height, gridStep, 2));
+    }
+    mProjectionLuts = std::move(projectionLuts);
+    mProjectionLutsSignal.notify_all();
+}
+
+void SurroundView2dSession::buildProjectionLuts() {
+    while (true) {
+        std::shared_ptr<ProjectionLuts> projectionLuts;
+        {
+            unique_lock<mutex> lock(mSurroundViewLock);
+            mProjectionLutsSignal.wait(lock, [this]() {
+                return mProjectionLutsStopping || mBuiltProjectionLuts != mProjectionLuts;
+            });
+            if (mProjectionLutsStopping) {
+                return;
+            }
+            projectionLuts = mProjectionLuts;
+        }
+
+        ATRACE_BEGIN(__PRETTY_FUNCTION__);
+
+        // The tables are cancelled when the output resolution changes, and
+        // the ones of the new resolution are built next. The core lib is
+        // locked per point only, so that stitching goes on meanwhile.
+        bool isBuilt = true;
+        for (int i = 0; isBuilt && i < projectionLuts->luts.size(); i++) {
+            isBuilt = projectionLuts->luts[i]->build(
+                    [this, i](const Coordinate2dInteger& cameraPoint, float* values) {
+                        Coordinate2dFloat projPoint2d(0.0, 0.0);
+                        scoped_lock<mutex> lock(mSurroundViewLock);
+                        if (!mSurroundView->GetProjectionPointFromRawCameraToSurroundView2d(
+                                    cameraPoint, i, &projPoint2d)) {
+                            return false;
+                        }
+                        values[0] = projPoint2d.x;
+                        values[1] = projPoint2d.y;
+                        return true;
+                    });
+            if (isBuilt) {
+                LOG(INFO) << "Projection lookup table of camera " << i << " is built for "
+                          << projectionLuts->width << "x" << projectionLuts->height << ".";
+            }
+        }
+
+        ATRACE_END();
+
+        // Tables replaced while being built are never marked as built, even
+        // if they completed, since their last points may be of the new
+        // resolution.
+        {
+            scoped_lock<mutex> lock(mSurroundViewLock);
+            if (isBuilt && projectionLuts == mProjectionLuts) {
+                mBuiltProjectionLuts = projectionLuts;
+            }
+        }
+        mProjectionLutsSignal.notify_all();
+    }
+}
+
 bool SurroundView2dSession::setupEvs() {
     ATRACE_BEGIN(__PRETTY_FUNCTION__);
 
@@ -887,6 +1194,16 @@ bool SurroundView2dSession::setupEvs() {
 bool SurroundView2dSession::startEvs() {
     ATRACE_BEGIN(__PRETTY_FUNCTION__);
 
+    // Each slot may hold a set of EVS frames until it is stitched, and one
+    // more set is being delivered.
+    const bool holdsEvsFrames = mGpuAccelerationEnabled ||
+                                mIOModuleConfig->cameraConfig.zeroCopyInputEnabled;
+    if (holdsEvsFrames &&
+        mCamera->setMaxFramesInFlight(mFramesSlots.size() + 1) != EvsResult::OK) {
+        LOG(WARNING) << "Failed to hold " << mFramesSlots.size() + 1
+                     << " frames in flight. Frames may be delayed.";
+    }
+
     mFramesHandler = new FramesHandler(mCamera, this);
     Return<EvsResult> result = mCamera->startVideoStream(mFramesHandler);
     if (result != EvsResult::OK) {
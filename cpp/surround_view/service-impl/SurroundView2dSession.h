@@ -17,6 +17,9 @@
 #pragma once
 
 #include "IOModule.h"
+#include "InputBufferCache.h"
+#include "OutputBufferPool.h"
+#include "ProjectionLut.h"
 
 #include <android/hardware/automotive/evs/1.1/IEvsCamera.h>
 #include <android/hardware/automotive/evs/1.1/IEvsCameraStream.h>
@@ -30,6 +33,8 @@
 
 #include <ui/GraphicBuffer.h>
 
+#include <deque>
+#include <memory>
 #include <thread>
 
 using namespace ::android::hardware::automotive::evs::V1_1;
@@ -83,6 +88,11 @@ public:
     ~SurroundView2dSession();
     bool initialize();
 
+    // Blocks until the projection lookup tables of the current output
+    // resolution are built. Meant for tests, must not be called concurrently
+    // with the destructor.
+    void waitForProjectionLuts();
+
     // Methods from ::android::hardware::automotive::sv::V1_0::ISurroundViewSession.
     Return<SvResult> startStream(
         const sp<ISurroundViewStream>& stream) override;
@@ -99,18 +109,83 @@ public:
         projectCameraPoints_cb _hidl_cb) override;
 
 private:
+    // A set of EVS input frames and the Surround View result stitched from
+    // them. Each stage of the pipeline owns a slot only while the slot is in
+    // the state of that stage, so consecutive frames are captured, stitched,
+    // copied and consumed by the client concurrently.
+    struct FramesSlot {
+        enum State {
+            FREE,
+            CAPTURING,      // EVS frames are being copied or imported
+            CAPTURED,       // Queued for stitching
+            STITCHING,      // Owned by the core lib
+            STITCHED,       // Queued for the output copy
+            WITH_CLIENT,    // Delivered; waiting for doneWithFrames
+        };
+
+        State state = FREE;
+        int sequenceId = 0;
+
+        std::vector<SurroundViewInputBufferPointers> inputPointers;
+        SurroundViewResultPointer outputPointer;
+
+        // For the CPU solution only. The memory the EVS frames are copied to,
+        // unless inputPointers refer to the EVS buffers in place, in which
+        // case the buffers stay locked until the stitching is done.
+        std::vector<void*> inputMemory;
+        std::vector<sp<GraphicBuffer>> lockedInputBuffers;
+
+        // For the GPU solution only. Keeps the imported EVS buffers, which
+        // own the AHardwareBuffers in inputPointers, until the stitching is
+        // done.
+        std::vector<sp<GraphicBuffer>> gpuInputBuffers;
+
+        // SvTexture on the CPU solution, SvOutputHolder on the GPU solution.
+        // On the CPU solution, it and the memory of outputPointer are taken
+        // from mOutputBufferPool.
+        sp<GraphicBuffer> outputBuffer;
+
+        // The EVS frames held by the slot; returned once the stitching is
+        // done.
+        hidl_vec<BufferDesc_1_1> evsGraphicBuffers;
+
+        SvFramesDesc frames;
+    };
+
+    // Stitches the captured slots; runs on mProcessThread.
     void processFrames();
 
+    // Copies the stitched slots to their output buffers and delivers them;
+    // runs on mOutputThread.
+    void outputFrames();
+
     // Set up and open the Evs camera(s), triggered when session is created.
     bool setupEvs();
 
     // Start Evs camera video stream, triggered when SV stream is started.
     bool startEvs();
 
-    bool handleFrames(int sequenceId);
+    bool captureFrames(const hidl_vec<BufferDesc_1_1>& buffers, FramesSlot* slot);
+    bool stitchFrames(FramesSlot* slot);
+    bool copyToOutputBuffer(FramesSlot* slot);
 
-    bool copyFromBufferToPointers(BufferDesc_1_1 buffer,
-                                  SurroundViewInputBufferPointers pointers);
+    // Releases the imported or locked EVS frames of a slot, if any.
+    void releaseEvsFrames(FramesSlot* slot);
+
+    // Replaces the output buffers of a slot with ones of the given resolution.
+    bool allocateOutputBuffer(FramesSlot* slot, int width, int height);
+
+    // Builds mProjectionLuts whenever they are replaced, until the session is
+    // destroyed; runs on mProjectionLutThread.
+    void buildProjectionLuts();
+
+    // Replaces mProjectionLuts with tables of the given output resolution,
+    // which mProjectionLutThread then builds.
+    void resetProjectionLuts(int width, int height) REQUIRES(mSurroundViewLock);
+
+    // Makes the input pointers of a slot refer to the content of an EVS
+    // buffer, either in place or through a copy.
+    bool mapInputBuffer(const BufferDesc_1_1& buffer, FramesSlot* slot, int index);
 
     enum StreamStateValues {
         STOPPED,
@@ -133,23 +208,28 @@ private:
     sp<ISurroundViewStream> mStream GUARDED_BY(mAccessLock);
     StreamStateValues mStreamState GUARDED_BY(mAccessLock);
 
-    std::thread mProcessThread; // The thread we'll use to process frames
+    std::thread mProcessThread; // The thread we'll use to stitch frames
+    std::thread mOutputThread;  // The thread we'll use to deliver frames
 
     // Reference to the inner class, to handle the incoming Evs frames
     sp<FramesHandler> mFramesHandler;
 
-    // Used to signal a set of frames is ready
+    // Used to signal a set of frames is ready to be stitched
     condition_variable mFramesSignal GUARDED_BY(mAccessLock);
-    bool mProcessingEvsFrames GUARDED_BY(mAccessLock);
+
+    // Used to signal a set of frames is ready to be delivered
+    condition_variable mOutputSignal GUARDED_BY(mAccessLock);
+
+    // Set once mProcessThread has drained mCapturedSlots after a stop request
+    bool mStitchingDone GUARDED_BY(mAccessLock);
 
     int mSequenceId;
 
-    struct FramesRecord {
-        SvFramesDesc frames;
-        bool inUse = false;
-    };
+    std::vector<FramesSlot> mFramesSlots GUARDED_BY(mAccessLock);
 
-    FramesRecord mFramesRecord GUARDED_BY(mAccessLock);
+    // Indices into mFramesSlots, in the order of their sequence ids
+    std::deque<int> mCapturedSlots GUARDED_BY(mAccessLock);
+    std::deque<int> mStitchedSlots GUARDED_BY(mAccessLock);
 
     // Synchronization necessary to deconflict mCaptureThread from the main
     // service thread
@@ -159,24 +239,46 @@ private:
 
     std::unique_ptr<SurroundView> mSurroundView GUARDED_BY(mAccessLock);
 
-    std::vector<SurroundViewInputBufferPointers>
-        mInputPointers GUARDED_BY(mAccessLock);
-    SurroundViewResultPointer mOutputPointer GUARDED_BY(mAccessLock);
-
     Sv2dConfig mConfig GUARDED_BY(mAccessLock);
     int mHeight GUARDED_BY(mAccessLock);
 
     // TODO(b/158479099): Rename it to mMappingInfo
     Sv2dMappingInfo mInfo GUARDED_BY(mAccessLock);
-    int mOutputWidth, mOutputHeight GUARDED_BY(mAccessLock);
-    sp<GraphicBuffer> mOutputHolder;
 
-    sp<GraphicBuffer> mSvTexture GUARDED_BY(mAccessLock);
+    // The output resolution the core lib is configured with. Only accessed by
+    // the stitching stage once the stream is running.
+    int mOutputWidth, mOutputHeight;
 
     bool mIsInitialized GUARDED_BY(mAccessLock) = false;
 
     bool mGpuAccelerationEnabled;
-    hidl_vec<BufferDesc_1_1> mEvsGraphicBuffers;
+
+    // Imported EVS buffers; cleared whenever the stream is started.
+    InputBufferCache mInputBufferCache;
+
+    // Serializes the calls into the core lib, which the stitching stage,
+    // projectCameraPoints() and mProjectionLutThread make concurrently.
+    std::mutex mSurroundViewLock;
+
+    // Precomputed projections of the camera points, by camera index. The
+    // projections are in pixels of the output image, so the tables only hold
+    // for the output resolution they are built at.
+    struct ProjectionLuts {
+        int width = 0;
+        int height = 0;
+        std::vector<std::unique_ptr<ProjectionLut>> luts;
+    };
+
+    // Null if disabled by the config. Replaced whenever the output resolution
+    // changes, and built on mProjectionLutThread.
+    std::shared_ptr<ProjectionLuts> mProjectionLuts GUARDED_BY(mSurroundViewLock);
+    std::shared_ptr<ProjectionLuts> mBuiltProjectionLuts GUARDED_BY(mSurroundViewLock);
+    bool mProjectionLutsStopping GUARDED_BY(mSurroundViewLock) = false;
+    condition_variable mProjectionLutsSignal;
+    std::thread mProjectionLutThread;
+
+    // Output buffers of the CPU solution, per output resolution.
+    std::unique_ptr<OutputBufferPool> mOutputBufferPool;
 };
 
 }  // namespace implementation
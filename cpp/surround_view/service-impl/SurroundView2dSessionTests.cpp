@@ -25,10 +25,18 @@
 #include <android/hardware/automotive/vehicle/2.0/IVehicle.h>
 
 #include <android-base/logging.h>
+#include <android/hardware_buffer.h>
 
 #include <gtest/gtest.h>
 #include <time.h>
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <thread>
+
 namespace android {
 namespace hardware {
 namespace automotive {
@@ -46,6 +54,103 @@ using android::hardware::automotive::sv::V1_0::SvQuality;
 const int kSv2dWidth = 768;
 const int kSv2dHeight = 1024;
 
+// Keeps the delivered frames until the test lets them go, so the test
+// controls how many slots are with the client.
+class HoldingSurroundViewCallback : public ISurroundViewStream {
+public:
+    HoldingSurroundViewCallback(sp<ISurroundViewSession> session) : mSession(session) {}
+
+    Return<void> notify(SvEvent svEvent) override {
+        std::scoped_lock<std::mutex> lock(mAccessLock);
+        if (svEvent == SvEvent::FRAME_DROPPED) {
+            mHeldOnDrops.push_back(mHeld.size());
+        }
+        return {};
+    }
+
+    Return<void> receiveFrames(const SvFramesDesc& svFramesDesc) override {
+        {
+            std::scoped_lock<std::mutex> lock(mAccessLock);
+            ++mReceivedCount;
+            if (svFramesDesc.svBuffers.size() > 0) {
+                mLastWidth = reinterpret_cast<const AHardwareBuffer_Desc*>(
+                                     &svFramesDesc.svBuffers[0].hardwareBuffer.description)
+                                     ->width;
+            }
+            if (mHolding) {
+                mHeld.push_back(svFramesDesc);
+            } else {
+                returnFrames(svFramesDesc);
+            }
+        }
+        mSignal.notify_all();
+        return {};
+    }
+
+    // Returns the held frames and every frame received from now on.
+    void releaseFrames() {
+        std::scoped_lock<std::mutex> lock(mAccessLock);
+        mHolding = false;
+        for (auto&& frames : mHeld) {
+            returnFrames(frames);
+        }
+        mHeld.clear();
+    }
+
+    bool waitForHeldFrames(size_t count) {
+        std::unique_lock<std::mutex> lock(mAccessLock);
+        return mSignal.wait_for(lock, kTimeout, [this, count]() { return mHeld.size() >= count; });
+    }
+
+    bool waitForReceivedFrames(int count) {
+        std::unique_lock<std::mutex> lock(mAccessLock);
+        return mSignal.wait_for(lock, kTimeout,
+                                [this, count]() { return mReceivedCount >= count; });
+    }
+
+    bool waitForFramesWidth(uint32_t width) {
+        std::unique_lock<std::mutex> lock(mAccessLock);
+        return mSignal.wait_for(lock, kTimeout, [this, width]() { return mLastWidth == width; });
+    }
+
+    int getReceivedFramesCount() {
+        std::scoped_lock<std::mutex> lock(mAccessLock);
+        return mReceivedCount;
+    }
+
+    std::vector<SvFramesDesc> getHeldFrames() {
+        std::scoped_lock<std::mutex> lock(mAccessLock);
+        return mHeld;
+    }
+
+    // The number of frames held by the client when each FRAME_DROPPED event
+    // arrived.
+    std::vector<size_t> getHeldFramesOnDrops() {
+        std::scoped_lock<std::mutex> lock(mAccessLock);
+        return mHeldOnDrops;
+    }
+
+private:
+    static constexpr std::chrono::seconds kTimeout{5};
+
+    // Frames are returned on a separate thread, as a oneway HIDL call would
+    // be, because the session delivers them with its lock held.
+    void returnFrames(const SvFramesDesc& frames) {
+        std::thread([session = mSession, frames]() {
+            session->doneWithFrames(frames);
+        }).detach();
+    }
+
+    std::mutex mAccessLock;
+    std::condition_variable mSignal;
+    sp<ISurroundViewSession> mSession;
+    bool mHolding = true;
+    int mReceivedCount = 0;
+    uint32_t mLastWidth = 0;
+    std::vector<SvFramesDesc> mHeld;
+    std::vector<size_t> mHeldOnDrops;
+};
+
 class SurroundView2dSessionTests : public ::testing::Test {
 protected:
     void SetUp() override {
@@ -75,6 +180,39 @@ TEST_F(SurroundView2dSessionTests, startAndStopSurroundView2dSession) {
     mSv2dSession->stopStream();
 }
 
+// The client keeps every slot, one set of frames each, and frames are dropped
+// until it returns one.
+TEST_F(SurroundView2dSessionTests, receiveFramesWithQueuedSlots) {
+    const size_t depth = mIoModuleConfig.sv2dConfig.framesQueueDepth;
+    ASSERT_EQ(depth, 3u);
+
+    sp<HoldingSurroundViewCallback> sv2dCallback =
+            new HoldingSurroundViewCallback(mSv2dSession);
+
+    EXPECT_EQ(mSv2dSession->startStream(sv2dCallback), SvResult::OK);
+
+    // Several sets of frames are out at once, each in its own slot.
+    ASSERT_TRUE(sv2dCallback->waitForHeldFrames(depth));
+    std::set<int> sequenceIds;
+    for (auto&& frames : sv2dCallback->getHeldFrames()) {
+        sequenceIds.insert(frames.sequenceId);
+    }
+    EXPECT_EQ(sequenceIds.size(), depth);
+
+    // Nothing more is delivered while the client holds every slot; the new
+    // frames are dropped instead.
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    EXPECT_EQ(sv2dCallback->getReceivedFramesCount(), static_cast<int>(depth));
+    const auto heldOnDrops = sv2dCallback->getHeldFramesOnDrops();
+    EXPECT_GT(std::count(heldOnDrops.begin(), heldOnDrops.end(), depth), 0);
+
+    // Frames flow again once the slots are returned.
+    sv2dCallback->releaseFrames();
+    EXPECT_TRUE(sv2dCallback->waitForReceivedFrames(depth + 2));
+
+    mSv2dSession->stopStream();
+}
+
 TEST_F(SurroundView2dSessionTests, get2dMappingInfoSuccess) {
     Sv2dMappingInfo sv2dMappingInfo;
     mSv2dSession->get2dMappingInfo(
@@ -133,6 +271,90 @@ TEST_F(SurroundView2dSessionTests, projectPoints2dSuccess) {
     }
 }
 
+// Checks the projections of |lutSession|, interpolated from its lookup tables,
+// against the projections of the core lib by |exactSession|.
+void expectLutProjectionsMatch(const sp<SurroundView2dSession>& lutSession,
+                               const sp<SurroundView2dSession>& exactSession) {
+    lutSession->waitForProjectionLuts();
+
+    hidl_vec<Point2dInt> points2dCamera;
+    for (int y = 0; y < kSv2dHeight; y += 13) {
+        for (int x = 0; x < kSv2dWidth; x += 11) {
+            points2dCamera.resize(points2dCamera.size() + 1);
+            points2dCamera[points2dCamera.size() - 1] = {.x = x, .y = y};
+        }
+    }
+
+    std::vector<hidl_string> cameraIds = {"/dev/video60", "/dev/video61", "/dev/video62",
+                                          "/dev/video63"};
+
+    // The projections are in pixels of the 2d surround view.
+    const float kMaxError = 1.0f;
+    int comparedCount = 0;
+    for (int i = 0; i < cameraIds.size(); i++) {
+        hidl_vec<Point2dFloat> lutPoints, exactPoints;
+        lutSession->projectCameraPoints(points2dCamera, cameraIds[i],
+            [&lutPoints](const hidl_vec<Point2dFloat>& projectedPoints) {
+                lutPoints = projectedPoints;
+            });
+        exactSession->projectCameraPoints(points2dCamera, cameraIds[i],
+            [&exactPoints](const hidl_vec<Point2dFloat>& projectedPoints) {
+                exactPoints = projectedPoints;
+            });
+
+        ASSERT_EQ(lutPoints.size(), points2dCamera.size());
+        ASSERT_EQ(exactPoints.size(), points2dCamera.size());
+        for (int j = 0; j < points2dCamera.size(); j++) {
+            if (!lutPoints[j].isValid || !exactPoints[j].isValid) {
+                continue;
+            }
+            EXPECT_NEAR(lutPoints[j].x, exactPoints[j].x, kMaxError);
+            EXPECT_NEAR(lutPoints[j].y, exactPoints[j].y, kMaxError);
+            comparedCount++;
+        }
+    }
+    EXPECT_GT(comparedCount, 0);
+}
+
+// Checks the projections interpolated from the lookup tables against the
+// projections of the core lib.
+TEST_F(SurroundView2dSessionTests, projectPoints2dLutMatchesCoreLib) {
+    ASSERT_GT(mIoModuleConfig.cameraConfig.projectionLutGridStep, 0);
+
+    IOModuleConfig exactConfig = mIoModuleConfig;
+    exactConfig.cameraConfig.projectionLutGridStep = 0;
+    sp<SurroundView2dSession> exactSession =
+            new SurroundView2dSession(new MockEvsEnumerator(), &exactConfig);
+    ASSERT_TRUE(exactSession->initialize());
+
+    expectLutProjectionsMatch(mSv2dSession, exactSession);
+}
+
+// The projections are in pixels of the output image, so the lookup tables
+// must follow the output resolution set by the client.
+TEST_F(SurroundView2dSessionTests, projectPoints2dLutMatchesCoreLibAfterSet2dConfig) {
+    ASSERT_GT(mIoModuleConfig.cameraConfig.projectionLutGridStep, 0);
+
+    IOModuleConfig exactConfig = mIoModuleConfig;
+    exactConfig.cameraConfig.projectionLutGridStep = 0;
+    sp<SurroundView2dSession> exactSession =
+            new SurroundView2dSession(new MockEvsEnumerator(), &exactConfig);
+    ASSERT_TRUE(exactSession->initialize());
+
+    // The core lib takes the new resolution once frames are stitched at it.
+    const Sv2dConfig sv2dConfig = {kSv2dWidth / 2, SvQuality::HIGH};
+    for (const sp<SurroundView2dSession>& session : {mSv2dSession, exactSession}) {
+        sp<HoldingSurroundViewCallback> sv2dCallback = new HoldingSurroundViewCallback(session);
+        sv2dCallback->releaseFrames();
+        ASSERT_EQ(session->startStream(sv2dCallback), SvResult::OK);
+        ASSERT_EQ(session->set2dConfig(sv2dConfig), SvResult::OK);
+        EXPECT_TRUE(sv2dCallback->waitForFramesWidth(sv2dConfig.width));
+        session->stopStream();
+    }
+
+    expectLutProjectionsMatch(mSv2dSession, exactSession);
+}
+
 }  // namespace
 }  // namespace implementation
 }  // namespace V1_0
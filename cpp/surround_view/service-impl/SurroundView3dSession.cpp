@@ -19,15 +19,12 @@
 
 #include <android-base/logging.h>
 #include <android/hardware_buffer.h>
-#include <android/hidl/memory/1.0/IMemory.h>
-#include <hidlmemory/mapping.h>
 #include <system/camera_metadata.h>
 #include <utils/SystemClock.h>
 #include <utils/Trace.h>
 
 #include <array>
 #include <thread>
-#include <set>
 
 #include <android/hardware/camera/device/3.2/ICameraDevice.h>
 
@@ -41,7 +38,6 @@ using ::std::lock_guard;
 using ::std::map;
 using ::std::mutex;
 using ::std::scoped_lock;
-using ::std::set;
 using ::std::string;
 using ::std::thread;
 using ::std::unique_lock;
@@ -51,7 +47,6 @@ using ::std::vector;
 using ::android::hardware::automotive::evs::V1_0::EvsResult;
 using ::android::hardware::camera::device::V3_2::Stream;
 using ::android::hardware::hidl_memory;
-using ::android::hidl::memory::V1_0::IMemory;
 
 using GraphicsPixelFormat = ::android::hardware::graphics::common::V1_0::PixelFormat;
 
@@ -96,72 +91,69 @@ Return<void> SurroundView3dSession::FramesHandler::deliverFrame_1_1(
     ATRACE_BEGIN(__PRETTY_FUNCTION__);
 
     LOG(INFO) << "Received " << buffers.size() << " frames from the camera";
-    mSession->mSequenceId++;
+    const int sequenceId = ++mSession->mSequenceId;
 
+    FramesSlot* slot = nullptr;
     {
         scoped_lock<mutex> lock(mSession->mAccessLock);
-        if (mSession->mProcessingEvsFrames) {
-            LOG(WARNING) << "EVS frames are being processed. Skip frames:"
-                         << mSession->mSequenceId;
+        if (mSession->mStreamState != RUNNING) {
+            LOG(DEBUG) << "The stream is not running. Skip frames:" << sequenceId;
             mCamera->doneWithFrame_1_1(buffers);
+            ATRACE_END();
             return {};
-        } else {
-            // Sets the flag to true immediately so the new coming frames will
-            // be skipped.
-            mSession->mProcessingEvsFrames = true;
         }
-    }
 
-    if (buffers.size() != kNumFrames) {
-        scoped_lock<mutex> lock(mSession->mAccessLock);
-        LOG(ERROR) << "The number of incoming frames is " << buffers.size()
-                   << ", which is different from the number " << kNumFrames
-                   << ", specified in config file";
-        mSession->mProcessingEvsFrames = false;
-        mCamera->doneWithFrame_1_1(buffers);
-        return {};
-    }
-
-    {
-        scoped_lock<mutex> lock(mSession->mAccessLock);
-
-        // The incoming frames may not follow the same order as listed cameras.
-        // We should re-order them following the camera ids listed in camera
-        // config.
-        vector<int> indices;
-        for (const auto& id
-                : mSession->mIOModuleConfig->cameraConfig.evsCameraIds) {
-            for (int i = 0; i < kNumFrames; i++) {
-                if (buffers[i].deviceId == id) {
-                    indices.emplace_back(i);
-                    break;
-                }
+        for (auto& candidate : mSession->mFramesSlots) {
+            if (candidate.state == FramesSlot::FREE) {
+                slot = &candidate;
+                break;
             }
         }
 
-        // If the size of indices is smaller than the kNumFrames, it means that
-        // there is frame(s) that comes from different camera(s) than we
-        // expected.
-        if (indices.size() != kNumFrames) {
-            LOG(ERROR) << "The frames are not from the cameras we expected!";
-            mSession->mProcessingEvsFrames = false;
+        if (slot == nullptr) {
+            LOG(WARNING) << "All " << mSession->mFramesSlots.size()
+                         << " frame slots are busy. Skip frames:" << sequenceId;
+            LOG(DEBUG) << "Notify SvEvent::FRAME_DROPPED";
+            mSession->mStream->notify(SvEvent::FRAME_DROPPED);
             mCamera->doneWithFrame_1_1(buffers);
+            ATRACE_END();
             return {};
         }
 
-        for (int i = 0; i < kNumFrames; i++) {
-            LOG(DEBUG) << "Copying buffer from camera ["
-                       << buffers[indices[i]].deviceId
-                       << "] to Surround View Service";
-            mSession->copyFromBufferToPointers(buffers[indices[i]],
-                                               mSession->mInputPointers[i]);
-        }
+        // Claims the slot immediately so the frames delivered next will use
+        // another one.
+        slot->state = FramesSlot::INGESTING;
+        mSession->traceSlotCounters_Locked();
     }
 
-    mCamera->doneWithFrame_1_1(buffers);
+    // The slot is owned by this thread while it is INGESTING, so the frames
+    // are copied without holding the lock and the previous frames can be
+    // rendered meanwhile.
+    const bool ingested = mSession->ingestFrames(buffers, slot);
+
+    bool queued = false;
+    {
+        scoped_lock<mutex> lock(mSession->mAccessLock);
+        if (ingested && mSession->mRenderingDone) {
+            // The stream was stopped while the frames were being ingested.
+            mSession->releaseEvsFrames(slot);
+            slot->state = FramesSlot::FREE;
+        } else if (ingested) {
+            slot->sequenceId = sequenceId;
+            slot->state = FramesSlot::INGESTED;
+            mSession->mIngestedSlots.push_back(
+                    static_cast<int>(slot - mSession->mFramesSlots.data()));
+            queued = true;
+        } else {
+            slot->state = FramesSlot::FREE;
+        }
+        mSession->traceSlotCounters_Locked();
+    }
 
     // Notify the session that a new set of frames is ready
-    mSession->mFramesSignal.notify_all();
+    if (queued) {
+        mSession->mFramesSignal.notify_all();
+    }
 
     ATRACE_END();
 
@@ -199,56 +191,164 @@ Return<void> SurroundView3dSession::FramesHandler::notify(const EvsEventDesc& ev
     return {};
 }
 
-bool SurroundView3dSession::copyFromBufferToPointers(
-    BufferDesc_1_1 buffer, SurroundViewInputBufferPointers pointers) {
-
+bool SurroundView3dSession::ingestFrames(const hidl_vec<BufferDesc_1_1>& buffers,
+                                         FramesSlot* slot) {
     ATRACE_BEGIN(__PRETTY_FUNCTION__);
 
-    AHardwareBuffer_Desc* pDesc =
-        reinterpret_cast<AHardwareBuffer_Desc *>(&buffer.buffer.description);
+    if (buffers.size() != kNumFrames) {
+        LOG(ERROR) << "The number of incoming frames is " << buffers.size()
+                   << ", which is different from the number " << kNumFrames
+                   << ", specified in config file";
+        mCamera->doneWithFrame_1_1(buffers);
+        ATRACE_END();
+        return false;
+    }
 
-    ATRACE_BEGIN("Create Graphic Buffer");
-    // create a GraphicBuffer from the existing handle
-    sp<GraphicBuffer> inputBuffer = new GraphicBuffer(
-        buffer.buffer.nativeHandle, GraphicBuffer::CLONE_HANDLE, pDesc->width,
-        pDesc->height, pDesc->format, pDesc->layers,
-        GRALLOC_USAGE_HW_TEXTURE, pDesc->stride);
+    // The incoming frames may not follow the same order as listed cameras.
+    // We should re-order them following the camera ids listed in camera
+    // config.
+    vector<int> indices;
+    for (const auto& id : mIOModuleConfig->cameraConfig.evsCameraIds) {
+        for (int i = 0; i < kNumFrames; i++) {
+            if (buffers[i].deviceId == id) {
+                indices.emplace_back(i);
+                break;
+            }
+        }
+    }
 
-    if (inputBuffer == nullptr) {
-        LOG(ERROR) << "Failed to allocate GraphicBuffer to wrap image handle";
-        // Returning "true" in this error condition because we already released the
-        // previous image (if any) and so the texture may change in unpredictable
-        // ways now!
+    // If the size of indices is smaller than the kNumFrames, it means that
+    // there is frame(s) that comes from different camera(s) than we
+    // expected.
+    if (indices.size() != kNumFrames) {
+        LOG(ERROR) << "The frames are not from the cameras we expected!";
+        mCamera->doneWithFrame_1_1(buffers);
+        ATRACE_END();
         return false;
-    } else {
-        LOG(INFO) << "Managed to allocate GraphicBuffer with "
-                  << " width: " << pDesc->width
-                  << " height: " << pDesc->height
-                  << " format: " << pDesc->format
-                  << " stride: " << pDesc->stride;
     }
+
+    slot->evsBuffers = buffers;
+    for (int i = 0; i < kNumFrames; i++) {
+        LOG(DEBUG) << "Mapping buffer from camera ["
+                   << buffers[indices[i]].deviceId
+                   << "] to Surround View Service";
+        if (!mapInputBuffer(buffers[indices[i]], slot, i)) {
+            releaseEvsFrames(slot);
+            ATRACE_END();
+            return false;
+        }
+    }
+
+    // We do not need to hold the EVS frames any more if all of them are
+    // copied already.
+    if (slot->lockedInputBuffers.empty()) {
+        releaseEvsFrames(slot);
+    }
+
     ATRACE_END();
 
+    return true;
+}
+
+void SurroundView3dSession::traceSlotCounters_Locked() {
+    int64_t ingesting = 0, rendering = 0, withClient = 0;
+    for (const auto& slot : mFramesSlots) {
+        switch (slot.state) {
+            case FramesSlot::INGESTING:
+                ingesting++;
+                break;
+            case FramesSlot::RENDERING:
+                rendering++;
+                break;
+            case FramesSlot::WITH_CLIENT:
+                withClient++;
+                break;
+            default:
+                break;
+        }
+    }
+
+    ATRACE_INT64("SV3d ingesting frames", ingesting);
+    ATRACE_INT64("SV3d render queue", static_cast<int64_t>(mIngestedSlots.size()));
+    ATRACE_INT64("SV3d rendering frames", rendering);
+    ATRACE_INT64("SV3d publish queue", static_cast<int64_t>(mRenderedSlots.size()));
+    ATRACE_INT64("SV3d frames with client", withClient);
+}
+
+void SurroundView3dSession::releaseEvsFrames(FramesSlot* slot) {
+    for (auto& inputBuffer : slot->lockedInputBuffers) {
+        inputBuffer->unlock();
+    }
+    slot->lockedInputBuffers.clear();
+
+    if (slot->evsBuffers.size() > 0) {
+        mCamera->doneWithFrame_1_1(slot->evsBuffers);
+        slot->evsBuffers.resize(0);
+    }
+}
+
+bool SurroundView3dSession::mapInputBuffer(const BufferDesc_1_1& buffer, FramesSlot* slot,
+                                           int index) {
+    ATRACE_BEGIN(__PRETTY_FUNCTION__);
+
+    const AHardwareBuffer_Desc* pDesc =
+        reinterpret_cast<const AHardwareBuffer_Desc *>(&buffer.buffer.description);
+    SurroundViewInputBufferPointers& pointers = slot->inputPointers[index];
+    if (static_cast<int>(pDesc->width) != pointers.width ||
+        static_cast<int>(pDesc->height) != pointers.height) {
+        LOG(ERROR) << "Unexpected buffer size " << pDesc->width << "x" << pDesc->height
+                   << " from camera " << buffer.deviceId;
+        ATRACE_END();
+        return false;
+    }
+
+    sp<GraphicBuffer> inputBuffer = mInputBufferCache.getGraphicBuffer(buffer);
+    if (inputBuffer == nullptr) {
+        ATRACE_END();
+        return false;
+    }
+
     ATRACE_BEGIN("Lock input buffer (gpu to cpu)");
     // Lock the input GraphicBuffer and map it to a pointer.  If we failed to
     // lock, return false.
-    void* inputDataPtr;
+    void* inputDataPtr = nullptr;
     inputBuffer->lock(
         GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_NEVER,
         &inputDataPtr);
+    ATRACE_END();
     if (!inputDataPtr) {
         LOG(ERROR) << "Failed to gain read access to GraphicBuffer";
         inputBuffer->unlock();
+        ATRACE_END();
         return false;
-    } else {
-        LOG(INFO) << "Managed to get read access to GraphicBuffer";
     }
-    ATRACE_END();
+
+    // The core lib expects rows without padding, so only such buffers can be
+    // read in place.
+    if (mIOModuleConfig->cameraConfig.zeroCopyInputEnabled && pDesc->stride == pDesc->width) {
+        pointers.cpu_data_pointer = inputDataPtr;
+        slot->lockedInputBuffers.emplace_back(inputBuffer);
+        ATRACE_END();
+        return true;
+    }
 
     ATRACE_BEGIN("Copy input data");
-    // Both source and destination are with 4 channels
-    memcpy(pointers.cpu_data_pointer, inputDataPtr,
-           pDesc->height * pDesc->width * kInputNumChannels);
+    // Both source and destination are with 4 channels, while the source rows
+    // may be padded up to the stride.
+    pointers.cpu_data_pointer = slot->inputMemory[index];
+    const uint8_t* readPtr = static_cast<const uint8_t*>(inputDataPtr);
+    uint8_t* writePtr = static_cast<uint8_t*>(pointers.cpu_data_pointer);
+    const int readStride = pDesc->stride * kInputNumChannels;
+    const int writeStride = pDesc->width * kInputNumChannels;
+    if (readStride == writeStride) {
+        memcpy(writePtr, readPtr, writeStride * pDesc->height);
+    } else {
+        for (int i=0; i<pDesc->height; i++) {
+            memcpy(writePtr, readPtr, writeStride);
+            writePtr = writePtr + writeStride;
+            readPtr = readPtr + readStride;
+        }
+    }
     LOG(INFO) << "Buffer copying finished";
     ATRACE_END();
 
@@ -265,32 +365,108 @@ bool SurroundView3dSession::copyFromBufferToPointers(
 void SurroundView3dSession::processFrames() {
     ATRACE_BEGIN(__PRETTY_FUNCTION__);
 
+    // The core lib renders with a GL context of the thread that starts the
+    // pipeline, so all the rendering stays on this thread.
     ATRACE_BEGIN("SV core lib method: Start3dPipeline");
-    if (mSurroundView->Start3dPipeline()) {
+    const bool started = mSurroundView->Start3dPipeline();
+    if (started) {
         LOG(INFO) << "Start3dPipeline succeeded";
+
+        // The animation module is shared by the sessions, and this pipeline
+        // has none of the params it returned to the previous ones.
+        if (mAnimationModule != nullptr) {
+            mAnimationModule->requestFullUpdate();
+        }
     } else {
         LOG(ERROR) << "Start3dPipeline failed";
-        return;
     }
     ATRACE_END();
 
+    while (started) {
+        FramesSlot* slot = nullptr;
+        {
+            unique_lock<mutex> lock(mAccessLock);
+            mFramesSignal.wait(lock, [this]() {
+                return !mIngestedSlots.empty() || mStreamState != RUNNING;
+            });
+
+            // The frames ingested before the stream was stopped are still
+            // rendered and delivered.
+            if (mIngestedSlots.empty()) {
+                break;
+            }
+
+            slot = &mFramesSlots[mIngestedSlots.front()];
+            mIngestedSlots.pop_front();
+            slot->state = FramesSlot::RENDERING;
+            traceSlotCounters_Locked();
+        }
+
+        const bool rendered = renderFrames(slot);
+
+        {
+            scoped_lock<mutex> lock(mAccessLock);
+            if (rendered) {
+                slot->state = FramesSlot::RENDERED;
+                mRenderedSlots.push_back(static_cast<int>(slot - mFramesSlots.data()));
+            } else {
+                releaseEvsFrames(slot);
+                slot->state = FramesSlot::FREE;
+            }
+            traceSlotCounters_Locked();
+        }
+
+        if (rendered) {
+            mPublishSignal.notify_all();
+        }
+    }
+
+    {
+        scoped_lock<mutex> lock(mAccessLock);
+        mRenderingDone = true;
+
+        // Frames ingested after a failed start are never rendered.
+        for (const auto index : mIngestedSlots) {
+            releaseEvsFrames(&mFramesSlots[index]);
+            mFramesSlots[index].state = FramesSlot::FREE;
+        }
+        mIngestedSlots.clear();
+    }
+    mPublishSignal.notify_all();
+
+    ATRACE_END();
+}
+
+void SurroundView3dSession::publishFrames() {
+    ATRACE_BEGIN(__PRETTY_FUNCTION__);
+
     while (true) {
+        FramesSlot* slot = nullptr;
         {
             unique_lock<mutex> lock(mAccessLock);
+            mPublishSignal.wait(lock, [this]() {
+                return !mRenderedSlots.empty() || mRenderingDone;
+            });
 
-            if (mStreamState != RUNNING) {
+            if (mRenderedSlots.empty()) {
                 break;
             }
 
-            mFramesSignal.wait(lock, [this]() { return mProcessingEvsFrames; });
+            slot = &mFramesSlots[mRenderedSlots.front()];
+            mRenderedSlots.pop_front();
         }
 
-        handleFrames(mSequenceId);
+        const bool copied = copyToOutputBuffer(slot);
 
         {
-            // Set the boolean to false to receive the next set of frames.
             scoped_lock<mutex> lock(mAccessLock);
-            mProcessingEvsFrames = false;
+            if (copied) {
+                slot->state = FramesSlot::WITH_CLIENT;
+                mStream->receiveFrames(slot->frames);
+            } else {
+                slot->state = FramesSlot::FREE;
+            }
+            traceSlotCounters_Locked();
         }
     }
 
@@ -314,6 +490,7 @@ SurroundView3dSession::SurroundView3dSession(sp<IEvsEnumerator> pEvs,
                                              IOModuleConfig* pConfig) :
       mEvs(pEvs),
       mStreamState(STOPPED),
+      mRenderingDone(false),
       mVhalHandler(vhalHandler),
       mAnimationModule(animationModule),
       mIOModuleConfig(pConfig) {}
@@ -324,10 +501,21 @@ SurroundView3dSession::~SurroundView3dSession() {
     // join.
     stopStream();
 
-    // Waiting for the process thread to finish the buffered frames.
+    // Waiting for the stage threads to finish the buffered frames.
     if (mProcessThread.joinable()) {
         mProcessThread.join();
     }
+    if (mPublishThread.joinable()) {
+        mPublishThread.join();
+    }
+
+    // Stops building the projection lookup tables, if still in progress.
+    for (auto& projectionLut : mProjectionLuts) {
+        projectionLut->cancel();
+    }
+    if (mProjectionLutThread.joinable()) {
+        mProjectionLutThread.join();
+    }
 
     mEvs->closeCamera(mCamera);
 }
@@ -364,6 +552,11 @@ Return<SvResult> SurroundView3dSession::startStream(
     mStream = stream;
 
     mSequenceId = 0;
+
+    // The cameras may deliver other buffers in the new stream. Each camera
+    // has at most a set of frames per slot, and one more, in flight.
+    mInputBufferCache.clear();
+    mInputBufferCache.setMaxBuffersPerDevice(mFramesSlots.size() + 1);
     startEvs();
 
     if (mVhalHandler != nullptr) {
@@ -379,14 +572,25 @@ Return<SvResult> SurroundView3dSession::startStream(
     // moved to EVS notify callback.
     LOG(DEBUG) << "Notify SvEvent::STREAM_STARTED";
     mStream->notify(SvEvent::STREAM_STARTED);
-    mProcessingEvsFrames = false;
+    mRenderingDone = false;
 
-    // Start the frame generation thread
+    // Start the frame generation threads
     mStreamState = RUNNING;
 
+    // The threads of a previous stream have finished once it is STOPPED.
+    if (mProcessThread.joinable()) {
+        mProcessThread.join();
+    }
+    if (mPublishThread.joinable()) {
+        mPublishThread.join();
+    }
+
     mProcessThread = thread([this]() {
         processFrames();
     });
+    mPublishThread = thread([this]() {
+        publishFrames();
+    });
 
     return SvResult::OK;
 }
@@ -407,6 +611,9 @@ Return<void> SurroundView3dSession::stopStream() {
 
         // Stop the EVS stream asynchronizely
         mCamera->stopVideoStream();
+
+        // Wake up processFrames in case no more frames arrive
+        mFramesSignal.notify_all();
     }
 
     return {};
@@ -417,9 +624,17 @@ Return<void> SurroundView3dSession::doneWithFrames(
     LOG(DEBUG) << __FUNCTION__;
     scoped_lock <mutex> lock(mAccessLock);
 
-    mFramesRecord.inUse = false;
+    for (auto& slot : mFramesSlots) {
+        if (slot.state == FramesSlot::WITH_CLIENT &&
+            slot.frames.sequenceId == svFramesDesc.sequenceId) {
+            slot.state = FramesSlot::FREE;
+            traceSlotCounters_Locked();
+            return {};
+        }
+    }
 
-    (void)svFramesDesc;
+    LOG(WARNING) << "Frames of an unknown sequenceId " << svFramesDesc.sequenceId
+                 << " are returned. Ignored!";
     return {};
 }
 
@@ -477,95 +692,15 @@ Return<void> SurroundView3dSession::get3dConfig(get3dConfig_cb _hidl_cb) {
     return {};
 }
 
-bool VerifyAndGetOverlays(const OverlaysData& overlaysData, std::vector<Overlay>* svCoreOverlays) {
-    // Clear the overlays.
-    svCoreOverlays->clear();
-
-    // Check size of shared memory matches overlaysMemoryDesc.
-    const int kVertexSize = 16;
-    const int kIdSize = 2;
-    int memDescSize = 0;
-    for (auto& overlayMemDesc : overlaysData.overlaysMemoryDesc) {
-        memDescSize += kIdSize + kVertexSize * overlayMemDesc.verticesCount;
-    }
-    if (overlaysData.overlaysMemory.size() < memDescSize) {
-        LOG(ERROR) << "Allocated shared memory size is less than overlaysMemoryDesc size.";
-        return false;
-    }
-
-    // Map memory.
-    sp<IMemory> pSharedMemory = mapMemory(overlaysData.overlaysMemory);
-    if(pSharedMemory == nullptr) {
-        LOG(ERROR) << "mapMemory failed.";
-        return false;
-    }
-
-    // Get Data pointer.
-    uint8_t* pData = static_cast<uint8_t*>(
-        static_cast<void*>(pSharedMemory->getPointer()));
-    if (pData == nullptr) {
-        LOG(ERROR) << "Shared memory getPointer() failed.";
-        return false;
-    }
-
-    int idOffset = 0;
-    set<uint16_t> overlayIdSet;
-    for (auto& overlayMemDesc : overlaysData.overlaysMemoryDesc) {
-
-        if (overlayIdSet.find(overlayMemDesc.id) != overlayIdSet.end()) {
-            LOG(ERROR) << "Duplicate id within memory descriptor.";
-            svCoreOverlays->clear();
-            return false;
-        }
-        overlayIdSet.insert(overlayMemDesc.id);
-
-        if(overlayMemDesc.verticesCount < 3) {
-            LOG(ERROR) << "Less than 3 vertices.";
-            svCoreOverlays->clear();
-            return false;
-        }
-
-        if (overlayMemDesc.overlayPrimitive == OverlayPrimitive::TRIANGLES &&
-                overlayMemDesc.verticesCount % 3 != 0) {
-            LOG(ERROR) << "Triangles primitive does not have vertices "
-                       << "multiple of 3.";
-            svCoreOverlays->clear();
-            return false;
-        }
-
-        const uint16_t overlayId = *((uint16_t*)(pData + idOffset));
-
-        if (overlayId != overlayMemDesc.id) {
-            LOG(ERROR) << "Overlay id mismatch " << overlayId << ", " << overlayMemDesc.id;
-            svCoreOverlays->clear();
-            return false;
-        }
-
-        // Copy over shared memory data to sv core overlays.
-        Overlay svCoreOverlay;
-        svCoreOverlay.id = overlayMemDesc.id;
-        svCoreOverlay.vertices.resize(overlayMemDesc.verticesCount);
-        uint8_t* verticesDataPtr = pData + idOffset + kIdSize;
-        memcpy(svCoreOverlay.vertices.data(), verticesDataPtr,
-                kVertexSize * overlayMemDesc.verticesCount);
-        svCoreOverlays->push_back(svCoreOverlay);
-
-        idOffset += kIdSize + (kVertexSize * overlayMemDesc.verticesCount);
-    }
-
-    return true;
-}
-
 Return<SvResult>  SurroundView3dSession::updateOverlays(const OverlaysData& overlaysData) {
     LOG(DEBUG) << __FUNCTION__;
 
     scoped_lock <mutex> lock(mAccessLock);
-    if(!VerifyAndGetOverlays(overlaysData, &mOverlays)) {
-        LOG(ERROR) << "VerifyAndGetOverlays failed.";
+    if (!mOverlayCache.update(overlaysData)) {
+        LOG(ERROR) << "Failed to update the overlays.";
         return SvResult::INVALID_ARG;
     }
 
-    mOverlayIsUpdated = true;
     return SvResult::OK;
 }
 
@@ -607,8 +742,19 @@ Return<void> SurroundView3dSession::projectCameraPointsTo3dSurface(
             continue;
         }
 
-        // Project points using mSurroundView function.
+        // Interpolate the projection from the lookup table when possible.
         const Coordinate2dInteger camCoord(cameraPoint.x, cameraPoint.y);
+        float lutPoint3d[3];
+        if (!mProjectionLuts.empty() &&
+            mProjectionLuts[cameraIndex]->lookup(camCoord, lutPoint3d)) {
+            point3d.x = lutPoint3d[0] * 1000.0;
+            point3d.y = lutPoint3d[1] * 1000.0;
+            point3d.z = lutPoint3d[2] * 1000.0;
+            points3d.push_back(point3d);
+            continue;
+        }
+
+        // Project points using mSurroundView function.
         Coordinate3dFloat projPoint3d(0.0, 0.0, 0.0);
         point3d.isValid =
                 mSurroundView->GetProjectionPointFromRawCameraToSurroundView3d(camCoord,
@@ -624,83 +770,108 @@ Return<void> SurroundView3dSession::projectCameraPointsTo3dSurface(
     return {};
 }
 
-bool SurroundView3dSession::handleFrames(int sequenceId) {
-    LOG(INFO) << __FUNCTION__ << "Handling sequenceId " << sequenceId << ".";
+bool SurroundView3dSession::allocateOutputBuffer(FramesSlot* slot, int width, int height) {
+    delete[] static_cast<char*>(slot->outputPointer.cpu_data_pointer);
+    slot->outputPointer.height = height;
+    slot->outputPointer.width = width;
+    slot->outputPointer.format = Format::RGBA;
+    slot->outputPointer.cpu_data_pointer =
+            static_cast<void*>(new char[height * width * kOutputNumChannels]);
+
+    if (!slot->outputPointer.cpu_data_pointer) {
+        LOG(ERROR) << "Memory allocation failed. Exiting.";
+        return false;
+    }
+
+    slot->svTexture = new GraphicBuffer(width,
+                                        height,
+                                        HAL_PIXEL_FORMAT_RGBA_8888,
+                                        1,
+                                        GRALLOC_USAGE_HW_TEXTURE,
+                                        "SvTexture");
+    if (slot->svTexture->initCheck() == OK) {
+        LOG(INFO) << "Successfully allocated Graphic Buffer";
+    } else {
+        LOG(ERROR) << "Failed to allocate Graphic Buffer";
+        return false;
+    }
+
+    return true;
+}
+
+bool SurroundView3dSession::renderFrames(FramesSlot* slot) {
+    LOG(INFO) << __FUNCTION__ << "Handling sequenceId " << slot->sequenceId << ".";
 
     ATRACE_BEGIN(__PRETTY_FUNCTION__);
 
-    // TODO(b/157498592): Now only one sets of EVS input frames and one SV
-    // output frame is supported. Implement buffer queue for both of them.
+    // Takes a snapshot of the states set by the client, so the lock is not
+    // held while rendering.
+    int width, height;
+    View3d view3d;
+    vector<Overlay> overlays;
+    uint64_t overlaysGeneration;
     {
         scoped_lock<mutex> lock(mAccessLock);
-
-        if (mFramesRecord.inUse) {
-            LOG(DEBUG) << "Notify SvEvent::FRAME_DROPPED";
-            mStream->notify(SvEvent::FRAME_DROPPED);
-            return true;
+        width = mConfig.width;
+        height = mConfig.height;
+
+        // TODO(161399517): Only single view is currently supported, add support for multiple
+        // views.
+        view3d = mViews[0];
+
+        // The overlays are only copied when they changed since they were
+        // last set to the core lib.
+        overlaysGeneration = mOverlayCache.getGeneration();
+        if (overlaysGeneration != mOverlaysGeneration) {
+            overlays = mOverlayCache.getOverlays();
         }
     }
 
-    // If the width/height was changed, re-allocate the data pointer.
-    if (mOutputWidth != mConfig.width
-        || mOutputHeight != mConfig.height) {
-        LOG(DEBUG) << "Config changed. Re-allocate memory. "
+    // If the width/height was changed, update the core lib resolution.
+    if (mOutputWidth != width || mOutputHeight != height) {
+        LOG(DEBUG) << "Config changed. Update the output resolution. "
                    << "Old width: "
                    << mOutputWidth
                    << ", old height: "
                    << mOutputHeight
                    << "; New width: "
-                   << mConfig.width
+                   << width
                    << ", new height: "
-                   << mConfig.height;
-        delete[] static_cast<char*>(mOutputPointer.cpu_data_pointer);
-        mOutputWidth = mConfig.width;
-        mOutputHeight = mConfig.height;
-        mOutputPointer.height = mOutputHeight;
-        mOutputPointer.width = mOutputWidth;
-        mOutputPointer.format = Format::RGBA;
-        mOutputPointer.cpu_data_pointer =
-                static_cast<void*>(new char[mOutputHeight * mOutputWidth * kOutputNumChannels]);
-
-        if (!mOutputPointer.cpu_data_pointer) {
-            LOG(ERROR) << "Memory allocation failed. Exiting.";
-            return false;
-        }
+                   << height;
+        mOutputWidth = width;
+        mOutputHeight = height;
 
         Size2dInteger size = Size2dInteger(mOutputWidth, mOutputHeight);
         mSurroundView->Update3dOutputResolution(size);
+    }
 
-        mSvTexture = new GraphicBuffer(mOutputWidth,
-                                       mOutputHeight,
-                                       HAL_PIXEL_FORMAT_RGBA_8888,
-                                       1,
-                                       GRALLOC_USAGE_HW_TEXTURE,
-                                       "SvTexture");
-        if (mSvTexture->initCheck() == OK) {
-            LOG(INFO) << "Successfully allocated Graphic Buffer";
-        } else {
-            LOG(ERROR) << "Failed to allocate Graphic Buffer";
+    // Each slot keeps the buffers of the resolution it was last rendered at,
+    // and catches up when it is reused.
+    if (slot->outputPointer.width != mOutputWidth ||
+        slot->outputPointer.height != mOutputHeight) {
+        LOG(DEBUG) << "Re-allocate the output buffers of the frame slot.";
+        if (!allocateOutputBuffer(slot, mOutputWidth, mOutputHeight)) {
+            ATRACE_END();
             return false;
         }
     }
 
     ATRACE_BEGIN("SV core lib method: Set3dOverlay");
     // Set 3d overlays.
-    {
-        scoped_lock<mutex> lock(mAccessLock);
-        if (mOverlayIsUpdated) {
-            if (!mSurroundView->Set3dOverlay(mOverlays)) {
-                LOG(ERROR) << "Set 3d overlays failed.";
-            }
-            mOverlayIsUpdated = false;
+    if (overlaysGeneration != mOverlaysGeneration) {
+        if (!mSurroundView->Set3dOverlay(overlays)) {
+            LOG(ERROR) << "Set 3d overlays failed.";
         }
+        mOverlaysGeneration = overlaysGeneration;
     }
     ATRACE_END();
 
     ATRACE_BEGIN("VhalHandler method: getPropertyValues");
-    // Get the latest VHal property values
+    // Get the latest VHal property values, mPropertyValues is kept if they
+    // did not change.
     if (mVhalHandler != nullptr) {
-        if (!mVhalHandler->getPropertyValues(&mPropertyValues)) {
+        bool isUpdated = false;
+        if (!mVhalHandler->getPropertyValues(&mPropertyValues, &isUpdated)) {
             LOG(ERROR) << "Failed to get property values";
         }
     } else {
@@ -721,13 +892,11 @@ bool SurroundView3dSession::handleFrames(int sequenceId) {
     if (!params.empty()) {
         mSurroundView->SetAnimations(params);
     } else {
-        LOG(INFO) << "AnimationParams is empty. Ignored";
+        LOG(DEBUG) << "AnimationParams is empty. Ignored";
     }
     ATRACE_END();
 
     // Get the view.
-    // TODO(161399517): Only single view is currently supported, add support for multiple views.
-    const View3d view3d = mViews[0];
     const RotationQuat quat = view3d.pose.rotation;
     const Translation trans = view3d.pose.translation;
     const std::array<float, 4> viewQuaternion = {quat.x, quat.y, quat.z, quat.w};
@@ -735,25 +904,39 @@ bool SurroundView3dSession::handleFrames(int sequenceId) {
 
     ATRACE_BEGIN("SV core lib method: Get3dSurroundView");
     if (mSurroundView->Get3dSurroundView(
-            mInputPointers, viewQuaternion, viewTranslation, &mOutputPointer)) {
+            slot->inputPointers, viewQuaternion, viewTranslation, &slot->outputPointer)) {
         LOG(INFO) << "Get3dSurroundView succeeded";
     } else {
         LOG(ERROR) << "Get3dSurroundView failed. "
                    << "Using memset to initialize to gray.";
-        memset(mOutputPointer.cpu_data_pointer, kGrayColor,
+        memset(slot->outputPointer.cpu_data_pointer, kGrayColor,
                mOutputHeight * mOutputWidth * kOutputNumChannels);
     }
     ATRACE_END();
 
+    // The frames were returned already unless they are read in place.
+    releaseEvsFrames(slot);
+
+    ATRACE_END();
+
+    return true;
+}
+
+bool SurroundView3dSession::copyToOutputBuffer(FramesSlot* slot) {
+    ATRACE_BEGIN(__PRETTY_FUNCTION__);
+
+    const sp<GraphicBuffer>& svTexture = slot->svTexture;
+
     ATRACE_BEGIN("Lock output texture (gpu to cpu)");
     void* textureDataPtr = nullptr;
-    mSvTexture->lock(GRALLOC_USAGE_SW_WRITE_OFTEN
+    svTexture->lock(GRALLOC_USAGE_SW_WRITE_OFTEN
                     | GRALLOC_USAGE_SW_READ_NEVER,
                     &textureDataPtr);
     ATRACE_END();
 
     if (!textureDataPtr) {
         LOG(ERROR) << "Failed to gain write access to GraphicBuffer!";
+        ATRACE_END();
         return false;
     }
 
@@ -763,13 +946,13 @@ bool SurroundView3dSession::handleFrames(int sequenceId) {
     // the width is 1080, but the stride is 2048. So we'd better copy the
     // data line by line, instead of single memcpy.
     uint8_t* writePtr = static_cast<uint8_t*>(textureDataPtr);
-    uint8_t* readPtr = static_cast<uint8_t*>(mOutputPointer.cpu_data_pointer);
-    const int readStride = mOutputWidth * kOutputNumChannels;
-    const int writeStride = mSvTexture->getStride() * kOutputNumChannels;
+    uint8_t* readPtr = static_cast<uint8_t*>(slot->outputPointer.cpu_data_pointer);
+    const int readStride = slot->outputPointer.width * kOutputNumChannels;
+    const int writeStride = svTexture->getStride() * kOutputNumChannels;
     if (readStride == writeStride) {
-        memcpy(writePtr, readPtr, readStride * mSvTexture->getHeight());
+        memcpy(writePtr, readPtr, readStride * svTexture->getHeight());
     } else {
-        for (int i=0; i<mSvTexture->getHeight(); i++) {
+        for (int i=0; i<svTexture->getHeight(); i++) {
             memcpy(writePtr, readPtr, readStride);
             writePtr = writePtr + writeStride;
             readPtr = readPtr + readStride;
@@ -779,34 +962,27 @@ bool SurroundView3dSession::handleFrames(int sequenceId) {
     ATRACE_END();
 
     ATRACE_BEGIN("Unlock output texture (cpu to gpu)");
-    mSvTexture->unlock();
+    svTexture->unlock();
     ATRACE_END();
 
-    ANativeWindowBuffer* buffer = mSvTexture->getNativeBuffer();
+    ANativeWindowBuffer* buffer = svTexture->getNativeBuffer();
     LOG(DEBUG) << "ANativeWindowBuffer->handle: " << buffer->handle;
 
-    {
-        scoped_lock<mutex> lock(mAccessLock);
-
-        mFramesRecord.frames.svBuffers.resize(1);
-        SvBuffer& svBuffer = mFramesRecord.frames.svBuffers[0];
-        svBuffer.viewId = 0;
-        svBuffer.hardwareBuffer.nativeHandle = buffer->handle;
-        AHardwareBuffer_Desc* pDesc =
-            reinterpret_cast<AHardwareBuffer_Desc *>(
-                &svBuffer.hardwareBuffer.description);
-        pDesc->width = mOutputWidth;
-        pDesc->height = mOutputHeight;
-        pDesc->layers = 1;
-        pDesc->usage = GRALLOC_USAGE_HW_TEXTURE;
-        pDesc->stride = mSvTexture->getStride();
-        pDesc->format = HAL_PIXEL_FORMAT_RGBA_8888;
-        mFramesRecord.frames.timestampNs = elapsedRealtimeNano();
-        mFramesRecord.frames.sequenceId = sequenceId;
-
-        mFramesRecord.inUse = true;
-        mStream->receiveFrames(mFramesRecord.frames);
-    }
+    slot->frames.svBuffers.resize(1);
+    SvBuffer& svBuffer = slot->frames.svBuffers[0];
+    svBuffer.viewId = 0;
+    svBuffer.hardwareBuffer.nativeHandle = buffer->handle;
+    AHardwareBuffer_Desc* pDesc =
+        reinterpret_cast<AHardwareBuffer_Desc *>(
+            &svBuffer.hardwareBuffer.description);
+    pDesc->width = slot->outputPointer.width;
+    pDesc->height = slot->outputPointer.height;
+    pDesc->layers = 1;
+    pDesc->usage = GRALLOC_USAGE_HW_TEXTURE;
+    pDesc->stride = svTexture->getStride();
+    pDesc->format = HAL_PIXEL_FORMAT_RGBA_8888;
+    slot->frames.timestampNs = elapsedRealtimeNano();
+    slot->frames.sequenceId = slot->sequenceId;
 
     ATRACE_END();
 
@@ -843,18 +1019,6 @@ bool SurroundView3dSession::initialize() {
     mSurroundView->SetStaticData(params);
     ATRACE_END();
 
-    ATRACE_BEGIN("Allocate cpu buffers");
-    mInputPointers.resize(kNumFrames);
-    for (int i = 0; i < kNumFrames; i++) {
-        mInputPointers[i].width = mCameraParams[i].size.width;
-        mInputPointers[i].height = mCameraParams[i].size.height;
-        mInputPointers[i].format = Format::RGBA;
-        mInputPointers[i].cpu_data_pointer =
-                static_cast<void*>(new uint8_t[mInputPointers[i].width * mInputPointers[i].height *
-                                               kInputNumChannels]);
-    }
-    LOG(INFO) << "Allocated " << kNumFrames << " input pointers";
-
     mOutputWidth = mIOModuleConfig->sv3dConfig.sv3dParams.resolution.width;
     mOutputHeight = mIOModuleConfig->sv3dConfig.sv3dParams.resolution.height;
 
@@ -862,33 +1026,40 @@ bool SurroundView3dSession::initialize() {
     mConfig.height = mOutputHeight;
     mConfig.carDetails = SvQuality::HIGH;
 
-    mOutputPointer.height = mOutputHeight;
-    mOutputPointer.width = mOutputWidth;
-    mOutputPointer.format = Format::RGBA;
-    mOutputPointer.cpu_data_pointer =
-            static_cast<void*>(new char[mOutputHeight * mOutputWidth * kOutputNumChannels]);
+    // Every slot holds a complete set of input and output buffers, so up to
+    // framesQueueDepth sets of frames are in flight at once.
+    ATRACE_BEGIN("Allocate frame slots");
+    mFramesSlots.resize(mIOModuleConfig->sv3dConfig.framesQueueDepth);
+    for (auto& slot : mFramesSlots) {
+        slot.inputPointers.resize(kNumFrames);
+        for (int i = 0; i < kNumFrames; i++) {
+            slot.inputPointers[i].width = mCameraParams[i].size.width;
+            slot.inputPointers[i].height = mCameraParams[i].size.height;
+            slot.inputPointers[i].format = Format::RGBA;
+            slot.inputMemory.emplace_back(
+                    static_cast<void*>(new uint8_t[slot.inputPointers[i].width *
+                                                   slot.inputPointers[i].height *
+                                                   kInputNumChannels]));
+            slot.inputPointers[i].cpu_data_pointer = slot.inputMemory[i];
+        }
 
-    if (!mOutputPointer.cpu_data_pointer) {
-        LOG(ERROR) << "Memory allocation failed. Exiting.";
-        return false;
+        if (!allocateOutputBuffer(&slot, mOutputWidth, mOutputHeight)) {
+            return false;
+        }
     }
+    LOG(INFO) << "Allocated " << mFramesSlots.size() << " frame slots of "
+              << kNumFrames << " input pointers";
     ATRACE_END();
 
-    ATRACE_BEGIN("Allocate output texture");
-    mSvTexture = new GraphicBuffer(mOutputWidth,
-                                   mOutputHeight,
-                                   HAL_PIXEL_FORMAT_RGBA_8888,
-                                   1,
-                                   GRALLOC_USAGE_HW_TEXTURE,
-                                   "SvTexture");
-
-    if (mSvTexture->initCheck() == OK) {
-        LOG(INFO) << "Successfully allocated Graphic Buffer";
-    } else {
-        LOG(ERROR) << "Failed to allocate Graphic Buffer";
-        return false;
+    // Points are projected exactly until the lookup tables are built.
+    const int gridStep = mIOModuleConfig->cameraConfig.projectionLutGridStep;
+    if (gridStep > 0) {
+        for (int i = 0; i < kNumFrames; i++) {
+            mProjectionLuts.push_back(std::make_unique<ProjectionLut>(
+                    mCameraParams[i].size.width, mCameraParams[i].size.height, gridStep, 3));
+        }
+        mProjectionLutThread = thread([this]() { buildProjectionLuts(); });
     }
-    ATRACE_END();
 
     mIsInitialized = true;
 
@@ -897,6 +1068,38 @@ bool SurroundView3dSession::initialize() {
     return true;
 }
 
+void SurroundView3dSession::waitForProjectionLuts() {
+    if (mProjectionLutThread.joinable()) {
+        mProjectionLutThread.join();
+    }
+}
+
+void SurroundView3dSession::buildProjectionLuts() {
+    ATRACE_BEGIN(__PRETTY_FUNCTION__);
+
+    // The tables keep the projections in meters, like the core lib.
+    for (int i = 0; i < mProjectionLuts.size(); i++) {
+        const bool isBuilt = mProjectionLuts[i]->build(
+                [this, i](const Coordinate2dInteger& cameraPoint, float* values) {
+                    Coordinate3dFloat projPoint3d(0.0, 0.0, 0.0);
+                    if (!mSurroundView->GetProjectionPointFromRawCameraToSurroundView3d(
+                                cameraPoint, i, &projPoint3d)) {
+                        return false;
+                    }
+                    values[0] = projPoint3d.x;
+                    values[1] = projPoint3d.y;
+                    values[2] = projPoint3d.z;
+                    return true;
+                });
+        if (!isBuilt) {
+            break;
+        }
+        LOG(INFO) << "Projection lookup table of camera " << i << " is built.";
+    }
+
+    ATRACE_END();
+}
+
 bool SurroundView3dSession::setupEvs() {
     ATRACE_BEGIN(__PRETTY_FUNCTION__);
 
@@ -1012,6 +1215,14 @@ bool SurroundView3dSession::setupEvs() {
 bool SurroundView3dSession::startEvs() {
     ATRACE_BEGIN(__PRETTY_FUNCTION__);
 
+    // Each slot may hold a set of EVS frames until it is rendered, and one
+    // more set is being delivered.
+    if (mIOModuleConfig->cameraConfig.zeroCopyInputEnabled &&
+        mCamera->setMaxFramesInFlight(mFramesSlots.size() + 1) != EvsResult::OK) {
+        LOG(WARNING) << "Failed to hold " << mFramesSlots.size() + 1
+                     << " frames in flight. Frames may be delayed.";
+    }
+
     mFramesHandler = new FramesHandler(mCamera, this);
     Return<EvsResult> result = mCamera->startVideoStream(mFramesHandler);
     if (result != EvsResult::OK) {
@@ -27,8 +27,12 @@
 #include <hidl/Status.h>
 
 #include "AnimationModule.h"
+#include "InputBufferCache.h"
+#include "OverlayCache.h"
+#include "ProjectionLut.h"
 #include "VhalHandler.h"
 
+#include <deque>
 #include <thread>
 
 #include <ui/GraphicBuffer.h>
@@ -89,6 +93,10 @@ public:
     ~SurroundView3dSession();
     bool initialize();
 
+    // Blocks until the projection lookup tables are built. Meant for tests,
+    // must not be called concurrently with the destructor.
+    void waitForProjectionLuts();
+
     // Methods from ::android::hardware::automotive::sv::V1_0::ISurroundViewSession.
     Return<SvResult> startStream(
         const sp<ISurroundViewStream>& stream) override;
@@ -106,18 +114,71 @@ public:
         projectCameraPointsTo3dSurface_cb _hidl_cb);
 
 private:
+    // A set of EVS input frames and the Surround View result rendered from
+    // them. The frames pass through three stages, each of which owns a slot
+    // only while the slot is in the state of that stage:
+    //   ingest  - copies the EVS frames in, on the EVS callback thread
+    //   render  - runs the core lib, on mProcessThread
+    //   publish - copies the result out and delivers it, on mPublishThread
+    // The slots bound the number of frames queued between the stages.
+    struct FramesSlot {
+        enum State {
+            FREE,
+            INGESTING,
+            INGESTED,       // Queued for rendering
+            RENDERING,
+            RENDERED,       // Queued for publishing
+            WITH_CLIENT,    // Delivered; waiting for doneWithFrames
+        };
+
+        State state = FREE;
+        int sequenceId = 0;
+
+        std::vector<SurroundViewInputBufferPointers> inputPointers;
+        SurroundViewResultPointer outputPointer;
+        sp<GraphicBuffer> svTexture;
+
+        // The memory the EVS frames are copied to, unless inputPointers refer
+        // to the EVS buffers in place. In that case the buffers stay locked,
+        // and the EVS frames are held, until the rendering is done.
+        std::vector<void*> inputMemory;
+        std::vector<sp<GraphicBuffer>> lockedInputBuffers;
+        hidl_vec<BufferDesc_1_1> evsBuffers;
+
+        SvFramesDesc frames;
+    };
+
+    // Render stage; owns the core lib 3d pipeline.
     void processFrames();
 
+    // Publish stage.
+    void publishFrames();
+
     // Set up and open the Evs camera(s), triggered when session is created.
     bool setupEvs();
 
     // Start Evs camera video stream, triggered when SV stream is started.
     bool startEvs();
 
-    bool handleFrames(int sequenceId);
+    bool ingestFrames(const hidl_vec<BufferDesc_1_1>& buffers, FramesSlot* slot);
+    bool renderFrames(FramesSlot* slot);
+    bool copyToOutputBuffer(FramesSlot* slot);
+
+    bool allocateOutputBuffer(FramesSlot* slot, int width, int height);
+
+    // Builds mProjectionLuts; runs on mProjectionLutThread.
+    void buildProjectionLuts();
+
+    // Unlocks the EVS buffers read in place by a slot and returns the EVS
+    // frames held by it, if any.
+    void releaseEvsFrames(FramesSlot* slot);
 
-    bool copyFromBufferToPointers(BufferDesc_1_1 buffer,
-                                  SurroundViewInputBufferPointers pointers);
+    // Emits the number of slots in each state as trace counters.
+    void traceSlotCounters_Locked();
+
+    // Makes the input pointers of a slot refer to the content of an EVS
+    // buffer, either in place or through a copy.
+    bool mapInputBuffer(const BufferDesc_1_1& buffer, FramesSlot* slot, int index);
 
     enum StreamStateValues {
         STOPPED,
@@ -138,23 +199,28 @@ private:
     sp<ISurroundViewStream> mStream GUARDED_BY(mAccessLock);
     StreamStateValues mStreamState GUARDED_BY(mAccessLock);
 
-    std::thread mProcessThread; // The thread we'll use to process frames
+    std::thread mProcessThread; // The thread we'll use to render frames
+    std::thread mPublishThread; // The thread we'll use to deliver frames
 
     // Reference to the inner class, to handle the incoming Evs frames
     sp<FramesHandler> mFramesHandler;
 
-    // Used to signal a set of frames is ready
+    // Used to signal a set of frames is ready to be rendered
     condition_variable mFramesSignal GUARDED_BY(mAccessLock);
-    bool mProcessingEvsFrames GUARDED_BY(mAccessLock);
+
+    // Used to signal a set of frames is ready to be published
+    condition_variable mPublishSignal GUARDED_BY(mAccessLock);
+
+    // Set once mProcessThread has drained mIngestedSlots after a stop request
+    bool mRenderingDone GUARDED_BY(mAccessLock);
 
     int mSequenceId;
 
-    struct FramesRecord {
-        SvFramesDesc frames;
-        bool inUse = false;
-    };
+    std::vector<FramesSlot> mFramesSlots GUARDED_BY(mAccessLock);
 
-    FramesRecord mFramesRecord GUARDED_BY(mAccessLock);
+    // Indices into mFramesSlots, in the order of their sequence ids
+    std::deque<int> mIngestedSlots GUARDED_BY(mAccessLock);
+    std::deque<int> mRenderedSlots GUARDED_BY(mAccessLock);
 
     // Synchronization necessary to deconflict mCaptureThread from the main service thread
     std::mutex mAccessLock;
@@ -167,12 +233,9 @@ private:
 
     std::unique_ptr<SurroundView> mSurroundView GUARDED_BY(mAccessLock);
 
-    std::vector<SurroundViewInputBufferPointers>
-        mInputPointers GUARDED_BY(mAccessLock);
-    SurroundViewResultPointer mOutputPointer GUARDED_BY(mAccessLock);
-    int mOutputWidth, mOutputHeight GUARDED_BY(mAccessLock);
-
-    sp<GraphicBuffer> mSvTexture GUARDED_BY(mAccessLock);
+    // The output resolution the core lib is configured with. Only accessed by
+    // the render stage once the stream is running.
+    int mOutputWidth, mOutputHeight;
 
     bool mIsInitialized GUARDED_BY(mAccessLock) = false;
 
@@ -180,10 +243,21 @@ private:
     AnimationModule* mAnimationModule;
     IOModuleConfig* mIOModuleConfig;
 
-    std::vector<Overlay> mOverlays GUARDED_BY(mAccessLock);
-    bool mOverlayIsUpdated GUARDED_BY(mAccessLock) = false;
+    OverlayCache mOverlayCache GUARDED_BY(mAccessLock);
+
+    // Generation of the overlays last set to the core lib. Only accessed by
+    // the render stage.
+    uint64_t mOverlaysGeneration = 0;
 
     std::vector<VehiclePropValue> mPropertyValues;
+
+    // Imported EVS buffers; cleared whenever the stream is started.
+    InputBufferCache mInputBufferCache;
+
+    // Precomputed projections of the camera points, by camera index. Empty if
+    // disabled by the config, built on mProjectionLutThread otherwise.
+    std::vector<std::unique_ptr<ProjectionLut>> mProjectionLuts;
+    std::thread mProjectionLutThread;
 };
 
 }  // namespace implementation
@@ -123,7 +123,7 @@ bool SurroundViewService::initialize() {
     // Initialize the VHal Handler with update method and rate.
     // TODO(b/157498592): The update rate should align with the EVS camera
     // update rate.
-    if (mVhalHandler->initialize(VhalHandler::GET, kVhalUpdateRate)) {
+    if (mVhalHandler->initialize(VhalHandler::SUBSCRIBE, kVhalUpdateRate)) {
         // Initialize the vhal handler properties to read.
         std::vector<uint64_t> propertiesToRead;
 
@@ -16,6 +16,7 @@
 
 #include "VhalHandler.h"
 
+#include <algorithm>
 #include <chrono>
 #include <cmath>
 #include <condition_variable>
@@ -35,12 +36,46 @@ namespace V1_0 {
 namespace implementation {
 
 using vehicle::V2_0::IVehicle;
+using vehicle::V2_0::IVehicleCallback;
 using vehicle::V2_0::StatusCode;
+using vehicle::V2_0::SubscribeFlags;
+using vehicle::V2_0::SubscribeOptions;
 using vehicle::V2_0::VehiclePropertyType;
 using vehicle::V2_0::VehiclePropValue;
 
+namespace {
+
+// Returns the distinct property ids of |properties|, as each subscription
+// covers all the areas of a property.
+std::vector<int32_t> getPropertyIds(const std::vector<VehiclePropValue>& properties) {
+    std::vector<int32_t> propertyIds;
+    for (const auto& property : properties) {
+        if (std::find(propertyIds.begin(), propertyIds.end(), property.prop) ==
+            propertyIds.end()) {
+            propertyIds.push_back(property.prop);
+        }
+    }
+    return propertyIds;
+}
+
+}  // namespace
+
 bool VhalHandler::initialize(UpdateMethod updateMethod, int rate) {
     LOG(DEBUG) << __FUNCTION__;
+
+    LOG(INFO) << "Connecting to Vehicle HAL";
+    sp<IVehicle> vhalService = IVehicle::getService();
+    if (vhalService.get() == nullptr) {
+        LOG(ERROR) << "Vehicle HAL getService failed.";
+        return false;
+    }
+
+    return initialize(updateMethod, rate, vhalService);
+}
+
+bool VhalHandler::initialize(UpdateMethod updateMethod, int rate,
+                             const sp<IVehicle>& vhalService) {
+    LOG(DEBUG) << __FUNCTION__;
     std::scoped_lock<std::mutex> lock(mAccessLock);
 
     if (mIsInitialized) {
@@ -48,10 +83,8 @@ bool VhalHandler::initialize(UpdateMethod updateMethod, int rate) {
         return false;
     }
 
-    LOG(INFO) << "Connecting to Vehicle HAL";
-    mVhalServicePtr = IVehicle::getService();
-    if (mVhalServicePtr.get() == nullptr) {
-        LOG(ERROR) << "Vehicle HAL getService failed.";
+    if (vhalService.get() == nullptr) {
+        LOG(ERROR) << "Vehicle HAL service is null.";
         return false;
     }
 
@@ -60,11 +93,7 @@ bool VhalHandler::initialize(UpdateMethod updateMethod, int rate) {
         return false;
     }
 
-    if (mUpdateMethod == UpdateMethod::SUBSCRIBE) {
-        LOG(ERROR) << "Update method Subscribe is not currently implemented.";
-        return false;
-    }
-
+    mVhalServicePtr = vhalService;
     mUpdateMethod = updateMethod;
     mRate = rate;
     mIsInitialized = true;
@@ -73,6 +102,68 @@ bool VhalHandler::initialize(UpdateMethod updateMethod, int rate) {
     return true;
 }
 
+std::vector<VehiclePropValue> VhalHandler::readProperties(
+        const std::vector<VehiclePropValue>& propertiesToRead) {
+    std::vector<VehiclePropValue> vehiclePropValues;
+    for (auto& propertyToRead : propertiesToRead) {
+        StatusCode statusResult = StatusCode::INTERNAL_ERROR;
+        VehiclePropValue propValueResult;
+        mVhalServicePtr->get(propertyToRead,
+                             [&statusResult,
+                              &propValueResult](StatusCode status,
+                                                const VehiclePropValue& propValue) {
+                                 statusResult = status;
+                                 propValueResult = propValue;
+                             });
+        if (statusResult != StatusCode::OK) {
+            LOG(WARNING) << "Failed to read vhal property: " << propertyToRead.prop
+                         << ", with status code: " << static_cast<int32_t>(statusResult);
+        } else {
+            vehiclePropValues.push_back(propValueResult);
+        }
+    }
+    return vehiclePropValues;
+}
+
+void VhalHandler::updatePropertyValues(const std::vector<VehiclePropValue>& propValues) {
+    std::scoped_lock<std::mutex> lock(mUpdateLock);
+
+    bool isChanged = false;
+    for (const auto& propValue : propValues) {
+        for (size_t i = 0; i < mLatestValues.size(); i++) {
+            VehiclePropValue& latestValue = mLatestValues[i];
+            if (latestValue.prop != propValue.prop || latestValue.areaId != propValue.areaId) {
+                continue;
+            }
+            // Only the value matters to the readers, a new timestamp alone
+            // is not a change.
+            if (!mIsValueReceived[i] || latestValue.status != propValue.status ||
+                latestValue.value != propValue.value) {
+                latestValue = propValue;
+                mIsValueReceived[i] = true;
+                isChanged = true;
+            }
+            break;
+        }
+    }
+
+    if (isChanged) {
+        publishPropertyValues();
+    }
+}
+
+void VhalHandler::publishPropertyValues() {
+    // Fill the write buffer, then publish it.
+    std::vector<VehiclePropValue>& propertyValues = mPropertyValuesBuffers[mWriteIndex];
+    propertyValues.clear();
+    for (size_t i = 0; i < mLatestValues.size(); i++) {
+        if (mIsValueReceived[i]) {
+            propertyValues.push_back(mLatestValues[i]);
+        }
+    }
+    mWriteIndex = mPublishedIndex.exchange(mWriteIndex | kNewValuesFlag) & ~kNewValuesFlag;
+}
+
 void VhalHandler::pollProperties() {
     LOG(DEBUG) << "Polling thread started.";
     while (true) {
@@ -91,32 +182,8 @@ void VhalHandler::pollProperties() {
             rate = mRate;
         }
 
-        // Make get call for each VHAL property.
-        // Write to back property values, note lock is not needed as only this thread uses it.
-        std::vector<VehiclePropValue> vehiclePropValuesUpdated;
-        for (auto& propertyToRead : propertiesToRead) {
-            StatusCode statusResult;
-            VehiclePropValue propValueResult;
-            mVhalServicePtr->get(propertyToRead,
-                                 [&statusResult,
-                                  &propValueResult](StatusCode status,
-                                                    const VehiclePropValue& propValue) {
-                                     statusResult = status;
-                                     propValueResult = propValue;
-                                 });
-            if (statusResult != StatusCode::OK) {
-                LOG(WARNING) << "Failed to read vhal property: " << propertyToRead.prop
-                             << ", with status code: " << static_cast<int32_t>(statusResult);
-            } else {
-                vehiclePropValuesUpdated.push_back(propValueResult);
-            }
-        }
-
-        // Update property values by swapping with updated property values.
-        {
-            std::scoped_lock<std::mutex> lock(mAccessLock);
-            std::swap(mPropertyValues, vehiclePropValuesUpdated);
-        }
+        // Make get call for each VHAL property, and update the property values.
+        updatePropertyValues(readProperties(propertiesToRead));
 
         std::unique_lock<std::mutex> sleepLock(mPollThreadSleepMutex);
         // Sleep to generate frames at kTargetFrameRate.
@@ -134,6 +201,55 @@ void VhalHandler::pollProperties() {
     }
 }
 
+bool VhalHandler::subscribeProperties() {
+    // Read the current values, as on-change properties are only reported
+    // when they change.
+    updatePropertyValues(readProperties(mPropertiesToRead));
+
+    std::vector<SubscribeOptions> options;
+    for (const int32_t propertyId : getPropertyIds(mPropertiesToRead)) {
+        options.push_back(SubscribeOptions{
+                .propId = propertyId,
+                .sampleRate = static_cast<float>(mRate),
+                .flags = SubscribeFlags::EVENTS_FROM_CAR,
+        });
+    }
+    if (options.empty()) {
+        return true;
+    }
+
+    mVhalCallback = new VhalCallback(this);
+    Return<StatusCode> result = mVhalServicePtr->subscribe(mVhalCallback, options);
+    if (!result.isOk()) {
+        LOG(ERROR) << "Failed to subscribe to vhal properties: " << result.description();
+        return false;
+    }
+    if (static_cast<StatusCode>(result) != StatusCode::OK) {
+        LOG(ERROR) << "Failed to subscribe to vhal properties, with status code: "
+                   << static_cast<int32_t>(static_cast<StatusCode>(result));
+        return false;
+    }
+
+    return true;
+}
+
+void VhalHandler::unsubscribeProperties() {
+    if (mVhalCallback == nullptr) {
+        return;
+    }
+
+    for (const int32_t propertyId : getPropertyIds(mPropertiesToRead)) {
+        Return<StatusCode> result = mVhalServicePtr->unsubscribe(mVhalCallback, propertyId);
+        if (!result.isOk() || static_cast<StatusCode>(result) != StatusCode::OK) {
+            LOG(WARNING) << "Failed to unsubscribe from vhal property: " << propertyId;
+        }
+    }
+
+    // Events may still be in flight.
+    mVhalCallback->detach();
+    mVhalCallback = nullptr;
+}
+
 bool VhalHandler::startPropertiesUpdate() {
     LOG(DEBUG) << __FUNCTION__;
     std::scoped_lock<std::mutex> lock(mAccessLock);
@@ -156,8 +272,25 @@ bool VhalHandler::startPropertiesUpdate() {
         mPollStopSleeping = false;
     }
 
+    // A reader of the previous update may have taken the values already, and
+    // the update only publishes the values that change.
+    {
+        std::scoped_lock<std::mutex> updateLock(mUpdateLock);
+        if (std::find(mIsValueReceived.begin(), mIsValueReceived.end(), true) !=
+            mIsValueReceived.end()) {
+            publishPropertyValues();
+        }
+    }
+
+    mIsPolling = mUpdateMethod == UpdateMethod::GET;
+    if (mUpdateMethod == UpdateMethod::SUBSCRIBE && !subscribeProperties()) {
+        LOG(WARNING) << "Cannot subscribe to vhal properties, polling them instead.";
+        unsubscribeProperties();
+        mIsPolling = true;
+    }
+
     // Start polling thread if updated method is GET.
-    if (mUpdateMethod == UpdateMethod::GET) {
+    if (mIsPolling) {
         mPollingThread = std::thread([this]() { pollProperties(); });
     }
 
@@ -168,9 +301,21 @@ bool VhalHandler::setPropertiesToRead(const std::vector<VehiclePropValue>& prope
     LOG(DEBUG) << __FUNCTION__;
     std::scoped_lock<std::mutex> lock(mAccessLock);
 
+    // Subscriptions are made for the properties when the update starts.
+    if (mIsUpdateActive && !mIsPolling) {
+        LOG(ERROR) << "Cannot change subscribed properties while the update is active.";
+        return false;
+    }
+
     // Replace property ids to read.
     mPropertiesToRead = propertiesToRead;
 
+    {
+        std::scoped_lock<std::mutex> updateLock(mUpdateLock);
+        mLatestValues = propertiesToRead;
+        mIsValueReceived.assign(propertiesToRead.size(), false);
+    }
+
     return true;
 }
 
@@ -188,8 +333,21 @@ bool VhalHandler::setPropertiesToRead(const std::vector<uint64_t>& propertiesToR
 }
 
 bool VhalHandler::getPropertyValues(std::vector<VehiclePropValue>* property_values) {
+    bool isUpdated = false;
+    if (!getPropertyValues(property_values, &isUpdated)) {
+        return false;
+    }
+
+    if (!isUpdated) {
+        *property_values = mPropertyValuesBuffers[mReadIndex];
+    }
+
+    return true;
+}
+
+bool VhalHandler::getPropertyValues(std::vector<VehiclePropValue>* property_values,
+                                    bool* isUpdated) {
     LOG(DEBUG) << __FUNCTION__;
-    std::scoped_lock<std::mutex> lock(mAccessLock);
 
     // Check Vhal service is initialized.
     if (!mIsInitialized) {
@@ -197,8 +355,16 @@ bool VhalHandler::getPropertyValues(std::vector<VehiclePropValue>* property_valu
         return false;
     }
 
+    *isUpdated = (mPublishedIndex.load() & kNewValuesFlag) != 0;
+    if (!*isUpdated) {
+        return true;
+    }
+
+    // Take the published values, and give back the ones read previously.
+    mReadIndex = mPublishedIndex.exchange(mReadIndex) & ~kNewValuesFlag;
+
     // Copy current property values to argument.
-    *property_values = mPropertyValues;
+    *property_values = mPropertyValuesBuffers[mReadIndex];
 
     return true;
 }
@@ -220,6 +386,11 @@ bool VhalHandler::stopPropertiesUpdate() {
         }
 
         mIsUpdateActive = false;
+
+        if (!mIsPolling) {
+            unsubscribeProperties();
+            return true;
+        }
     }
 
     // Wake up the polling thread.
@@ -235,6 +406,32 @@ bool VhalHandler::stopPropertiesUpdate() {
     return true;
 }
 
+void VhalHandler::VhalCallback::detach() {
+    std::scoped_lock<std::mutex> lock(mLock);
+    mVhalHandler = nullptr;
+}
+
+Return<void> VhalHandler::VhalCallback::onPropertyEvent(
+        const hidl_vec<VehiclePropValue>& propValues) {
+    std::scoped_lock<std::mutex> lock(mLock);
+    if (mVhalHandler != nullptr) {
+        mVhalHandler->updatePropertyValues(propValues);
+    }
+    return {};
+}
+
+Return<void> VhalHandler::VhalCallback::onPropertySet(const VehiclePropValue& /*propValue*/) {
+    // Only events from the car are subscribed.
+    return {};
+}
+
+Return<void> VhalHandler::VhalCallback::onPropertySetError(StatusCode errorCode, int32_t propId,
+                                                           int32_t areaId) {
+    LOG(WARNING) << "Vhal property: " << propId << ", area: " << areaId
+                 << " set error, with status code: " << static_cast<int32_t>(errorCode);
+    return {};
+}
+
 }  // namespace implementation
 }  // namespace V1_0
 }  // namespace sv
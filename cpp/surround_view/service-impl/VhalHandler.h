@@ -17,11 +17,14 @@
 #ifndef SURROUND_VIEW_SERVICE_IMPL_VHALHANDLER_H_
 #define SURROUND_VIEW_SERVICE_IMPL_VHALHANDLER_H_
 
+#include <atomic>
+#include <condition_variable>
 #include <mutex>
 #include <thread>
 #include <vector>
 
 #include <android/hardware/automotive/vehicle/2.0/IVehicle.h>
+#include <android/hardware/automotive/vehicle/2.0/IVehicleCallback.h>
 
 using android::sp;
 
@@ -43,12 +46,20 @@ public:
 
         // Subscribes to the VHAL properties, to receive values periodically in a callback.
         // Use when VHAL implementation support multiple clients in subscribe calls.
-        // NOTE: Currently not implemented.
+        // Falls back to GET if the VHAL rejects the subscription.
         SUBSCRIBE
     };
 
     // Empty vhal handler constructor.
-    VhalHandler() : mIsInitialized(false), mUpdateMethod(GET), mRate(0), mIsUpdateActive(false) {}
+    VhalHandler() :
+          mIsInitialized(false),
+          mUpdateMethod(GET),
+          mRate(0),
+          mIsUpdateActive(false),
+          mIsPolling(false),
+          mWriteIndex(0),
+          mPublishedIndex(1),
+          mReadIndex(2) {}
 
     // Initializes the VHAL handler.
     // Valid range of rate is [1, 100] Hz.
@@ -56,6 +67,10 @@ public:
     // For get, higher rate may result in excessive binder calls and increased latency.
     bool initialize(UpdateMethod updateMethod, int rate);
 
+    // Same as above, with the VHAL service to use instead of the default one.
+    bool initialize(UpdateMethod updateMethod, int rate,
+                    const sp<vehicle::V2_0::IVehicle>& vhalService);
+
     // List of VHAL properties to read, can include vendor specific VHAL properties.
     // The updated method determines if properties are updated using get or subscribe calls.
     bool setPropertiesToRead(const std::vector<vehicle::V2_0::VehiclePropValue>& propertiesToRead);
@@ -64,21 +79,67 @@ public:
     // uint64_t = (32 bits vhal property id) | (32 bits area id).
     bool setPropertiesToRead(const std::vector<uint64_t>& propertiesToRead);
 
-    // Starts updating the VHAL properties with the specified rate.
+    // Starts updating the VHAL properties with the specified rate. The values
+    // received before are published again, so that a new reader gets them
+    // even if they do not change.
     bool startPropertiesUpdate();
 
     // Gets the last updated VHAL property values.
     // property_values is empty if startPropertiesUpdate() has not been called.
+    // It does not lock, and must not be called from several threads at once.
     bool getPropertyValues(std::vector<vehicle::V2_0::VehiclePropValue>* property_values);
 
+    // Same as above. |isUpdated| is set to false if the values did not change
+    // since the last call, in which case |property_values| is left untouched.
+    bool getPropertyValues(std::vector<vehicle::V2_0::VehiclePropValue>* property_values,
+                           bool* isUpdated);
+
     // Stops updating the VHAL properties.
     // For Get method, waits for the polling thread to exit.
     bool stopPropertiesUpdate();
 
 private:
+    // Callback receiving the subscribed VHAL property events.
+    class VhalCallback : public vehicle::V2_0::IVehicleCallback {
+    public:
+        explicit VhalCallback(VhalHandler* vhalHandler) : mVhalHandler(vhalHandler) {}
+
+        // Stops forwarding property events to the vhal handler.
+        void detach();
+
+        // Methods from ::android::hardware::automotive::vehicle::V2_0::IVehicleCallback.
+        Return<void> onPropertyEvent(
+                const hidl_vec<vehicle::V2_0::VehiclePropValue>& propValues) override;
+        Return<void> onPropertySet(const vehicle::V2_0::VehiclePropValue& propValue) override;
+        Return<void> onPropertySetError(vehicle::V2_0::StatusCode errorCode, int32_t propId,
+                                        int32_t areaId) override;
+
+    private:
+        std::mutex mLock;
+        VhalHandler* mVhalHandler;
+    };
+
     // Thread function to poll properties.
     void pollProperties();
 
+    // Makes a get call for each of |propertiesToRead|, and returns the values read.
+    std::vector<vehicle::V2_0::VehiclePropValue> readProperties(
+            const std::vector<vehicle::V2_0::VehiclePropValue>& propertiesToRead);
+
+    // Subscribes to the properties to read. Reads their current values first,
+    // as on-change properties are only reported when they change.
+    bool subscribeProperties();
+
+    // Unsubscribes from the properties to read.
+    void unsubscribeProperties();
+
+    // Stores the received values of the properties to read, and publishes
+    // them to the readers if any of them changed.
+    void updatePropertyValues(const std::vector<vehicle::V2_0::VehiclePropValue>& propValues);
+
+    // Publishes the received values to the readers. Requires mUpdateLock.
+    void publishPropertyValues();
+
     // Pointer to VHAL service.
     sp<vehicle::V2_0::IVehicle> mVhalServicePtr;
 
@@ -86,22 +147,42 @@ private:
     std::mutex mAccessLock;
 
     // Initialized parameters.
-    bool mIsInitialized;
+    std::atomic<bool> mIsInitialized;
     UpdateMethod mUpdateMethod;
     int mRate;
     bool mIsUpdateActive;
 
     // GET method related data members.
+    bool mIsPolling;
     std::thread mPollingThread;
     std::mutex mPollThreadSleepMutex;
     std::condition_variable mPollThreadCondition;
     bool mPollStopSleeping;
 
+    // SUBSCRIBE method related data members.
+    sp<VhalCallback> mVhalCallback;
+
     // List of properties to read.
     std::vector<vehicle::V2_0::VehiclePropValue> mPropertiesToRead;
 
-    // Updated list of property values.
-    std::vector<vehicle::V2_0::VehiclePropValue> mPropertyValues;
+    // Mutex for serializing the property value updates, which come from the
+    // polling thread or from the binder threads.
+    std::mutex mUpdateLock;
+
+    // Latest value of each property to read, and whether it was received.
+    // Guarded by mUpdateLock.
+    std::vector<vehicle::V2_0::VehiclePropValue> mLatestValues;
+    std::vector<bool> mIsValueReceived;
+
+    // Triple buffered property values. The updater fills the buffer at
+    // mWriteIndex and swaps it with the published one, the reader swaps the
+    // published buffer with the one at mReadIndex when it is new. Neither
+    // side waits for the other.
+    static constexpr int kNewValuesFlag = 0x4;
+    std::vector<vehicle::V2_0::VehiclePropValue> mPropertyValuesBuffers[3];
+    int mWriteIndex;
+    std::atomic<int> mPublishedIndex;
+    int mReadIndex;
 };
 
 }  // namespace implementation
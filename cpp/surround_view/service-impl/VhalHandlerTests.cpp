@@ -22,6 +22,10 @@
 #include <gtest/gtest.h>
 #include <time.h>
 
+#include <map>
+#include <mutex>
+#include <set>
+
 namespace android {
 namespace hardware {
 namespace automotive {
@@ -30,8 +34,102 @@ namespace V1_0 {
 namespace implementation {
 namespace {
 
+using vehicle::V2_0::IVehicle;
+using vehicle::V2_0::IVehicleCallback;
+using vehicle::V2_0::StatusCode;
+using vehicle::V2_0::SubscribeOptions;
 using vehicle::V2_0::VehicleArea;
 using vehicle::V2_0::VehicleProperty;
+using vehicle::V2_0::VehiclePropValue;
+
+// Local VHAL keeping the property values set, and reporting them to the
+// subscribed callback.
+class FakeVehicle : public IVehicle {
+public:
+    Return<void> getAllPropConfigs(getAllPropConfigs_cb _hidl_cb) override {
+        _hidl_cb({});
+        return {};
+    }
+
+    Return<void> getPropConfigs(const hidl_vec<int32_t>& /*props*/,
+                                getPropConfigs_cb _hidl_cb) override {
+        _hidl_cb(StatusCode::INVALID_ARG, {});
+        return {};
+    }
+
+    Return<void> get(const VehiclePropValue& requestedPropValue, get_cb _hidl_cb) override {
+        std::scoped_lock<std::mutex> lock(mLock);
+        const auto propValue = mPropValues.find(requestedPropValue.prop);
+        if (propValue == mPropValues.end()) {
+            _hidl_cb(StatusCode::NOT_AVAILABLE, requestedPropValue);
+        } else {
+            _hidl_cb(StatusCode::OK, propValue->second);
+        }
+        return {};
+    }
+
+    Return<StatusCode> set(const VehiclePropValue& propValue) override {
+        sp<IVehicleCallback> callback;
+        {
+            std::scoped_lock<std::mutex> lock(mLock);
+            mPropValues[propValue.prop] = propValue;
+            if (mSubscribedProps.find(propValue.prop) != mSubscribedProps.end()) {
+                callback = mCallback;
+            }
+        }
+        if (callback != nullptr) {
+            callback->onPropertyEvent(hidl_vec<VehiclePropValue>{propValue});
+        }
+        return StatusCode::OK;
+    }
+
+    Return<StatusCode> subscribe(const sp<IVehicleCallback>& callback,
+                                 const hidl_vec<SubscribeOptions>& options) override {
+        std::scoped_lock<std::mutex> lock(mLock);
+        mCallback = callback;
+        for (const auto& option : options) {
+            mSubscribedProps.insert(option.propId);
+        }
+        return StatusCode::OK;
+    }
+
+    Return<StatusCode> unsubscribe(const sp<IVehicleCallback>& /*callback*/,
+                                   int32_t propId) override {
+        std::scoped_lock<std::mutex> lock(mLock);
+        mSubscribedProps.erase(propId);
+        return StatusCode::OK;
+    }
+
+    Return<void> debugDump(debugDump_cb _hidl_cb) override {
+        _hidl_cb("");
+        return {};
+    }
+
+    size_t getSubscribedPropsCount() {
+        std::scoped_lock<std::mutex> lock(mLock);
+        return mSubscribedProps.size();
+    }
+
+private:
+    std::mutex mLock;
+    std::map<int32_t, VehiclePropValue> mPropValues;
+    std::set<int32_t> mSubscribedProps;
+    sp<IVehicleCallback> mCallback;
+};
+
+VehiclePropValue getSpeedPropValue(float speed) {
+    VehiclePropValue propValue;
+    propValue.prop = static_cast<int32_t>(VehicleProperty::PERF_VEHICLE_SPEED);
+    propValue.areaId = static_cast<int32_t>(VehicleArea::GLOBAL);
+    propValue.value.floatValues = {speed};
+    return propValue;
+}
+
+void SetSpeedPropertyToRead(VhalHandler* vhalHandler) {
+    std::vector<VehiclePropValue> propertiesToRead;
+    propertiesToRead.push_back(getSpeedPropValue(0.0f));
+    ASSERT_TRUE(vhalHandler->setPropertiesToRead(propertiesToRead));
+}
 
 void SetSamplePropertiesToRead(VhalHandler* vhalHandler) {
     std::vector<vehicle::V2_0::VehiclePropValue> propertiesToRead;
@@ -118,6 +216,116 @@ TEST(VhalhandlerTests, GetMethodInt64Success) {
     EXPECT_TRUE(vhalHandler.stopPropertiesUpdate());
 }
 
+TEST(VhalhandlerTests, SubscribeMethodSuccess) {
+    sp<FakeVehicle> fakeVehicle = new FakeVehicle();
+    fakeVehicle->set(getSpeedPropValue(10.0f));
+
+    VhalHandler vhalHandler;
+    ASSERT_TRUE(vhalHandler.initialize(VhalHandler::UpdateMethod::SUBSCRIBE, 10, fakeVehicle));
+    SetSpeedPropertyToRead(&vhalHandler);
+    ASSERT_TRUE(vhalHandler.startPropertiesUpdate());
+    EXPECT_EQ(fakeVehicle->getSubscribedPropsCount(), 1);
+
+    // The value set before subscribing is read when the update starts.
+    std::vector<VehiclePropValue> propertyValues;
+    bool isUpdated = false;
+    EXPECT_TRUE(vhalHandler.getPropertyValues(&propertyValues, &isUpdated));
+    EXPECT_TRUE(isUpdated);
+    ASSERT_EQ(propertyValues.size(), 1);
+    EXPECT_EQ(propertyValues[0].value.floatValues[0], 10.0f);
+
+    fakeVehicle->set(getSpeedPropValue(20.0f));
+    EXPECT_TRUE(vhalHandler.getPropertyValues(&propertyValues, &isUpdated));
+    EXPECT_TRUE(isUpdated);
+    ASSERT_EQ(propertyValues.size(), 1);
+    EXPECT_EQ(propertyValues[0].value.floatValues[0], 20.0f);
+
+    EXPECT_TRUE(vhalHandler.stopPropertiesUpdate());
+    EXPECT_EQ(fakeVehicle->getSubscribedPropsCount(), 0);
+}
+
+TEST(VhalhandlerTests, SubscribeMethodUnchangedValueNotUpdated) {
+    sp<FakeVehicle> fakeVehicle = new FakeVehicle();
+
+    VhalHandler vhalHandler;
+    ASSERT_TRUE(vhalHandler.initialize(VhalHandler::UpdateMethod::SUBSCRIBE, 10, fakeVehicle));
+    SetSpeedPropertyToRead(&vhalHandler);
+    ASSERT_TRUE(vhalHandler.startPropertiesUpdate());
+
+    // No value is available until one is set.
+    std::vector<VehiclePropValue> propertyValues;
+    bool isUpdated = true;
+    EXPECT_TRUE(vhalHandler.getPropertyValues(&propertyValues, &isUpdated));
+    EXPECT_FALSE(isUpdated);
+    EXPECT_TRUE(propertyValues.empty());
+
+    fakeVehicle->set(getSpeedPropValue(10.0f));
+    EXPECT_TRUE(vhalHandler.getPropertyValues(&propertyValues, &isUpdated));
+    EXPECT_TRUE(isUpdated);
+    EXPECT_EQ(propertyValues.size(), 1);
+
+    // Same value with a new timestamp.
+    VehiclePropValue propValue = getSpeedPropValue(10.0f);
+    propValue.timestamp = 1;
+    fakeVehicle->set(propValue);
+    EXPECT_TRUE(vhalHandler.getPropertyValues(&propertyValues, &isUpdated));
+    EXPECT_FALSE(isUpdated);
+
+    // Values are still returned without change detection.
+    propertyValues.clear();
+    EXPECT_TRUE(vhalHandler.getPropertyValues(&propertyValues));
+    EXPECT_EQ(propertyValues.size(), 1);
+
+    EXPECT_TRUE(vhalHandler.stopPropertiesUpdate());
+}
+
+TEST(VhalhandlerTests, StartAgainRepublishesValues) {
+    sp<FakeVehicle> fakeVehicle = new FakeVehicle();
+    fakeVehicle->set(getSpeedPropValue(10.0f));
+
+    VhalHandler vhalHandler;
+    ASSERT_TRUE(vhalHandler.initialize(VhalHandler::UpdateMethod::SUBSCRIBE, 10, fakeVehicle));
+    SetSpeedPropertyToRead(&vhalHandler);
+    ASSERT_TRUE(vhalHandler.startPropertiesUpdate());
+
+    std::vector<VehiclePropValue> propertyValues;
+    bool isUpdated = false;
+    EXPECT_TRUE(vhalHandler.getPropertyValues(&propertyValues, &isUpdated));
+    EXPECT_TRUE(isUpdated);
+    EXPECT_TRUE(vhalHandler.stopPropertiesUpdate());
+
+    // The value did not change, but a new reader needs it.
+    propertyValues.clear();
+    isUpdated = false;
+    ASSERT_TRUE(vhalHandler.startPropertiesUpdate());
+    EXPECT_TRUE(vhalHandler.getPropertyValues(&propertyValues, &isUpdated));
+    EXPECT_TRUE(isUpdated);
+    ASSERT_EQ(propertyValues.size(), 1);
+    EXPECT_EQ(propertyValues[0].value.floatValues[0], 10.0f);
+
+    EXPECT_TRUE(vhalHandler.stopPropertiesUpdate());
+}
+
+TEST(VhalhandlerTests, GetMethodFakeVhalSuccess) {
+    sp<FakeVehicle> fakeVehicle = new FakeVehicle();
+    fakeVehicle->set(getSpeedPropValue(10.0f));
+
+    VhalHandler vhalHandler;
+    ASSERT_TRUE(vhalHandler.initialize(VhalHandler::UpdateMethod::GET, 100, fakeVehicle));
+    SetSpeedPropertyToRead(&vhalHandler);
+    ASSERT_TRUE(vhalHandler.startPropertiesUpdate());
+    EXPECT_EQ(fakeVehicle->getSubscribedPropsCount(), 0);
+
+    fakeVehicle->set(getSpeedPropValue(20.0f));
+    usleep(100000);
+    std::vector<VehiclePropValue> propertyValues;
+    EXPECT_TRUE(vhalHandler.getPropertyValues(&propertyValues));
+    ASSERT_EQ(propertyValues.size(), 1);
+    EXPECT_EQ(propertyValues[0].value.floatValues[0], 20.0f);
+
+    EXPECT_TRUE(vhalHandler.stopPropertiesUpdate());
+}
+
 }  // namespace
 }  // namespace implementation
 }  // namespace V1_0
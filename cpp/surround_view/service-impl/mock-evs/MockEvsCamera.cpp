@@ -241,6 +241,15 @@ void MockEvsCamera::initializeFrames(int framesCount) {
     LOG(INFO) << "StreamCfg width: " << mStreamCfg.width
               << " height: " << mStreamCfg.height;
 
+    // Each frame is tagged with a physical camera of the group, so the frames
+    // are recognized by the surround view sessions.
+    vector<string> deviceIds;
+    unique_ptr<ConfigManager::CameraGroupInfo>& cameraGroupInfo =
+            mConfigManager->getCameraGroupInfo(mCameraDesc.v1.cameraId);
+    if (cameraGroupInfo != nullptr) {
+        deviceIds.assign(cameraGroupInfo->devices.begin(), cameraGroupInfo->devices.end());
+    }
+
     string label = "EmptyBuffer_";
     mGraphicBuffers.resize(framesCount);
     mBufferDescs.resize(framesCount);
@@ -262,6 +271,10 @@ void MockEvsCamera::initializeFrames(int framesCount) {
         pDesc->usage = GRALLOC_USAGE_HW_TEXTURE;
         pDesc->stride = mGraphicBuffers[i]->getStride();
         pDesc->format = HAL_PIXEL_FORMAT_RGBA_8888;
+        mBufferDescs[i].bufferId = i;
+        if (i < static_cast<int>(deviceIds.size())) {
+            mBufferDescs[i].deviceId = deviceIds[i];
+        }
     }
 }
 
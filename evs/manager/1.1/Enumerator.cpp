@@ -450,7 +450,11 @@ Return<sp<IEvsDisplay_1_0>> Enumerator::openDisplay() {
     // wraps the IEvsDisplay object the driver returns.  We may want to remove this
     // additional class when it is fixed properly.
     sp<IEvsDisplay_1_0> pHalDisplay = new HalDisplay(pActiveDisplay, mInternalDisplayPort);
+    sp<IEvsDisplay_1_0> pPrevDisplay = mActiveDisplay.promote();
     mActiveDisplay = pHalDisplay;
+    if (pPrevDisplay != nullptr) {
+        detachDisplay(pPrevDisplay);
+    }
 
     return pHalDisplay;
 }
@@ -469,12 +473,20 @@ Return<void> Enumerator::closeDisplay(const ::android::sp<IEvsDisplay_1_0>& disp
         sp<HalDisplay> halDisplay = reinterpret_cast<HalDisplay *>(pActiveDisplay.get());
         mHwEnumerator->closeDisplay(halDisplay->getHwDisplay());
         mActiveDisplay = nullptr;
+        detachDisplay(pActiveDisplay);
     }
 
     return Void();
 }
 
 
+void Enumerator::detachDisplay(const sp<IEvsDisplay_1_0>& display) {
+    for (auto&& [id, hwCamera] : mActiveCameras) {
+        hwCamera->detachDisplay(display);
+    }
+}
+
+
 Return<EvsDisplayState> Enumerator::getDisplayState()  {
     LOG(DEBUG) << __FUNCTION__;
     if (!checkPermission()) {
@@ -525,7 +537,11 @@ Return<sp<IEvsDisplay_1_1>> Enumerator::openDisplay_1_1(uint8_t id) {
     // wraps the IEvsDisplay object the driver returns.  We may want to remove this
     // additional class when it is fixed properly.
     sp<IEvsDisplay_1_1> pHalDisplay = new HalDisplay(pActiveDisplay, id);
+    sp<IEvsDisplay_1_0> pPrevDisplay = mActiveDisplay.promote();
     mActiveDisplay = pHalDisplay;
+    if (pPrevDisplay != nullptr) {
+        detachDisplay(pPrevDisplay);
+    }
 
     return pHalDisplay;
 }
@@ -86,6 +86,9 @@ private:
     bool                            isLogicalCamera(const camera_metadata_t *metadata);
     std::unordered_set<std::string> getPhysicalCameraIds(const std::string& id);
 
+    // Tells camera clients that a display is closed or replaced
+    void                            detachDisplay(const sp<IEvsDisplay_1_0>& display);
+
     sp<IEvsEnumerator_1_1>            mHwEnumerator;  // Hardware enumerator
     wp<IEvsDisplay_1_0>               mActiveDisplay; // Display proxy object warpping hw display
 
@@ -22,6 +22,8 @@
 #include <android-base/logging.h>
 #include <android-base/strings.h>
 
+#include <algorithm>
+
 namespace android {
 namespace automotive {
 namespace evs {
@@ -35,6 +37,13 @@ namespace implementation {
 using ::android::base::StringAppendF;
 using ::android::base::WriteStringToFd;
 
+// A frame held longer than this by a lower priority client can be taken away
+// to serve a higher priority client.
+constexpr int64_t kPreemptionDeadlineMs = 100;
+
+// Extra buffers reserved for each critical client while the camera is shared
+constexpr unsigned kReservedBuffersPerCriticalClient = 1;
+
 HalCamera::~HalCamera() {
     // Reports the usage statistics before the destruction
     // EvsUsageStatsReported atom is defined in
@@ -78,7 +87,13 @@ bool HalCamera::ownVirtualCamera(sp<VirtualCamera> virtualCamera) {
     }
 
     // Add this virtualCamera to our ownership list via weak pointer
-    mClients.emplace_back(virtualCamera);
+    {
+        std::lock_guard<std::mutex> lock(mFrameRecordMutex);
+        mClients.emplace_back(virtualCamera);
+    }
+
+    // A new client ends the pass-through mode
+    updatePassThroughMode();
 
     // Update statistics
     mUsageStats->updateNumClients(mClients.size());
@@ -95,10 +110,13 @@ void HalCamera::disownVirtualCamera(sp<VirtualCamera> virtualCamera) {
     }
 
     // Remove the virtual camera from our client list
-    unsigned clientCount = mClients.size();
-    mClients.remove(virtualCamera);
-    if (clientCount != mClients.size() + 1) {
-        LOG(ERROR) << "Couldn't find camera in our client list to remove it";
+    {
+        std::lock_guard<std::mutex> lock(mFrameRecordMutex);
+        unsigned clientCount = mClients.size();
+        mClients.remove(virtualCamera);
+        if (clientCount != mClients.size() + 1) {
+            LOG(ERROR) << "Couldn't find camera in our client list to remove it";
+        }
     }
 
     // Recompute the number of buffers required with the target camera removed from the list
@@ -106,21 +124,52 @@ void HalCamera::disownVirtualCamera(sp<VirtualCamera> virtualCamera) {
         LOG(ERROR) << "Error when trying to reduce the in flight buffer count";
     }
 
+    updatePassThroughMode();
+
     // Update statistics
     mUsageStats->updateNumClients(mClients.size());
 }
 
 
-bool HalCamera::changeFramesInFlight(int delta) {
-    // Walk all our clients and count their currently required frames
-    unsigned bufferCount = 0;
-    for (auto&& client :  mClients) {
+std::vector<sp<VirtualCamera>> HalCamera::getClients() {
+    std::vector<sp<VirtualCamera>> clients;
+    std::lock_guard<std::mutex> lock(mFrameRecordMutex);
+    for (auto&& client : mClients) {
         sp<VirtualCamera> virtCam = client.promote();
         if (virtCam != nullptr) {
-            bufferCount += virtCam->getAllowedBuffers();
+            clients.emplace_back(virtCam);
+        }
+    }
+
+    return clients;
+}
+
+
+unsigned HalCamera::getRequiredBufferCount() {
+    // Walk all our clients and count their currently required frames
+    unsigned bufferCount = 0;
+    unsigned numCriticalClients = 0;
+    const auto clients = getClients();
+    for (auto&& virtCam : clients) {
+        bufferCount += virtCam->getAllowedBuffers();
+        if (virtCam->getPriority() == VirtualCamera::Priority::CRITICAL) {
+            ++numCriticalClients;
         }
     }
 
+    // Critical clients get extra buffers so they do not starve while other
+    // clients hold theirs
+    if (clients.size() > 1) {
+        bufferCount += numCriticalClients * kReservedBuffersPerCriticalClient;
+    }
+
+    return bufferCount;
+}
+
+
+bool HalCamera::changeFramesInFlight(int delta) {
+    unsigned bufferCount = getRequiredBufferCount();
+
     // Add the requested delta
     bufferCount += delta;
 
@@ -135,6 +184,7 @@ bool HalCamera::changeFramesInFlight(int delta) {
 
     // Update the size of our array of outstanding frame records
     if (success) {
+        std::lock_guard<std::mutex> lock(mFrameRecordMutex);
         std::vector<FrameRecord> newRecords;
         newRecords.reserve(bufferCount);
 
@@ -149,6 +199,7 @@ bool HalCamera::changeFramesInFlight(int delta) {
         }
 
         mFrames.swap(newRecords);
+        mBufferCount = bufferCount;
     }
 
     return success;
@@ -163,14 +214,7 @@ bool HalCamera::changeFramesInFlight(const hidl_vec<BufferDesc_1_1>& buffers,
         return true;
     }
 
-    // Walk all our clients and count their currently required frames
-    auto bufferCount = 0;
-    for (auto&& client :  mClients) {
-        sp<VirtualCamera> virtCam = client.promote();
-        if (virtCam != nullptr) {
-            bufferCount += virtCam->getAllowedBuffers();
-        }
-    }
+    int bufferCount = getRequiredBufferCount();
 
     EvsResult status = EvsResult::OK;
     // Ask the hardware for the resulting buffer count
@@ -187,6 +231,7 @@ bool HalCamera::changeFramesInFlight(const hidl_vec<BufferDesc_1_1>& buffers,
     bufferCount += *delta;
 
     // Update the size of our array of outstanding frame records
+    std::lock_guard<std::mutex> lock(mFrameRecordMutex);
     std::vector<FrameRecord> newRecords;
     newRecords.reserve(bufferCount);
 
@@ -202,6 +247,7 @@ bool HalCamera::changeFramesInFlight(const hidl_vec<BufferDesc_1_1>& buffers,
     }
 
     mFrames.swap(newRecords);
+    mBufferCount = bufferCount;
 
     return true;
 }
@@ -218,6 +264,64 @@ void HalCamera::requestNewFrame(sp<VirtualCamera> client,
 }
 
 
+void HalCamera::preemptFrames(sp<VirtualCamera> virtualCamera) {
+    // Preemption runs on the clients' capture threads so it is serialized
+    // with the frame delivery and returns through the frame records.
+    const auto clients = getClients();
+    std::vector<sp<VirtualCamera>> victims;
+    {
+        std::lock_guard<std::mutex> lock(mFrameRecordMutex);
+
+        // A free buffer is going to be filled with the next frame; nothing
+        // needs to be taken away from other clients.  Frames forwarded in the
+        // pass-through mode may still be held after the mode ends.
+        const unsigned numBuffersInUse =
+                std::count_if(mFrames.begin(), mFrames.end(),
+                              [](const FrameRecord& rec) { return rec.refCount > 0; }) +
+                mNumFramesForwarded;
+        if (numBuffersInUse < mBufferCount) {
+            return;
+        }
+
+        const auto priority = virtualCamera->getPriority();
+        for (auto&& vCam : clients) {
+            if (vCam == virtualCamera || vCam->getPriority() >= priority) {
+                continue;
+            }
+
+            bool preempted = false;
+            std::vector<BufferDesc_1_1> forwarded;
+            for (auto&& buffer : vCam->preemptFrames(mId, kPreemptionDeadlineMs, &forwarded)) {
+                LOG(INFO) << getId() << ": Buffer #" << buffer.bufferId
+                          << " is preempted from " << vCam.get();
+                doneWithFrameLocked(buffer);
+                preempted = true;
+            }
+
+            for (auto&& buffer : forwarded) {
+                LOG(INFO) << getId() << ": Forwarded buffer #" << buffer.bufferId
+                          << " is preempted from " << vCam.get();
+                doneWithForwardedFrame(buffer);
+                preempted = true;
+            }
+
+            if (preempted) {
+                victims.emplace_back(vCam);
+            }
+        }
+    }
+
+    // Tells clients that they lost frames; their doneWithFrame calls on these
+    // buffers will be ignored.
+    EvsEventDesc event;
+    event.deviceId = mId;
+    event.aType = EvsEventType::FRAME_DROPPED;
+    for (auto&& vCam : victims) {
+        vCam->notify(event);
+    }
+}
+
+
 Return<EvsResult> HalCamera::clientStreamStarting() {
     Return<EvsResult> result = EvsResult::OK;
 
@@ -226,6 +330,8 @@ Return<EvsResult> HalCamera::clientStreamStarting() {
         result = mHwCamera->startVideoStream(this);
     }
 
+    updatePassThroughMode();
+
     return result;
 }
 
@@ -246,9 +352,10 @@ void HalCamera::clientStreamEnding(const VirtualCamera* client) {
             mNextRequests->erase(itReq);
         }
 
+        std::lock_guard<std::mutex> recordLock(mFrameRecordMutex);
         auto itCam = mClients.begin();
         while (itCam != mClients.end()) {
-            if (itCam->promote() == client) {
+            if (*itCam == client) {
                 break;
             } else {
                 ++itCam;
@@ -263,11 +370,8 @@ void HalCamera::clientStreamEnding(const VirtualCamera* client) {
 
     // Do we still have a running client?
     bool stillRunning = false;
-    for (auto&& client : mClients) {
-        sp<VirtualCamera> virtCam = client.promote();
-        if (virtCam != nullptr) {
-            stillRunning |= virtCam->isStreaming();
-        }
+    for (auto&& virtCam : getClients()) {
+        stillRunning |= virtCam->isStreaming();
     }
 
     // If not, then stop the hardware stream
@@ -275,64 +379,189 @@ void HalCamera::clientStreamEnding(const VirtualCamera* client) {
         mStreamState = STOPPING;
         mHwCamera->stopVideoStream();
     }
+
+    updatePassThroughMode();
 }
 
 
-Return<void> HalCamera::doneWithFrame(const BufferDesc_1_0& buffer) {
-    // Find this frame in our list of outstanding frames
-    unsigned i;
-    for (i = 0; i < mFrames.size(); i++) {
-        if (mFrames[i].frameId == buffer.bufferId) {
-            break;
+void HalCamera::updatePassThroughMode() {
+    // Pass-through mode is available only while a single v1.1 client is
+    // streaming from this physical camera.
+    std::vector<sp<VirtualCamera>> clients;
+    sp<VirtualCamera> soleClient = nullptr;
+    sp<VirtualCamera> prevClient = nullptr;
+
+    // Declared after the references above so it is released before them;
+    // dropping the last reference to a client calls back into this method.
+    std::lock_guard<std::mutex> switchLock(mPassThroughMutex);
+    clients = getClients();
+    soleClient = clients.empty() ? nullptr : clients.back();
+    bool passThrough = false;
+    uint64_t generation = 0;
+    {
+        std::lock_guard<std::mutex> lock(mFrameRecordMutex);
+        passThrough = clients.size() == 1 &&
+                      soleClient->getVersion() > 0 &&
+                      soleClient->isStreaming() &&
+                      !soleClient->isLogicalCamera();
+        prevClient = mPassThroughClient.promote();
+        if (passThrough == mPassThrough && (!passThrough || prevClient == soleClient)) {
+            // Nothing to change
+            return;
+        }
+
+        // New frames fall back to the fan-out delivery until the mode is
+        // settled.  mPassThrough stays as is so deliverFrame_1_1() keeps
+        // checking for the pass-through client.
+        mPassThroughClient = nullptr;
+        if (passThrough) {
+            generation = ++mPassThroughGeneration;
         }
     }
-    if (i == mFrames.size()) {
-        LOG(ERROR) << "We got a frame back with an ID we don't recognize!";
-    } else {
-        // Are there still clients using this buffer?
-        mFrames[i].refCount--;
-        if (mFrames[i].refCount <= 0) {
-            // Since all our clients are done with this buffer, return it to the device layer
-            mHwCamera->doneWithFrame(buffer);
-
-            // Counts a returned buffer
-            mUsageStats->framesReturned();
+
+    if (prevClient != nullptr) {
+        // A frame being forwarded to the previous client is refused from now
+        // on.  Frames it already holds are returned via
+        // doneWithForwardedFrame() regardless of the mode.
+        prevClient->setPassThrough(false, 0);
+    }
+
+    if (passThrough) {
+        {
+            // The client stops requesting frames while it is in the
+            // pass-through mode so pending requests are dropped.
+            std::lock_guard<std::mutex> lock(mFrameMutex);
+            mNextRequests->clear();
         }
+
+        soleClient->setPassThrough(true, generation);
+
+        std::lock_guard<std::mutex> lock(mFrameRecordMutex);
+        mPassThroughClient = soleClient;
     }
 
-    return Void();
+    mPassThrough = passThrough;
+
+    LOG(DEBUG) << getId() << (passThrough ? " enters" : " leaves") << " the pass-through mode";
 }
 
 
-Return<void> HalCamera::doneWithFrame(const BufferDesc_1_1& buffer) {
-    // Find this frame in our list of outstanding frames
-    unsigned i;
-    for (i = 0; i < mFrames.size(); i++) {
-        if (mFrames[i].frameId == buffer.bufferId) {
-            break;
+void HalCamera::holdFrameLocked(uint32_t frameId) {
+    auto it = std::find_if(mFrames.begin(), mFrames.end(),
+                           [frameId](const FrameRecord& rec) {
+                               return rec.frameId == frameId && rec.refCount > 0;
+                           });
+    if (it == mFrames.end()) {
+        it = std::find_if(mFrames.begin(), mFrames.end(),
+                          [](const FrameRecord& rec) { return rec.refCount == 0; });
+        if (it == mFrames.end()) {
+            it = mFrames.emplace(mFrames.end(), frameId);
+        } else {
+            it->frameId = frameId;
         }
     }
-    if (i == mFrames.size()) {
+
+    ++it->refCount;
+}
+
+
+bool HalCamera::releaseFrameLocked(uint32_t frameId, bool* released) {
+    auto it = std::find_if(mFrames.begin(), mFrames.end(),
+                           [frameId](const FrameRecord& rec) {
+                               return rec.frameId == frameId && rec.refCount > 0;
+                           });
+    if (it == mFrames.end()) {
+        return false;
+    }
+
+    --it->refCount;
+    *released = it->refCount == 0;
+    return true;
+}
+
+
+Return<void> HalCamera::doneWithFrame(const BufferDesc_1_0& buffer) {
+    std::lock_guard<std::mutex> lock(mFrameRecordMutex);
+
+    // Find this frame in our list of outstanding frames
+    bool released = false;
+    if (!releaseFrameLocked(buffer.bufferId, &released)) {
         LOG(ERROR) << "We got a frame back with an ID we don't recognize!";
-    } else {
-        // Are there still clients using this buffer?
-        mFrames[i].refCount--;
-        if (mFrames[i].refCount <= 0) {
-            // Since all our clients are done with this buffer, return it to the device layer
-            hardware::hidl_vec<BufferDesc_1_1> returnedBuffers;
-            returnedBuffers.resize(1);
-            returnedBuffers[0] = buffer;
-            mHwCamera->doneWithFrame_1_1(returnedBuffers);
-
-            // Counts a returned buffer
-            mUsageStats->framesReturned(returnedBuffers);
-        }
+    } else if (released) {
+        // Since all our clients are done with this buffer, return it to the device layer
+        mHwCamera->doneWithFrame(buffer);
+
+        // Counts a returned buffer
+        mUsageStats->framesReturned();
     }
 
     return Void();
 }
 
 
+Return<void> HalCamera::doneWithFrame(const BufferDesc_1_1& buffer) {
+    std::lock_guard<std::mutex> lock(mFrameRecordMutex);
+    doneWithFrameLocked(buffer);
+
+    return Void();
+}
+
+
+void HalCamera::doneWithForwardedFrame(const BufferDesc_1_1& buffer) {
+    // Frames forwarded in the pass-through mode are not tracked and therefore
+    // go back to the hardware directly.
+    --mNumFramesForwarded;
+    hardware::hidl_vec<BufferDesc_1_1> returnedBuffers;
+    returnedBuffers.resize(1);
+    returnedBuffers[0] = buffer;
+    mHwCamera->doneWithFrame_1_1(returnedBuffers);
+
+    // Counts a returned buffer
+    mUsageStats->framesReturned(returnedBuffers);
+}
+
+
+void HalCamera::doneWithFrameLocked(const BufferDesc_1_1& buffer) {
+    // Find this frame in our list of outstanding frames
+    bool released = false;
+    if (!releaseFrameLocked(buffer.bufferId, &released)) {
+        LOG(ERROR) << "We got a frame back with an ID we don't recognize!";
+    }
+
+    if (released) {
+        // Since all our clients are done with this buffer, return it to the device layer
+        hardware::hidl_vec<BufferDesc_1_1> returnedBuffers;
+        returnedBuffers.resize(1);
+        returnedBuffers[0] = buffer;
+        mHwCamera->doneWithFrame_1_1(returnedBuffers);
+
+        // Counts a returned buffer
+        mUsageStats->framesReturned(returnedBuffers);
+    }
+}
+
+
+bool HalCamera::deliverFrameToClient(const sp<VirtualCamera>& client,
+                                     const BufferDesc_1_1& buffer) {
+    // Counts a delivery before the client gets a chance to return the buffer
+    {
+        std::lock_guard<std::mutex> lock(mFrameRecordMutex);
+        holdFrameLocked(buffer.bufferId);
+    }
+
+    if (client->deliverFrame(buffer)) {
+        return true;
+    }
+
+    // The delivery did not happen.  This never releases the buffer because
+    // deliverFrame_1_1() holds it until all deliveries are done.
+    std::lock_guard<std::mutex> lock(mFrameRecordMutex);
+    bool released = false;
+    releaseFrameLocked(buffer.bufferId, &released);
+    return false;
+}
+
+
 // Methods from ::android::hardware::automotive::evs::V1_0::IEvsCameraStream follow.
 Return<void> HalCamera::deliverFrame(const BufferDesc_1_0& buffer) {
     /* Frames are delivered via deliverFrame_1_1 callback for clients that implement
@@ -353,11 +582,50 @@ Return<void> HalCamera::deliverFrame(const BufferDesc_1_0& buffer) {
 // Methods from ::android::hardware::automotive::evs::V1_1::IEvsCameraStream follow.
 Return<void> HalCamera::deliverFrame_1_1(const hardware::hidl_vec<BufferDesc_1_1>& buffer) {
     LOG(VERBOSE) << "Received a frame";
+    if (mPassThrough) {
+        // A single client is streaming; hand the frame over without a
+        // timeline and frame records.
+        sp<VirtualCamera> vCam;
+        uint64_t generation = 0;
+        {
+            std::lock_guard<std::mutex> lock(mFrameRecordMutex);
+            vCam = mPassThroughClient.promote();
+            generation = mPassThroughGeneration;
+        }
+
+        if (vCam != nullptr && !vCam->isFrameWanted(buffer[0].deviceId, buffer[0].timestamp)) {
+            // Decimated to meet the client's target frame rate
+            mHwCamera->doneWithFrame_1_1(buffer);
+            mUsageStats->framesReceived(buffer);
+            mUsageStats->framesReturned(buffer);
+            return Void();
+        } else if (vCam != nullptr) {
+            // Counted first as the client may return the frame right away
+            ++mNumFramesForwarded;
+            if (vCam->forwardFrame(buffer, generation)) {
+                // Reports the number of received buffers
+                mUsageStats->framesReceived(buffer);
+                return Void();
+            }
+            --mNumFramesForwarded;
+        }
+
+        // Falls back to the fan-out path, which returns a frame nobody accepts.
+    }
+
     // Frames are being forwarded to v1.1 clients only who requested new frame.
     const auto timestamp = buffer[0].timestamp;
     // TODO(b/145750636): For now, we are using a approximately half of 1 seconds / 30 frames = 33ms
     //           but this must be derived from current framerate.
     constexpr int64_t kThreshold = 16 * 1e+3; // ms
+
+    // Holds the buffer until all deliveries are done so a client returning it
+    // early, or preempting it, does not release the buffer to the hardware.
+    {
+        std::lock_guard<std::mutex> lock(mFrameRecordMutex);
+        holdFrameLocked(buffer[0].bufferId);
+    }
+
     unsigned frameDeliveriesV1 = 0;
     {
         // Handle frame requests from v1.1 clients
@@ -376,7 +644,11 @@ Return<void> HalCamera::deliverFrame_1_1(const hardware::hidl_vec<BufferDesc_1_1
 
                 // Reports a skipped frame
                 mUsageStats->framesSkippedToSync();
-            } else if (vCam != nullptr && vCam->deliverFrame(buffer[0])) {
+            } else if (!vCam->isFrameWanted(buffer[0].deviceId, timestamp)) {
+                // Skip current frame to meet the client's target frame rate.
+                LOG(VERBOSE) << "Decimates a frame from " << getId();
+                mNextRequests->push_back(req);
+            } else if (deliverFrameToClient(vCam, buffer[0])) {
                 // Forward a frame and move a timeline.
                 LOG(DEBUG) << getId() << " forwarded the buffer #" << buffer[0].bufferId;
                 ++frameDeliveriesV1;
@@ -390,42 +662,26 @@ Return<void> HalCamera::deliverFrame_1_1(const hardware::hidl_vec<BufferDesc_1_1
     // Frames are being forwarded to active v1.0 clients and v1.1 clients if we
     // failed to create a timeline.
     unsigned frameDeliveries = 0;
-    for (auto&& client : mClients) {
-        sp<VirtualCamera> vCam = client.promote();
-        if (vCam == nullptr || vCam->getVersion() > 0) {
-            continue;
-        }
-
-        if (vCam->deliverFrame(buffer[0])) {
+    for (auto&& vCam : getClients()) {
+        if (vCam->getVersion() == 0 && vCam->isFrameWanted(buffer[0].deviceId, timestamp) &&
+            deliverFrameToClient(vCam, buffer[0])) {
             ++frameDeliveries;
         }
     }
 
     frameDeliveries += frameDeliveriesV1;
     if (frameDeliveries < 1) {
-        // If none of our clients could accept the frame, then return it
-        // right away.
+        // If none of our clients could accept the frame, then it is returned
+        // right away below.
         LOG(INFO) << "Trivially rejecting frame (" << buffer[0].bufferId
                   << ") from " << getId() << " with no acceptance";
-        mHwCamera->doneWithFrame_1_1(buffer);
-
-        // Reports a returned buffer
-        mUsageStats->framesReturned(buffer);
-    } else {
-        // Add an entry for this frame in our tracking list.
-        unsigned i;
-        for (i = 0; i < mFrames.size(); ++i) {
-            if (mFrames[i].refCount == 0) {
-                break;
-            }
-        }
+    }
 
-        if (i == mFrames.size()) {
-            mFrames.emplace_back(buffer[0].bufferId);
-        } else {
-            mFrames[i].frameId = buffer[0].bufferId;
-        }
-        mFrames[i].refCount = frameDeliveries;
+    // Drops the delivery hold, which returns the buffer if every client has
+    // already released it or nobody accepted it.
+    {
+        std::lock_guard<std::mutex> lock(mFrameRecordMutex);
+        doneWithFrameLocked(buffer[0]);
     }
 
     return Void();
@@ -514,6 +770,13 @@ Return<EvsResult> HalCamera::unsetMaster(sp<VirtualCamera> virtualCamera) {
 }
 
 
+void HalCamera::detachDisplay(const sp<IEvsDisplay_1_0>& display) {
+    for (auto&& vCam : getClients()) {
+        vCam->detachDisplay(display);
+    }
+}
+
+
 Return<EvsResult> HalCamera::setParameter(sp<VirtualCamera> virtualCamera,
                                           CameraParam id, int32_t& value) {
     EvsResult result = EvsResult::INVALID_ARG;
@@ -592,6 +855,8 @@ std::string HalCamera::toString(const char* indent) const {
 
     StringAppendF(&buffer, "%sMaster client: %p\n",
                            indent, mMaster.promote().get());
+    StringAppendF(&buffer, "%sPass-through: %s\n",
+                           indent, mPassThrough ? "T" : "F");
 
     buffer += HalCamera::toString(mStreamConfig, indent);
 
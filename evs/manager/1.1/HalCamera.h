@@ -19,6 +19,7 @@
 
 #include "stats/CameraUsageStats.h"
 
+#include <atomic>
 #include <deque>
 #include <list>
 #include <thread>
@@ -41,6 +42,7 @@ using BufferDesc_1_0 = ::android::hardware::automotive::evs::V1_0::BufferDesc;
 using BufferDesc_1_1 = ::android::hardware::automotive::evs::V1_1::BufferDesc;
 using IEvsCameraStream_1_0 = ::android::hardware::automotive::evs::V1_0::IEvsCameraStream;
 using IEvsCameraStream_1_1 = ::android::hardware::automotive::evs::V1_1::IEvsCameraStream;
+using IEvsDisplay_1_0 = ::android::hardware::automotive::evs::V1_0::IEvsDisplay;
 
 namespace android {
 namespace automotive {
@@ -88,18 +90,25 @@ public:
                                              int* delta);
     void                requestNewFrame(sp<VirtualCamera> virtualCamera,
                                         const int64_t timestamp);
+    void                preemptFrames(sp<VirtualCamera> virtualCamera);
 
     Return<EvsResult>   clientStreamStarting();
     void                clientStreamEnding(const VirtualCamera* client);
     Return<void>        doneWithFrame(const BufferDesc_1_0& buffer);
     Return<void>        doneWithFrame(const BufferDesc_1_1& buffer);
+    void                doneWithForwardedFrame(const BufferDesc_1_1& buffer);
     Return<EvsResult>   setMaster(sp<VirtualCamera> virtualCamera);
     Return<EvsResult>   forceMaster(sp<VirtualCamera> virtualCamera);
     Return<EvsResult>   unsetMaster(sp<VirtualCamera> virtualCamera);
+    void                detachDisplay(const sp<IEvsDisplay_1_0>& display);
     Return<EvsResult>   setParameter(sp<VirtualCamera> virtualCamera,
                                      CameraParam id, int32_t& value);
     Return<EvsResult>   getParameter(CameraParam id, int32_t& value);
 
+    // Returns true if frames are forwarded to a single client without fan-out
+    // bookkeeping
+    bool                isPassThrough() const { return mPassThrough; }
+
     // Returns a snapshot of collected usage statistics
     CameraUsageStatsRecord getStats() const;
 
@@ -120,6 +129,38 @@ public:
     Return<void> notify(const EvsEventDesc& event) override;
 
 private:
+    // Switches between the pass-through and the fan-out delivery modes
+    // depending on the current set of clients
+    void                            updatePassThroughMode();
+
+    // Returns strong references to all live clients.  Callers release them
+    // without holding mFrameRecordMutex because dropping the last reference
+    // destroys a client, which returns its frames to this object.
+    std::vector<sp<VirtualCamera>>  getClients();
+
+    // Returns the number of buffers required by all clients including ones
+    // reserved for high priority clients
+    unsigned                        getRequiredBufferCount();
+
+    // Adds a reference to the record of a given frame, creating one if the
+    // frame is not tracked yet
+    void                            holdFrameLocked(uint32_t frameId)
+                                        REQUIRES(mFrameRecordMutex);
+
+    // Drops a reference to the record of a given frame.  Returns false if the
+    // frame is not tracked; otherwise, true with *released set if nobody
+    // holds the frame anymore.
+    bool                            releaseFrameLocked(uint32_t frameId, bool* released)
+                                        REQUIRES(mFrameRecordMutex);
+
+    // Returns a buffer to the hardware if no client holds it anymore
+    void                            doneWithFrameLocked(const BufferDesc_1_1& buffer)
+                                        REQUIRES(mFrameRecordMutex);
+
+    // Delivers a frame to a given client while tracking it
+    bool                            deliverFrameToClient(const sp<VirtualCamera>& client,
+                                                         const BufferDesc_1_1& buffer);
+
     sp<IEvsCamera_1_1>              mHwCamera;
     std::list<wp<VirtualCamera>>    mClients;   // Weak pointers -> objects destruct if client dies
 
@@ -134,7 +175,14 @@ private:
         uint32_t    refCount;
         FrameRecord(uint32_t id) : frameId(id), refCount(0) {};
     };
-    std::vector<FrameRecord>        mFrames;
+
+    // Frame records and the clients list are updated from the binder threads,
+    // the hardware callback thread and the clients' capture threads, which
+    // preempt frames.  This lock is never held while calling into a client's
+    // stream; mFrameMutex, if needed, is acquired before this lock.
+    mutable std::mutex              mFrameRecordMutex;
+    std::vector<FrameRecord>        mFrames GUARDED_BY(mFrameRecordMutex);
+    unsigned                        mBufferCount GUARDED_BY(mFrameRecordMutex) = 0;
     wp<VirtualCamera>               mMaster = nullptr;
     std::string                     mId;
     Stream                          mStreamConfig;
@@ -150,6 +198,18 @@ private:
     std::deque<FrameRequest>* mCurrentRequests  PT_GUARDED_BY(mFrameMutex);
     std::deque<FrameRequest>* mNextRequests     PT_GUARDED_BY(mFrameMutex);
 
+    // Set while exactly one v1.1 client streams from this camera.  In this
+    // mode, frames are forwarded directly to that client and are not tracked
+    // in mFrames; the client remembers them and returns them via
+    // doneWithForwardedFrame().  The generation changes whenever the mode is
+    // entered so a frame picked for a client before it left the mode is
+    // refused by that client.
+    std::mutex                mPassThroughMutex;    // Serializes mode switches
+    std::atomic<bool>         mPassThrough = false;
+    wp<VirtualCamera>         mPassThroughClient GUARDED_BY(mFrameRecordMutex) = nullptr;
+    uint64_t                  mPassThroughGeneration GUARDED_BY(mFrameRecordMutex) = 0;
+    std::atomic<unsigned>     mNumFramesForwarded = 0;  // Forwarded, not returned yet
+
     // Time this object was created
     int64_t mTimeCreatedMs;
 
@@ -23,6 +23,8 @@
 #include <android-base/logging.h>
 #include <android-base/stringprintf.h>
 
+#include <algorithm>
+
 using ::android::base::StringAppendF;
 using ::android::base::StringPrintf;
 using ::android::base::WriteStringToFd;
@@ -66,15 +68,23 @@ void VirtualCamera::shutdown() {
                 continue;
             }
 
-            if (mFramesHeld[key].size() > 0) {
+            deque<BufferDesc_1_1> framesHeld;
+            unordered_set<uint32_t> framesForwarded;
+            {
+                std::lock_guard<std::mutex> lock(mFramesHeldMutex);
+                framesHeld.swap(mFramesHeld[key]);
+                framesForwarded.swap(mFramesForwarded[key]);
+            }
+
+            if (framesHeld.size() > 0) {
                 LOG(WARNING) << "VirtualCamera destructing with frames in flight.";
 
                 // Return to the underlying hardware camera any buffers the client was holding
-                for (auto&& heldBuffer : mFramesHeld[key]) {
+                for (auto&& heldBuffer : framesHeld) {
                     // Tell our parent that we're done with this buffer
-                    pHwCamera->doneWithFrame(heldBuffer);
+                    returnFrame(pHwCamera, heldBuffer,
+                                framesForwarded.count(heldBuffer.bufferId) > 0);
                 }
-                mFramesHeld[key].clear();
             }
 
             // Retire from a master client
@@ -85,11 +95,18 @@ void VirtualCamera::shutdown() {
         }
 
         // Join a capture thread
+        mFramesReadySignal.notify_all();
         if (mCaptureThread.joinable()) {
             mCaptureThread.join();
         }
 
-        mFramesHeld.clear();
+        {
+            std::lock_guard<std::mutex> lock(mFramesHeldMutex);
+            mFramesHeld.clear();
+            mFramesHeldSince.clear();
+            mFramesPreempted.clear();
+            mFramesForwarded.clear();
+        }
 
         // Drop our reference to our associated hardware camera
         mHalCamera.clear();
@@ -115,9 +132,24 @@ bool VirtualCamera::deliverFrame(const BufferDesc_1_1& bufDesc) {
         // A stopped stream gets no frames
         LOG(ERROR) << "A stopped stream should not get any frames";
         return false;
-    } else if (mFramesHeld[bufDesc.deviceId].size() >= mFramesAllowed) {
+    }
+
+    size_t numFramesHeld = 0;
+    {
+        std::lock_guard<std::mutex> lock(mFramesHeldMutex);
+        auto& framesHeld = mFramesHeld[bufDesc.deviceId];
+        numFramesHeld = framesHeld.size();
+        if (numFramesHeld < mFramesAllowed) {
+            // Keep a record of this frame so we can clean up if we have to in case of client death
+            framesHeld.emplace_back(bufDesc);
+            mFramesHeldSince[bufDesc.deviceId][bufDesc.bufferId] = android::uptimeMillis();
+            advanceTimelineLocked(bufDesc.deviceId, bufDesc.timestamp);
+        }
+    }
+
+    if (numFramesHeld >= mFramesAllowed) {
         // Indicate that we declined to send the frame to the client because they're at quota
-        LOG(INFO) << "Skipping new frame as we hold " << mFramesHeld[bufDesc.deviceId].size()
+        LOG(INFO) << "Skipping new frame as we hold " << numFramesHeld
                   << " of " << mFramesAllowed;
 
         if (mStream_1_1 != nullptr) {
@@ -132,48 +164,247 @@ bool VirtualCamera::deliverFrame(const BufferDesc_1_1& bufDesc) {
         }
 
         return false;
+    }
+
+    // v1.0 client uses an old frame-delivery mechanism.
+    if (mStream_1_1 == nullptr) {
+        // Forward a frame to v1.0 client
+        BufferDesc_1_0 frame_1_0 = {};
+        const AHardwareBuffer_Desc* pDesc =
+            reinterpret_cast<const AHardwareBuffer_Desc *>(&bufDesc.buffer.description);
+        frame_1_0.width     = pDesc->width;
+        frame_1_0.height    = pDesc->height;
+        frame_1_0.format    = pDesc->format;
+        frame_1_0.usage     = pDesc->usage;
+        frame_1_0.stride    = pDesc->stride;
+        frame_1_0.memHandle = bufDesc.buffer.nativeHandle;
+        frame_1_0.pixelSize = bufDesc.pixelSize;
+        frame_1_0.bufferId  = bufDesc.bufferId;
+
+        mStream->deliverFrame(frame_1_0);
+    } else if (mCaptureThread.joinable()) {
+        // Keep forwarding frames as long as a capture thread is alive; notify
+        // a new frame receipt
+        {
+            std::lock_guard<std::mutex> lock(mFrameDeliveryMutex);
+            mSourceCameras.erase(bufDesc.deviceId);
+        }
+        mFramesReadySignal.notify_all();
+    }
+
+    return true;
+}
+
+
+void VirtualCamera::setPassThrough(bool enable, uint64_t generation) {
+    {
+        // Frames being forwarded in the previous mode are refused from now on
+        std::lock_guard<std::mutex> lock(mFramesHeldMutex);
+        mPassThroughGeneration = enable ? generation : 0;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mFrameDeliveryMutex);
+        mPassThrough = enable;
+
+        // Outstanding frame requests are discarded by HalCamera
+        mSourceCameras.clear();
+    }
+
+    // Wakes up the capture thread to switch its mode
+    mFramesReadySignal.notify_all();
+}
+
+
+bool VirtualCamera::forwardFrame(const hidl_vec<BufferDesc_1_1>& buffers,
+                                 uint64_t generation) {
+    if (mStreamState != RUNNING || mStream_1_1 == nullptr || buffers.size() < 1) {
+        return false;
+    }
+
+    const auto& deviceId = buffers[0].deviceId;
+    size_t numFramesHeld = 0;
+    {
+        std::lock_guard<std::mutex> lock(mFramesHeldMutex);
+        if (generation == 0 || generation != mPassThroughGeneration) {
+            // HalCamera has left the pass-through mode since it picked us;
+            // the frame goes through the fan-out delivery instead.
+            return false;
+        }
+
+        auto& framesHeld = mFramesHeld[deviceId];
+        numFramesHeld = framesHeld.size();
+        if (numFramesHeld < mFramesAllowed) {
+            // Keep a record of this frame so we can clean up if we have to in
+            // case of client death
+            framesHeld.emplace_back(buffers[0]);
+            mFramesHeldSince[deviceId][buffers[0].bufferId] = android::uptimeMillis();
+            mFramesForwarded[deviceId].emplace(buffers[0].bufferId);
+        }
+    }
+
+    if (numFramesHeld >= mFramesAllowed) {
+        // Indicate that we declined to send the frame to the client because they're at quota
+        LOG(INFO) << "Skipping new frame as we hold " << numFramesHeld
+                  << " of " << mFramesAllowed;
+
+        EvsEventDesc event;
+        event.deviceId = buffers[0].deviceId;
+        event.aType = EvsEventType::FRAME_DROPPED;
+        auto result = mStream_1_1->notify(event);
+        if (!result.isOk()) {
+            LOG(ERROR) << "Error delivering a frame drop event";
+        }
+
+        return false;
+    }
+
+    // Pass a received buffer through to our client
+    auto ret = mStream_1_1->deliverFrame_1_1(buffers);
+    if (!ret.isOk()) {
+        LOG(WARNING) << "Failed to forward frames";
+
+        std::lock_guard<std::mutex> lock(mFramesHeldMutex);
+        auto& framesHeld = mFramesHeld[deviceId];
+        auto it = std::find_if(framesHeld.begin(), framesHeld.end(),
+                               [&buffers](const BufferDesc_1_1& frame) {
+                                   return frame.bufferId == buffers[0].bufferId;
+                               });
+        if (it != framesHeld.end()) {
+            framesHeld.erase(it);
+        }
+        mFramesHeldSince[deviceId].erase(buffers[0].bufferId);
+        mFramesForwarded[deviceId].erase(buffers[0].bufferId);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mFramesHeldMutex);
+    advanceTimelineLocked(deviceId, buffers[0].timestamp);
+    return true;
+}
+
+
+void VirtualCamera::returnFrame(const sp<HalCamera>& halCamera,
+                                const BufferDesc_1_1& buffer, bool forwarded) {
+    if (forwarded) {
+        // HalCamera has no record of this frame
+        halCamera->doneWithForwardedFrame(buffer);
     } else {
-        // Keep a record of this frame so we can clean up if we have to in case of client death
-        mFramesHeld[bufDesc.deviceId].emplace_back(bufDesc);
-
-        // v1.0 client uses an old frame-delivery mechanism.
-        if (mStream_1_1 == nullptr) {
-            // Forward a frame to v1.0 client
-            BufferDesc_1_0 frame_1_0 = {};
-            const AHardwareBuffer_Desc* pDesc =
-                reinterpret_cast<const AHardwareBuffer_Desc *>(&bufDesc.buffer.description);
-            frame_1_0.width     = pDesc->width;
-            frame_1_0.height    = pDesc->height;
-            frame_1_0.format    = pDesc->format;
-            frame_1_0.usage     = pDesc->usage;
-            frame_1_0.stride    = pDesc->stride;
-            frame_1_0.memHandle = bufDesc.buffer.nativeHandle;
-            frame_1_0.pixelSize = bufDesc.pixelSize;
-            frame_1_0.bufferId  = bufDesc.bufferId;
-
-            mStream->deliverFrame(frame_1_0);
-        } else if (mCaptureThread.joinable()) {
-            // Keep forwarding frames as long as a capture thread is alive
-            if (mFramesHeld.size() > 0 && mStream_1_1 != nullptr) {
-                // Pass this buffer through to our client
-                hardware::hidl_vec<BufferDesc_1_1> frames;
-                frames.resize(1);
-                auto pHwCamera = mHalCamera.begin()->second.promote();
-                if (pHwCamera != nullptr) {
-                    frames[0] = mFramesHeld[mHalCamera.begin()->first].back();
-                }
+        halCamera->doneWithFrame(buffer);
+    }
+}
 
-                // Notify a new frame receipt
-                {
-                    std::lock_guard<std::mutex> lock(mFrameDeliveryMutex);
-                    mSourceCameras.erase(bufDesc.deviceId);
-                }
-                mFramesReadySignal.notify_all();
-            }
+
+void VirtualCamera::setPriority(Priority priority) {
+    if (mPriority == priority) {
+        return;
+    }
+
+    LOG(INFO) << this << ": Priority changes from " << static_cast<int32_t>(mPriority.load())
+              << " to " << static_cast<int32_t>(priority);
+    mPriority = priority;
+
+    // Recompute the number of buffers because higher priority clients reserve
+    // extra buffers.
+    for (auto&& [key, hwCamera] : mHalCamera) {
+        auto pHwCamera = hwCamera.promote();
+        if (pHwCamera != nullptr && !pHwCamera->changeFramesInFlight(0)) {
+            LOG(WARNING) << key << ": Failed to update the number of buffers";
         }
+    }
+}
 
+
+void VirtualCamera::restorePriorityLocked() {
+    if (!mPriorityBeforeMaster) {
+        return;
+    }
+
+    setPriority(*mPriorityBeforeMaster);
+    mPriorityBeforeMaster.reset();
+    mMasterDisplay = nullptr;
+}
+
+
+void VirtualCamera::detachDisplay(const sp<IEvsDisplay_1_0>& display) {
+    std::lock_guard<std::mutex> lock(mPriorityMutex);
+    if (mPriorityBeforeMaster && mMasterDisplay.promote() == display) {
+        LOG(INFO) << this << ": The display the master role was taken with is detached";
+        restorePriorityLocked();
+    }
+}
+
+
+bool VirtualCamera::isFrameWanted(const std::string& deviceId, int64_t timestamp) {
+    const auto frameRate = mTargetFrameRate.load();
+    if (frameRate <= 0) {
+        // Takes every frame
         return true;
     }
+
+    // Frames are selected on an evenly spaced timeline.  A quarter of the
+    // interval is tolerated to absorb the capture jitter.
+    const int64_t interval = 1000000 / frameRate;
+    std::lock_guard<std::mutex> lock(mFramesHeldMutex);
+    auto it = mNextFrameTimestamps.find(deviceId);
+    return it == mNextFrameTimestamps.end() || timestamp + interval / 4 >= it->second;
+}
+
+
+void VirtualCamera::advanceTimelineLocked(const std::string& deviceId, int64_t timestamp) {
+    const auto frameRate = mTargetFrameRate.load();
+    if (frameRate <= 0) {
+        return;
+    }
+
+    const int64_t interval = 1000000 / frameRate;
+    auto [it, inserted] = mNextFrameTimestamps.try_emplace(deviceId, -1);
+    const int64_t next = it->second;
+    if (next < 0 || timestamp - next >= interval) {
+        // Restarts a timeline if this is the first frame or we fell behind
+        it->second = timestamp + interval;
+    } else {
+        it->second = next + interval;
+    }
+}
+
+
+std::vector<BufferDesc_1_1> VirtualCamera::preemptFrames(const std::string& deviceId,
+                                                         int64_t holdLimitMs,
+                                                         std::vector<BufferDesc_1_1>* forwarded) {
+    std::vector<BufferDesc_1_1> preempted;
+    std::lock_guard<std::mutex> lock(mFramesHeldMutex);
+    auto itQueue = mFramesHeld.find(deviceId);
+    if (itQueue == mFramesHeld.end()) {
+        return preempted;
+    }
+
+    const auto now = android::uptimeMillis();
+    auto& heldSince = mFramesHeldSince[deviceId];
+    auto& framesPreempted = mFramesPreempted[deviceId];
+    auto& framesForwarded = mFramesForwarded[deviceId];
+    auto& framesHeld = itQueue->second;
+    auto it = framesHeld.begin();
+    while (it != framesHeld.end()) {
+        auto itTime = heldSince.find(it->bufferId);
+        if (itTime != heldSince.end() && now - itTime->second > holdLimitMs) {
+            // The client is going to return this buffer eventually; remembers
+            // it so that return is not taken for a later delivery of the same
+            // buffer.
+            if (framesForwarded.erase(it->bufferId) > 0) {
+                forwarded->emplace_back(*it);
+            } else {
+                preempted.emplace_back(*it);
+            }
+            framesPreempted.emplace(it->bufferId);
+            heldSince.erase(itTime);
+            it = framesHeld.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    return preempted;
 }
 
 
@@ -209,6 +440,16 @@ bool VirtualCamera::notify(const EvsEventDesc& event) {
 
         case EvsEventType::MASTER_RELEASED:
             LOG(DEBUG) << "The master client has been released";
+            {
+                // Either we gave up the master role or another client took
+                // it; both end the elevated priority.
+                std::lock_guard<std::mutex> lock(mPriorityMutex);
+                restorePriorityLocked();
+            }
+            break;
+
+        case EvsEventType::FRAME_DROPPED:
+            LOG(DEBUG) << "Frames from " << event.deviceId << " are dropped";
             break;
 
         default:
@@ -299,8 +540,15 @@ Return<EvsResult> VirtualCamera::startVideoStream(const ::android::sp<IEvsCamera
         return EvsResult::STREAM_ALREADY_RUNNING;
     }
 
-    // Validate our held frame count is starting out at zero as we expect
-    assert(mFramesHeld.size() == 0);
+    {
+        std::lock_guard<std::mutex> lock(mFramesHeldMutex);
+
+        // Validate our held frame count is starting out at zero as we expect
+        assert(mFramesHeld.size() == 0);
+
+        // Frames preempted from the previous stream are not expected anymore
+        mFramesPreempted.clear();
+    }
 
     // Record the user's callback for use when we have a frame ready
     mStream = stream;
@@ -352,8 +600,19 @@ Return<EvsResult> VirtualCamera::startVideoStream(const ::android::sp<IEvsCamera
             // TODO(b/145466570): With a proper camera hang handler, we may want
             // to reduce an amount of timeout.
             constexpr auto kFrameTimeout = 5s; // timeout in seconds.
+            constexpr auto kPreemptionInterval = 100ms;
             int64_t lastFrameTimestamp = -1;
             while (mStreamState == RUNNING) {
+                if (mPassThrough) {
+                    // HalCamera forwards frames directly; waits until we need
+                    // to resume requesting frames.
+                    std::unique_lock<std::mutex> lock(mFrameDeliveryMutex);
+                    mFramesReadySignal.wait_for(lock, kFrameTimeout, [this]() {
+                        return !mPassThrough || mStreamState != RUNNING;
+                    });
+                    continue;
+                }
+
                 unsigned count = 0;
                 for (auto&& [key, hwCamera] : mHalCamera) {
                     auto pHwCamera = hwCamera.promote();
@@ -362,42 +621,70 @@ Return<EvsResult> VirtualCamera::startVideoStream(const ::android::sp<IEvsCamera
                         continue;
                     }
 
-                    pHwCamera->requestNewFrame(this, lastFrameTimestamp);
+                    // Waits for the camera before requesting a frame; otherwise,
+                    // a frame that arrives in between is never picked up.
                     {
                         std::lock_guard<std::mutex> lock(mFrameDeliveryMutex);
                         mSourceCameras.emplace(pHwCamera->getId());
                     }
+                    pHwCamera->requestNewFrame(this, lastFrameTimestamp);
                     ++count;
                 }
 
                 std::unique_lock<std::mutex> lock(mFrameDeliveryMutex);
-                if (!mFramesReadySignal.wait_for(lock,
-                                                 kFrameTimeout,
-                                                 [this]() REQUIRES(mFrameDeliveryMutex) {
-                                                     return mSourceCameras.empty();
-                                                 })) {
+                auto framesReady = [this]() REQUIRES(mFrameDeliveryMutex) {
+                    return mSourceCameras.empty() || mPassThrough || mStreamState != RUNNING;
+                };
+
+                bool ready = false;
+                if (mPriority > Priority::BACKGROUND) {
+                    // Buffers we are waiting for may be held by lower priority
+                    // clients; reclaims ones held past the deadline.
+                    const auto deadline = std::chrono::steady_clock::now() + kFrameTimeout;
+                    while (!(ready = mFramesReadySignal.wait_for(lock,
+                                                                 kPreemptionInterval,
+                                                                 framesReady)) &&
+                           std::chrono::steady_clock::now() < deadline) {
+                        lock.unlock();
+                        for (auto&& [key, hwCamera] : mHalCamera) {
+                            auto pHwCamera = hwCamera.promote();
+                            if (pHwCamera != nullptr) {
+                                pHwCamera->preemptFrames(this);
+                            }
+                        }
+                        lock.lock();
+                    }
+                } else {
+                    ready = mFramesReadySignal.wait_for(lock, kFrameTimeout, framesReady);
+                }
+
+                if (!ready) {
                     PLOG(ERROR) << this << ": Camera hangs?";
                     break;
-                } else if (mStreamState == RUNNING) {
+                } else if (mStreamState == RUNNING && !mPassThrough) {
                     // Fetch frames and forward to the client
-                    if (mFramesHeld.size() > 0 && mStream_1_1 != nullptr) {
-                        // Pass this buffer through to our client
-                        hardware::hidl_vec<BufferDesc_1_1> frames;
-                        frames.resize(count);
-                        unsigned i = 0;
+                    std::vector<BufferDesc_1_1> frames;
+                    {
+                        std::lock_guard<std::mutex> heldLock(mFramesHeldMutex);
+                        frames.reserve(count);
                         for (auto&& [key, hwCamera] : mHalCamera) {
                             auto pHwCamera = hwCamera.promote();
-                            if (pHwCamera == nullptr) {
+                            auto itHeld = mFramesHeld.find(key);
+                            if (pHwCamera == nullptr || itHeld == mFramesHeld.end() ||
+                                itHeld->second.empty()) {
                                 continue;
                             }
 
-                            const auto frame = mFramesHeld[key].back();
+                            const auto frame = itHeld->second.back();
                             if (frame.timestamp > lastFrameTimestamp) {
                                 lastFrameTimestamp = frame.timestamp;
                             }
-                            frames[i++] = frame;
+                            frames.emplace_back(frame);
                         }
+                    }
 
+                    if (frames.size() > 0 && mStream_1_1 != nullptr) {
+                        // Pass this buffer through to our client
                         auto ret = mStream_1_1->deliverFrame_1_1(frames);
                         if (!ret.isOk()) {
                             LOG(WARNING) << "Failed to forward frames";
@@ -417,39 +704,22 @@ Return<EvsResult> VirtualCamera::startVideoStream(const ::android::sp<IEvsCamera
 
 
 Return<void> VirtualCamera::doneWithFrame(const BufferDesc_1_0& buffer) {
+    // v1.0 clients never enter the pass-through mode
+    bool forwarded = false;
     if (buffer.memHandle == nullptr) {
         LOG(ERROR) << "Ignoring doneWithFrame called with invalid handle";
-    } else if (mFramesHeld.size() > 1) {
+    } else if (mHalCamera.size() > 1) {
         LOG(ERROR) << __FUNCTION__
                    << " must NOT be called on a logical camera object.";
-    } else {
-        // Find this buffer in our "held" list
-        auto& frameQueue = mFramesHeld.begin()->second;
-        auto it = frameQueue.begin();
-        while (it != frameQueue.end()) {
-            if (it->bufferId == buffer.bufferId) {
-                // found it!
-                break;
-            }
-            ++it;
-        }
-        if (it == frameQueue.end()) {
-            // We should always find the frame in our "held" list
-            LOG(ERROR) << "Ignoring doneWithFrame called with unrecognized frameID "
-                       << buffer.bufferId;
+    } else if (takeHeldFrame(mHalCamera.begin()->first, buffer.bufferId, &forwarded)) {
+        // Tell our parent that we're done with this buffer
+        auto pHwCamera = mHalCamera.begin()->second.promote();
+        if (pHwCamera != nullptr) {
+            pHwCamera->doneWithFrame(buffer);
         } else {
-            // Take this frame out of our "held" list
-            frameQueue.erase(it);
-
-            // Tell our parent that we're done with this buffer
-            auto pHwCamera = mHalCamera.begin()->second.promote();
-            if (pHwCamera != nullptr) {
-                pHwCamera->doneWithFrame(buffer);
-            } else {
-                LOG(WARNING) << "Possible memory leak because a device "
-                             << mHalCamera.begin()->first
-                             << " is not valid.";
-            }
+            LOG(WARNING) << "Possible memory leak because a device "
+                         << mHalCamera.begin()->first
+                         << " is not valid.";
         }
     }
 
@@ -457,6 +727,43 @@ Return<void> VirtualCamera::doneWithFrame(const BufferDesc_1_0& buffer) {
 }
 
 
+bool VirtualCamera::takeHeldFrame(const std::string& deviceId, uint32_t bufferId,
+                                  bool* forwarded) {
+    std::lock_guard<std::mutex> lock(mFramesHeldMutex);
+    auto itPreempted = mFramesPreempted.find(deviceId);
+    if (itPreempted != mFramesPreempted.end()) {
+        auto it = itPreempted->second.find(bufferId);
+        if (it != itPreempted->second.end()) {
+            // This buffer was already taken back; a frame held now with the
+            // same identifier, if any, is a later delivery.
+            LOG(DEBUG) << "Ignoring doneWithFrame called with a preempted frameID "
+                       << bufferId;
+            itPreempted->second.erase(it);
+            return false;
+        }
+    }
+
+    // Find this buffer in our "held" list
+    auto& frameQueue = mFramesHeld[deviceId];
+    auto it = std::find_if(frameQueue.begin(), frameQueue.end(),
+                           [bufferId](const BufferDesc_1_1& frame) {
+                               return frame.bufferId == bufferId;
+                           });
+    if (it == frameQueue.end()) {
+        // We should always find the frame in our "held" list
+        LOG(ERROR) << "Ignoring doneWithFrame called with unrecognized frameID "
+                   << bufferId;
+        return false;
+    }
+
+    // Take this frame out of our "held" list
+    frameQueue.erase(it);
+    mFramesHeldSince[deviceId].erase(bufferId);
+    *forwarded = mFramesForwarded[deviceId].erase(bufferId) > 0;
+    return true;
+}
+
+
 Return<void> VirtualCamera::stopVideoStream()  {
     if (mStreamState == RUNNING) {
         // Tell the frame delivery pipeline we don't want any more frames
@@ -493,6 +800,9 @@ Return<void> VirtualCamera::stopVideoStream()  {
             }
         }
 
+        // Wake up a capture thread in case it idles in the pass-through mode
+        mFramesReadySignal.notify_all();
+
         // Join a thread
         if (mCaptureThread.joinable()) {
             mCaptureThread.join();
@@ -597,35 +907,18 @@ Return<void> VirtualCamera::getPhysicalCameraInfo(const hidl_string& deviceId,
 Return<EvsResult> VirtualCamera::doneWithFrame_1_1(
     const hardware::hidl_vec<BufferDesc_1_1>& buffers) {
 
+    bool forwarded = false;
     for (auto&& buffer : buffers) {
         if (buffer.buffer.nativeHandle == nullptr) {
             LOG(WARNING) << "Ignoring doneWithFrame called with invalid handle";
-        } else {
-            // Find this buffer in our "held" list
-            auto it = mFramesHeld[buffer.deviceId].begin();
-            while (it != mFramesHeld[buffer.deviceId].end()) {
-                if (it->bufferId == buffer.bufferId) {
-                    // found it!
-                    break;
-                }
-                ++it;
-            }
-            if (it == mFramesHeld[buffer.deviceId].end()) {
-                // We should always find the frame in our "held" list
-                LOG(ERROR) << "Ignoring doneWithFrame called with unrecognized frameID "
-                           << buffer.bufferId;
+        } else if (takeHeldFrame(buffer.deviceId, buffer.bufferId, &forwarded)) {
+            // Tell our parent that we're done with this buffer
+            auto pHwCamera = mHalCamera[buffer.deviceId].promote();
+            if (pHwCamera != nullptr) {
+                returnFrame(pHwCamera, buffer, forwarded);
             } else {
-                // Take this frame out of our "held" list
-                mFramesHeld[buffer.deviceId].erase(it);
-
-                // Tell our parent that we're done with this buffer
-                auto pHwCamera = mHalCamera[buffer.deviceId].promote();
-                if (pHwCamera != nullptr) {
-                    pHwCamera->doneWithFrame(buffer);
-                } else {
-                    LOG(WARNING) << "Possible memory leak; "
-                                 << buffer.deviceId << " is not valid.";
-                }
+                LOG(WARNING) << "Possible memory leak; "
+                             << buffer.deviceId << " is not valid.";
             }
         }
     }
@@ -673,7 +966,17 @@ Return<EvsResult> VirtualCamera::forceMaster(const sp<IEvsDisplay_1_0>& display)
 
     auto pHwCamera = mHalCamera.begin()->second.promote();
     if (pHwCamera != nullptr) {
-        return pHwCamera->forceMaster(this);
+        auto result = pHwCamera->forceMaster(this);
+        if (result.isOk() && result == EvsResult::OK) {
+            // A client that owns the display is on the safety-critical path.
+            std::lock_guard<std::mutex> lock(mPriorityMutex);
+            if (!mPriorityBeforeMaster) {
+                mPriorityBeforeMaster = mPriority.load();
+            }
+            mMasterDisplay = display;
+            setPriority(Priority::CRITICAL);
+        }
+        return result;
     } else {
         LOG(WARNING) << "Camera device " << mHalCamera.begin()->first << " is not alive.";
         return EvsResult::INVALID_ARG;
@@ -689,7 +992,12 @@ Return<EvsResult> VirtualCamera::unsetMaster() {
 
     auto pHwCamera = mHalCamera.begin()->second.promote();
     if (pHwCamera != nullptr) {
-        return pHwCamera->unsetMaster(this);
+        auto result = pHwCamera->unsetMaster(this);
+        if (result.isOk() && result == EvsResult::OK) {
+            std::lock_guard<std::mutex> lock(mPriorityMutex);
+            restorePriorityLocked();
+        }
+        return result;
     } else {
         LOG(WARNING) << "Camera device " << mHalCamera.begin()->first << " is not alive.";
         return EvsResult::INVALID_ARG;
@@ -825,6 +1133,50 @@ Return<void> VirtualCamera::getIntParameter(CameraParam id,
 
 Return<EvsResult> VirtualCamera::setExtendedInfo_1_1(uint32_t opaqueIdentifier,
                                                      const hidl_vec<uint8_t>& opaqueValue) {
+    if (opaqueIdentifier == kOpaqueIdClientPriority) {
+        // Handled by the manager
+        int32_t value;
+        if (opaqueValue.size() < sizeof(value)) {
+            return EvsResult::INVALID_ARG;
+        }
+
+        memcpy(&value, opaqueValue.data(), sizeof(value));
+        if (value < static_cast<int32_t>(Priority::BACKGROUND) ||
+            value > static_cast<int32_t>(Priority::CRITICAL)) {
+            LOG(ERROR) << "Invalid priority class " << value;
+            return EvsResult::INVALID_ARG;
+        }
+
+        std::lock_guard<std::mutex> lock(mPriorityMutex);
+        if (mPriorityBeforeMaster) {
+            // Takes effect when the master role taken by forceMaster() ends
+            mPriorityBeforeMaster = static_cast<Priority>(value);
+        } else {
+            setPriority(static_cast<Priority>(value));
+        }
+        return EvsResult::OK;
+    } else if (opaqueIdentifier == kOpaqueIdTargetFrameRate) {
+        // Handled by the manager
+        int32_t value;
+        if (opaqueValue.size() < sizeof(value)) {
+            return EvsResult::INVALID_ARG;
+        }
+
+        memcpy(&value, opaqueValue.data(), sizeof(value));
+        if (value < 0) {
+            LOG(ERROR) << "Invalid target frame rate " << value;
+            return EvsResult::INVALID_ARG;
+        }
+
+        LOG(INFO) << this << ": Target frame rate is set to " << value;
+        mTargetFrameRate = value;
+        {
+            std::lock_guard<std::mutex> lock(mFramesHeldMutex);
+            mNextFrameTimestamps.clear();
+        }
+        return EvsResult::OK;
+    }
+
     hardware::hidl_vec<int32_t> values;
     if (mHalCamera.size() > 1) {
         LOG(WARNING) << "Logical camera device does not support " << __FUNCTION__;
@@ -851,6 +1203,17 @@ Return<void> VirtualCamera::getExtendedInfo_1_1(uint32_t opaqueIdentifier,
                                                 getExtendedInfo_1_1_cb _hidl_cb) {
     hardware::hidl_vec<uint8_t> values;
     EvsResult status = EvsResult::INVALID_ARG;
+    if (opaqueIdentifier == kOpaqueIdClientPriority ||
+        opaqueIdentifier == kOpaqueIdTargetFrameRate) {
+        const int32_t value = opaqueIdentifier == kOpaqueIdClientPriority ?
+                              static_cast<int32_t>(mPriority.load()) :
+                              mTargetFrameRate.load();
+        values.resize(sizeof(value));
+        memcpy(values.data(), &value, sizeof(value));
+        _hidl_cb(EvsResult::OK, values);
+        return Void();
+    }
+
     if (mHalCamera.size() > 1) {
         LOG(WARNING) << "Logical camera device does not support " << __FUNCTION__;
         _hidl_cb(status, values);
@@ -915,6 +1278,7 @@ std::string VirtualCamera::toString(const char* indent) const {
 
     std::string next_indent(indent);
     next_indent += "\t";
+    std::lock_guard<std::mutex> lock(mFramesHeldMutex);
     for (auto&& [id, queue] : mFramesHeld) {
         StringAppendF(&buffer, "%s%s: %d\n",
                                next_indent.c_str(),
@@ -923,6 +1287,10 @@ std::string VirtualCamera::toString(const char* indent) const {
     }
     StringAppendF(&buffer, "%sCurrent stream state: %d\n",
                                  indent, mStreamState);
+    StringAppendF(&buffer, "%sPriority: %d\n",
+                                 indent, static_cast<int32_t>(mPriority.load()));
+    StringAppendF(&buffer, "%sTarget frame rate: %d\n",
+                                 indent, mTargetFrameRate.load());
 
     return buffer;
 }
@@ -22,10 +22,13 @@
 #include <android/hardware/automotive/evs/1.1/IEvsCameraStream.h>
 #include <android/hardware/automotive/evs/1.1/IEvsDisplay.h>
 
+#include <atomic>
 #include <deque>
+#include <optional>
 #include <set>
 #include <thread>
 #include <unordered_map>
+#include <unordered_set>
 
 #include <utils/Mutex.h>
 
@@ -58,17 +61,47 @@ namespace implementation {
 class HalCamera;        // From HalCamera.h
 
 
+// Opaque identifier to set a priority class of a client via setExtendedInfo_1_1().
+// The value is a little-endian int32_t of VirtualCamera::Priority.
+constexpr uint32_t kOpaqueIdClientPriority = 0x80000001;
+
+// Opaque identifier to set a target frame rate of a client via
+// setExtendedInfo_1_1().  The value is a little-endian int32_t in frames per
+// second and zero disables the decimation.
+constexpr uint32_t kOpaqueIdTargetFrameRate = 0x80000002;
+
+
 // This class represents an EVS camera to the client application.  As such it presents
 // the IEvsCamera interface, and also proxies the frame delivery to the client's
 // IEvsCameraStream object.
 class VirtualCamera : public IEvsCamera_1_1 {
 public:
+    // Priority classes of clients.  Buffers held by lower priority clients
+    // may be reclaimed to serve higher priority clients.
+    enum class Priority : int32_t {
+        BACKGROUND = 0,
+        NORMAL,
+        CRITICAL,
+    };
+
     explicit          VirtualCamera(const std::vector<sp<HalCamera>>& halCameras);
     virtual           ~VirtualCamera();
 
     unsigned          getAllowedBuffers() { return mFramesAllowed; };
     bool              isStreaming()       { return mStreamState == RUNNING; }
     bool              getVersion() const  { return (int)(mStream_1_1 != nullptr); }
+    bool              isLogicalCamera() const { return mHalCamera.size() > 1; }
+    Priority          getPriority() const { return mPriority; }
+    void              setPriority(Priority priority);
+
+    // Called when a display is closed or replaced by another one.  A client
+    // that forced the master role with that display loses its elevated
+    // priority.
+    void              detachDisplay(const sp<IEvsDisplay_1_0>& display);
+
+    // Returns false if a frame captured by a given camera device at a given
+    // timestamp should be skipped to meet the target frame rate of this client
+    bool              isFrameWanted(const std::string& deviceId, int64_t timestamp);
     vector<sp<HalCamera>>
                       getHalCameras();
     void              setDescriptor(CameraDesc* desc) { mDesc = desc; }
@@ -77,6 +110,21 @@ public:
     bool              notify(const EvsEventDesc& event);
     bool              deliverFrame(const BufferDesc& bufDesc);
 
+    // Pass-through mode; frames are forwarded to the client directly from the
+    // HalCamera's callback instead of the capture thread.  A forwarded frame
+    // is refused once the mode of a given generation is left.
+    void              setPassThrough(bool enable, uint64_t generation);
+    bool              forwardFrame(const hidl_vec<BufferDesc_1_1>& buffers,
+                                   uint64_t generation);
+
+    // Takes away frames held longer than a given time limit and returns them
+    // to the caller.  Later returns of these frames from the client are
+    // ignored.  Frames forwarded in the pass-through mode are returned via
+    // a separate list because HalCamera does not keep records for them.
+    std::vector<BufferDesc_1_1>
+                      preemptFrames(const std::string& deviceId, int64_t holdLimitMs,
+                                    std::vector<BufferDesc_1_1>* forwarded);
+
     // Methods from ::android::hardware::automotive::evs::V1_0::IEvsCamera follow.
     Return<void>      getCameraInfo(getCameraInfo_cb _hidl_cb)  override;
     Return<EvsResult> setMaxFramesInFlight(uint32_t bufferCount) override;
@@ -117,6 +165,24 @@ public:
 private:
     void shutdown();
 
+    // Removes a returned frame from the held list.  Returns false if the
+    // frame must not go back to HalCamera; either it is unknown or it has
+    // been preempted already.  |forwarded| tells whether the frame was
+    // forwarded in the pass-through mode.
+    bool takeHeldFrame(const std::string& deviceId, uint32_t bufferId, bool* forwarded);
+
+    // Returns a frame taken out of the held list to a given HalCamera
+    static void returnFrame(const sp<HalCamera>& halCamera,
+                            const BufferDesc_1_1& buffer, bool forwarded);
+
+    // Moves the frame decimation timeline of a given camera device past a
+    // frame delivered to the client
+    void advanceTimelineLocked(const std::string& deviceId, int64_t timestamp)
+            REQUIRES(mFramesHeldMutex);
+
+    // Drops the priority raised by forceMaster() back to what it was
+    void restorePriorityLocked() REQUIRES(mPriorityMutex);
+
     // The low level camera interface that backs this proxy
     unordered_map<string,
                  wp<HalCamera>> mHalCamera;
@@ -131,14 +197,46 @@ private:
         STOPPING,
     }                           mStreamState;
 
+    // Frames held by the client; these are updated by HalCamera callbacks,
+    // the client's calls and other clients' capture threads preempting frames.
+    // This lock is never held while calling out of this object.
+    mutable std::mutex          mFramesHeldMutex;
+    unordered_map<string,
+         deque<BufferDesc_1_1>> mFramesHeld GUARDED_BY(mFramesHeldMutex);
+    unordered_map<string,
+         unordered_map<uint32_t,
+                       int64_t>> mFramesHeldSince  // Uptime in milliseconds
+                                    GUARDED_BY(mFramesHeldMutex);
+    unordered_map<string,
+         unordered_multiset<uint32_t>>
+                                mFramesPreempted   // Preempted, not returned yet
+                                    GUARDED_BY(mFramesHeldMutex);
+    unordered_map<string,
+         unordered_set<uint32_t>>
+                                mFramesForwarded   // Held frames not recorded by HalCamera
+                                    GUARDED_BY(mFramesHeldMutex);
+    uint64_t                    mPassThroughGeneration  // Zero if not in the pass-through mode
+                                    GUARDED_BY(mFramesHeldMutex) = 0;
+    std::atomic<Priority>       mPriority = Priority::NORMAL;
+
+    // Priority to restore when the master role taken by forceMaster() is
+    // lost, and the display that role was taken with
+    std::mutex                  mPriorityMutex;
+    std::optional<Priority>     mPriorityBeforeMaster GUARDED_BY(mPriorityMutex);
+    wp<IEvsDisplay_1_0>         mMasterDisplay GUARDED_BY(mPriorityMutex);
+
+    // Frame decimation; timestamps are in microseconds.  Each physical camera
+    // device has its own timeline.
+    std::atomic<int32_t>        mTargetFrameRate = 0;
     unordered_map<string,
-         deque<BufferDesc_1_1>> mFramesHeld;
+                  int64_t>      mNextFrameTimestamps GUARDED_BY(mFramesHeldMutex);
     thread                      mCaptureThread;
     CameraDesc*                 mDesc;
 
     mutable std::mutex          mFrameDeliveryMutex;
     std::condition_variable     mFramesReadySignal;
     std::set<std::string>       mSourceCameras GUARDED_BY(mFrameDeliveryMutex);
+    std::atomic<bool>           mPassThrough = false;
 
 };
 
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "HalCamera.h"
+#include "VirtualCamera.h"
+#include "MockEvsCameraStream.h"
+
+#include <benchmark/benchmark.h>
+#include <cutils/native_handle.h>
+
+#include <chrono>
+#include <unordered_map>
+#include <vector>
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+namespace {
+
+constexpr char kDeviceId[] = "/dev/mockcamera0";
+constexpr int64_t kFrameIntervalUs = 33333;
+
+// Measures the time from the hardware delivering a buffer to the first
+// client receiving it.  A single client is served in the pass-through mode;
+// more clients take the fan-out path, where a buffer arriving before the
+// first client requests one is returned and the next buffer is measured.
+void BM_FrameLatency(benchmark::State& state) {
+    sp<RecordingHWCamera> hwCamera = new RecordingHWCamera();
+    sp<HalCamera> halCamera = new HalCamera(hwCamera, kDeviceId);
+    std::vector<sp<MockEvsCameraStream>> streams;
+    std::vector<sp<VirtualCamera>> clients;
+    for (int i = 0; i < state.range(0); ++i) {
+        sp<MockEvsCameraStream> stream = new MockEvsCameraStream();
+        sp<VirtualCamera> client = halCamera->makeVirtualCamera();
+        if (client == nullptr || client->startVideoStream(stream) != EvsResult::OK) {
+            state.SkipWithError("Failed to start a client");
+            return;
+        }
+        streams.emplace_back(stream);
+        clients.emplace_back(client);
+    }
+
+    native_handle_t* handle = native_handle_create(/* numFds = */ 0, /* numInts = */ 0);
+    std::unordered_map<uint32_t, std::chrono::steady_clock::time_point> deliveredAt;
+    uint32_t nextBufferId = 0;
+    for (auto _ : state) {
+        BufferDesc_1_1 received;
+        do {
+            hidl_vec<BufferDesc_1_1> buffers(1);
+            buffers[0].bufferId = nextBufferId++;
+            buffers[0].deviceId = kDeviceId;
+            buffers[0].timestamp = nextBufferId * kFrameIntervalUs;
+            buffers[0].buffer.nativeHandle = handle;
+            deliveredAt[buffers[0].bufferId] = std::chrono::steady_clock::now();
+            halCamera->deliverFrame_1_1(buffers);
+        } while (!streams[0]->waitForFrame(&received, std::chrono::milliseconds(10)));
+
+        const auto latency = std::chrono::steady_clock::now() - deliveredAt[received.bufferId];
+        state.SetIterationTime(std::chrono::duration<double>(latency).count());
+
+        // Returns all frames so the clients keep accepting new ones
+        hidl_vec<BufferDesc_1_1> frames(1);
+        frames[0] = received;
+        clients[0]->doneWithFrame_1_1(frames);
+        for (size_t i = 0; i < clients.size(); ++i) {
+            for (auto&& frame : streams[i]->takeFrames()) {
+                frames[0] = frame;
+                clients[i]->doneWithFrame_1_1(frames);
+            }
+        }
+    }
+
+    for (auto&& client : clients) {
+        client->stopVideoStream();
+    }
+    clients.clear();
+    native_handle_delete(handle);
+}
+
+BENCHMARK(BM_FrameLatency)->Arg(1)->Arg(2)->UseManualTime();
+
+}  // namespace
+}  // namespace implementation
+}  // namespace V1_1
+}  // namespace evs
+}  // namespace automotive
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -0,0 +1,372 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "HalCamera.h"
+#include "VirtualCamera.h"
+#include "MockEvsCameraStream.h"
+
+#include <cutils/native_handle.h>
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+namespace {
+
+constexpr char kDeviceId[] = "/dev/mockcamera0";
+constexpr int64_t kFrameIntervalUs = 33333;
+
+// Identifies a buffer that the emulated hardware never delivers
+constexpr uint32_t kUntrackedBufferId = 0xFFFF;
+
+class HalCameraTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        mHwCamera = new RecordingHWCamera();
+        mHalCamera = new HalCamera(mHwCamera, kDeviceId);
+        mHandle = native_handle_create(/* numFds = */ 0, /* numInts = */ 0);
+    }
+
+    void TearDown() override {
+        for (auto&& client : mClients) {
+            client->stopVideoStream();
+        }
+        mClients.clear();
+
+        // Every buffer goes back to the hardware exactly once
+        for (uint32_t id = 0; id < mNextBufferId; ++id) {
+            EXPECT_EQ(mHwCamera->getReturnCount(id), 1) << "Buffer #" << id;
+        }
+
+        mHalCamera = nullptr;
+        native_handle_delete(mHandle);
+    }
+
+    sp<VirtualCamera> startClient(const sp<MockEvsCameraStream>& stream) {
+        sp<VirtualCamera> client = mHalCamera->makeVirtualCamera();
+        if (client == nullptr || client->startVideoStream(stream) != EvsResult::OK) {
+            return nullptr;
+        }
+
+        mClients.emplace_back(client);
+        return client;
+    }
+
+    void stopClient(const sp<VirtualCamera>& client) {
+        client->stopVideoStream();
+        mClients.erase(std::find(mClients.begin(), mClients.end(), client));
+    }
+
+    hidl_vec<BufferDesc_1_1> makeFrames(uint32_t bufferId) {
+        hidl_vec<BufferDesc_1_1> buffers(1);
+        buffers[0].bufferId = bufferId;
+        buffers[0].deviceId = kDeviceId;
+        buffers[0].timestamp = (bufferId + 1) * kFrameIntervalUs;
+        buffers[0].buffer.nativeHandle = mHandle;
+        return buffers;
+    }
+
+    // Emulates the hardware delivering a new buffer
+    uint32_t deliverFrame() {
+        const auto bufferId = mNextBufferId++;
+        mHalCamera->deliverFrame_1_1(makeFrames(bufferId));
+        return bufferId;
+    }
+
+    // Keeps delivering buffers until a given client gets one.  In the fan-out
+    // mode, buffers are returned right away until the client's capture thread
+    // requests a frame.
+    bool deliverFrameTo(const sp<MockEvsCameraStream>& stream, BufferDesc_1_1* frame) {
+        for (int i = 0; i < 100; ++i) {
+            deliverFrame();
+            if (stream->waitForFrame(frame, std::chrono::milliseconds(20))) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    static EvsResult setPriority(const sp<VirtualCamera>& client,
+                                 VirtualCamera::Priority priority) {
+        const int32_t value = static_cast<int32_t>(priority);
+        hidl_vec<uint8_t> bytes(sizeof(value));
+        memcpy(bytes.data(), &value, sizeof(value));
+        return client->setExtendedInfo_1_1(kOpaqueIdClientPriority, bytes);
+    }
+
+    static void returnFrame(const sp<VirtualCamera>& client, const BufferDesc_1_1& frame) {
+        hidl_vec<BufferDesc_1_1> frames(1);
+        frames[0] = frame;
+        client->doneWithFrame_1_1(frames);
+    }
+
+    // Returns frames a client has received or is about to receive.  A frame
+    // is delivered to the clients' streams from their capture threads.
+    static void returnFrames(const sp<VirtualCamera>& client,
+                             const sp<MockEvsCameraStream>& stream) {
+        BufferDesc_1_1 frame;
+        while (stream->waitForFrame(&frame, std::chrono::milliseconds(100))) {
+            returnFrame(client, frame);
+        }
+    }
+
+    sp<RecordingHWCamera> mHwCamera;
+    sp<HalCamera> mHalCamera;
+    native_handle_t* mHandle = nullptr;
+    std::vector<sp<VirtualCamera>> mClients;
+    uint32_t mNextBufferId = 0;
+};
+
+TEST_F(HalCameraTests, SingleClientReceivesForwardedFrames) {
+    sp<MockEvsCameraStream> stream = new MockEvsCameraStream();
+    sp<VirtualCamera> client = startClient(stream);
+    ASSERT_NE(client, nullptr);
+    EXPECT_TRUE(mHalCamera->isPassThrough());
+
+    // No frame request is needed in the pass-through mode
+    const auto id = deliverFrame();
+    BufferDesc_1_1 frame;
+    ASSERT_TRUE(stream->waitForFrame(&frame));
+    EXPECT_EQ(frame.bufferId, id);
+    EXPECT_EQ(mHwCamera->getReturnCount(id), 0);
+
+    returnFrame(client, frame);
+    EXPECT_EQ(mHwCamera->getReturnCount(id), 1);
+}
+
+TEST_F(HalCameraTests, LeavesPassThroughWhileForwardedFrameIsHeld) {
+    sp<MockEvsCameraStream> stream = new MockEvsCameraStream();
+    sp<VirtualCamera> client = startClient(stream);
+    ASSERT_NE(client, nullptr);
+    ASSERT_TRUE(mHalCamera->isPassThrough());
+
+    BufferDesc_1_1 forwarded;
+    deliverFrame();
+    ASSERT_TRUE(stream->waitForFrame(&forwarded));
+
+    // A second client ends the pass-through mode
+    sp<MockEvsCameraStream> otherStream = new MockEvsCameraStream();
+    sp<VirtualCamera> otherClient = startClient(otherStream);
+    ASSERT_NE(otherClient, nullptr);
+    EXPECT_FALSE(mHalCamera->isPassThrough());
+
+    // The forwarded frame still goes back to the hardware
+    returnFrame(client, forwarded);
+    EXPECT_EQ(mHwCamera->getReturnCount(forwarded.bufferId), 1);
+
+    // Both clients now receive frames through the fan-out delivery
+    BufferDesc_1_1 frame;
+    ASSERT_TRUE(deliverFrameTo(stream, &frame));
+    returnFrame(client, frame);
+    ASSERT_TRUE(deliverFrameTo(otherStream, &frame));
+    returnFrame(otherClient, frame);
+    returnFrames(client, stream);
+    returnFrames(otherClient, otherStream);
+}
+
+TEST_F(HalCameraTests, EntersPassThroughWhileRecordedFrameIsHeld) {
+    sp<MockEvsCameraStream> stream = new MockEvsCameraStream();
+    sp<VirtualCamera> client = startClient(stream);
+    sp<MockEvsCameraStream> otherStream = new MockEvsCameraStream();
+    sp<VirtualCamera> otherClient = startClient(otherStream);
+    ASSERT_NE(client, nullptr);
+    ASSERT_NE(otherClient, nullptr);
+    ASSERT_FALSE(mHalCamera->isPassThrough());
+
+    BufferDesc_1_1 recorded;
+    ASSERT_TRUE(deliverFrameTo(stream, &recorded));
+    returnFrames(otherClient, otherStream);
+
+    // The last client standing enters the pass-through mode
+    stopClient(otherClient);
+    EXPECT_TRUE(mHalCamera->isPassThrough());
+
+    // The buffer is still tracked and is returned once the client is done
+    returnFrame(client, recorded);
+    EXPECT_EQ(mHwCamera->getReturnCount(recorded.bufferId), 1);
+
+    BufferDesc_1_1 forwarded;
+    const auto id = deliverFrame();
+    ASSERT_TRUE(stream->waitForFrame(&forwarded));
+    EXPECT_EQ(forwarded.bufferId, id);
+    returnFrame(client, forwarded);
+    EXPECT_EQ(mHwCamera->getReturnCount(id), 1);
+}
+
+TEST_F(HalCameraTests, ClientRefusesFramesOfOtherPassThroughModes) {
+    sp<MockEvsCameraStream> stream = new MockEvsCameraStream();
+    sp<VirtualCamera> client = startClient(stream);
+    ASSERT_NE(client, nullptr);
+    ASSERT_TRUE(mHalCamera->isPassThrough());
+
+    // Emulates frames that HalCamera picked for this client before the client
+    // switched its mode; HalCamera sends them through the fan-out delivery.
+    constexpr uint64_t kGeneration = 100;
+    const auto buffers = makeFrames(kUntrackedBufferId);
+    client->setPassThrough(true, kGeneration);
+    EXPECT_FALSE(client->forwardFrame(buffers, kGeneration - 1));
+    client->setPassThrough(false, 0);
+    EXPECT_FALSE(client->forwardFrame(buffers, kGeneration));
+
+    BufferDesc_1_1 frame;
+    EXPECT_FALSE(stream->waitForFrame(&frame, std::chrono::milliseconds(100)));
+}
+
+TEST_F(HalCameraTests, CriticalClientReservesBuffers) {
+    sp<MockEvsCameraStream> stream = new MockEvsCameraStream();
+    sp<VirtualCamera> client = startClient(stream);
+    sp<MockEvsCameraStream> otherStream = new MockEvsCameraStream();
+    sp<VirtualCamera> otherClient = startClient(otherStream);
+    ASSERT_NE(client, nullptr);
+    ASSERT_NE(otherClient, nullptr);
+    EXPECT_EQ(mHwCamera->getBufferCount(), 2);
+
+    // A failed attempt does not raise the priority
+    EXPECT_EQ(client->forceMaster(nullptr), EvsResult::INVALID_ARG);
+    EXPECT_EQ(client->getPriority(), VirtualCamera::Priority::NORMAL);
+
+    sp<IEvsDisplay_1_0> display = new MockHWDisplay();
+    ASSERT_EQ(client->forceMaster(display), EvsResult::OK);
+    EXPECT_EQ(client->getPriority(), VirtualCamera::Priority::CRITICAL);
+    EXPECT_EQ(mHwCamera->getBufferCount(), 3);
+
+    // Losing the master role gives the reserved buffer to the new master
+    ASSERT_EQ(otherClient->forceMaster(display), EvsResult::OK);
+    EXPECT_EQ(client->getPriority(), VirtualCamera::Priority::NORMAL);
+    EXPECT_EQ(otherClient->getPriority(), VirtualCamera::Priority::CRITICAL);
+    EXPECT_EQ(stream->getEventCount(EvsEventType::MASTER_RELEASED), 1);
+    EXPECT_EQ(mHwCamera->getBufferCount(), 3);
+
+    // Giving up the master role releases the reserved buffer
+    ASSERT_EQ(otherClient->unsetMaster(), EvsResult::OK);
+    EXPECT_EQ(otherClient->getPriority(), VirtualCamera::Priority::NORMAL);
+    EXPECT_EQ(mHwCamera->getBufferCount(), 2);
+}
+
+TEST_F(HalCameraTests, DetachedDisplayRestoresPriority) {
+    sp<MockEvsCameraStream> stream = new MockEvsCameraStream();
+    sp<VirtualCamera> client = startClient(stream);
+    sp<MockEvsCameraStream> otherStream = new MockEvsCameraStream();
+    sp<VirtualCamera> otherClient = startClient(otherStream);
+    ASSERT_NE(client, nullptr);
+    ASSERT_NE(otherClient, nullptr);
+    ASSERT_EQ(setPriority(client, VirtualCamera::Priority::BACKGROUND), EvsResult::OK);
+
+    sp<IEvsDisplay_1_0> display = new MockHWDisplay();
+    ASSERT_EQ(client->forceMaster(display), EvsResult::OK);
+    EXPECT_EQ(client->getPriority(), VirtualCamera::Priority::CRITICAL);
+
+    // A priority requested while the master role is held applies afterwards
+    ASSERT_EQ(setPriority(client, VirtualCamera::Priority::NORMAL), EvsResult::OK);
+    EXPECT_EQ(client->getPriority(), VirtualCamera::Priority::CRITICAL);
+
+    sp<IEvsDisplay_1_0> otherDisplay = new MockHWDisplay();
+    mHalCamera->detachDisplay(otherDisplay);
+    EXPECT_EQ(client->getPriority(), VirtualCamera::Priority::CRITICAL);
+
+    mHalCamera->detachDisplay(display);
+    EXPECT_EQ(client->getPriority(), VirtualCamera::Priority::NORMAL);
+    EXPECT_EQ(mHwCamera->getBufferCount(), 2);
+}
+
+TEST_F(HalCameraTests, LowerPriorityClientLosesFramesHeldPastDeadline) {
+    sp<MockEvsCameraStream> stream = new MockEvsCameraStream();
+    sp<VirtualCamera> client = startClient(stream);
+    sp<MockEvsCameraStream> lowStream = new MockEvsCameraStream();
+    sp<VirtualCamera> lowClient = startClient(lowStream);
+    ASSERT_NE(client, nullptr);
+    ASSERT_NE(lowClient, nullptr);
+    ASSERT_EQ(setPriority(lowClient, VirtualCamera::Priority::BACKGROUND), EvsResult::OK);
+    ASSERT_EQ(mHwCamera->getBufferCount(), 2);
+
+    // Each client holds a different buffer so none is left to the hardware.
+    // A client at its quota declines a frame and drops its request, so the
+    // higher priority client returns frames until the other one holds one.
+    BufferDesc_1_1 held;
+    BufferDesc_1_1 frame;
+    bool isHeld = false;
+    for (int i = 0; i < 100 && !isHeld; ++i) {
+        deliverFrame();
+        if (stream->waitForFrame(&frame, std::chrono::milliseconds(50))) {
+            returnFrame(client, frame);
+        }
+        isHeld = lowStream->waitForFrame(&held, std::chrono::milliseconds(50));
+    }
+    ASSERT_TRUE(isHeld);
+    ASSERT_TRUE(deliverFrameTo(stream, &frame));
+
+    // The higher priority client waits for its next frame and takes the
+    // buffer back once the deadline has passed.  Frames declined over the
+    // quota are reported as dropped too.
+    const int numDropped = lowStream->getEventCount(EvsEventType::FRAME_DROPPED);
+    for (int i = 0; i < 100 && mHwCamera->getReturnCount(held.bufferId) == 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    EXPECT_EQ(mHwCamera->getReturnCount(held.bufferId), 1);
+    EXPECT_EQ(lowStream->getEventCount(EvsEventType::FRAME_DROPPED), numDropped + 1);
+    EXPECT_EQ(mHwCamera->getReturnCount(frame.bufferId), 0);
+
+    // A late return of the preempted buffer is ignored
+    returnFrame(lowClient, held);
+    EXPECT_EQ(mHwCamera->getReturnCount(held.bufferId), 1);
+    returnFrame(client, frame);
+}
+
+TEST_F(HalCameraTests, ForwardedFrameHeldPastDeadlineIsPreempted) {
+    sp<MockEvsCameraStream> lowStream = new MockEvsCameraStream();
+    sp<VirtualCamera> lowClient = startClient(lowStream);
+    ASSERT_NE(lowClient, nullptr);
+    ASSERT_EQ(setPriority(lowClient, VirtualCamera::Priority::BACKGROUND), EvsResult::OK);
+    ASSERT_TRUE(mHalCamera->isPassThrough());
+
+    BufferDesc_1_1 forwarded;
+    deliverFrame();
+    ASSERT_TRUE(lowStream->waitForFrame(&forwarded));
+
+    // The forwarded buffer counts as in use once the mode ends
+    sp<MockEvsCameraStream> stream = new MockEvsCameraStream();
+    sp<VirtualCamera> client = startClient(stream);
+    ASSERT_NE(client, nullptr);
+    ASSERT_FALSE(mHalCamera->isPassThrough());
+    ASSERT_EQ(mHwCamera->getBufferCount(), 2);
+
+    BufferDesc_1_1 frame;
+    ASSERT_TRUE(deliverFrameTo(stream, &frame));
+    for (int i = 0; i < 100 && mHwCamera->getReturnCount(forwarded.bufferId) == 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    EXPECT_EQ(mHwCamera->getReturnCount(forwarded.bufferId), 1);
+
+    returnFrame(lowClient, forwarded);
+    EXPECT_EQ(mHwCamera->getReturnCount(forwarded.bufferId), 1);
+    returnFrame(client, frame);
+}
+
+}  // namespace
+}  // namespace implementation
+}  // namespace V1_1
+}  // namespace evs
+}  // namespace automotive
+}  // namespace android
@@ -0,0 +1,132 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef EVS_MANAGER_1_1_TEST_UNIT_MOCKEVSCAMERASTREAM_H_
+#define EVS_MANAGER_1_1_TEST_UNIT_MOCKEVSCAMERASTREAM_H_
+
+#include "HalCamera.h"
+#include "HalDisplay.h"
+#include "VirtualCamera.h"
+#include "MockHWCamera.h"
+#include "MockHWDisplay.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+// A client's stream; keeps received frames until the test takes them.
+class MockEvsCameraStream : public IEvsCameraStream_1_1 {
+public:
+    Return<void> deliverFrame(const BufferDesc_1_0& buffer) override { return {}; }
+
+    Return<void> deliverFrame_1_1(const hidl_vec<BufferDesc_1_1>& buffers) override {
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            for (auto&& buffer : buffers) {
+                mFrames.emplace_back(buffer);
+            }
+        }
+        mFrameSignal.notify_all();
+        return {};
+    }
+
+    Return<void> notify(const EvsEventDesc& event) override {
+        std::lock_guard<std::mutex> lock(mLock);
+        ++mEvents[event.aType];
+        return {};
+    }
+
+    // Takes the oldest frame received.  Returns false if none arrives in time.
+    bool waitForFrame(BufferDesc_1_1* frame,
+                      std::chrono::milliseconds timeout = std::chrono::milliseconds(500)) {
+        std::unique_lock<std::mutex> lock(mLock);
+        if (!mFrameSignal.wait_for(lock, timeout, [this]() { return !mFrames.empty(); })) {
+            return false;
+        }
+
+        *frame = mFrames.front();
+        mFrames.pop_front();
+        return true;
+    }
+
+    // Takes all frames received so far
+    std::deque<BufferDesc_1_1> takeFrames() {
+        std::deque<BufferDesc_1_1> frames;
+        std::lock_guard<std::mutex> lock(mLock);
+        frames.swap(mFrames);
+        return frames;
+    }
+
+    int getEventCount(EvsEventType type) {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mEvents[type];
+    }
+
+private:
+    std::mutex mLock;
+    std::condition_variable mFrameSignal;
+    std::deque<BufferDesc_1_1> mFrames;
+    std::unordered_map<EvsEventType, int> mEvents;
+};
+
+
+// A hardware camera that counts buffers returned by the manager and
+// remembers the number of buffers it was asked for
+class RecordingHWCamera : public MockHWCamera {
+public:
+    Return<EvsResult> setMaxFramesInFlight(uint32_t bufferCount) override {
+        mBufferCount = bufferCount;
+        return MockHWCamera::setMaxFramesInFlight(bufferCount);
+    }
+
+    Return<EvsResult> doneWithFrame_1_1(const hidl_vec<BufferDesc_1_1>& buffers) override {
+        std::lock_guard<std::mutex> lock(mLock);
+        for (auto&& buffer : buffers) {
+            ++mReturnCounts[buffer.bufferId];
+        }
+        return EvsResult::OK;
+    }
+
+    int getReturnCount(uint32_t bufferId) {
+        std::lock_guard<std::mutex> lock(mLock);
+        auto it = mReturnCounts.find(bufferId);
+        return it == mReturnCounts.end() ? 0 : it->second;
+    }
+
+    uint32_t getBufferCount() const { return mBufferCount; }
+
+private:
+    std::atomic<uint32_t> mBufferCount = 0;
+    std::mutex mLock;
+    std::unordered_map<uint32_t, int> mReturnCounts;
+};
+
+}  // namespace implementation
+}  // namespace V1_1
+}  // namespace evs
+}  // namespace automotive
+}  // namespace android
+
+#endif  // EVS_MANAGER_1_1_TEST_UNIT_MOCKEVSCAMERASTREAM_H_
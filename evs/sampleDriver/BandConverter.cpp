@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BandConverter.h"
+
+#include <algorithm>
+
+#include <android-base/logging.h>
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+BandConverter::BandConverter(unsigned numWorkers) {
+    LOG(DEBUG) << "Starting " << numWorkers << " conversion worker threads";
+
+    mWorkers.reserve(numWorkers);
+    for (unsigned i = 0; i < numWorkers; ++i) {
+        // Band 0 belongs to the calling thread
+        mWorkers.emplace_back([this, i]() { workerLoop(i + 1); });
+    }
+}
+
+
+BandConverter::~BandConverter() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mRunning = false;
+    }
+    mJobReady.notify_all();
+
+    for (auto&& worker : mWorkers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+
+bool BandConverter::convert(ConvertFunction fill, const BufferDesc& tgtBuff, uint8_t* tgt,
+                            const SourceFrame& src, unsigned height) {
+    const unsigned numBands = mWorkers.size() + 1;
+
+    // Bands start on even rows so that no NV21 chroma row is written by two
+    // threads.
+    const unsigned rowsPerBand = (((height + 1) / 2 + numBands - 1) / numBands) * 2;
+    if (mWorkers.empty() || rowsPerBand >= height) {
+        // Too small to be worth splitting
+        return fill(tgtBuff, tgt, src, 0, height);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mFill = fill;
+        mTgtBuff = &tgtBuff;
+        mTgt = tgt;
+        mSrc = &src;
+        mHeight = height;
+        mRowsPerBand = rowsPerBand;
+        mPending = mWorkers.size();
+        mFailed = false;
+        ++mGeneration;
+    }
+    mJobReady.notify_all();
+
+    const bool succeeded = runBand(0);
+
+    // The job description must stay valid until every worker is done with it
+    std::unique_lock<std::mutex> lock(mLock);
+    mJobDone.wait(lock, [this]() { return mPending == 0; });
+
+    return succeeded && !mFailed;
+}
+
+
+bool BandConverter::runBand(unsigned band) {
+    // The job fields are stable while a frame is in progress; convert() does
+    // not return, and so cannot publish another job, until every band is done.
+    const unsigned startRow = std::min(band * mRowsPerBand, mHeight);
+    const unsigned endRow = std::min(startRow + mRowsPerBand, mHeight);
+    if (startRow >= endRow) {
+        return true;
+    }
+
+    return mFill(*mTgtBuff, mTgt, *mSrc, startRow, endRow);
+}
+
+
+void BandConverter::workerLoop(unsigned band) {
+    uint64_t lastGeneration = 0;
+    std::unique_lock<std::mutex> lock(mLock);
+    while (true) {
+        mJobReady.wait(lock, [this, &lastGeneration]() {
+            return !mRunning || mGeneration != lastGeneration;
+        });
+        if (!mRunning) {
+            break;
+        }
+        lastGeneration = mGeneration;
+
+        lock.unlock();
+        const bool succeeded = runBand(band);
+        lock.lock();
+
+        if (!succeeded) {
+            mFailed = true;
+        }
+
+        if (--mPending == 0) {
+            mJobDone.notify_one();
+        }
+    }
+}
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_BANDCONVERTER_H
+#define ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_BANDCONVERTER_H
+
+#include "ConversionRegistry.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+
+// Splits a pixel format conversion into horizontal bands of rows and runs them
+// in parallel.  Worker threads are created once and reused for every frame;
+// the calling thread converts the first band itself and returns only after
+// all bands are written.
+class BandConverter {
+public:
+    explicit BandConverter(unsigned numWorkers);
+    ~BandConverter();
+
+    BandConverter(const BandConverter&) = delete;
+    BandConverter& operator=(const BandConverter&) = delete;
+
+    // Converts rows [0, height) of the target buffer.  Returns false if any
+    // band failed.  Not reentrant; a camera calls this only from its capture
+    // thread.
+    bool convert(ConvertFunction fill, const BufferDesc& tgtBuff, uint8_t* tgt,
+                 const SourceFrame& src, unsigned height);
+
+    unsigned getNumWorkers() const { return mWorkers.size(); }
+
+private:
+    void workerLoop(unsigned band);
+    bool runBand(unsigned band);
+
+    std::vector<std::thread> mWorkers;
+
+    // Guards the job description and the counters below
+    std::mutex              mLock;
+    std::condition_variable mJobReady;
+    std::condition_variable mJobDone;
+    uint64_t                mGeneration = 0;   // Bumped for each new frame
+    unsigned                mPending = 0;      // Worker bands not yet finished
+    bool                    mFailed = false;   // A worker band of this frame failed
+    bool                    mRunning = true;
+
+    // Current job; written by convert() before mGeneration is bumped
+    ConvertFunction     mFill = nullptr;
+    const BufferDesc*   mTgtBuff = nullptr;
+    uint8_t*            mTgt = nullptr;
+    const SourceFrame*  mSrc = nullptr;
+    unsigned            mHeight = 0;
+    unsigned            mRowsPerBand = 0;
+};
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
+
+#endif  // ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_BANDCONVERTER_H
@@ -14,9 +14,19 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+#include <cstring>
 #include <sstream>
 #include <fstream>
 #include <thread>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <android-base/file.h>
 
 #include <hardware/gralloc.h>
 #include <utils/SystemClock.h>
@@ -30,6 +40,268 @@ const char* ConfigManager::CONFIG_DEFAULT_PATH =
         "/vendor/etc/automotive/evs/evs_configuration.xml";
 const char* ConfigManager::CONFIG_OVERRIDE_PATH =
         "/vendor/etc/automotive/evs/evs_configuration_override.xml";
+const char* ConfigManager::CONFIG_BINARY_PATH =
+        "/data/vendor/evs/evs_configuration.bin";
+
+namespace {
+
+/*
+ * Binary configuration file layout.  A fixed header is followed by the
+ * payload written by ConfigManager::writeConfigDataToBinary().  Every field
+ * in the payload is 4-byte aligned and camera metadata blobs are 8-byte
+ * aligned so they can be validated where they are mapped.  kBinaryVersion
+ * must be bumped whenever the payload layout changes.
+ */
+const uint32_t kBinaryMagic = 0x43535645;   // "EVSC"
+const uint32_t kBinaryVersion = 1;
+
+struct BinaryHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t payloadSize;
+    uint64_t checksum;
+    /* XML files the payload was generated from; override file first */
+    int64_t  xmlModifiedTime[2];
+    int64_t  xmlSize[2];
+};
+static_assert(sizeof(BinaryHeader) % 8 == 0, "Payload must start 8-byte aligned");
+
+
+/* 64-bit FNV-1a hash of the payload */
+uint64_t computeChecksum(const uint8_t *data, const size_t size) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+
+/* Modification time in nanoseconds and size of each file, or -1 if missing */
+void readXmlFileStamps(const char *overridePath, const char *defaultPath,
+                       int64_t modifiedTime[2], int64_t size[2]) {
+    const char *paths[2] = { overridePath, defaultPath };
+    for (auto i = 0; i < 2; ++i) {
+        struct stat fileStat;
+        if (stat(paths[i], &fileStat) == 0) {
+            modifiedTime[i] = fileStat.st_mtim.tv_sec * 1000000000LL + fileStat.st_mtim.tv_nsec;
+            size[i] = fileStat.st_size;
+        } else {
+            modifiedTime[i] = -1;
+            size[i] = -1;
+        }
+    }
+}
+
+
+class BinaryWriter {
+public:
+    template <typename T>
+    void write(const T &value) {
+        static_assert(std::is_trivially_copyable<T>::value, "Type cannot be serialized");
+        append(&value, sizeof(T));
+        align(4);
+    }
+
+    void writeString(const string &str) {
+        write(static_cast<uint32_t>(str.size()));
+        append(str.data(), str.size());
+        align(4);
+    }
+
+    void writeBlob(const void *data, const size_t size) {
+        write(static_cast<uint32_t>(size));
+        align(8);
+        append(data, size);
+        align(4);
+    }
+
+    const vector<uint8_t> &getData() const {
+        return mBuffer;
+    }
+
+private:
+    void append(const void *data, const size_t size) {
+        const uint8_t *bytes = static_cast<const uint8_t *>(data);
+        mBuffer.insert(mBuffer.end(), bytes, bytes + size);
+    }
+
+    void align(const size_t alignment) {
+        mBuffer.resize((mBuffer.size() + alignment - 1) & ~(alignment - 1), 0);
+    }
+
+    vector<uint8_t> mBuffer;
+};
+
+
+/* Reads fields in place; every read is bounds checked */
+class BinaryReader {
+public:
+    BinaryReader(const uint8_t *data, const size_t size) :
+        mData(data), mSize(size) {}
+
+    template <typename T>
+    bool read(T &value) {
+        if (mSize - mOffset < sizeof(T)) {
+            return false;
+        }
+
+        memcpy(&value, mData + mOffset, sizeof(T));
+        mOffset += sizeof(T);
+        return align(4);
+    }
+
+    bool readString(string &str) {
+        uint32_t len = 0;
+        if (!read(len) || mSize - mOffset < len) {
+            return false;
+        }
+
+        str.assign(reinterpret_cast<const char *>(mData + mOffset), len);
+        mOffset += len;
+        return align(4);
+    }
+
+    const uint8_t *readBlob(size_t &size) {
+        uint32_t len = 0;
+        if (!read(len) || !align(8) || mSize - mOffset < len) {
+            return nullptr;
+        }
+
+        const uint8_t *blob = mData + mOffset;
+        size = len;
+        mOffset += len;
+        return align(4) ? blob : nullptr;
+    }
+
+    bool isAtEnd() const {
+        return mOffset == mSize;
+    }
+
+private:
+    bool align(const size_t alignment) {
+        const size_t aligned = (mOffset + alignment - 1) & ~(alignment - 1);
+        if (aligned > mSize) {
+            return false;
+        }
+
+        mOffset = aligned;
+        return true;
+    }
+
+    const uint8_t *mData;
+    const size_t mSize;
+    size_t mOffset = 0;
+};
+
+
+void serializeStreamConfigurations(BinaryWriter &writer,
+                                   const unordered_map<int32_t, RawStreamConfiguration> &cfgs) {
+    writer.write(static_cast<uint32_t>(cfgs.size()));
+    for (auto&& [id, cfg] : cfgs) {
+        writer.write(id);
+        writer.write(cfg);
+    }
+}
+
+
+bool deserializeStreamConfigurations(BinaryReader &reader,
+                                     unordered_map<int32_t, RawStreamConfiguration> &cfgs) {
+    uint32_t count = 0;
+    if (!reader.read(count)) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        int32_t id;
+        RawStreamConfiguration cfg;
+        if (!reader.read(id) || !reader.read(cfg)) {
+            return false;
+        }
+        cfgs.insert_or_assign(id, cfg);
+    }
+
+    return true;
+}
+
+
+void serializeCameraInfo(BinaryWriter &writer, const ConfigManager::CameraInfo &aCamera) {
+    writer.write(aCamera.conversionWorkers);
+    writer.write(static_cast<int32_t>(aCamera.zeroCopy));
+
+    /* controls */
+    writer.write(static_cast<uint32_t>(aCamera.controls.size()));
+    for (auto&& [cid, range] : aCamera.controls) {
+        writer.write(static_cast<int32_t>(cid));
+        writer.write(get<0>(range));
+        writer.write(get<1>(range));
+        writer.write(get<2>(range));
+    }
+
+    /* stream configurations */
+    serializeStreamConfigurations(writer, aCamera.streamConfigurations);
+
+    /* camera_metadata_t is a flat buffer so it is stored as it is */
+    if (aCamera.characteristics != nullptr) {
+        writer.writeBlob(aCamera.characteristics,
+                         get_camera_metadata_size(aCamera.characteristics));
+    } else {
+        writer.writeBlob(nullptr, 0);
+    }
+}
+
+
+bool deserializeCameraInfo(BinaryReader &reader, ConfigManager::CameraInfo *aCamera) {
+    int32_t zeroCopy = 0;
+    uint32_t numControls = 0;
+    if (!reader.read(aCamera->conversionWorkers) ||
+        !reader.read(zeroCopy) ||
+        !reader.read(numControls)) {
+        return false;
+    }
+    aCamera->zeroCopy = zeroCopy != 0;
+
+    /* controls */
+    for (uint32_t i = 0; i < numControls; ++i) {
+        int32_t cid, min, max, step;
+        if (!reader.read(cid) || !reader.read(min) ||
+            !reader.read(max) || !reader.read(step)) {
+            return false;
+        }
+        aCamera->controls.emplace(static_cast<CameraParam>(cid),
+                                  make_tuple(min, max, step));
+    }
+
+    /* stream configurations */
+    if (!deserializeStreamConfigurations(reader, aCamera->streamConfigurations)) {
+        return false;
+    }
+
+    /* camera metadata is validated in the mapped file and then cloned */
+    size_t metadataSize = 0;
+    const uint8_t *metadata = reader.readBlob(metadataSize);
+    if (metadata == nullptr) {
+        return false;
+    } else if (metadataSize > 0) {
+        const camera_metadata_t *src = reinterpret_cast<const camera_metadata_t *>(metadata);
+        if (validate_camera_metadata_structure(src, &metadataSize)) {
+            LOG(WARNING) << "Stored camera metadata is invalid";
+            return false;
+        }
+
+        aCamera->characteristics = clone_camera_metadata(src);
+        if (aCamera->characteristics == nullptr) {
+            LOG(ERROR) << "Failed to clone stored camera metadata";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+} // namespace
 
 ConfigManager::~ConfigManager() {
     /* Nothing to do */
@@ -109,6 +381,18 @@ void ConfigManager::readCameraInfo(const XMLElement * const aCameraElem) {
                 continue;
             }
 
+            /* optional number of format conversion worker threads */
+            const XMLAttribute *workersAttr = curElem->FindAttribute("conversion_workers");
+            if (workersAttr != nullptr) {
+                aCamera->conversionWorkers = std::max(0, workersAttr->IntValue());
+            }
+
+            /* optional zero-copy delivery of capture buffers */
+            const XMLAttribute *zeroCopyAttr = curElem->FindAttribute("zero_copy");
+            if (zeroCopyAttr != nullptr) {
+                aCamera->zeroCopy = zeroCopyAttr->BoolValue();
+            }
+
             /* store read camera module information */
             mCameraInfo.insert_or_assign(id, unique_ptr<CameraInfo>(aCamera));
 
@@ -497,6 +781,9 @@ bool ConfigManager::readConfigDataFromXML() noexcept {
 
     const int64_t parsingStart = android::elapsedRealtimeNano();
 
+    /* remember which files are parsed so a stored binary can be validated */
+    readXmlFileStamps(CONFIG_OVERRIDE_PATH, CONFIG_DEFAULT_PATH, mXmlModifiedTime, mXmlSize);
+
     /* load and parse a configuration file */
     xmlDoc.LoadFile(CONFIG_OVERRIDE_PATH);
     if (xmlDoc.ErrorID() != XML_SUCCESS) {
@@ -547,495 +834,252 @@ bool ConfigManager::readConfigDataFromXML() noexcept {
 
 
 bool ConfigManager::readConfigDataFromBinary() {
-    /* Temporary buffer to hold configuration data read from a binary file */
-    char mBuffer[1024];
-
-    fstream srcFile;
     const int64_t readStart = android::elapsedRealtimeNano();
 
-    srcFile.open(mBinaryFilePath, fstream::in | fstream::binary);
-    if (!srcFile) {
-        LOG(ERROR) << "Failed to open a source binary file, " << mBinaryFilePath;
+    int fd = open(mBinaryFilePath, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        LOG(INFO) << "No binary configuration file at " << mBinaryFilePath;
         return false;
     }
 
-    unique_lock<mutex> lock(mConfigLock);
-    mIsReady = false;
-
-    /* read configuration data into the internal buffer */
-    srcFile.read(mBuffer, sizeof(mBuffer));
-    LOG(VERBOSE) << __FUNCTION__ << ": " << srcFile.gcount() << " bytes are read.";
-    char *p = mBuffer;
-    size_t sz = 0;
-
-    /* read number of camera group information entries */
-    size_t ngrps = *(reinterpret_cast<size_t *>(p)); p += sizeof(size_t);
-
-    /* read each camera information entry */
-    for (auto cidx = 0; cidx < ngrps; ++cidx) {
-        /* read camera identifier */
-        string cameraId = *(reinterpret_cast<string *>(p)); p += sizeof(string);
-
-        /* size of camera_metadata_t */
-        size_t num_entry = *(reinterpret_cast<size_t *>(p)); p += sizeof(size_t);
-        size_t num_data  = *(reinterpret_cast<size_t *>(p)); p += sizeof(size_t);
-
-        /* create CameraInfo and add it to hash map */
-        unique_ptr<ConfigManager::CameraGroupInfo> aCamera;
-        if (aCamera == nullptr ||
-            !aCamera->allocate(num_entry, num_data))  {
-            LOG(ERROR) << "Failed to create new CameraInfo object";
-            mCameraInfo.clear();
-            return false;
-        }
-
-        /* controls */
-        typedef struct {
-            CameraParam cid;
-            int32_t min;
-            int32_t max;
-            int32_t step;
-        } CameraCtrl;
-        sz = *(reinterpret_cast<size_t *>(p)); p += sizeof(size_t);
-        CameraCtrl *ptr = reinterpret_cast<CameraCtrl *>(p);
-        for (auto idx = 0; idx < sz; ++idx) {
-            CameraCtrl temp = *ptr++;
-            aCamera->controls.emplace(temp.cid,
-                                      make_tuple(temp.min, temp.max, temp.step));
-        }
-        p = reinterpret_cast<char *>(ptr);
-
-        /* stream configurations */
-        sz = *(reinterpret_cast<size_t *>(p)); p += sizeof(size_t);
-        int32_t *i32_ptr = reinterpret_cast<int32_t *>(p);
-        for (auto idx = 0; idx < sz; ++idx) {
-            const int32_t id = *i32_ptr++;
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) < 0 ||
+        fileStat.st_size < static_cast<off_t>(sizeof(BinaryHeader))) {
+        LOG(WARNING) << "Binary configuration file is too short, " << mBinaryFilePath;
+        close(fd);
+        return false;
+    }
 
-            std::array<int32_t, kStreamCfgSz> temp;
-            for (auto i = 0; i < kStreamCfgSz; ++i) {
-                temp[i] = *i32_ptr++;
-            }
-            aCamera->streamConfigurations.insert_or_assign(id, temp);
-        }
-        p = reinterpret_cast<char *>(i32_ptr);
-
-        /* synchronization */
-        aCamera->synchronized =
-            *(reinterpret_cast<int32_t *>(p)); p += sizeof(int32_t);
-
-        for (auto idx = 0; idx < num_entry; ++idx) {
-            /* Read camera metadata entries */
-            camera_metadata_tag_t tag =
-                *reinterpret_cast<camera_metadata_tag_t *>(p);
-            p += sizeof(camera_metadata_tag_t);
-            size_t count = *reinterpret_cast<size_t *>(p); p += sizeof(size_t);
-
-            int32_t type = get_camera_metadata_tag_type(tag);
-            switch (type) {
-                case TYPE_BYTE: {
-                    add_camera_metadata_entry(aCamera->characteristics,
-                                              tag,
-                                              p,
-                                              count);
-                    p += count * sizeof(uint8_t);
-                    break;
-                }
-                case TYPE_INT32: {
-                    add_camera_metadata_entry(aCamera->characteristics,
-                                              tag,
-                                              p,
-                                              count);
-                    p += count * sizeof(int32_t);
-                    break;
-                }
-                case TYPE_FLOAT: {
-                    add_camera_metadata_entry(aCamera->characteristics,
-                                              tag,
-                                              p,
-                                              count);
-                    p += count * sizeof(float);
-                    break;
-                }
-                case TYPE_INT64: {
-                    add_camera_metadata_entry(aCamera->characteristics,
-                                              tag,
-                                              p,
-                                              count);
-                    p += count * sizeof(int64_t);
-                    break;
-                }
-                case TYPE_DOUBLE: {
-                    add_camera_metadata_entry(aCamera->characteristics,
-                                              tag,
-                                              p,
-                                              count);
-                    p += count * sizeof(double);
-                    break;
-                }
-                case TYPE_RATIONAL:
-                    p += count * sizeof(camera_metadata_rational_t);
-                    break;
-                default:
-                    LOG(WARNING) << "Type " << type << " is unknown; "
-                                 << "data may be corrupted.";
-                    break;
-            }
-        }
+    /* map the file; it is validated and parsed in place */
+    const size_t fileSize = fileStat.st_size;
+    void *addr = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        PLOG(WARNING) << "Failed to map a binary configuration file, " << mBinaryFilePath;
+        return false;
+    }
 
-        mCameraInfo.insert_or_assign(cameraId, std::move(aCamera));
+    const bool success = parseConfigDataFromBinary(static_cast<const uint8_t *>(addr),
+                                                   fileSize);
+    munmap(addr, fileSize);
+    if (!success) {
+        return false;
     }
 
+    const int64_t readEnd = android::elapsedRealtimeNano();
+    LOG(INFO) << __FUNCTION__ << " takes "
+              << std::scientific << (double)(readEnd - readStart) / 1000000.0
+              << " ms.";
 
+    return true;
+}
 
-    /* read number of camera information entries */
-    size_t ncams = *(reinterpret_cast<size_t *>(p)); p += sizeof(size_t);
 
-    /* read each camera information entry */
-    for (auto cidx = 0; cidx < ncams; ++cidx) {
-        /* read camera identifier */
-        string cameraId = *(reinterpret_cast<string *>(p)); p += sizeof(string);
+bool ConfigManager::parseConfigDataFromBinary(const uint8_t *data, const size_t size) {
+    /* validate a header */
+    BinaryHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != kBinaryMagic || header.version != kBinaryVersion) {
+        LOG(INFO) << "Binary configuration file has an unsupported version " << header.version;
+        return false;
+    }
 
-        /* size of camera_metadata_t */
-        size_t num_entry = *(reinterpret_cast<size_t *>(p)); p += sizeof(size_t);
-        size_t num_data  = *(reinterpret_cast<size_t *>(p)); p += sizeof(size_t);
+    if (header.payloadSize != size - sizeof(header)) {
+        LOG(WARNING) << "Binary configuration file is truncated";
+        return false;
+    }
 
-        /* create CameraInfo and add it to hash map */
-        unique_ptr<ConfigManager::CameraInfo> aCamera;
-        if (aCamera == nullptr ||
-            !aCamera->allocate(num_entry, num_data))  {
-            LOG(ERROR) << "Failed to create new CameraInfo object";
-            mCameraInfo.clear();
+    int64_t xmlModifiedTime[2];
+    int64_t xmlSize[2];
+    readXmlFileStamps(CONFIG_OVERRIDE_PATH, CONFIG_DEFAULT_PATH, xmlModifiedTime, xmlSize);
+    for (auto i = 0; i < 2; ++i) {
+        if (header.xmlModifiedTime[i] != xmlModifiedTime[i] ||
+            header.xmlSize[i] != xmlSize[i]) {
+            LOG(INFO) << "Binary configuration file is older than the XML configuration";
             return false;
         }
+    }
+
+    const uint8_t *payload = data + sizeof(header);
+    if (header.checksum != computeChecksum(payload, header.payloadSize)) {
+        LOG(WARNING) << "Binary configuration file is corrupted";
+        return false;
+    }
 
-        /* controls */
-        typedef struct {
-            CameraParam cid;
-            int32_t min;
-            int32_t max;
-            int32_t step;
-        } CameraCtrl;
-        sz = *(reinterpret_cast<size_t *>(p)); p += sizeof(size_t);
-        CameraCtrl *ptr = reinterpret_cast<CameraCtrl *>(p);
-        for (auto idx = 0; idx < sz; ++idx) {
-            CameraCtrl temp = *ptr++;
-            aCamera->controls.emplace(temp.cid,
-                                      make_tuple(temp.min, temp.max, temp.step));
+    /*
+     * read everything into local containers first so a malformed file does
+     * not leave partial configuration behind
+     */
+    BinaryReader reader(payload, header.payloadSize);
+    SystemInfo systemInfo;
+    unordered_map<string, unique_ptr<CameraGroupInfo>> cameraGroups;
+    unordered_map<string, unique_ptr<CameraInfo>> cameraInfo;
+    unordered_map<string, unordered_set<string>> cameraPosition;
+    unordered_map<string, unique_ptr<DisplayInfo>> displayInfo;
+
+    /* system information */
+    bool success = reader.read(systemInfo.numCameras);
+
+    /* camera groups */
+    uint32_t count = 0;
+    success = success && reader.read(count);
+    for (uint32_t i = 0; success && i < count; ++i) {
+        string id;
+        uint32_t numDevices = 0;
+        unique_ptr<CameraGroupInfo> aGroup(new CameraGroupInfo());
+        success = reader.readString(id) &&
+                  deserializeCameraInfo(reader, aGroup.get()) &&
+                  reader.read(numDevices);
+        for (uint32_t j = 0; success && j < numDevices; ++j) {
+            string device;
+            success = reader.readString(device);
+            aGroup->devices.emplace(device);
         }
-        p = reinterpret_cast<char *>(ptr);
+        success = success && reader.read(aGroup->synchronized);
+        cameraGroups.insert_or_assign(id, std::move(aGroup));
+    }
 
-        /* stream configurations */
-        sz = *(reinterpret_cast<size_t *>(p)); p += sizeof(size_t);
-        int32_t *i32_ptr = reinterpret_cast<int32_t *>(p);
-        for (auto idx = 0; idx < sz; ++idx) {
-            const int32_t id = *i32_ptr++;
+    /* camera devices */
+    success = success && reader.read(count);
+    for (uint32_t i = 0; success && i < count; ++i) {
+        string id;
+        unique_ptr<CameraInfo> aCamera(new CameraInfo());
+        success = reader.readString(id) &&
+                  deserializeCameraInfo(reader, aCamera.get());
+        cameraInfo.insert_or_assign(id, std::move(aCamera));
+    }
 
-            std::array<int32_t, kStreamCfgSz> temp;
-            for (auto i = 0; i < kStreamCfgSz; ++i) {
-                temp[i] = *i32_ptr++;
-            }
-            aCamera->streamConfigurations.insert_or_assign(id, temp);
-        }
-        p = reinterpret_cast<char *>(i32_ptr);
-
-        for (auto idx = 0; idx < num_entry; ++idx) {
-            /* Read camera metadata entries */
-            camera_metadata_tag_t tag =
-                *reinterpret_cast<camera_metadata_tag_t *>(p);
-            p += sizeof(camera_metadata_tag_t);
-            size_t count = *reinterpret_cast<size_t *>(p); p += sizeof(size_t);
-
-            int32_t type = get_camera_metadata_tag_type(tag);
-            switch (type) {
-                case TYPE_BYTE: {
-                    add_camera_metadata_entry(aCamera->characteristics,
-                                              tag,
-                                              p,
-                                              count);
-                    p += count * sizeof(uint8_t);
-                    break;
-                }
-                case TYPE_INT32: {
-                    add_camera_metadata_entry(aCamera->characteristics,
-                                              tag,
-                                              p,
-                                              count);
-                    p += count * sizeof(int32_t);
-                    break;
-                }
-                case TYPE_FLOAT: {
-                    add_camera_metadata_entry(aCamera->characteristics,
-                                              tag,
-                                              p,
-                                              count);
-                    p += count * sizeof(float);
-                    break;
-                }
-                case TYPE_INT64: {
-                    add_camera_metadata_entry(aCamera->characteristics,
-                                              tag,
-                                              p,
-                                              count);
-                    p += count * sizeof(int64_t);
-                    break;
-                }
-                case TYPE_DOUBLE: {
-                    add_camera_metadata_entry(aCamera->characteristics,
-                                              tag,
-                                              p,
-                                              count);
-                    p += count * sizeof(double);
-                    break;
-                }
-                case TYPE_RATIONAL:
-                    p += count * sizeof(camera_metadata_rational_t);
-                    break;
-                default:
-                    LOG(WARNING) << "Type " << type << " is unknown; "
-                                 << "data may be corrupted.";
-                    break;
-            }
+    /* camera positions */
+    success = success && reader.read(count);
+    for (uint32_t i = 0; success && i < count; ++i) {
+        string pos;
+        uint32_t numDevices = 0;
+        success = reader.readString(pos) && reader.read(numDevices);
+        for (uint32_t j = 0; success && j < numDevices; ++j) {
+            string device;
+            success = reader.readString(device);
+            cameraPosition[pos].emplace(device);
         }
+    }
 
-        mCameraInfo.insert_or_assign(cameraId, std::move(aCamera));
+    /* displays */
+    success = success && reader.read(count);
+    for (uint32_t i = 0; success && i < count; ++i) {
+        string id;
+        unique_ptr<DisplayInfo> dpy(new DisplayInfo());
+        success = reader.readString(id) &&
+                  deserializeStreamConfigurations(reader, dpy->streamConfigurations);
+        displayInfo.insert_or_assign(id, std::move(dpy));
     }
 
+    if (!success || !reader.isAtEnd()) {
+        LOG(WARNING) << "Binary configuration file is malformed";
+        return false;
+    }
+
+    unique_lock<mutex> lock(mConfigLock);
+    mSystemInfo = systemInfo;
+    mCameraGroups = std::move(cameraGroups);
+    mCameraInfo = std::move(cameraInfo);
+    mCameraPosition = std::move(cameraPosition);
+    mDisplayInfo = std::move(displayInfo);
+
+    /* configuration data is ready to be consumed */
     mIsReady = true;
 
     /* notify that configuration data is ready */
     lock.unlock();
     mConfigCond.notify_all();
 
-    int64_t readEnd = android::elapsedRealtimeNano();
-    LOG(INFO) << __FUNCTION__ << " takes "
-              << std::scientific << (double)(readEnd - readStart) / 1000000.0
-              << " ms.";
-
     return true;
 }
 
 
 bool ConfigManager::writeConfigDataToBinary() {
-    fstream outFile;
-
-    int64_t writeStart = android::elapsedRealtimeNano();
-
-    outFile.open(mBinaryFilePath, fstream::out | fstream::binary);
-    if (!outFile) {
-        LOG(ERROR) << "Failed to open a destination binary file, " << mBinaryFilePath;
-        return false;
-    }
-
-    /* lock a configuration data while it's being written to the filesystem */
-    lock_guard<mutex> lock(mConfigLock);
-
-    /* write camera group information */
-    size_t sz = mCameraGroups.size();
-    outFile.write(reinterpret_cast<const char *>(&sz),
-                  sizeof(size_t));
-    for (auto&& [camId, camInfo] : mCameraGroups) {
-        LOG(INFO) << "Storing camera group " << camId;
-
-        /* write a camera identifier string */
-        outFile.write(reinterpret_cast<const char *>(&camId),
-                      sizeof(string));
-
-        /* controls */
-        sz = camInfo->controls.size();
-        outFile.write(reinterpret_cast<const char *>(&sz),
-                      sizeof(size_t));
-        for (auto&& [ctrl, range] : camInfo->controls) {
-            outFile.write(reinterpret_cast<const char *>(&ctrl),
-                          sizeof(CameraParam));
-            outFile.write(reinterpret_cast<const char *>(&get<0>(range)),
-                          sizeof(int32_t));
-            outFile.write(reinterpret_cast<const char *>(&get<1>(range)),
-                          sizeof(int32_t));
-            outFile.write(reinterpret_cast<const char *>(&get<2>(range)),
-                          sizeof(int32_t));
-        }
-
-        /* stream configurations */
-        sz = camInfo->streamConfigurations.size();
-        outFile.write(reinterpret_cast<const char *>(&sz),
-                      sizeof(size_t));
-        for (auto&& [sid, cfg] : camInfo->streamConfigurations) {
-            outFile.write(reinterpret_cast<const char *>(sid),
-                          sizeof(int32_t));
-            for (int idx = 0; idx < kStreamCfgSz; ++idx) {
-                outFile.write(reinterpret_cast<const char *>(&cfg[idx]),
-                              sizeof(int32_t));
+    const int64_t writeStart = android::elapsedRealtimeNano();
+
+    BinaryWriter writer;
+    {
+        /* lock a configuration data while it's being serialized */
+        lock_guard<mutex> lock(mConfigLock);
+
+        /* system information */
+        writer.write(mSystemInfo.numCameras);
+
+        /* camera groups */
+        writer.write(static_cast<uint32_t>(mCameraGroups.size()));
+        for (auto&& [id, aGroup] : mCameraGroups) {
+            writer.writeString(id);
+            serializeCameraInfo(writer, *aGroup);
+            writer.write(static_cast<uint32_t>(aGroup->devices.size()));
+            for (auto&& device : aGroup->devices) {
+                writer.writeString(device);
             }
+            writer.write(aGroup->synchronized);
         }
 
-        /* synchronization */
-        outFile.write(reinterpret_cast<const char *>(&camInfo->synchronized),
-                      sizeof(int32_t));
-
-        /* size of camera_metadata_t */
-        size_t num_entry = 0;
-        size_t num_data  = 0;
-        if (camInfo->characteristics != nullptr) {
-            num_entry = get_camera_metadata_entry_count(camInfo->characteristics);
-            num_data  = get_camera_metadata_data_count(camInfo->characteristics);
+        /* camera devices */
+        writer.write(static_cast<uint32_t>(mCameraInfo.size()));
+        for (auto&& [id, aCamera] : mCameraInfo) {
+            writer.writeString(id);
+            serializeCameraInfo(writer, *aCamera);
         }
-        outFile.write(reinterpret_cast<const char *>(&num_entry),
-                      sizeof(size_t));
-        outFile.write(reinterpret_cast<const char *>(&num_data),
-                      sizeof(size_t));
-
-        /* write each camera metadata entry */
-        if (num_entry > 0) {
-            camera_metadata_entry_t entry;
-            for (auto idx = 0; idx < num_entry; ++idx) {
-                if (get_camera_metadata_entry(camInfo->characteristics, idx, &entry)) {
-                    LOG(ERROR) << "Failed to retrieve camera metadata entry " << idx;
-                    outFile.close();
-                    return false;
-                }
 
-                outFile.write(reinterpret_cast<const char *>(&entry.tag),
-                              sizeof(entry.tag));
-                outFile.write(reinterpret_cast<const char *>(&entry.count),
-                              sizeof(entry.count));
-
-                int32_t type = get_camera_metadata_tag_type(entry.tag);
-                switch (type) {
-                    case TYPE_BYTE:
-                        outFile.write(reinterpret_cast<const char *>(entry.data.u8),
-                                      sizeof(uint8_t) * entry.count);
-                        break;
-                    case TYPE_INT32:
-                        outFile.write(reinterpret_cast<const char *>(entry.data.i32),
-                                      sizeof(int32_t) * entry.count);
-                        break;
-                    case TYPE_FLOAT:
-                        outFile.write(reinterpret_cast<const char *>(entry.data.f),
-                                      sizeof(float) * entry.count);
-                        break;
-                    case TYPE_INT64:
-                        outFile.write(reinterpret_cast<const char *>(entry.data.i64),
-                                      sizeof(int64_t) * entry.count);
-                        break;
-                    case TYPE_DOUBLE:
-                        outFile.write(reinterpret_cast<const char *>(entry.data.d),
-                                      sizeof(double) * entry.count);
-                        break;
-                    case TYPE_RATIONAL:
-                        [[fallthrough]];
-                    default:
-                        LOG(WARNING) << "Type " << type << " is not supported.";
-                        break;
-                }
+        /* camera positions */
+        writer.write(static_cast<uint32_t>(mCameraPosition.size()));
+        for (auto&& [pos, devices] : mCameraPosition) {
+            writer.writeString(pos);
+            writer.write(static_cast<uint32_t>(devices.size()));
+            for (auto&& device : devices) {
+                writer.writeString(device);
             }
         }
-    }
 
-    /* write camera device information */
-    sz = mCameraInfo.size();
-    outFile.write(reinterpret_cast<const char *>(&sz),
-                  sizeof(size_t));
-    for (auto&& [camId, camInfo] : mCameraInfo) {
-        LOG(INFO) << "Storing camera " << camId;
-
-        /* write a camera identifier string */
-        outFile.write(reinterpret_cast<const char *>(&camId),
-                      sizeof(string));
-
-        /* controls */
-        sz = camInfo->controls.size();
-        outFile.write(reinterpret_cast<const char *>(&sz),
-                      sizeof(size_t));
-        for (auto& [ctrl, range] : camInfo->controls) {
-            outFile.write(reinterpret_cast<const char *>(&ctrl),
-                          sizeof(CameraParam));
-            outFile.write(reinterpret_cast<const char *>(&get<0>(range)),
-                          sizeof(int32_t));
-            outFile.write(reinterpret_cast<const char *>(&get<1>(range)),
-                          sizeof(int32_t));
-            outFile.write(reinterpret_cast<const char *>(&get<2>(range)),
-                          sizeof(int32_t));
+        /* displays */
+        writer.write(static_cast<uint32_t>(mDisplayInfo.size()));
+        for (auto&& [id, dpy] : mDisplayInfo) {
+            writer.writeString(id);
+            serializeStreamConfigurations(writer, dpy->streamConfigurations);
         }
+    }
 
-        /* stream configurations */
-        sz = camInfo->streamConfigurations.size();
-        outFile.write(reinterpret_cast<const char *>(&sz),
-                      sizeof(size_t));
-        for (auto&& [sid, cfg] : camInfo->streamConfigurations) {
-            outFile.write(reinterpret_cast<const char *>(sid),
-                          sizeof(int32_t));
-            for (int idx = 0; idx < kStreamCfgSz; ++idx) {
-                outFile.write(reinterpret_cast<const char *>(&cfg[idx]),
-                              sizeof(int32_t));
-            }
-        }
+    const vector<uint8_t> &payload = writer.getData();
+    BinaryHeader header = {};
+    header.magic = kBinaryMagic;
+    header.version = kBinaryVersion;
+    header.payloadSize = payload.size();
+    header.checksum = computeChecksum(payload.data(), payload.size());
+    for (auto i = 0; i < 2; ++i) {
+        header.xmlModifiedTime[i] = mXmlModifiedTime[i];
+        header.xmlSize[i] = mXmlSize[i];
+    }
 
-        /* size of camera_metadata_t */
-        size_t num_entry = 0;
-        size_t num_data  = 0;
-        if (camInfo->characteristics != nullptr) {
-            num_entry = get_camera_metadata_entry_count(camInfo->characteristics);
-            num_data  = get_camera_metadata_data_count(camInfo->characteristics);
-        }
-        outFile.write(reinterpret_cast<const char *>(&num_entry),
-                      sizeof(size_t));
-        outFile.write(reinterpret_cast<const char *>(&num_data),
-                      sizeof(size_t));
-
-        /* write each camera metadata entry */
-        if (num_entry > 0) {
-            camera_metadata_entry_t entry;
-            for (auto idx = 0; idx < num_entry; ++idx) {
-                if (get_camera_metadata_entry(camInfo->characteristics, idx, &entry)) {
-                    LOG(ERROR) << "Failed to retrieve camera metadata entry " << idx;
-                    outFile.close();
-                    return false;
-                }
+    /*
+     * write a temporary file and rename it so a reader never maps a partially
+     * written file
+     */
+    const string tmpPath = string(mBinaryFilePath) + ".tmp";
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+    if (fd < 0) {
+        PLOG(WARNING) << "Failed to open a destination binary file, " << tmpPath;
+        return false;
+    }
 
-                outFile.write(reinterpret_cast<const char *>(&entry.tag),
-                              sizeof(entry.tag));
-                outFile.write(reinterpret_cast<const char *>(&entry.count),
-                              sizeof(entry.count));
-
-                int32_t type = get_camera_metadata_tag_type(entry.tag);
-                switch (type) {
-                    case TYPE_BYTE:
-                        outFile.write(reinterpret_cast<const char *>(entry.data.u8),
-                                      sizeof(uint8_t) * entry.count);
-                        break;
-                    case TYPE_INT32:
-                        outFile.write(reinterpret_cast<const char *>(entry.data.i32),
-                                      sizeof(int32_t) * entry.count);
-                        break;
-                    case TYPE_FLOAT:
-                        outFile.write(reinterpret_cast<const char *>(entry.data.f),
-                                      sizeof(float) * entry.count);
-                        break;
-                    case TYPE_INT64:
-                        outFile.write(reinterpret_cast<const char *>(entry.data.i64),
-                                      sizeof(int64_t) * entry.count);
-                        break;
-                    case TYPE_DOUBLE:
-                        outFile.write(reinterpret_cast<const char *>(entry.data.d),
-                                      sizeof(double) * entry.count);
-                        break;
-                    case TYPE_RATIONAL:
-                        [[fallthrough]];
-                    default:
-                        LOG(WARNING) << "Type " << type << " is not supported.";
-                        break;
-                }
-            }
-        }
+    bool success = android::base::WriteFully(fd, &header, sizeof(header)) &&
+                   android::base::WriteFully(fd, payload.data(), payload.size()) &&
+                   fsync(fd) == 0;
+    close(fd);
+    if (!success || rename(tmpPath.c_str(), mBinaryFilePath) != 0) {
+        PLOG(WARNING) << "Failed to store a binary configuration file, " << mBinaryFilePath;
+        unlink(tmpPath.c_str());
+        return false;
     }
 
-    outFile.close();
-    int64_t writeEnd = android::elapsedRealtimeNano();
+    const int64_t writeEnd = android::elapsedRealtimeNano();
     LOG(INFO) << __FUNCTION__ << " takes "
               << std::scientific << (double)(writeEnd - writeStart) / 1000000.0
               << " ms.";
 
-
     return true;
 }
 
@@ -1044,18 +1088,22 @@ std::unique_ptr<ConfigManager> ConfigManager::Create() {
     unique_ptr<ConfigManager> cfgMgr(new ConfigManager());
 
     /*
-     * Read a configuration from XML file
-     *
-     * If this is too slow, ConfigManager::readConfigDataFromBinary() and
-     * ConfigManager::writeConfigDataToBinary()can serialize CameraInfo object
-     * to the filesystem and construct CameraInfo instead; this was
-     * evaluated as 10x faster.
+     * Read a configuration from the binary file that a previous run stored,
+     * if it is still valid; this is much faster than parsing the XML file.
      */
+    if (cfgMgr->readConfigDataFromBinary()) {
+        return cfgMgr;
+    }
+
+    /* Read a configuration from XML file */
     if (!cfgMgr->readConfigDataFromXML()) {
         return nullptr;
-    } else {
-        return cfgMgr;
     }
+
+    /* Store parsed configuration for the next start */
+    cfgMgr->writeConfigDataToBinary();
+
+    return cfgMgr;
 }
 
 ConfigManager::CameraInfo::~CameraInfo() {
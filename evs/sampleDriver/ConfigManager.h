@@ -95,6 +95,18 @@ public:
 
         /* Camera module characteristics */
         camera_metadata_t *characteristics;
+
+        /*
+         * Number of additional threads that convert each captured frame in
+         * row bands; 0 converts a frame on the capture thread alone.
+         */
+        int32_t conversionWorkers = 0;
+
+        /*
+         * Deliver the capture buffers to the client instead of copying them
+         * when no format conversion is needed.
+         */
+        bool zeroCopy = false;
     };
 
     class CameraGroupInfo : public CameraInfo {
@@ -219,11 +231,12 @@ public:
 private:
     /* Constructors */
     ConfigManager() :
-        mBinaryFilePath("") {
+        mBinaryFilePath(CONFIG_BINARY_PATH) {
     }
 
     static const char* CONFIG_DEFAULT_PATH;
     static const char* CONFIG_OVERRIDE_PATH;
+    static const char* CONFIG_BINARY_PATH;
 
     /* System configuration */
     SystemInfo mSystemInfo;
@@ -255,6 +268,13 @@ private:
     /* A path to a binary configuration file */
     const char *mBinaryFilePath;
 
+    /*
+     * Modification times and sizes of the override and the default XML files
+     * when they were parsed; -1 if a file does not exist.
+     */
+    int64_t mXmlModifiedTime[2] = { -1, -1 };
+    int64_t mXmlSize[2] = { -1, -1 };
+
     /* Configuration data readiness */
     bool mIsReady = false;
 
@@ -369,17 +389,34 @@ private:
     /*
      * Read configuration data from the binary file
      *
+     * The file is memory-mapped and used only if its version and checksum
+     * are valid and it was generated from the XML files currently installed.
+     *
      * @return bool
      *         True if it succeeds to read configuration data from a binary
      *         file.
      */
     bool readConfigDataFromBinary();
 
+    /*
+     * Validate and parse the contents of a binary configuration file
+     *
+     * @param  data
+     *         A pointer to the mapped file.
+     * @param  size
+     *         Size of the file in bytes.
+     *
+     * @return bool
+     *         True if the configuration data is valid and has been stored.
+     */
+    bool parseConfigDataFromBinary(const uint8_t *data, const size_t size);
+
     /*
      * Store configuration data to the file
      *
      * @return bool
-     *         True if it succeeds to serialize mCameraInfo to the file.
+     *         True if it succeeds to serialize the configuration data to the
+     *         file.
      */
     bool writeConfigDataToBinary();
 
@@ -0,0 +1,512 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ConversionRegistry.h"
+#include "bufferCopy.h"
+
+#include <algorithm>
+#include <csetjmp>
+#include <cstdio>
+
+#include <android/hardware_buffer.h>
+#include <android-base/logging.h>
+#include <linux/videodev2.h>
+#include <system/graphics.h>
+
+extern "C" {
+#include <jpeglib.h>
+}
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+namespace {
+
+// Relative costs of the conversions below.  A plain copy is the unit; the
+// generic kernels sample every pixel through a lookup and cost more than the
+// row kernels in bufferCopy.cpp, and decoding dominates everything else.
+constexpr uint32_t kCostCopy        = 1;
+constexpr uint32_t kCostSwizzle     = 2;
+constexpr uint32_t kCostRowKernel   = 3;
+constexpr uint32_t kCostSampled     = 6;
+constexpr uint32_t kCostColorSpace  = 2;    // Added when converting between YUV and RGB
+constexpr uint32_t kCostDecode      = 24;
+
+
+// Same-size conversions implemented by the row kernels in bufferCopy.cpp
+using FillFunction = void(*)(const BufferDesc& tgtBuff, uint8_t* tgt,
+                             void* imgData, unsigned imgStride,
+                             unsigned startRow, unsigned endRow);
+
+template<FillFunction fill>
+bool convertSameSize(const BufferDesc& tgtBuff, uint8_t* tgt, const SourceFrame& src,
+                     unsigned startRow, unsigned endRow) {
+    fill(tgtBuff, tgt, const_cast<uint8_t*>(src.data), src.stride, startRow, endRow);
+    return true;
+}
+
+
+// Limit the given value to the 8-bit range.
+inline uint8_t clampToByte(int v) {
+    return static_cast<uint8_t>(std::clamp(v, 0, 255));
+}
+
+
+struct Pixel {
+    uint8_t c0, c1, c2;     // Y, U, V or R, G, B depending on the reader
+};
+
+
+// Same arithmetic as the row kernels in bufferCopy.cpp so that a frame looks
+// the same whichever conversion produced it
+inline Pixel yuvToRgb(const Pixel& p) {
+    constexpr int kRound = 1 << (kCoeffBits - 1);
+    const int Y = p.c0;
+    const int U = p.c1 - 128;
+    const int V = p.c2 - 128;
+    return { clampToByte(Y + ((kCoeffRV * V + kRound) >> kCoeffBits)),
+             clampToByte(Y - ((kCoeffGU * U + kCoeffGV * V + kRound) >> kCoeffBits)),
+             clampToByte(Y + ((kCoeffBU * U + kRound) >> kCoeffBits)) };
+}
+
+
+// The inverse of yuvToRgb() in Q8 fixed point; U = 0.492 (B - Y) and
+// V = 0.877 (R - Y).  Each chroma row sums to zero so grays stay neutral.
+inline Pixel rgbToYuv(const Pixel& p) {
+    const int R = p.c0;
+    const int G = p.c1;
+    const int B = p.c2;
+    return { clampToByte((77 * R + 150 * G + 29 * B + 128) >> 8),
+             clampToByte(((-38 * R - 74 * G + 112 * B + 128) >> 8) + 128),
+             clampToByte(((157 * R - 132 * G - 25 * B + 128) >> 8) + 128) };
+}
+
+
+// Readers return the pixel at the given position of the whole source frame
+struct ReadYUYV {
+    static constexpr bool kRgb = false;
+    static Pixel read(const SourceFrame& src, unsigned x, unsigned y) {
+        const uint8_t* p = src.data + y * src.stride + (x & ~1u) * 2;
+        return { p[(x & 1) * 2], p[1], p[3] };
+    }
+};
+
+
+struct ReadUYVY {
+    static constexpr bool kRgb = false;
+    static Pixel read(const SourceFrame& src, unsigned x, unsigned y) {
+        const uint8_t* p = src.data + y * src.stride + (x & ~1u) * 2;
+        return { p[(x & 1) * 2 + 1], p[0], p[2] };
+    }
+};
+
+
+template<bool uFirst>
+struct ReadSemiPlanar {
+    static constexpr bool kRgb = false;
+    static Pixel read(const SourceFrame& src, unsigned x, unsigned y) {
+        const uint8_t* uv = src.data + src.stride * src.height + (y / 2) * src.stride + (x & ~1u);
+        return { src.data[y * src.stride + x], uv[uFirst ? 0 : 1], uv[uFirst ? 1 : 0] };
+    }
+};
+using ReadNV12 = ReadSemiPlanar<true>;
+using ReadNV21 = ReadSemiPlanar<false>;
+
+
+struct ReadRGB565 {
+    static constexpr bool kRgb = true;
+    static Pixel read(const SourceFrame& src, unsigned x, unsigned y) {
+        const uint8_t* p = src.data + y * src.stride + x * 2;
+        const unsigned v = p[0] | (p[1] << 8);
+        const unsigned r = (v >> 11) & 0x1F;
+        const unsigned g = (v >> 5) & 0x3F;
+        const unsigned b = v & 0x1F;
+        return { static_cast<uint8_t>((r << 3) | (r >> 2)),
+                 static_cast<uint8_t>((g << 2) | (g >> 4)),
+                 static_cast<uint8_t>((b << 3) | (b >> 2)) };
+    }
+};
+
+
+// Three bytes per pixel as produced by the JPEG decoder below
+struct ReadYCbCr {
+    static constexpr bool kRgb = false;
+    static Pixel read(const SourceFrame& src, unsigned x, unsigned y) {
+        const uint8_t* p = src.data + y * src.stride + x * 3;
+        return { p[0], p[1], p[2] };
+    }
+};
+
+
+template<typename Reader>
+inline Pixel readYuv(const SourceFrame& src, unsigned x, unsigned y) {
+    if constexpr (Reader::kRgb) {
+        return rgbToYuv(Reader::read(src, x, y));
+    } else {
+        return Reader::read(src, x, y);
+    }
+}
+
+
+template<typename Reader>
+inline Pixel readRgb(const SourceFrame& src, unsigned x, unsigned y) {
+    if constexpr (Reader::kRgb) {
+        return Reader::read(src, x, y);
+    } else {
+        return yuvToRgb(Reader::read(src, x, y));
+    }
+}
+
+
+// Nearest neighbour mapping from target to source coordinates
+inline unsigned mapCoordinate(unsigned pos, unsigned cropStart, unsigned cropSize,
+                              unsigned targetSize) {
+    return cropStart + static_cast<unsigned>(
+            (static_cast<uint64_t>(pos) * cropSize) / targetSize);
+}
+
+
+// Column lookup shared by every row of a band
+const std::vector<unsigned>& mapColumns(const SourceFrame& src, unsigned width) {
+    thread_local std::vector<unsigned> columns;
+    columns.resize(width);
+    for (unsigned c = 0; c < width; ++c) {
+        columns[c] = mapCoordinate(c, src.cropX, src.cropWidth, width);
+    }
+    return columns;
+}
+
+
+template<typename Reader>
+bool convertScaledToRGBA(const BufferDesc& tgtBuff, uint8_t* tgt, const SourceFrame& src,
+                         unsigned startRow, unsigned endRow) {
+    const AHardwareBuffer_Desc* pDesc =
+        reinterpret_cast<const AHardwareBuffer_Desc*>(&tgtBuff.buffer.description);
+    const auto& columns = mapColumns(src, pDesc->width);
+
+    for (unsigned r = startRow; r < endRow; ++r) {
+        const unsigned y = mapCoordinate(r, src.cropY, src.cropHeight, pDesc->height);
+        uint32_t* dst = reinterpret_cast<uint32_t*>(tgt) + r * pDesc->stride;
+        for (unsigned c = 0; c < pDesc->width; ++c) {
+            const Pixel p = readRgb<Reader>(src, columns[c], y);
+            dst[c] = p.c0 | (p.c1 << 8) | (p.c2 << 16) | 0xFF000000;
+        }
+    }
+
+    return true;
+}
+
+
+template<typename Reader>
+bool convertScaledToYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, const SourceFrame& src,
+                         unsigned startRow, unsigned endRow) {
+    const AHardwareBuffer_Desc* pDesc =
+        reinterpret_cast<const AHardwareBuffer_Desc*>(&tgtBuff.buffer.description);
+    const auto& columns = mapColumns(src, pDesc->width);
+
+    for (unsigned r = startRow; r < endRow; ++r) {
+        const unsigned y = mapCoordinate(r, src.cropY, src.cropHeight, pDesc->height);
+        uint8_t* dst = tgt + r * pDesc->stride * 2;
+        for (unsigned c = 0; c + 1 < pDesc->width; c += 2) {
+            // A macro pixel shares the average chroma of its two pixels
+            const Pixel p0 = readYuv<Reader>(src, columns[c], y);
+            const Pixel p1 = readYuv<Reader>(src, columns[c + 1], y);
+            dst[c * 2]     = p0.c0;
+            dst[c * 2 + 1] = (p0.c1 + p1.c1) >> 1;
+            dst[c * 2 + 2] = p1.c0;
+            dst[c * 2 + 3] = (p0.c2 + p1.c2) >> 1;
+        }
+    }
+
+    return true;
+}
+
+
+template<typename Reader>
+bool convertScaledToNV21(const BufferDesc& tgtBuff, uint8_t* tgt, const SourceFrame& src,
+                         unsigned startRow, unsigned endRow) {
+    // Same layout as fillNV21FromYUYV(); 16-byte aligned rows shared by both planes
+    const AHardwareBuffer_Desc* pDesc =
+        reinterpret_cast<const AHardwareBuffer_Desc*>(&tgtBuff.buffer.description);
+    const unsigned strideLum = (pDesc->width + 15) & ~15u;
+    uint8_t* const uvPlane = tgt + strideLum * pDesc->height;
+    const auto& columns = mapColumns(src, pDesc->width);
+
+    for (unsigned r = startRow; r < endRow; ++r) {
+        const unsigned y = mapCoordinate(r, src.cropY, src.cropHeight, pDesc->height);
+        uint8_t* yRow = tgt + r * strideLum;
+        uint8_t* uvRow = (r % 2 == 0 && r / 2 < pDesc->height / 2) ?
+                         uvPlane + (r / 2) * strideLum : nullptr;
+        for (unsigned c = 0; c < pDesc->width; ++c) {
+            const Pixel p = readYuv<Reader>(src, columns[c], y);
+            yRow[c] = p.c0;
+            if (uvRow != nullptr && c % 2 == 0) {
+                uvRow[c]     = p.c2;
+                uvRow[c + 1] = p.c1;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+// Reports libjpeg errors through the log instead of exiting the process
+struct JpegErrorManager {
+    jpeg_error_mgr base;
+    jmp_buf        escape;
+};
+
+
+void onJpegError(j_common_ptr cinfo) {
+    char message[JMSG_LENGTH_MAX];
+    (*cinfo->err->format_message)(cinfo, message);
+    LOG(ERROR) << "Failed to decode a MJPEG frame: " << message;
+
+    longjmp(reinterpret_cast<JpegErrorManager*>(cinfo->err)->escape, 1);
+}
+
+
+// Decodes a JPEG frame into packed YCbCr, downscaled by the given factor.
+// Returns false if the frame is corrupt.
+bool decodeJpeg(const SourceFrame& src, unsigned scale,
+                std::vector<uint8_t>& decoded, SourceFrame& frame) {
+    jpeg_decompress_struct cinfo;
+    JpegErrorManager errorManager;
+    cinfo.err = jpeg_std_error(&errorManager.base);
+    errorManager.base.error_exit = onJpegError;
+    if (setjmp(errorManager.escape)) {
+        jpeg_destroy_decompress(&cinfo);
+        return false;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, const_cast<uint8_t*>(src.data), src.size);
+    jpeg_read_header(&cinfo, TRUE);
+    cinfo.out_color_space = JCS_YCbCr;
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = scale;
+    jpeg_start_decompress(&cinfo);
+
+    const unsigned stride = cinfo.output_width * 3;
+    decoded.resize(stride * cinfo.output_height);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW row = decoded.data() + cinfo.output_scanline * stride;
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_decompress(&cinfo);
+
+    frame.data = decoded.data();
+    frame.size = decoded.size();
+    frame.width = cinfo.output_width;
+    frame.height = cinfo.output_height;
+    frame.stride = stride;
+    jpeg_destroy_decompress(&cinfo);
+
+    return true;
+}
+
+
+// Decodes the frame, letting the decoder downscale by up to eight when the
+// target is much smaller than the crop region, and then samples the result
+// like any other source.  A frame is decoded as a whole, so these conversions
+// are never split into bands.  A frame that cannot be decoded leaves the
+// target untouched and fails the conversion.
+template<ConvertFunction sample>
+bool convertMJPEG(const BufferDesc& tgtBuff, uint8_t* tgt, const SourceFrame& src,
+                  unsigned startRow, unsigned endRow) {
+    const AHardwareBuffer_Desc* pDesc =
+        reinterpret_cast<const AHardwareBuffer_Desc*>(&tgtBuff.buffer.description);
+
+    unsigned scale = 1;
+    while (scale < 8 &&
+           src.cropWidth / (scale * 2) >= pDesc->width &&
+           src.cropHeight / (scale * 2) >= pDesc->height) {
+        scale *= 2;
+    }
+
+    thread_local std::vector<uint8_t> decoded;
+    SourceFrame frame;
+    if (!decodeJpeg(src, scale, decoded, frame) || frame.width == 0 || frame.height == 0) {
+        return false;
+    }
+
+    frame.cropX = std::min(src.cropX / scale, frame.width - 1);
+    frame.cropY = std::min(src.cropY / scale, frame.height - 1);
+    frame.cropWidth = std::min(src.cropWidth / scale, frame.width - frame.cropX);
+    frame.cropHeight = std::min(src.cropHeight / scale, frame.height - frame.cropY);
+
+    return sample(tgtBuff, tgt, frame, startRow, endRow);
+}
+
+
+// Registers the sampled conversions from one source format into every target
+template<typename Reader>
+void addSampledConversions(std::vector<Conversion>& conversions, uint32_t srcFormat) {
+    const uint32_t toYuv = Reader::kRgb ? kCostColorSpace : 0;
+    const uint32_t toRgb = Reader::kRgb ? 0 : kCostColorSpace;
+    const uint32_t flags = Conversion::SCALES | Conversion::BANDED;
+
+    conversions.push_back({srcFormat, HAL_PIXEL_FORMAT_YCRCB_420_SP, "sampled",
+                           convertScaledToNV21<Reader>, kCostSampled + toYuv, flags});
+    conversions.push_back({srcFormat, HAL_PIXEL_FORMAT_RGBA_8888, "sampled",
+                           convertScaledToRGBA<Reader>, kCostSampled + toRgb, flags});
+    conversions.push_back({srcFormat, HAL_PIXEL_FORMAT_YCBCR_422_I, "sampled",
+                           convertScaledToYUYV<Reader>, kCostSampled + toYuv, flags});
+}
+
+} // namespace
+
+
+ConversionRegistry& ConversionRegistry::get() {
+    static ConversionRegistry sRegistry;
+    return sRegistry;
+}
+
+
+ConversionRegistry::ConversionRegistry() {
+    // Row kernels for frames captured at the output resolution
+    mConversions = {
+        {V4L2_PIX_FMT_NV21, HAL_PIXEL_FORMAT_YCRCB_420_SP, "fillNV21FromNV21",
+         convertSameSize<fillNV21FromNV21>, kCostCopy,
+         Conversion::BANDED | Conversion::IDENTITY},
+        {V4L2_PIX_FMT_YUYV, HAL_PIXEL_FORMAT_YCRCB_420_SP, "fillNV21FromYUYV",
+         convertSameSize<fillNV21FromYUYV>, kCostRowKernel, Conversion::BANDED},
+        {V4L2_PIX_FMT_YUYV, HAL_PIXEL_FORMAT_RGBA_8888, "fillRGBAFromYUYV",
+         convertSameSize<fillRGBAFromYUYV>, kCostRowKernel + kCostColorSpace, Conversion::BANDED},
+        {V4L2_PIX_FMT_YUYV, HAL_PIXEL_FORMAT_YCBCR_422_I, "fillYUYVFromYUYV",
+         convertSameSize<fillYUYVFromYUYV>, kCostCopy,
+         Conversion::BANDED | Conversion::IDENTITY},
+        {V4L2_PIX_FMT_UYVY, HAL_PIXEL_FORMAT_YCBCR_422_I, "fillYUYVFromUYVY",
+         convertSameSize<fillYUYVFromUYVY>, kCostSwizzle, Conversion::BANDED},
+    };
+
+    // Sampled conversions that also crop and scale
+    addSampledConversions<ReadYUYV>(mConversions, V4L2_PIX_FMT_YUYV);
+    addSampledConversions<ReadUYVY>(mConversions, V4L2_PIX_FMT_UYVY);
+    addSampledConversions<ReadNV21>(mConversions, V4L2_PIX_FMT_NV21);
+    addSampledConversions<ReadNV12>(mConversions, V4L2_PIX_FMT_NV12);
+    addSampledConversions<ReadRGB565>(mConversions, V4L2_PIX_FMT_RGB565);
+
+    // Compressed frames
+    const uint32_t decodeFlags = Conversion::SCALES;
+    mConversions.push_back({V4L2_PIX_FMT_MJPEG, HAL_PIXEL_FORMAT_YCRCB_420_SP, "decoded",
+                            convertMJPEG<convertScaledToNV21<ReadYCbCr>>,
+                            kCostDecode + kCostSampled, decodeFlags});
+    mConversions.push_back({V4L2_PIX_FMT_MJPEG, HAL_PIXEL_FORMAT_RGBA_8888, "decoded",
+                            convertMJPEG<convertScaledToRGBA<ReadYCbCr>>,
+                            kCostDecode + kCostSampled + kCostColorSpace, decodeFlags});
+    mConversions.push_back({V4L2_PIX_FMT_MJPEG, HAL_PIXEL_FORMAT_YCBCR_422_I, "decoded",
+                            convertMJPEG<convertScaledToYUYV<ReadYCbCr>>,
+                            kCostDecode + kCostSampled, decodeFlags});
+}
+
+
+void ConversionRegistry::add(const Conversion& conversion) {
+    if (conversion.convert == nullptr) {
+        LOG(ERROR) << "Ignoring a conversion without a function";
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    const auto scales = conversion.flags & Conversion::SCALES;
+    auto it = std::find_if(mConversions.begin(), mConversions.end(),
+                           [&conversion, scales](const Conversion& entry) {
+                               return entry.srcFormat == conversion.srcFormat &&
+                                      entry.dstFormat == conversion.dstFormat &&
+                                      (entry.flags & Conversion::SCALES) == scales;
+                           });
+    if (it != mConversions.end()) {
+        *it = conversion;
+    } else {
+        mConversions.push_back(conversion);
+    }
+}
+
+
+bool ConversionRegistry::find(uint32_t srcFormat, uint32_t dstFormat, bool needsScaling,
+                              Conversion& conversion) const {
+    std::lock_guard<std::mutex> lock(mLock);
+    const Conversion* best = nullptr;
+    for (auto&& entry : mConversions) {
+        if (entry.srcFormat != srcFormat || entry.dstFormat != dstFormat ||
+            (needsScaling && !(entry.flags & Conversion::SCALES))) {
+            continue;
+        }
+
+        if (best == nullptr || entry.cost < best->cost) {
+            best = &entry;
+        }
+    }
+
+    if (best == nullptr) {
+        return false;
+    }
+
+    conversion = *best;
+    return true;
+}
+
+
+std::vector<uint32_t> ConversionRegistry::getSourceFormats(uint32_t dstFormat) const {
+    std::vector<std::pair<uint32_t, uint32_t>> candidates;     // cost, format
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        for (auto&& entry : mConversions) {
+            if (entry.dstFormat != dstFormat) {
+                continue;
+            }
+
+            auto it = std::find_if(candidates.begin(), candidates.end(),
+                                   [&entry](const auto& candidate) {
+                                       return candidate.second == entry.srcFormat;
+                                   });
+            if (it == candidates.end()) {
+                candidates.emplace_back(entry.cost, entry.srcFormat);
+            } else {
+                it->first = std::min(it->first, entry.cost);
+            }
+        }
+    }
+
+    std::stable_sort(candidates.begin(), candidates.end(),
+                     [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    std::vector<uint32_t> formats;
+    for (auto&& candidate : candidates) {
+        formats.emplace_back(candidate.second);
+    }
+
+    return formats;
+}
+
+
+std::vector<Conversion> ConversionRegistry::getConversions() const {
+    std::lock_guard<std::mutex> lock(mLock);
+    return mConversions;
+}
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
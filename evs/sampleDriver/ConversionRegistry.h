@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_CONVERSIONREGISTRY_H
+#define ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_CONVERSIONREGISTRY_H
+
+#include <android/hardware/automotive/evs/1.1/types.h>
+
+#include <mutex>
+#include <vector>
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_1 {
+namespace implementation {
+
+
+// A captured frame and the region of it to convert.  The region is scaled to
+// fill the target buffer.
+struct SourceFrame {
+    const uint8_t* data = nullptr;
+    size_t   size = 0;          // Valid bytes; needed by compressed formats
+    unsigned width = 0;         // Dimensions of the whole captured frame
+    unsigned height = 0;
+    unsigned stride = 0;        // Bytes per row of the first plane
+
+    unsigned cropX = 0;
+    unsigned cropY = 0;
+    unsigned cropWidth = 0;
+    unsigned cropHeight = 0;
+};
+
+
+// Converts the rows in [startRow, endRow) of the target buffer.  Band
+// boundaries must be even rows because NV21 chroma rows are shared by two
+// luma rows.  Returns false if the source frame is corrupt and the target
+// must not be delivered.
+using ConvertFunction = bool(*)(const BufferDesc& tgtBuff, uint8_t* tgt,
+                                const SourceFrame& src,
+                                unsigned startRow, unsigned endRow);
+
+
+struct Conversion {
+    enum Flags : uint32_t {
+        SCALES    = 1 << 0,     // Accepts a crop region of any size
+        BANDED    = 1 << 1,     // Row bands may be converted in parallel
+        IDENTITY  = 1 << 2,     // The target bytes equal the source bytes
+    };
+
+    uint32_t        srcFormat = 0;      // V4L2_PIX_FMT_*
+    uint32_t        dstFormat = 0;      // android_pixel_format_t
+    const char*     name = nullptr;
+    ConvertFunction convert = nullptr;
+    uint32_t        cost = 0;           // Relative cost per output pixel; lower is cheaper
+    uint32_t        flags = 0;
+};
+
+
+// Conversions from V4L2 capture formats into the graphics buffer formats that
+// a camera can deliver.  Built-in conversions are registered when the registry
+// is first used; others may be added at any time.
+class ConversionRegistry {
+public:
+    static ConversionRegistry& get();
+
+    // Adds a conversion, replacing a registered one with the same formats and
+    // scaling ability
+    void add(const Conversion& conversion);
+
+    // Finds the cheapest conversion between the given formats.  Conversions
+    // without the SCALES flag are only considered if needsScaling is false.
+    bool find(uint32_t srcFormat, uint32_t dstFormat, bool needsScaling,
+              Conversion& conversion) const;
+
+    // Returns the source formats that can be converted into dstFormat,
+    // cheapest first
+    std::vector<uint32_t> getSourceFormats(uint32_t dstFormat) const;
+
+    std::vector<Conversion> getConversions() const;
+
+private:
+    ConversionRegistry();
+
+    mutable std::mutex      mLock;
+    std::vector<Conversion> mConversions;
+};
+
+} // namespace implementation
+} // namespace V1_1
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
+
+#endif  // ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_1_CONVERSIONREGISTRY_H
@@ -19,15 +19,20 @@
 #include "EvsGlDisplay.h"
 #include "ConfigManager.h"
 
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
 #include <dirent.h>
 #include <hardware_legacy/uevent.h>
 #include <hwbinder/IPCThreadState.h>
 #include <cutils/android_filesystem_config.h>
+#include <utils/SystemClock.h>
 
 
 using namespace std::chrono_literals;
 using CameraDesc_1_0 = ::android::hardware::automotive::evs::V1_0::CameraDesc;
 using CameraDesc_1_1 = ::android::hardware::automotive::evs::V1_1::CameraDesc;
+using ::android::base::StringPrintf;
+using ::android::base::WriteStringToFd;
 
 namespace android {
 namespace hardware {
@@ -44,6 +49,7 @@ std::unordered_map<std::string, EvsEnumerator::CameraRecord> EvsEnumerator::sCam
 wp<EvsGlDisplay>                                             EvsEnumerator::sActiveDisplay;
 std::mutex                                                   EvsEnumerator::sLock;
 std::condition_variable                                      EvsEnumerator::sCameraSignal;
+std::vector<EvsEnumerator::DeviceListener>                   EvsEnumerator::sDeviceListeners;
 std::unique_ptr<ConfigManager>                               EvsEnumerator::sConfigManager;
 sp<IAutomotiveDisplayProxyService>                           EvsEnumerator::sDisplayProxy;
 std::unordered_map<uint8_t, uint64_t>                        EvsEnumerator::sDisplayPortList;
@@ -74,74 +80,140 @@ void EvsEnumerator::EvsUeventThread(std::atomic<bool>& running) {
         return;
     }
 
-    char uevent_data[PAGE_SIZE - 2] = {};
+    char uevent_data[PAGE_SIZE] = {};
     while (running) {
         int length = uevent_next_event(uevent_data, static_cast<int32_t>(sizeof(uevent_data)));
 
-        // Ensure double-null termination.
-        uevent_data[length] = uevent_data[length + 1] = '\0';
-
-        const char *action = nullptr;
-        const char *devname = nullptr;
-        const char *subsys = nullptr;
-        char *cp = uevent_data;
-        while (*cp) {
-            // EVS is interested only in ACTION, SUBSYSTEM, and DEVNAME.
-            if (!std::strncmp(cp, "ACTION=", 7)) {
-                action = cp + 7;
-            } else if (!std::strncmp(cp, "SUBSYSTEM=", 10)) {
-                subsys = cp + 10;
-            } else if (!std::strncmp(cp, "DEVNAME=", 8)) {
-                devname = cp + 8;
-            }
-
-            // Advance to after next \0
-            while (*cp++);
+        VideoUevent event;
+        if (length > 0 && parseVideoUevent(uevent_data, length, event)) {
+            applyVideoUevent(event);
         }
+    }
+
+    return;
+}
+
 
-        if (!devname || !subsys || std::strcmp(subsys, "video4linux")) {
-            // EVS expects that the subsystem of enabled video devices is
-            // video4linux.
-            continue;
+bool EvsEnumerator::parseVideoUevent(const char* data, size_t length, VideoUevent& event) {
+    const char *action = nullptr;
+    const char *devname = nullptr;
+    const char *subsys = nullptr;
+    size_t actionLen = 0, devnameLen = 0, subsysLen = 0;
+
+    // A message is a sequence of null-terminated KEY=VALUE strings; the last
+    // one may not be terminated.
+    const char *end = data + length;
+    for (const char *cp = data; cp < end;) {
+        const char *next = static_cast<const char *>(memchr(cp, '\0', end - cp));
+        if (next == nullptr) {
+            next = end;
+        }
+        const size_t len = next - cp;
+
+        // EVS is interested only in ACTION, SUBSYSTEM, and DEVNAME.
+        if (len >= 7 && !std::strncmp(cp, "ACTION=", 7)) {
+            action = cp + 7;
+            actionLen = len - 7;
+        } else if (len >= 10 && !std::strncmp(cp, "SUBSYSTEM=", 10)) {
+            subsys = cp + 10;
+            subsysLen = len - 10;
+        } else if (len >= 8 && !std::strncmp(cp, "DEVNAME=", 8)) {
+            devname = cp + 8;
+            devnameLen = len - 8;
         }
 
-        // Update shared list.
-        bool cmd_addition = !std::strcmp(action, "add");
-        bool cmd_removal  = !std::strcmp(action, "remove");
-        {
-            std::string devpath = "/dev/";
-            devpath += devname;
-
-            std::lock_guard<std::mutex> lock(sLock);
-            if (cmd_removal) {
-                sCameraList.erase(devpath);
-                LOG(INFO) << devpath << " is removed.";
-            } else if (cmd_addition) {
-                // NOTE: we are here adding new device without a validation
-                // because it always fails to open, b/132164956.
-                CameraRecord cam(devpath.c_str());
-                if (sConfigManager != nullptr) {
-                    unique_ptr<ConfigManager::CameraInfo> &camInfo =
-                        sConfigManager->getCameraInfo(devpath);
-                    if (camInfo != nullptr) {
-                        cam.desc.metadata.setToExternal(
-                            (uint8_t *)camInfo->characteristics,
-                             get_camera_metadata_size(camInfo->characteristics)
-                        );
-                    }
+        // Advance to after next \0
+        cp = next + 1;
+    }
+
+    if (!action || !devname || devnameLen == 0 || !subsys ||
+        std::string_view(subsys, subsysLen) != "video4linux") {
+        // EVS expects that the subsystem of enabled video devices is
+        // video4linux.
+        return false;
+    }
+
+    const std::string_view actionStr(action, actionLen);
+    if (actionStr == "add") {
+        event.action = VideoUevent::Action::ADD;
+    } else if (actionStr == "remove") {
+        event.action = VideoUevent::Action::REMOVE;
+    } else {
+        event.action = VideoUevent::Action::OTHER;
+    }
+
+    event.devpath = "/dev/";
+    event.devpath.append(devname, devnameLen);
+
+    return true;
+}
+
+
+void EvsEnumerator::applyVideoUevent(const VideoUevent& event) {
+    bool changed = false;
+    std::vector<DeviceListener> listeners;
+    {
+        std::lock_guard<std::mutex> lock(sLock);
+        if (event.action == VideoUevent::Action::REMOVE) {
+            changed = sCameraList.erase(event.devpath) > 0;
+            LOG(INFO) << event.devpath << " is removed.";
+        } else if (event.action == VideoUevent::Action::ADD) {
+            // NOTE: we are here adding new device without a validation
+            // because it always fails to open, b/132164956.
+            CameraRecord cam(event.devpath.c_str());
+            if (sConfigManager != nullptr) {
+                unique_ptr<ConfigManager::CameraInfo> &camInfo =
+                    sConfigManager->getCameraInfo(event.devpath);
+                if (camInfo != nullptr) {
+                    cam.desc.metadata.setToExternal(
+                        (uint8_t *)camInfo->characteristics,
+                         get_camera_metadata_size(camInfo->characteristics)
+                    );
                 }
-                sCameraList.emplace(devpath, cam);
-                LOG(INFO) << devpath << " is added.";
-            } else {
-                // Ignore all other actions including "change".
             }
+            changed = sCameraList.emplace(event.devpath, cam).second;
+            LOG(INFO) << event.devpath << " is added.";
+        } else {
+            // Ignore all other actions including "change".
+        }
 
+        if (changed) {
             // Notify the change.
             sCameraSignal.notify_all();
+            listeners = sDeviceListeners;
         }
     }
 
-    return;
+    // Listeners are called without sLock so they can use the enumerator
+    for (auto&& listener : listeners) {
+        listener(event.devpath, event.action == VideoUevent::Action::ADD);
+    }
+}
+
+
+void EvsEnumerator::addDeviceListener(DeviceListener listener) {
+    std::lock_guard<std::mutex> lock(sLock);
+    sDeviceListeners.emplace_back(std::move(listener));
+}
+
+
+void EvsEnumerator::preopenHotpluggedCamera(const std::string& devpath) {
+    // Try to have a new camera ready before a client asks for it.  The device
+    // is opened without holding sLock because it may be slow.
+    sp<EvsV4lCamera> pCamera = preopenCamera(devpath);
+    if (pCamera == nullptr) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(sLock);
+    auto it = sCameraList.find(devpath);
+    if (it != sCameraList.end() &&
+        it->second.warmInstance == nullptr &&
+        it->second.activeInstance.promote() == nullptr) {
+        it->second.warmInstance = pCamera;
+    } else {
+        pCamera->shutdown();
+    }
 }
 
 EvsEnumerator::EvsEnumerator(sp<IAutomotiveDisplayProxyService> proxyService) {
@@ -151,6 +223,13 @@ EvsEnumerator::EvsEnumerator(sp<IAutomotiveDisplayProxyService> proxyService) {
         /* loads and initializes ConfigManager in a separate thread */
         sConfigManager =
             ConfigManager::Create();
+
+        /* pre-opens cameras that are plugged in later */
+        addDeviceListener([](const std::string& devpath, bool added) {
+            if (added) {
+                preopenHotpluggedCamera(devpath);
+            }
+        });
     }
 
     if (sDisplayProxy == nullptr) {
@@ -160,6 +239,7 @@ EvsEnumerator::EvsEnumerator(sp<IAutomotiveDisplayProxyService> proxyService) {
 
     enumerateCameras();
     enumerateDisplays();
+    preopenCameras();
 }
 
 void EvsEnumerator::enumerateCameras() {
@@ -205,6 +285,107 @@ void EvsEnumerator::enumerateCameras() {
 }
 
 
+void EvsEnumerator::preopenCameras() {
+    if (sConfigManager == nullptr) {
+        // Without a configuration, we don't know which cameras will be used
+        return;
+    }
+
+    // Open every configured camera concurrently so bring-up takes as long as
+    // the slowest device rather than the sum of all of them.
+    std::vector<std::string> cameraIds;
+    {
+        std::lock_guard<std::mutex> lock(sLock);
+        for (auto&& id : sConfigManager->getCameraIdList()) {
+            auto it = sCameraList.find(id);
+            if (it != sCameraList.end() && it->second.warmInstance == nullptr) {
+                cameraIds.emplace_back(id);
+            }
+        }
+    }
+
+    const int64_t preopenStart = android::elapsedRealtimeNano();
+    std::vector<sp<EvsV4lCamera>> cameras(cameraIds.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < cameraIds.size(); ++i) {
+        threads.emplace_back([&cameras, &cameraIds, i]() {
+            cameras[i] = preopenCamera(cameraIds[i]);
+        });
+    }
+    for (auto&& t : threads) {
+        t.join();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sLock);
+        for (size_t i = 0; i < cameraIds.size(); ++i) {
+            auto it = sCameraList.find(cameraIds[i]);
+            if (it != sCameraList.end()) {
+                it->second.warmInstance = cameras[i];
+            }
+        }
+    }
+
+    LOG(INFO) << "Pre-opened " << cameraIds.size() << " cameras in "
+              << (android::elapsedRealtimeNano() - preopenStart) / 1000000.0 << " ms.";
+}
+
+
+sp<EvsV4lCamera> EvsEnumerator::preopenCamera(const std::string& cameraId) {
+    if (sConfigManager == nullptr) {
+        return nullptr;
+    }
+
+    unique_ptr<ConfigManager::CameraInfo> &camInfo = sConfigManager->getCameraInfo(cameraId);
+    if (camInfo == nullptr) {
+        return nullptr;
+    }
+
+    // We can't know what a client will ask for, so the largest output stream is
+    // negotiated.  A client asking for a different stream gets a new instance.
+    int32_t streamId = -1, area = 0;
+    for (auto&& [id, cfg] : camInfo->streamConfigurations) {
+        if (cfg[4] == ANDROID_SCALER_AVAILABLE_STREAM_CONFIGURATIONS_OUTPUT &&
+            cfg[1] * cfg[2] > area) {
+            streamId = id;
+            area = cfg[1] * cfg[2];
+        }
+    }
+
+    sp<EvsV4lCamera> pCamera =
+        EvsV4lCamera::CreateWithStreamId(cameraId.c_str(), camInfo, streamId);
+    if (pCamera == nullptr) {
+        LOG(WARNING) << "Failed to pre-open " << cameraId;
+        return nullptr;
+    }
+
+    // Allocate an output buffer now as well
+    pCamera->setMaxFramesInFlight(1);
+
+    return pCamera;
+}
+
+
+sp<EvsV4lCamera> EvsEnumerator::takeWarmCamera(CameraRecord* pRecord,
+                                               std::optional<int32_t> streamId) {
+    sp<EvsV4lCamera> pWarmCamera;
+    {
+        std::lock_guard<std::mutex> lock(sLock);
+        pWarmCamera = pRecord->warmInstance;
+        pRecord->warmInstance = nullptr;
+    }
+
+    if (pWarmCamera != nullptr && streamId && pWarmCamera->getStreamId() != *streamId) {
+        // Release the device so it can be opened again with the requested stream
+        LOG(INFO) << "Pre-opened camera does not match the requested stream";
+        pWarmCamera->shutdown();
+        pWarmCamera = nullptr;
+    }
+
+    return pWarmCamera;
+}
+
+
 void EvsEnumerator::enumerateDisplays() {
     LOG(INFO) << __FUNCTION__
               << ": Starting display enumeration";
@@ -292,8 +473,12 @@ Return<sp<IEvsCamera_1_0>> EvsEnumerator::openCamera(const hidl_string& cameraId
         closeCamera(pActiveCamera);
     }
 
-    // Construct a camera instance for the caller
-    if (sConfigManager == nullptr) {
+    // Construct a camera instance for the caller unless one has been opened
+    // in advance; v1.0 clients take whatever stream it was opened with.
+    pActiveCamera = takeWarmCamera(pRecord);
+    if (pActiveCamera != nullptr) {
+        LOG(DEBUG) << "Handing out a pre-opened camera " << cameraId;
+    } else if (sConfigManager == nullptr) {
         pActiveCamera = EvsV4lCamera::Create(cameraId.c_str());
     } else {
         pActiveCamera = EvsV4lCamera::Create(cameraId.c_str(),
@@ -485,15 +670,22 @@ Return<sp<IEvsCamera_1_1>> EvsEnumerator::openCamera_1_1(const hidl_string& came
         closeCamera(pActiveCamera);
     }
 
-    // Construct a camera instance for the caller
+    // Construct a camera instance for the caller unless a matching one has
+    // been opened in advance
     if (sConfigManager == nullptr) {
         LOG(WARNING) << "ConfigManager is not available.  "
                      << "Given stream configuration is ignored.";
         pActiveCamera = EvsV4lCamera::Create(cameraId.c_str());
     } else {
-        pActiveCamera = EvsV4lCamera::Create(cameraId.c_str(),
-                                             sConfigManager->getCameraInfo(cameraId),
-                                             &streamCfg);
+        unique_ptr<ConfigManager::CameraInfo> &camInfo = sConfigManager->getCameraInfo(cameraId);
+        pActiveCamera = takeWarmCamera(pRecord,
+                                       EvsV4lCamera::selectStreamConfiguration(camInfo,
+                                                                               &streamCfg));
+        if (pActiveCamera != nullptr) {
+            LOG(DEBUG) << "Handing out a pre-opened camera " << cameraId;
+        } else {
+            pActiveCamera = EvsV4lCamera::Create(cameraId.c_str(), camInfo, &streamCfg);
+        }
     }
     pRecord->activeInstance = pActiveCamera;
     if (pActiveCamera == nullptr) {
@@ -681,6 +873,44 @@ Return<void> EvsEnumerator::closeUltrasonicsArray(
     return Void();
 }
 
+
+// Reports the capture timing of every open or pre-opened camera
+Return<void> EvsEnumerator::debug(const hidl_handle& fd,
+                                  const hidl_vec<hidl_string>& options) {
+    (void)options;
+    if (fd.getNativeHandle() == nullptr || fd->numFds < 1) {
+        LOG(ERROR) << "Given file descriptor is not valid.";
+        return {};
+    }
+
+    std::vector<std::pair<std::string, sp<EvsV4lCamera>>> cameras;
+    {
+        std::lock_guard<std::mutex> lock(sLock);
+        for (auto& [id, record] : sCameraList) {
+            sp<EvsV4lCamera> pCamera = record.activeInstance.promote();
+            if (pCamera == nullptr) {
+                pCamera = record.warmInstance;
+            }
+            if (pCamera != nullptr) {
+                cameras.emplace_back(id, pCamera);
+            }
+        }
+    }
+
+    const int out = fd->data[0];
+    if (cameras.empty()) {
+        WriteStringToFd("No camera is open.\n", out);
+    }
+    for (auto& [id, pCamera] : cameras) {
+        WriteStringToFd(StringPrintf("%s (stream %d):\n%s\n", id.c_str(),
+                                     pCamera->getStreamId(),
+                                     pCamera->getCaptureStats().toString().c_str()),
+                        out);
+    }
+
+    return {};
+}
+
 } // namespace implementation
 } // namespace V1_1
 } // namespace evs
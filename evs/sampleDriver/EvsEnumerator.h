@@ -22,9 +22,13 @@
 #include <android/hardware/camera/device/3.2/ICameraDevice.h>
 #include <android/frameworks/automotive/display/1.0/IAutomotiveDisplayProxyService.h>
 
+#include <functional>
+#include <optional>
+#include <string_view>
 #include <unordered_map>
 #include <thread>
 #include <atomic>
+#include <vector>
 
 #include "ConfigManager.h"
 
@@ -70,16 +74,40 @@ public:
     Return<void> closeUltrasonicsArray(
             const ::android::sp<IEvsUltrasonicsArray>& evsUltrasonicsArray) override;
 
+    // Methods from ::android.hidl.base::V1_0::IBase follow.
+    Return<void> debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options) override;
+
     // Implementation details
     EvsEnumerator(sp<IAutomotiveDisplayProxyService> proxyService = nullptr);
 
     // Listen to video device uevents
     static void EvsUeventThread(std::atomic<bool>& running);
 
+    // A uevent about a video4linux device node
+    struct VideoUevent {
+        enum class Action { ADD, REMOVE, OTHER };
+
+        Action      action = Action::OTHER;
+        std::string devpath;        // e.g. /dev/video0
+    };
+
+    // Parses a raw uevent message of a given length.  Returns false if the
+    // message is not about a video4linux device node.
+    static bool parseVideoUevent(const char* data, size_t length, VideoUevent& event);
+
+    // Applies a uevent to the camera device list.  Listeners are notified only
+    // if the list has changed.
+    static void applyVideoUevent(const VideoUevent& event);
+
+    // Called with a device path and whether it was added or removed
+    using DeviceListener = std::function<void(const std::string& devpath, bool added)>;
+    static void addDeviceListener(DeviceListener listener);
+
 private:
     struct CameraRecord {
         CameraDesc          desc;
         wp<EvsV4lCamera>    activeInstance;
+        sp<EvsV4lCamera>    warmInstance;   // Opened in advance; handed to the next client
 
         CameraRecord(const char *cameraId) : desc() { desc.v1.cameraId = cameraId; }
     };
@@ -90,6 +118,13 @@ private:
     static CameraRecord* findCameraById(const std::string& cameraId);
     static void enumerateCameras();
     static void enumerateDisplays();
+    static void preopenCameras();
+    static sp<EvsV4lCamera> preopenCamera(const std::string& cameraId);
+    // Hands out the pre-opened camera if it was opened with a given stream.
+    // Without a stream, as v1.0 clients can't ask for one, any is taken.
+    static sp<EvsV4lCamera> takeWarmCamera(CameraRecord* pRecord,
+                                           std::optional<int32_t> streamId = std::nullopt);
+    static void preopenHotpluggedCamera(const std::string& devpath);
 
     void closeCamera_impl(const sp<IEvsCamera_1_0>& pCamera, const std::string& cameraId);
 
@@ -107,6 +142,7 @@ private:
 
     static std::mutex                       sLock;          // Mutex on shared camera device list.
     static std::condition_variable          sCameraSignal;  // Signal on camera device addition.
+    static std::vector<DeviceListener>      sDeviceListeners;   // Guarded by sLock.
 
     static std::unique_ptr<ConfigManager>   sConfigManager; // ConfigManager
 
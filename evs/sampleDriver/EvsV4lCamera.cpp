@@ -16,7 +16,6 @@
 
 #include "EvsV4lCamera.h"
 #include "EvsEnumerator.h"
-#include "bufferCopy.h"
 
 #include <android/hardware_buffer.h>
 #include <android-base/logging.h>
@@ -39,6 +38,39 @@ const std::array<int32_t, 2> kDefaultResolution = {640, 480};
 // Safeguards against unreasonable resource consumption and provides a testable limit
 static const unsigned MAX_BUFFERS_IN_FLIGHT = 100;
 
+// Marks buffer identifiers that refer to exported capture buffers rather than
+// to entries in mBuffers
+static const uint32_t kDmaBufIdFlag = 0x80000000;
+
+// Each frame sent from mBuffers carries the generation of its buffer, so that a
+// client returning a frame it no longer owns is caught even after the buffer
+// has been sent out again.  The buffer identifier stays the index of the
+// buffer.  v1.1 frames carry the generation in their metadata; v1.0 frames
+// have no such field and carry it in the identifier bits above the index.
+// Generation 0 marks a frame returned without one, e.g. a v1.1 frame that the
+// manager returns through the v1.0 interface.
+static const unsigned kBufferIndexBits = 8;
+static const uint32_t kBufferIndexMask = (1u << kBufferIndexBits) - 1;
+static const uint32_t kBufferGenerationMask = (kDmaBufIdFlag - 1) >> kBufferIndexBits;
+static_assert(MAX_BUFFERS_IN_FLIGHT <= kBufferIndexMask + 1,
+              "Buffer indices must fit in their bits of the buffer identifier");
+
+
+static uint32_t readGeneration(const hidl_vec<uint8_t>& metadata) {
+    uint32_t generation = 0;
+    if (metadata.size() == sizeof(generation)) {
+        memcpy(&generation, metadata.data(), sizeof(generation));
+    }
+    return generation;
+}
+
+
+static void writeGeneration(hidl_vec<uint8_t>& metadata, uint32_t generation) {
+    metadata.resize(sizeof(generation));
+    memcpy(metadata.data(), &generation, sizeof(generation));
+}
+
+
 EvsV4lCamera::EvsV4lCamera(const char *deviceName,
                            unique_ptr<ConfigManager::CameraInfo> &camInfo) :
         mFramesAllowed(0),
@@ -50,6 +82,10 @@ EvsV4lCamera::EvsV4lCamera(const char *deviceName,
     if (camInfo != nullptr) {
         mDescription.metadata.setToExternal((uint8_t *)camInfo->characteristics,
                                             get_camera_metadata_size(camInfo->characteristics));
+
+        if (camInfo->conversionWorkers > 0) {
+            mBandConverter = std::make_unique<BandConverter>(camInfo->conversionWorkers);
+        }
     }
 
     // Default output buffer format.
@@ -84,6 +120,9 @@ void EvsV4lCamera::shutdown()
     // Close our video capture device
     mVideo.close();
 
+    // Stop the conversion workers; no more frames will arrive
+    mBandConverter.reset();
+
     // Drop all the graphics buffers we've been using
     if (mBuffers.size() > 0) {
         GraphicBufferAllocator& alloc(GraphicBufferAllocator::get());
@@ -95,6 +134,8 @@ void EvsV4lCamera::shutdown()
             rec.handle = nullptr;
         }
         mBuffers.clear();
+        mFreeBuffers.clear();
+        mEmptySlots.clear();
     }
 }
 
@@ -156,54 +197,67 @@ Return<EvsResult> EvsV4lCamera::startVideoStream(const sp<IEvsCameraStream_1_0>&
         }
     }
 
-    // Choose which image transfer function we need
-    // Map from V4L2 to Android graphic buffer format
+    // Choose how to transfer images from the capture format into our output
+    // buffers; frames captured at another size are center cropped to the
+    // output aspect ratio and scaled.
     const uint32_t videoSrcFormat = mVideo.getV4LFormat();
-    LOG(INFO) << "Configuring to accept " << (char*)&videoSrcFormat
-              << " camera data and convert to " << std::hex << mFormat;
+    const uint32_t srcWidth = mVideo.getWidth();
+    const uint32_t srcHeight = mVideo.getHeight();
+    const bool needsScaling = srcWidth != mOutputWidth || srcHeight != mOutputHeight;
+    if (!ConversionRegistry::get().find(videoSrcFormat, mFormat, needsScaling, mConversion)) {
+        LOG(ERROR) << "Unhandled conversion from camera format "
+                   << ((char*)&videoSrcFormat)[0]
+                   << ((char*)&videoSrcFormat)[1]
+                   << ((char*)&videoSrcFormat)[2]
+                   << ((char*)&videoSrcFormat)[3]
+                   << " " << srcWidth << " x " << srcHeight
+                   << " to " << std::hex << mFormat
+                   << std::dec << " " << mOutputWidth << " x " << mOutputHeight;
+        return EvsResult::UNDERLYING_SERVICE_ERROR;
+    }
 
-    switch (mFormat) {
-    case HAL_PIXEL_FORMAT_YCRCB_420_SP:
-        switch (videoSrcFormat) {
-        case V4L2_PIX_FMT_NV21:     mFillBufferFromVideo = fillNV21FromNV21;    break;
-        case V4L2_PIX_FMT_YUYV:     mFillBufferFromVideo = fillNV21FromYUYV;    break;
-        default:
-            LOG(ERROR) << "Unhandled camera output format: "
-                       << ((char*)&videoSrcFormat)[0]
-                       << ((char*)&videoSrcFormat)[1]
-                       << ((char*)&videoSrcFormat)[2]
-                       << ((char*)&videoSrcFormat)[3]
-                       << std::hex << videoSrcFormat;
-        }
-        break;
-    case HAL_PIXEL_FORMAT_RGBA_8888:
-        switch (videoSrcFormat) {
-        case V4L2_PIX_FMT_YUYV:     mFillBufferFromVideo = fillRGBAFromYUYV;    break;
-        default:
-            LOG(ERROR) << "Unhandled camera format " << (char*)&videoSrcFormat;
-        }
-        break;
-    case HAL_PIXEL_FORMAT_YCBCR_422_I:
-        switch (videoSrcFormat) {
-        case V4L2_PIX_FMT_YUYV:     mFillBufferFromVideo = fillYUYVFromYUYV;    break;
-        case V4L2_PIX_FMT_UYVY:     mFillBufferFromVideo = fillYUYVFromUYVY;    break;
-        default:
-            LOG(ERROR) << "Unhandled camera format " << (char*)&videoSrcFormat;
-        }
-        break;
-    default:
-        LOG(ERROR) << "Unhandled camera format " << (char*)&mFormat;
+    mSourceFrame = {};
+    mSourceFrame.width = srcWidth;
+    mSourceFrame.height = srcHeight;
+    mSourceFrame.stride = mVideo.getStride();
+    mSourceFrame.cropWidth = srcWidth;
+    mSourceFrame.cropHeight = srcHeight;
+    if (static_cast<uint64_t>(srcWidth) * mOutputHeight >
+            static_cast<uint64_t>(srcHeight) * mOutputWidth) {
+        mSourceFrame.cropWidth = static_cast<uint64_t>(srcHeight) * mOutputWidth / mOutputHeight;
+    } else {
+        mSourceFrame.cropHeight = static_cast<uint64_t>(srcWidth) * mOutputHeight / mOutputWidth;
     }
+    // Even offsets keep packed and subsampled chroma aligned
+    mSourceFrame.cropX = ((srcWidth - mSourceFrame.cropWidth) / 2) & ~1u;
+    mSourceFrame.cropY = ((srcHeight - mSourceFrame.cropHeight) / 2) & ~1u;
+
+    LOG(INFO) << "Configuring to accept " << (char*)&videoSrcFormat
+              << " camera data and convert to " << std::hex << mFormat << std::dec
+              << " with " << mConversion.name << " (cost " << mConversion.cost << ")";
 
+    // If no conversion is needed, try to send the capture buffers to the client
+    // instead of copying them.  This is opt-in because the platform's gralloc
+    // mapper must be able to import a DMABUF-backed native handle.
+    const bool tryZeroCopy = mCameraInfo != nullptr && mCameraInfo->zeroCopy &&
+                             (mConversion.flags & Conversion::IDENTITY);
 
     // Record the user's callback for use when we have a frame ready
     mStream = stream;
     mStream_1_1 = IEvsCameraStream_1_1::castFrom(mStream).withDefault(nullptr);
 
     // Set up the video stream with a callback to our member function forwardFrame()
+    mStreamStartTime = android::elapsedRealtimeNano();
     if (!mVideo.startStream([this](VideoCapture*, imageBuffer* tgt, void* data) {
-                                this->forwardFrame(tgt, data);
-                            })
+                                logFirstFrame();
+                                if (mZeroCopy) {
+                                    this->forwardDmaBuf(tgt);
+                                } else {
+                                    this->forwardFrame(tgt, data);
+                                }
+                            },
+                            tryZeroCopy ? mFramesAllowed : 1,
+                            tryZeroCopy)
     ) {
         // No need to hold onto this if we failed to start
         mStream = nullptr;
@@ -212,13 +266,33 @@ Return<EvsResult> EvsV4lCamera::startVideoStream(const sp<IEvsCameraStream_1_0>&
         return EvsResult::UNDERLYING_SERVICE_ERROR;
     }
 
+    if (tryZeroCopy && mVideo.hasDmaBufs()) {
+        // Wrap each exported buffer so it can be sent across HIDL.  VideoCapture
+        // keeps ownership of the file descriptors.
+        const int numBuffers = mVideo.getNumBuffers();
+        mDmaBufHandles.resize(numBuffers);
+        mDmaBufInUse.assign(numBuffers, false);
+        for (int i = 0; i < numBuffers; ++i) {
+            mDmaBufHandles[i] = native_handle_create(/* numFds = */ 1, /* numInts = */ 0);
+            mDmaBufHandles[i]->data[0] = mVideo.getDmaBufFd(i);
+        }
+
+        LOG(INFO) << "Delivering " << numBuffers << " capture buffers without a copy";
+        mZeroCopy = true;
+    }
+
     return EvsResult::OK;
 }
 
 
 Return<void> EvsV4lCamera::doneWithFrame(const BufferDesc_1_0& buffer)  {
     LOG(DEBUG) << __FUNCTION__;
-    doneWithFrame_impl(buffer.bufferId, buffer.memHandle);
+    if (buffer.bufferId & kDmaBufIdFlag) {
+        doneWithFrame_impl(buffer.bufferId, buffer.memHandle, 0);
+    } else {
+        doneWithFrame_impl(buffer.bufferId & kBufferIndexMask, buffer.memHandle,
+                           buffer.bufferId >> kBufferIndexBits);
+    }
 
     return Void();
 }
@@ -230,6 +304,24 @@ Return<void> EvsV4lCamera::stopVideoStream()  {
     // Tell the capture device to stop (and block until it does)
     mVideo.stopStream();
 
+    if (mZeroCopy) {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+
+        // The exported buffers are gone with the stream; any frames the client
+        // still holds no longer count against its quota.
+        mZeroCopy = false;
+        for (unsigned i = 0; i < mDmaBufHandles.size(); ++i) {
+            if (mDmaBufInUse[i]) {
+                mFramesInUse--;
+            }
+
+            // The file descriptors are closed by VideoCapture
+            native_handle_delete(mDmaBufHandles[i]);
+        }
+        mDmaBufHandles.clear();
+        mDmaBufInUse.clear();
+    }
+
     if (mStream_1_1 != nullptr) {
         // V1.1 client is waiting on STREAM_STOPPED event.
         std::unique_lock <std::mutex> lock(mAccessLock);
@@ -310,7 +402,8 @@ Return<EvsResult> EvsV4lCamera::doneWithFrame_1_1(const hidl_vec<BufferDesc_1_1>
     LOG(DEBUG) << __FUNCTION__;
 
     for (auto&& buffer : buffers) {
-        doneWithFrame_impl(buffer.bufferId, buffer.buffer.nativeHandle);
+        doneWithFrame_impl(buffer.bufferId, buffer.buffer.nativeHandle,
+                           readGeneration(buffer.metadata));
     }
 
     return EvsResult::OK;
@@ -435,6 +528,28 @@ Return<EvsResult> EvsV4lCamera::setExtendedInfo_1_1(uint32_t opaqueIdentifier,
 
 Return<void> EvsV4lCamera::getExtendedInfo_1_1(uint32_t opaqueIdentifier,
                                                getExtendedInfo_1_1_cb _hidl_cb) {
+    if (opaqueIdentifier == kCaptureStatsInfoId) {
+        const CaptureStats stats = mVideo.getCaptureStats();
+        std::vector<int64_t> values = {
+            static_cast<int64_t>(stats.framesCaptured),
+            static_cast<int64_t>(stats.framesDropped),
+            stats.meanIntervalNs,
+            stats.jitterNs,
+            stats.maxIntervalNs,
+            stats.meanDequeueLatencyNs,
+            stats.meanConversionNs,
+        };
+        for (auto count : stats.conversionHistogram) {
+            values.emplace_back(count);
+        }
+
+        hidl_vec<uint8_t> value;
+        value.setToExternal(reinterpret_cast<uint8_t*>(values.data()),
+                            values.size() * sizeof(int64_t));
+        _hidl_cb(EvsResult::OK, value);
+        return Void();
+    }
+
     const auto it = mExtInfo.find(opaqueIdentifier);
     hidl_vec<uint8_t> value;
     auto status = EvsResult::OK;
@@ -472,8 +587,11 @@ EvsV4lCamera::importExternalBuffers(const hidl_vec<BufferDesc_1_1>& buffers,
     {
         std::scoped_lock<std::mutex> lock(mAccessLock);
 
-        if (numBuffersToAdd > (MAX_BUFFERS_IN_FLIGHT - mFramesAllowed)) {
-            numBuffersToAdd -= (MAX_BUFFERS_IN_FLIGHT - mFramesAllowed);
+        // Never hold more than MAX_BUFFERS_IN_FLIGHT buffers
+        const unsigned room = mFramesAllowed < MAX_BUFFERS_IN_FLIGHT ?
+                              MAX_BUFFERS_IN_FLIGHT - mFramesAllowed : 0;
+        if (numBuffersToAdd > room) {
+            numBuffersToAdd = room;
             LOG(WARNING) << "Exceed the limit on number of buffers.  "
                          << numBuffersToAdd << " buffers will be added only.";
         }
@@ -501,23 +619,7 @@ EvsV4lCamera::importExternalBuffers(const hidl_vec<BufferDesc_1_1>& buffers,
                 continue;
             }
 
-            auto stored = false;
-            for (auto&& rec : mBuffers) {
-                if (rec.handle == nullptr) {
-                    // Use this existing entry
-                    rec.handle = memHandle;
-                    rec.inUse = false;
-
-                    stored = true;
-                    break;
-                }
-            }
-
-            if (!stored) {
-                // Add a BufferRecord wrapping this handle to our set of available buffers
-                mBuffers.emplace_back(memHandle);
-            }
-
+            storeBuffer_Locked(memHandle);
             ++mFramesAllowed;
         }
 
@@ -528,7 +630,8 @@ EvsV4lCamera::importExternalBuffers(const hidl_vec<BufferDesc_1_1>& buffers,
 
 
 EvsResult EvsV4lCamera::doneWithFrame_impl(const uint32_t bufferId,
-                                           const buffer_handle_t memHandle) {
+                                           const buffer_handle_t memHandle,
+                                           const uint32_t generation) {
     std::lock_guard <std::mutex> lock(mAccessLock);
 
     // If we've been displaced by another owner of the camera, then we can't do anything else
@@ -537,28 +640,32 @@ EvsResult EvsV4lCamera::doneWithFrame_impl(const uint32_t bufferId,
     } else {
         if (memHandle == nullptr) {
             LOG(ERROR) << "Ignoring doneWithFrame called with null handle";
-        } else if (bufferId >= mBuffers.size()) {
-            LOG(ERROR) << "Ignoring doneWithFrame called with invalid bufferId " << bufferId
-                       << " (max is " << mBuffers.size() - 1 << ")";
-        } else if (!mBuffers[bufferId].inUse) {
-            LOG(ERROR) << "Ignoring doneWithFrame called on frame " << bufferId
-                       << " which is already free";
+        } else if (bufferId & kDmaBufIdFlag) {
+            const unsigned index = bufferId & ~kDmaBufIdFlag;
+            if (index >= mDmaBufInUse.size() || !mDmaBufInUse[index]) {
+                LOG(ERROR) << "Ignoring doneWithFrame called on capture buffer " << index
+                           << " which is not in use";
+            } else {
+                // Let the device capture into this buffer again
+                mDmaBufInUse[index] = false;
+                mFramesInUse--;
+                mVideo.markFrameConsumed(index);
+            }
         } else {
-            // Mark the frame as available
-            mBuffers[bufferId].inUse = false;
-            mFramesInUse--;
-
-            // If this frame's index is high in the array, try to move it down
-            // to improve locality after mFramesAllowed has been reduced.
-            if (bufferId >= mFramesAllowed) {
-                // Find an empty slot lower in the array (which should always exist in this case)
-                for (auto&& rec : mBuffers) {
-                    if (rec.handle == nullptr) {
-                        rec.handle = mBuffers[bufferId].handle;
-                        mBuffers[bufferId].handle = nullptr;
-                        break;
-                    }
-                }
+            const unsigned idx = bufferId;
+            if (idx >= mBuffers.size()) {
+                LOG(ERROR) << "Ignoring doneWithFrame called with invalid bufferId " << bufferId
+                           << " (max index is " << mBuffers.size() - 1 << ")";
+            } else if (!mBuffers[idx].inUse) {
+                LOG(ERROR) << "Ignoring doneWithFrame called on frame " << bufferId
+                           << " which is already free";
+            } else if (generation != 0 && generation != mBuffers[idx].generation) {
+                LOG(ERROR) << "Ignoring doneWithFrame called on stale frame " << bufferId
+                           << "; buffer " << idx << " has been sent out again since";
+            } else {
+                // Mark the frame as available
+                releaseBuffer_Locked(idx);
+                mFramesInUse--;
             }
         }
     }
@@ -618,13 +725,13 @@ unsigned EvsV4lCamera::increaseAvailableFrames_Locked(unsigned numToAdd) {
     while (added < numToAdd) {
         unsigned pixelsPerLine;
         buffer_handle_t memHandle = nullptr;
-        status_t result = alloc.allocate(mVideo.getWidth(), mVideo.getHeight(),
+        status_t result = alloc.allocate(mOutputWidth, mOutputHeight,
                                          mFormat, 1,
                                          mUsage,
                                          &memHandle, &pixelsPerLine, 0, "EvsV4lCamera");
         if (result != NO_ERROR) {
             LOG(ERROR) << "Error " << result << " allocating "
-                       << mVideo.getWidth() << " x " << mVideo.getHeight()
+                       << mOutputWidth << " x " << mOutputHeight
                        << " graphics buffer";
             break;
         }
@@ -641,22 +748,7 @@ unsigned EvsV4lCamera::increaseAvailableFrames_Locked(unsigned numToAdd) {
             mStride = pixelsPerLine;
         }
 
-        // Find a place to store the new buffer
-        bool stored = false;
-        for (auto&& rec : mBuffers) {
-            if (rec.handle == nullptr) {
-                // Use this existing entry
-                rec.handle = memHandle;
-                rec.inUse = false;
-                stored = true;
-                break;
-            }
-        }
-        if (!stored) {
-            // Add a BufferRecord wrapping this handle to our set of available buffers
-            mBuffers.emplace_back(memHandle);
-        }
-
+        storeBuffer_Locked(memHandle);
         mFramesAllowed++;
         added++;
     }
@@ -671,30 +763,58 @@ unsigned EvsV4lCamera::decreaseAvailableFrames_Locked(unsigned numToRemove) {
 
     unsigned removed = 0;
 
-    for (auto&& rec : mBuffers) {
-        // Is this record not in use, but holding a buffer that we can free?
-        if ((rec.inUse == false) && (rec.handle != nullptr)) {
-            // Release buffer and update the record so we can recognize it as "empty"
-            alloc.free(rec.handle);
-            rec.handle = nullptr;
+    // Only buffers that are not in use can be freed
+    while (removed < numToRemove && !mFreeBuffers.empty()) {
+        const unsigned idx = mFreeBuffers.back();
+        mFreeBuffers.pop_back();
 
-            mFramesAllowed--;
-            removed++;
+        // Release buffer and update the record so we can recognize it as "empty"
+        alloc.free(mBuffers[idx].handle);
+        mBuffers[idx].handle = nullptr;
+        mEmptySlots.emplace_back(idx);
 
-            if (removed == numToRemove) {
-                break;
-            }
-        }
+        mFramesAllowed--;
+        removed++;
     }
 
     return removed;
 }
 
 
+void EvsV4lCamera::storeBuffer_Locked(buffer_handle_t handle) {
+    unsigned idx;
+    if (!mEmptySlots.empty()) {
+        // Use an existing entry
+        idx = mEmptySlots.back();
+        mEmptySlots.pop_back();
+        mBuffers[idx].handle = handle;
+        mBuffers[idx].inUse = false;
+    } else {
+        // Add a BufferRecord wrapping this handle to our set of available buffers
+        idx = mBuffers.size();
+        mBuffers.emplace_back(handle);
+    }
+
+    mFreeBuffers.emplace_back(idx);
+}
+
+
+void EvsV4lCamera::releaseBuffer_Locked(unsigned idx) {
+    mBuffers[idx].inUse = false;
+    mFreeBuffers.emplace_back(idx);
+}
+
+
 // This is the async callback from the video camera that tells us a frame is ready
 void EvsV4lCamera::forwardFrame(imageBuffer* pV4lBuff, void* pData) {
     bool readyForFrame = false;
-    size_t idx = 0;
+    unsigned idx = 0;
+    uint32_t generation = 0;
+    buffer_handle_t handle = nullptr;
+
+    // timestamp in microseconds.
+    const int64_t timestamp =
+        pV4lBuff->timestamp.tv_sec * 1000000LL + pV4lBuff->timestamp.tv_usec;
 
     // Lock scope for updating shared state
     {
@@ -704,25 +824,20 @@ void EvsV4lCamera::forwardFrame(imageBuffer* pV4lBuff, void* pData) {
         if (mFramesInUse >= mFramesAllowed) {
             // Can't do anything right now -- skip this frame
             LOG(WARNING) << "Skipped a frame because too many are in flight";
+        } else if (mFreeBuffers.empty()) {
+            // This shouldn't happen since we already checked mFramesInUse vs mFramesAllowed
+            LOG(ERROR) << "Failed to find an available buffer slot";
         } else {
-            // Identify an available buffer to fill
-            for (idx = 0; idx < mBuffers.size(); idx++) {
-                if (!mBuffers[idx].inUse) {
-                    if (mBuffers[idx].handle != nullptr) {
-                        // Found an available record, so stop looking
-                        break;
-                    }
-                }
-            }
-            if (idx >= mBuffers.size()) {
-                // This shouldn't happen since we already checked mFramesInUse vs mFramesAllowed
-                LOG(ERROR) << "Failed to find an available buffer slot";
-            } else {
-                // We're going to make the frame busy
-                mBuffers[idx].inUse = true;
-                mFramesInUse++;
-                readyForFrame = true;
-            }
+            // We're going to make the frame busy
+            idx = mFreeBuffers.back();
+            mFreeBuffers.pop_back();
+            mBuffers[idx].inUse = true;
+            mFramesInUse++;
+            readyForFrame = true;
+
+            handle = mBuffers[idx].handle;
+            mBuffers[idx].generation = mBuffers[idx].generation % kBufferGenerationMask + 1;
+            generation = mBuffers[idx].generation;
         }
     }
 
@@ -734,18 +849,17 @@ void EvsV4lCamera::forwardFrame(imageBuffer* pV4lBuff, void* pData) {
         BufferDesc_1_1 bufDesc_1_1 = {};
         AHardwareBuffer_Desc* pDesc =
             reinterpret_cast<AHardwareBuffer_Desc *>(&bufDesc_1_1.buffer.description);
-        pDesc->width  = mVideo.getWidth();
-        pDesc->height = mVideo.getHeight();
+        pDesc->width  = mOutputWidth;
+        pDesc->height = mOutputHeight;
         pDesc->layers = 1;
         pDesc->format = mFormat;
         pDesc->usage  = mUsage;
         pDesc->stride = mStride;
-        bufDesc_1_1.buffer.nativeHandle = mBuffers[idx].handle;
+        bufDesc_1_1.buffer.nativeHandle = handle;
         bufDesc_1_1.bufferId = idx;
         bufDesc_1_1.deviceId = mDescription.v1.cameraId;
-        // timestamp in microseconds.
-        bufDesc_1_1.timestamp =
-            pV4lBuff->timestamp.tv_sec * 1e+6 + pV4lBuff->timestamp.tv_usec;
+        bufDesc_1_1.timestamp = timestamp;
+        writeGeneration(bufDesc_1_1.metadata, generation);
 
         // Lock our output buffer for writing
         // TODO(b/145459970): Sometimes, physical camera device maps a buffer
@@ -771,10 +885,21 @@ void EvsV4lCamera::forwardFrame(imageBuffer* pV4lBuff, void* pData) {
 
         // Transfer the video image into the output buffer, making any needed
         // format conversion along the way
-        mFillBufferFromVideo(bufDesc_1_1, (uint8_t *)targetPixels, pData, mVideo.getStride());
+        SourceFrame src = mSourceFrame;
+        src.data = static_cast<const uint8_t*>(pData);
+        src.size = pV4lBuff->bytesused;
+        bool converted;
+        if (mBandConverter != nullptr && (mConversion.flags & Conversion::BANDED)) {
+            converted = mBandConverter->convert(mConversion.convert, bufDesc_1_1,
+                                                (uint8_t *)targetPixels, src, pDesc->height);
+        } else {
+            converted = mConversion.convert(bufDesc_1_1, (uint8_t *)targetPixels, src,
+                                            0, pDesc->height);
+        }
 
         // Unlock the output buffer
         mapper.unlock(bufDesc_1_1.buffer.nativeHandle);
+        mVideo.markFrameConverted(pV4lBuff->index);
 
         // Give the video frame back to the underlying device for reuse
         // Note that we do this before making the client callback to give the
@@ -782,50 +907,128 @@ void EvsV4lCamera::forwardFrame(imageBuffer* pV4lBuff, void* pData) {
         mVideo.markFrameConsumed(pV4lBuff->index);
 
         // Issue the (asynchronous) callback to the client -- can't be holding
-        // the lock
-        bool flag = false;
-        if (mStream_1_1 != nullptr) {
-            hidl_vec<BufferDesc_1_1> frames;
-            frames.resize(1);
-            frames[0] = bufDesc_1_1;
-            auto result = mStream_1_1->deliverFrame_1_1(frames);
-            flag = result.isOk();
-        } else {
-            BufferDesc_1_0 bufDesc_1_0 = {
-                pDesc->width,
-                pDesc->height,
-                pDesc->stride,
-                bufDesc_1_1.pixelSize,
-                static_cast<uint32_t>(pDesc->format),
-                static_cast<uint32_t>(pDesc->usage),
-                bufDesc_1_1.bufferId,
-                bufDesc_1_1.buffer.nativeHandle
-            };
-
-            auto result = mStream->deliverFrame(bufDesc_1_0);
-            flag = result.isOk();
+        // the lock.  A frame that failed to convert is dropped; the converter
+        // has logged why.
+        if (!converted || !deliverFrame(bufDesc_1_1)) {
+            // Since we didn't actually deliver it, mark the frame as available
+            std::lock_guard<std::mutex> lock(mAccessLock);
+            releaseBuffer_Locked(idx);
+            mFramesInUse--;
         }
+    }
+}
 
-        if (flag) {
-            LOG(DEBUG) << "Delivered " << bufDesc_1_1.buffer.nativeHandle.getNativeHandle()
-                       << " as id " << bufDesc_1_1.bufferId;
-        } else {
-            // This can happen if the client dies and is likely unrecoverable.
-            // To avoid consuming resources generating failing calls, we stop sending
-            // frames.  Note, however, that the stream remains in the "STREAMING" state
-            // until cleaned up on the main thread.
-            LOG(ERROR) << "Frame delivery call failed in the transport layer.";
 
-            // Since we didn't actually deliver it, mark the frame as available
-            std::lock_guard<std::mutex> lock(mAccessLock);
-            mBuffers[idx].inUse = false;
+void EvsV4lCamera::logFirstFrame() {
+    const int64_t streamStartTime = mStreamStartTime.exchange(0);
+    if (streamStartTime == 0) {
+        // Not the first frame of this stream
+        return;
+    }
 
-            mFramesInUse--;
+    const int64_t now = android::elapsedRealtimeNano();
+    LOG(INFO) << mDescription.v1.cameraId << ": the first frame arrived "
+              << (now - streamStartTime) / 1000000.0 << " ms after the stream started and "
+              << (now - mOpenTime) / 1000000.0 << " ms after the device was opened.";
+}
+
+
+// Sends a capture buffer to the client as it is; used instead of forwardFrame()
+// when the output format matches the capture format.  The V4L2 buffer stays
+// dequeued until the client returns it.
+void EvsV4lCamera::forwardDmaBuf(imageBuffer* pV4lBuff) {
+    const unsigned index = pV4lBuff->index;
+
+    // Lock scope for updating shared state
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+
+        // Are we allowed to issue another buffer?
+        if (mFramesInUse >= mFramesAllowed || mDmaBufInUse[index]) {
+            // Can't do anything right now -- skip this frame
+            LOG(WARNING) << "Skipped a frame because too many are in flight";
+            mVideo.markFrameConsumed(index);
+            return;
         }
+
+        // We're going to make the frame busy
+        mDmaBufInUse[index] = true;
+        mFramesInUse++;
+    }
+
+    // Describe the capture buffer as it was written by the driver
+    BufferDesc_1_1 bufDesc_1_1 = {};
+    AHardwareBuffer_Desc* pDesc =
+        reinterpret_cast<AHardwareBuffer_Desc *>(&bufDesc_1_1.buffer.description);
+    pDesc->width  = mVideo.getWidth();
+    pDesc->height = mVideo.getHeight();
+    pDesc->layers = 1;
+    pDesc->format = mFormat;
+    pDesc->usage  = mUsage;
+    pDesc->stride = mFormat == HAL_PIXEL_FORMAT_YCBCR_422_I ?
+                    mVideo.getStride() / 2 : mVideo.getStride();
+    bufDesc_1_1.buffer.nativeHandle = mDmaBufHandles[index];
+    bufDesc_1_1.bufferId = kDmaBufIdFlag | index;
+    bufDesc_1_1.deviceId = mDescription.v1.cameraId;
+    // timestamp in microseconds.
+    bufDesc_1_1.timestamp =
+        pV4lBuff->timestamp.tv_sec * 1000000LL + pV4lBuff->timestamp.tv_usec;
+
+    // Nothing to convert; the frame is ready as soon as it is described
+    mVideo.markFrameConverted(index);
+
+    if (!deliverFrame(bufDesc_1_1)) {
+        // Since we didn't actually deliver it, give the buffer back to the device
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        mDmaBufInUse[index] = false;
+        mFramesInUse--;
+        mVideo.markFrameConsumed(index);
     }
 }
 
 
+bool EvsV4lCamera::deliverFrame(const BufferDesc_1_1& bufDesc_1_1) {
+    const AHardwareBuffer_Desc* pDesc =
+        reinterpret_cast<const AHardwareBuffer_Desc *>(&bufDesc_1_1.buffer.description);
+
+    bool flag = false;
+    if (mStream_1_1 != nullptr) {
+        hidl_vec<BufferDesc_1_1> frames;
+        frames.resize(1);
+        frames[0] = bufDesc_1_1;
+        auto result = mStream_1_1->deliverFrame_1_1(frames);
+        flag = result.isOk();
+    } else {
+        BufferDesc_1_0 bufDesc_1_0 = {
+            pDesc->width,
+            pDesc->height,
+            pDesc->stride,
+            bufDesc_1_1.pixelSize,
+            static_cast<uint32_t>(pDesc->format),
+            static_cast<uint32_t>(pDesc->usage),
+            (readGeneration(bufDesc_1_1.metadata) << kBufferIndexBits) | bufDesc_1_1.bufferId,
+            bufDesc_1_1.buffer.nativeHandle
+        };
+
+        auto result = mStream->deliverFrame(bufDesc_1_0);
+        flag = result.isOk();
+    }
+
+    if (flag) {
+        LOG(DEBUG) << "Delivered " << bufDesc_1_1.buffer.nativeHandle.getNativeHandle()
+                   << " as id " << bufDesc_1_1.bufferId;
+    } else {
+        // This can happen if the client dies and is likely unrecoverable.
+        // To avoid consuming resources generating failing calls, we stop sending
+        // frames.  Note, however, that the stream remains in the "STREAMING" state
+        // until cleaned up on the main thread.
+        LOG(ERROR) << "Frame delivery call failed in the transport layer.";
+    }
+
+    return flag;
+}
+
+
 bool EvsV4lCamera::convertToV4l2CID(CameraParam id, uint32_t& v4l2cid) {
     switch (id) {
         case CameraParam::BRIGHTNESS:
@@ -877,7 +1080,50 @@ sp<EvsV4lCamera> EvsV4lCamera::Create(const char *deviceName) {
 sp<EvsV4lCamera> EvsV4lCamera::Create(const char *deviceName,
                                       unique_ptr<ConfigManager::CameraInfo> &camInfo,
                                       const Stream *requestedStreamCfg) {
+    return CreateWithStreamId(deviceName, camInfo,
+                              selectStreamConfiguration(camInfo, requestedStreamCfg));
+}
+
+
+int32_t EvsV4lCamera::selectStreamConfiguration(unique_ptr<ConfigManager::CameraInfo> &camInfo,
+                                                const Stream *requestedStreamCfg) {
+    if (camInfo == nullptr || requestedStreamCfg == nullptr) {
+        return -1;
+    }
+
+    // Validate a given stream configuration.  If there is no exact match,
+    // this will try to find the best match based on:
+    // 1) same output format
+    // 2) the largest resolution that is smaller that a given configuration.
+    int32_t streamId = -1, area = INT_MIN;
+    for (auto& [id, cfg] : camInfo->streamConfigurations) {
+        // RawConfiguration has id, width, height, format, direction, and
+        // fps.
+        if (cfg[3] == static_cast<uint32_t>(requestedStreamCfg->format)) {
+            if (cfg[1] == requestedStreamCfg->width &&
+                cfg[2] == requestedStreamCfg->height) {
+                // Find exact match.
+                streamId = id;
+                break;
+            } else if (requestedStreamCfg->width  > cfg[1] &&
+                       requestedStreamCfg->height > cfg[2] &&
+                       cfg[1] * cfg[2] > area) {
+                streamId = id;
+                area = cfg[1] * cfg[2];
+            }
+        }
+
+    }
+
+    return streamId;
+}
+
+
+sp<EvsV4lCamera> EvsV4lCamera::CreateWithStreamId(const char *deviceName,
+                                                  unique_ptr<ConfigManager::CameraInfo> &camInfo,
+                                                  int32_t streamId) {
     LOG(INFO) << "Create " << deviceName;
+    const int64_t openStart = android::elapsedRealtimeNano();
     sp<EvsV4lCamera> evsCamera = new EvsV4lCamera(deviceName, camInfo);
     if (evsCamera == nullptr) {
         return nullptr;
@@ -885,41 +1131,21 @@ sp<EvsV4lCamera> EvsV4lCamera::Create(const char *deviceName,
 
     // Initialize the video device
     bool success = false;
-    if (camInfo != nullptr && requestedStreamCfg != nullptr) {
-        // Validate a given stream configuration.  If there is no exact match,
-        // this will try to find the best match based on:
-        // 1) same output format
-        // 2) the largest resolution that is smaller that a given configuration.
-        int32_t streamId = -1, area = INT_MIN;
-        for (auto& [id, cfg] : camInfo->streamConfigurations) {
-            // RawConfiguration has id, width, height, format, direction, and
-            // fps.
-            if (cfg[3] == static_cast<uint32_t>(requestedStreamCfg->format)) {
-                if (cfg[1] == requestedStreamCfg->width &&
-                    cfg[2] == requestedStreamCfg->height) {
-                    // Find exact match.
-                    streamId = id;
-                    break;
-                } else if (requestedStreamCfg->width  > cfg[1] &&
-                           requestedStreamCfg->height > cfg[2] &&
-                           cfg[1] * cfg[2] > area) {
-                    streamId = id;
-                    area = cfg[1] * cfg[2];
-                }
-            }
-
-        }
-
-        if (streamId >= 0) {
-            LOG(INFO) << "Try to open a video with "
-                      << "width: " << camInfo->streamConfigurations[streamId][1]
-                      << ", height: " << camInfo->streamConfigurations[streamId][2]
-                      << ", format: " << camInfo->streamConfigurations[streamId][3];
-            success =
-                evsCamera->mVideo.open(deviceName,
-                                       camInfo->streamConfigurations[streamId][1],
-                                       camInfo->streamConfigurations[streamId][2]);
-            evsCamera->mFormat = static_cast<uint32_t>(camInfo->streamConfigurations[streamId][3]);
+    if (camInfo != nullptr && streamId >= 0) {
+        LOG(INFO) << "Try to open a video with "
+                  << "width: " << camInfo->streamConfigurations[streamId][1]
+                  << ", height: " << camInfo->streamConfigurations[streamId][2]
+                  << ", format: " << camInfo->streamConfigurations[streamId][3];
+        evsCamera->mFormat = static_cast<uint32_t>(camInfo->streamConfigurations[streamId][3]);
+        success =
+            evsCamera->mVideo.open(deviceName,
+                                   camInfo->streamConfigurations[streamId][1],
+                                   camInfo->streamConfigurations[streamId][2],
+                                   ConversionRegistry::get().getSourceFormats(evsCamera->mFormat));
+        if (success) {
+            evsCamera->mStreamId = streamId;
+            evsCamera->mOutputWidth = camInfo->streamConfigurations[streamId][1];
+            evsCamera->mOutputHeight = camInfo->streamConfigurations[streamId][2];
         }
     }
 
@@ -928,11 +1154,16 @@ sp<EvsV4lCamera> EvsV4lCamera::Create(const char *deviceName,
         // , HAL_PIXEL_FORMAT_RGBA_8888.
         LOG(INFO) << "Open a video with default parameters";
         success =
-            evsCamera->mVideo.open(deviceName, kDefaultResolution[0], kDefaultResolution[1]);
+            evsCamera->mVideo.open(deviceName, kDefaultResolution[0], kDefaultResolution[1],
+                                   ConversionRegistry::get().getSourceFormats(evsCamera->mFormat));
         if (!success) {
             LOG(ERROR) << "Failed to open a video stream";
             return nullptr;
         }
+
+        // Deliver frames at whatever resolution the device settled on
+        evsCamera->mOutputWidth = evsCamera->mVideo.getWidth();
+        evsCamera->mOutputHeight = evsCamera->mVideo.getHeight();
     }
 
     // List available camera parameters
@@ -944,6 +1175,10 @@ sp<EvsV4lCamera> EvsV4lCamera::Create(const char *deviceName,
                          GRALLOC_USAGE_SW_READ_RARELY |
                          GRALLOC_USAGE_SW_WRITE_OFTEN;
 
+    evsCamera->mOpenTime = android::elapsedRealtimeNano();
+    LOG(INFO) << deviceName << " is opened in "
+              << (evsCamera->mOpenTime - openStart) / 1000000.0 << " ms.";
+
     return evsCamera;
 }
 
@@ -24,10 +24,13 @@
 #include <android/hardware/camera/device/3.2/ICameraDevice.h>
 #include <ui/GraphicBuffer.h>
 
+#include <atomic>
 #include <functional>
 #include <thread>
 #include <set>
 
+#include "BandConverter.h"
+#include "ConversionRegistry.h"
 #include "VideoCapture.h"
 #include "ConfigManager.h"
 
@@ -56,6 +59,13 @@ class EvsEnumerator;
 
 class EvsV4lCamera : public IEvsCamera {
 public:
+    // getExtendedInfo_1_1() returns the capture timing of this camera for this
+    // identifier as an array of int64_t values: frames captured, frames dropped,
+    // mean frame interval, jitter, maximum frame interval, mean dequeue latency
+    // and mean conversion time, all in nanoseconds, followed by the counts of
+    // the conversion time histogram described in CaptureStats.
+    static const uint32_t kCaptureStatsInfoId = 0x80000100;
+
     // Methods from ::android::hardware::automotive::evs::V1_0::IEvsCamera follow.
     Return<void>      getCameraInfo(getCameraInfo_cb _hidl_cb)  override;
     Return<EvsResult> setMaxFramesInFlight(uint32_t bufferCount) override;
@@ -93,6 +103,14 @@ public:
     static sp<EvsV4lCamera> Create(const char *deviceName,
                                    unique_ptr<ConfigManager::CameraInfo> &camInfo,
                                    const Stream *streamCfg = nullptr);
+    static sp<EvsV4lCamera> CreateWithStreamId(const char *deviceName,
+                                               unique_ptr<ConfigManager::CameraInfo> &camInfo,
+                                               int32_t streamId);
+
+    // Returns the identifier of the configured stream that Create() would open
+    // for a given request, or -1 if the default resolution would be used.
+    static int32_t selectStreamConfiguration(unique_ptr<ConfigManager::CameraInfo> &camInfo,
+                                             const Stream *streamCfg);
     EvsV4lCamera(const EvsV4lCamera&) = delete;
     EvsV4lCamera& operator=(const EvsV4lCamera&) = delete;
 
@@ -100,18 +118,25 @@ public:
     void shutdown();
 
     const CameraDesc& getDesc() { return mDescription; };
+    int32_t getStreamId() const { return mStreamId; };
+    CaptureStats getCaptureStats() { return mVideo.getCaptureStats(); };
 
 private:
     // Constructors
     EvsV4lCamera(const char *deviceName,
                  unique_ptr<ConfigManager::CameraInfo> &camInfo);
 
-    // These three functions are expected to be called while mAccessLock is held
+    // These functions are expected to be called while mAccessLock is held
     bool setAvailableFrames_Locked(unsigned bufferCount);
     unsigned increaseAvailableFrames_Locked(unsigned numToAdd);
     unsigned decreaseAvailableFrames_Locked(unsigned numToRemove);
+    void storeBuffer_Locked(buffer_handle_t handle);
+    void releaseBuffer_Locked(unsigned idx);
 
     void forwardFrame(imageBuffer* tgt, void* data);
+    void forwardDmaBuf(imageBuffer* tgt);
+    bool deliverFrame(const BufferDesc_1_1& bufDesc);
+    void logFirstFrame();
     inline bool convertToV4l2CID(CameraParam id, uint32_t& v4l2cid);
 
     sp <IEvsCameraStream_1_0> mStream     = nullptr;  // The callback used to deliver each frame
@@ -123,26 +148,50 @@ private:
     uint32_t mFormat = 0;           // Values from android_pixel_format_t
     uint32_t mUsage  = 0;           // Values from from Gralloc.h
     uint32_t mStride = 0;           // Pixels per row (may be greater than image width)
+    int32_t  mStreamId = -1;        // Configured stream opened, or -1 for the default
+    uint32_t mOutputWidth  = 0;     // Size of our output buffers; the captured
+    uint32_t mOutputHeight = 0;     // frames are cropped and scaled to fit
+
+    // Time-to-first-frame measurement; values from elapsedRealtimeNano()
+    int64_t               mOpenTime = 0;
+    std::atomic<int64_t>  mStreamStartTime = 0;     // Cleared by the first frame
 
     struct BufferRecord {
         buffer_handle_t handle;
         bool inUse;
+        uint32_t generation;    // Bumped each time the buffer is sent out; never 0 once sent
 
-        explicit BufferRecord(buffer_handle_t h) : handle(h), inUse(false) {};
+        explicit BufferRecord(buffer_handle_t h) : handle(h), inUse(false), generation(0) {};
     };
 
     std::vector <BufferRecord> mBuffers;    // Graphics buffers to transfer images
+    std::vector <unsigned> mFreeBuffers;    // Indices of idle records holding a buffer
+    std::vector <unsigned> mEmptySlots;     // Indices of records without a buffer
     unsigned mFramesAllowed;                // How many buffers are we currently using
     unsigned mFramesInUse;                  // How many buffers are currently outstanding
 
     std::set<uint32_t> mCameraControls;     // Available camera controls
 
-    // Which format specific function we need to use to move camera imagery into our output buffers
-    void(*mFillBufferFromVideo)(const BufferDesc& tgtBuff, uint8_t* tgt,
-                                void* imgData, unsigned imgStride);
+    // Capture buffers exported by mVideo and wrapped for delivery to the client
+    // when frames are passed through without a copy
+    std::atomic<bool> mZeroCopy = false;
+    std::vector<native_handle_t*> mDmaBufHandles;
+    std::vector<bool> mDmaBufInUse;
+
+    // How camera imagery is moved into our output buffers, and the part of each
+    // captured frame that is used
+    Conversion  mConversion;
+    SourceFrame mSourceFrame;
+
+    // Splits each conversion across worker threads; null if the camera is
+    // configured to convert on the capture thread only
+    std::unique_ptr<BandConverter> mBandConverter;
 
 
-    EvsResult doneWithFrame_impl(const uint32_t id, const buffer_handle_t handle);
+    // A non-zero generation, when the client passes one back, rejects a late
+    // return of an earlier frame in the same buffer
+    EvsResult doneWithFrame_impl(const uint32_t id, const buffer_handle_t handle,
+                                 const uint32_t generation);
 
     // Synchronization necessary to deconflict the capture thread from the main service thread
     // Note that the service interface remains single threaded (ie: not reentrant)
@@ -15,6 +15,8 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <algorithm>
+#include <cinttypes>
 #include <error.h>
 #include <errno.h>
 #include <iomanip>
@@ -23,8 +25,10 @@
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <time.h>
 
 #include <android-base/logging.h>
+#include <android-base/stringprintf.h>
 
 #include "assert.h"
 
@@ -35,7 +39,8 @@
 //        during the resource setup phase.  Of particular note is the potential to leak
 //        the file descriptor.  This must be fixed before using this code for anything but
 //        experimentation.
-bool VideoCapture::open(const char* deviceName, const int32_t width, const int32_t height) {
+bool VideoCapture::open(const char* deviceName, const int32_t width, const int32_t height,
+                        const std::vector<uint32_t>& preferredFormats) {
     // If we want a polling interface for getting frames, we would use O_NONBLOCK
 //    int mDeviceFd = open(deviceName, O_RDWR | O_NONBLOCK, 0);
     mDeviceFd = ::open(deviceName, O_RDWR, 0);
@@ -65,11 +70,13 @@ bool VideoCapture::open(const char* deviceName, const int32_t width, const int32
 
     // Enumerate the available capture formats (if any)
     LOG(INFO) << "Supported capture formats:";
+    std::vector<uint32_t> supportedFormats;
     v4l2_fmtdesc formatDescriptions;
     formatDescriptions.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     for (int i=0; true; i++) {
         formatDescriptions.index = i;
         if (ioctl(mDeviceFd, VIDIOC_ENUM_FMT, &formatDescriptions) == 0) {
+            supportedFormats.emplace_back(formatDescriptions.pixelformat);
             LOG(INFO) << "  " << std::setw(2) << i
                       << ": " << formatDescriptions.description
                       << " " << std::hex << std::setw(8) << formatDescriptions.pixelformat
@@ -92,6 +99,13 @@ bool VideoCapture::open(const char* deviceName, const int32_t width, const int32
     v4l2_format format;
     format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     format.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
+    for (auto&& candidate : preferredFormats) {
+        if (std::find(supportedFormats.begin(), supportedFormats.end(), candidate) !=
+                supportedFormats.end()) {
+            format.fmt.pix.pixelformat = candidate;
+            break;
+        }
+    }
     format.fmt.pix.width = width;
     format.fmt.pix.height = height;
     LOG(INFO) << "Requesting format: "
@@ -125,7 +139,9 @@ bool VideoCapture::open(const char* deviceName, const int32_t width, const int32
 
     // Make sure we're initialized to the STOPPED state
     mRunMode = STOPPED;
-    mFrames.clear();
+    mFrameHeld = nullptr;
+    mNumFramesHeld = 0;
+    mLatestFrame = -1;
 
     // Ready to go!
     return true;
@@ -145,7 +161,9 @@ void VideoCapture::close() {
 }
 
 
-bool VideoCapture::startStream(std::function<void(VideoCapture*, imageBuffer*, void*)> callback) {
+bool VideoCapture::startStream(std::function<void(VideoCapture*, imageBuffer*, void*)> callback,
+                               unsigned numBuffers,
+                               bool exportBuffers) {
     // Set the state of our background thread
     int prevRunMode = mRunMode.fetch_or(RUN);
     if (prevRunMode & RUN) {
@@ -158,7 +176,7 @@ bool VideoCapture::startStream(std::function<void(VideoCapture*, imageBuffer*, v
     v4l2_requestbuffers bufrequest;
     bufrequest.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     bufrequest.memory = V4L2_MEMORY_MMAP;
-    bufrequest.count = 1;
+    bufrequest.count = std::max(numBuffers, 1u);
     if (ioctl(mDeviceFd, VIDIOC_REQBUFS, &bufrequest) < 0) {
         PLOG(ERROR) << "VIDIOC_REQBUFS failed";
         return false;
@@ -167,6 +185,21 @@ bool VideoCapture::startStream(std::function<void(VideoCapture*, imageBuffer*, v
     mNumBuffers = bufrequest.count;
     mBufferInfos = std::make_unique<v4l2_buffer[]>(mNumBuffers);
     mPixelBuffers = std::make_unique<void *[]>(mNumBuffers);
+    mFrameHeld = std::make_unique<std::atomic<bool>[]>(mNumBuffers);
+    mNumFramesHeld = 0;
+    mLatestFrame = -1;
+
+    // Start a new timing history for this stream
+    {
+        std::lock_guard<std::mutex> lock(mStatsLock);
+        memset(mTimingHistory, 0, sizeof(mTimingHistory));
+        memset(mConversionHistogram, 0, sizeof(mConversionHistogram));
+        mTimingSlots.assign(mNumBuffers, -1);
+        mFramesCaptured = 0;
+        mFramesDropped = 0;
+        mFramesConverted = 0;
+        mTotalConversionNs = 0;
+    }
 
     for (int i = 0; i < mNumBuffers; ++i) {
       // Get the information on the buffer that was created for us
@@ -210,6 +243,12 @@ bool VideoCapture::startStream(std::function<void(VideoCapture*, imageBuffer*, v
         }
     }
 
+    // Share the buffers as DMABUFs if requested; the mapped pointers above
+    // remain valid either way so callers can still copy out of them.
+    if (exportBuffers && !exportDmaBufs()) {
+        LOG(WARNING) << "Failed to export capture buffers; they will be copied instead";
+    }
+
     // Start the video stream
     const int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     if (ioctl(mDeviceFd, VIDIOC_STREAMON, &type) < 0) {
@@ -234,6 +273,11 @@ void VideoCapture::stopStream() {
     if (prevRunMode == STOPPED) {
         // The background thread wasn't running, so set the flag back to STOPPED
         mRunMode = STOPPED;
+
+        // The thread may have ended by itself on a capture error
+        if (mCaptureThread.joinable()) {
+            mCaptureThread.join();
+        }
     } else if (prevRunMode & STOPPING) {
         LOG(ERROR) << "stopStream called while stream is already stopping.  "
                    << "Reentrancy is not supported!";
@@ -253,6 +297,9 @@ void VideoCapture::stopStream() {
         LOG(DEBUG) << "Capture thread stopped.";
     }
 
+    // Exported buffers must be closed before the driver can release them
+    closeDmaBufs();
+
     for (int i = 0; i < mNumBuffers; ++i) {
         // Unmap the buffers we allocated
         munmap(mPixelBuffers[i], mBufferInfos[i].length);
@@ -268,32 +315,86 @@ void VideoCapture::stopStream() {
     // Drop our reference to the frame delivery callback interface
     mCallback = nullptr;
 
+    // Stop tracking held buffers but keep the timing history so it can still
+    // be reported
+    {
+        std::lock_guard<std::mutex> lock(mStatsLock);
+        mTimingSlots.clear();
+    }
+
     // Release capture buffers
+    mLatestFrame = -1;
+    mNumFramesHeld = 0;
     mNumBuffers = 0;
     mBufferInfos = nullptr;
     mPixelBuffers = nullptr;
+    mFrameHeld = nullptr;
 }
 
 
 bool VideoCapture::returnFrame(int id) {
-    if (mFrames.find(id) == mFrames.end()) {
+    // Only one caller can win the exchange, so a buffer is never queued twice
+    bool held = true;
+    if (id < 0 || id >= mNumBuffers ||
+        !mFrameHeld[id].compare_exchange_strong(held, false, std::memory_order_acq_rel)) {
         LOG(WARNING) << "Invalid request to return a buffer " << id << " is ignored.";
         return false;
     }
 
+    // Stop advertising this buffer before the driver starts writing into it
+    int latest = id;
+    mLatestFrame.compare_exchange_strong(latest, -1, std::memory_order_acq_rel);
+    mNumFramesHeld.fetch_sub(1, std::memory_order_acq_rel);
+
     // Requeue the buffer to capture the next available frame
     if (ioctl(mDeviceFd, VIDIOC_QBUF, &mBufferInfos[id]) < 0) {
         PLOG(ERROR) << "VIDIOC_QBUF failed";
         return false;
     }
 
-    // Remove ID of returned buffer from the set
-    mFrames.erase(id);
+    return true;
+}
+
+
+bool VideoCapture::exportDmaBufs() {
+    mDmaBufFds = std::make_unique<int[]>(mNumBuffers);
+    for (int i = 0; i < mNumBuffers; ++i) {
+        mDmaBufFds[i] = -1;
+    }
+
+    for (int i = 0; i < mNumBuffers; ++i) {
+        v4l2_exportbuffer expbuf = {};
+        expbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        expbuf.index = i;
+        expbuf.flags = O_RDONLY | O_CLOEXEC;
+        if (ioctl(mDeviceFd, VIDIOC_EXPBUF, &expbuf) < 0) {
+            PLOG(WARNING) << "VIDIOC_EXPBUF failed for buffer " << i;
+            closeDmaBufs();
+            return false;
+        }
+
+        mDmaBufFds[i] = expbuf.fd;
+        LOG(INFO) << "Buffer " << i << " exported as fd " << expbuf.fd;
+    }
 
     return true;
 }
 
 
+void VideoCapture::closeDmaBufs() {
+    if (mDmaBufFds == nullptr) {
+        return;
+    }
+
+    for (int i = 0; i < mNumBuffers; ++i) {
+        if (mDmaBufFds[i] >= 0) {
+            ::close(mDmaBufFds[i]);
+        }
+    }
+    mDmaBufFds = nullptr;
+}
+
+
 // This runs on a background thread to receive and dispatch video frames
 void VideoCapture::collectFrames() {
     // Run until our atomic signal is cleared
@@ -309,10 +410,15 @@ void VideoCapture::collectFrames() {
             break;
         }
 
-        mFrames.insert(buf.index);
-
         // Update a frame metadata
         mBufferInfos[buf.index] = buf;
+        recordFrameTiming(buf);
+
+        // Publish the frame; the release ordering makes the metadata above
+        // visible to whichever thread returns this buffer
+        mFrameHeld[buf.index].store(true, std::memory_order_release);
+        mNumFramesHeld.fetch_add(1, std::memory_order_acq_rel);
+        mLatestFrame.store(buf.index, std::memory_order_release);
 
         // If a callback was requested per frame, do that now
         if (mCallback) {
@@ -326,6 +432,141 @@ void VideoCapture::collectFrames() {
 }
 
 
+static int64_t monotonicTimeNs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+
+// Called on the capture thread as each frame is dequeued
+void VideoCapture::recordFrameTiming(const v4l2_buffer& buf) {
+    const int64_t dequeueTime = monotonicTimeNs();
+
+    std::lock_guard<std::mutex> lock(mStatsLock);
+    if (mFramesCaptured > 0) {
+        const FrameTiming& prev = mTimingHistory[(mFramesCaptured - 1) % kTimingHistorySize];
+        const uint32_t gap = buf.sequence - prev.sequence;
+        if (gap > 1) {
+            mFramesDropped += gap - 1;
+        }
+    }
+
+    const int slot = mFramesCaptured % kTimingHistorySize;
+    FrameTiming& entry = mTimingHistory[slot];
+    entry.sequence = buf.sequence;
+    entry.driverTimestamp = buf.timestamp.tv_sec * 1000000000LL + buf.timestamp.tv_usec * 1000LL;
+    entry.dequeueTime = dequeueTime;
+    entry.convertedTime = 0;
+
+    if (buf.index < mTimingSlots.size()) {
+        mTimingSlots[buf.index] = slot;
+    }
+    mMonotonicTimestamps = (buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) ==
+                           V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+    ++mFramesCaptured;
+}
+
+
+void VideoCapture::markFrameConverted(int id) {
+    const int64_t convertedTime = monotonicTimeNs();
+
+    std::lock_guard<std::mutex> lock(mStatsLock);
+    if (id < 0 || id >= static_cast<int>(mTimingSlots.size()) || mTimingSlots[id] < 0) {
+        return;
+    }
+
+    // The slot may have been reused if this buffer was held for a long time
+    FrameTiming& entry = mTimingHistory[mTimingSlots[id]];
+    mTimingSlots[id] = -1;
+    if (entry.sequence != mBufferInfos[id].sequence || entry.convertedTime != 0) {
+        return;
+    }
+    entry.convertedTime = convertedTime;
+
+    const int64_t elapsed = convertedTime - entry.dequeueTime;
+    int bucket = 0;
+    for (int64_t limit = 1000000; elapsed >= limit &&
+         bucket < CaptureStats::kNumConversionBuckets - 1; limit *= 2) {
+        ++bucket;
+    }
+    ++mConversionHistogram[bucket];
+    mTotalConversionNs += elapsed;
+    ++mFramesConverted;
+}
+
+
+CaptureStats VideoCapture::getCaptureStats() {
+    CaptureStats stats;
+
+    std::lock_guard<std::mutex> lock(mStatsLock);
+    stats.framesCaptured = mFramesCaptured;
+    stats.framesDropped = mFramesDropped;
+    memcpy(stats.conversionHistogram, mConversionHistogram, sizeof(mConversionHistogram));
+    if (mFramesConverted > 0) {
+        stats.meanConversionNs = mTotalConversionNs / static_cast<int64_t>(mFramesConverted);
+    }
+
+    // Walk the history from the oldest frame still recorded
+    const uint64_t numFrames = std::min<uint64_t>(mFramesCaptured, kTimingHistorySize);
+    const uint64_t first = mFramesCaptured - numFrames;
+    int64_t totalLatency = 0;
+    for (uint64_t i = first; i < mFramesCaptured; ++i) {
+        const FrameTiming& entry = mTimingHistory[i % kTimingHistorySize];
+        totalLatency += entry.dequeueTime - entry.driverTimestamp;
+    }
+    if (numFrames > 0 && mMonotonicTimestamps) {
+        stats.meanDequeueLatencyNs = totalLatency / static_cast<int64_t>(numFrames);
+    }
+
+    if (numFrames < 2) {
+        return stats;
+    }
+
+    const int64_t numIntervals = numFrames - 1;
+    const int64_t span = mTimingHistory[(mFramesCaptured - 1) % kTimingHistorySize].driverTimestamp -
+                         mTimingHistory[first % kTimingHistorySize].driverTimestamp;
+    stats.meanIntervalNs = span / numIntervals;
+
+    int64_t totalDeviation = 0;
+    for (uint64_t i = first + 1; i < mFramesCaptured; ++i) {
+        const int64_t interval = mTimingHistory[i % kTimingHistorySize].driverTimestamp -
+                                 mTimingHistory[(i - 1) % kTimingHistorySize].driverTimestamp;
+        stats.maxIntervalNs = std::max(stats.maxIntervalNs, interval);
+        totalDeviation += std::abs(interval - stats.meanIntervalNs);
+    }
+    stats.jitterNs = totalDeviation / numIntervals;
+
+    return stats;
+}
+
+
+std::string CaptureStats::toString() const {
+    using android::base::StringAppendF;
+
+    std::string out;
+    StringAppendF(&out, "frames captured: %" PRIu64 ", dropped: %" PRIu64 "\n",
+                  framesCaptured, framesDropped);
+    StringAppendF(&out, "interval (us): mean %" PRId64 ", max %" PRId64 ", jitter %" PRId64 "\n",
+                  meanIntervalNs / 1000, maxIntervalNs / 1000, jitterNs / 1000);
+    StringAppendF(&out, "dequeue latency (us): mean %" PRId64 "\n",
+                  meanDequeueLatencyNs / 1000);
+    StringAppendF(&out, "conversion (us): mean %" PRId64 "\n", meanConversionNs / 1000);
+    for (int i = 0; i < kNumConversionBuckets; ++i) {
+        if (i == 0) {
+            StringAppendF(&out, "    < 1 ms: %u\n", conversionHistogram[i]);
+        } else if (i < kNumConversionBuckets - 1) {
+            StringAppendF(&out, "    %d-%d ms: %u\n", 1 << (i - 1), 1 << i,
+                          conversionHistogram[i]);
+        } else {
+            StringAppendF(&out, "    >= %d ms: %u\n", 1 << (i - 1), conversionHistogram[i]);
+        }
+    }
+
+    return out;
+}
+
+
 int VideoCapture::setParameter(v4l2_control& control) {
     int status = ioctl(mDeviceFd, VIDIOC_S_CTRL, &control);
     if (status < 0) {
@@ -18,20 +18,53 @@
 
 #include <atomic>
 #include <functional>
+#include <mutex>
 #include <set>
+#include <string>
 #include <thread>
+#include <vector>
 
 #include <linux/videodev2.h>
 
 typedef v4l2_buffer imageBuffer;
 
 
+// Capture timing measured over the frames in VideoCapture's timing history.
+// All durations are in nanoseconds.
+struct CaptureStats {
+    static const int kNumConversionBuckets = 8;
+
+    uint64_t framesCaptured = 0;    // Frames dequeued since the stream started
+    uint64_t framesDropped = 0;     // Gaps in the driver's sequence numbers
+    int64_t  meanIntervalNs = 0;    // Between driver timestamps of consecutive frames
+    int64_t  jitterNs = 0;          // Mean absolute deviation from meanIntervalNs
+    int64_t  maxIntervalNs = 0;
+    int64_t  meanDequeueLatencyNs = 0;  // Driver timestamp to DQBUF return
+    int64_t  meanConversionNs = 0;  // DQBUF return to the end of format conversion
+
+    // Conversion times since the stream started; bucket 0 counts frames
+    // converted in under 1 ms, bucket i in [2^(i-1), 2^i) ms, and the last
+    // bucket everything slower.
+    uint32_t conversionHistogram[kNumConversionBuckets] = {};
+
+    std::string toString() const;
+};
+
+
 class VideoCapture {
 public:
-    bool open(const char* deviceName, const int32_t width = 0, const int32_t height = 0);
+    // Captures in the first of preferredFormats the device supports, or in
+    // YUYV if none of them is supported
+    bool open(const char* deviceName, const int32_t width = 0, const int32_t height = 0,
+              const std::vector<uint32_t>& preferredFormats = {});
     void close();
 
-    bool startStream(std::function<void(VideoCapture*, imageBuffer*, void*)> callback = nullptr);
+    // When exportBuffers is true, each capture buffer is also exported as a
+    // DMABUF file descriptor so that it can be shared without a copy.  Export
+    // is best effort; use hasDmaBufs() to find out whether it worked.
+    bool startStream(std::function<void(VideoCapture*, imageBuffer*, void*)> callback = nullptr,
+                     unsigned numBuffers = 1,
+                     bool exportBuffers = false);
     void stopStream();
 
     // Valid only after open()
@@ -42,19 +75,29 @@ public:
 
     // NULL until stream is started
     void* getLatestData() {
-        if (mFrames.empty()) {
+        const int latestBufferId = mLatestFrame.load(std::memory_order_acquire);
+        if (latestBufferId < 0) {
             // No frame is available
             return nullptr;
         }
 
         // Return a pointer to the buffer captured most recently
-        const int latestBufferId = *mFrames.end();
         return mPixelBuffers[latestBufferId];
     }
 
-    bool isFrameReady()             { return !mFrames.empty(); }
+    // Valid only while the stream is running
+    int     getNumBuffers()     { return mNumBuffers; };
+    bool    hasDmaBufs()        { return mDmaBufFds != nullptr; };
+    int     getDmaBufFd(int id) { return hasDmaBufs() ? mDmaBufFds[id] : -1; };
+
+    bool isFrameReady()             { return mNumFramesHeld.load(std::memory_order_acquire) > 0; }
     void markFrameConsumed(int id)  { returnFrame(id); }
 
+    // Records that the contents of a dequeued buffer have been converted (or
+    // handed off as they are); call before markFrameConsumed()
+    void markFrameConverted(int id);
+    CaptureStats getCaptureStats();
+
     bool isOpen()                   { return mDeviceFd >= 0; }
 
     int setParameter(struct v4l2_control& control);
@@ -64,12 +107,16 @@ public:
 private:
     void collectFrames();
     bool returnFrame(int id);
+    bool exportDmaBufs();
+    void closeDmaBufs();
+    void recordFrameTiming(const v4l2_buffer& buf);
 
     int mDeviceFd = -1;
 
     int mNumBuffers = 0;
     std::unique_ptr<v4l2_buffer[]> mBufferInfos = nullptr;
     std::unique_ptr<void*[]>       mPixelBuffers = nullptr;
+    std::unique_ptr<int[]>         mDmaBufFds = nullptr;
 
     __u32   mFormat = 0;
     __u32   mWidth  = 0;
@@ -80,7 +127,33 @@ private:
 
     std::thread mCaptureThread;             // The thread we'll use to dispatch frames
     std::atomic<int> mRunMode;              // Used to signal the frame loop (see RunModes below)
-    std::set<int> mFrames;                  // Set of available frame buffers
+
+    // Frames dequeued from the driver and not yet returned.  The capture thread
+    // sets a buffer's flag and any thread may clear it in returnFrame(), so
+    // these are atomics rather than a shared container.
+    std::unique_ptr<std::atomic<bool>[]> mFrameHeld = nullptr;
+    std::atomic<int> mNumFramesHeld = 0;
+    std::atomic<int> mLatestFrame = -1;     // Most recently captured buffer, or -1
+
+    // Timing of the most recent frames, kept in a ring indexed by mFramesCaptured.
+    // Times are in nanoseconds; convertedTime is zero until the frame is converted.
+    struct FrameTiming {
+        uint32_t sequence;
+        int64_t  driverTimestamp;
+        int64_t  dequeueTime;
+        int64_t  convertedTime;
+    };
+    static const int kTimingHistorySize = 128;
+
+    std::mutex                  mStatsLock;
+    FrameTiming                 mTimingHistory[kTimingHistorySize] = {};
+    std::vector<int>            mTimingSlots;   // History slot of each held buffer, or -1
+    uint64_t                    mFramesCaptured = 0;
+    uint64_t                    mFramesDropped = 0;
+    bool                        mMonotonicTimestamps = false;
+    uint64_t                    mFramesConverted = 0;
+    int64_t                     mTotalConversionNs = 0;
+    uint32_t                    mConversionHistogram[CaptureStats::kNumConversionBuckets] = {};
 
     // Careful changing these -- we're using bit-wise ops to manipulate these
     enum RunModes {
@@ -16,6 +16,10 @@
 
 #include "bufferCopy.h"
 
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 
 namespace android {
 namespace hardware {
@@ -36,37 +40,209 @@ int align(int value) {
 }
 
 
-// Limit the given value to the provided range.  :)
-static inline float clamp(float v, float min, float max) {
-    if (v < min) return min;
-    if (v > max) return max;
-    return v;
+// Limit the given value to the 8-bit range.  :)
+static inline uint8_t clampToByte(int v) {
+    if (v < 0) return 0;
+    if (v > 255) return 255;
+    return static_cast<uint8_t>(v);
 }
 
 
-static uint32_t yuvToRgbx(const unsigned char Y, const unsigned char Uin, const unsigned char Vin) {
-    // Don't use this if you want to see the best performance.  :)
-    // Better to do this in a pixel shader if we really have to, but on actual
-    // embedded hardware we expect to be able to texture directly from the YUV data
-    float U = Uin - 128.0f;
-    float V = Vin - 128.0f;
+static inline uint32_t yuvToRgbx(const unsigned char Y, const unsigned char Uin, const unsigned char Vin) {
+    const int U = Uin - 128;
+    const int V = Vin - 128;
 
-    float Rf = Y + 1.140f*V;
-    float Gf = Y - 0.395f*U - 0.581f*V;
-    float Bf = Y + 2.032f*U;
-    unsigned char R = (unsigned char)clamp(Rf, 0.0f, 255.0f);
-    unsigned char G = (unsigned char)clamp(Gf, 0.0f, 255.0f);
-    unsigned char B = (unsigned char)clamp(Bf, 0.0f, 255.0f);
+    // Rounding shifts below match vrshrq_n_s16() of the vectorized kernels
+    constexpr int kRound = 1 << (kCoeffBits - 1);
+    const int R = Y + ((kCoeffRV * V + kRound) >> kCoeffBits);
+    const int G = Y - ((kCoeffGU * U + kCoeffGV * V + kRound) >> kCoeffBits);
+    const int B = Y + ((kCoeffBU * U + kRound) >> kCoeffBits);
 
-    return ((R & 0xFF))       |
-           ((G & 0xFF) << 8)  |
-           ((B & 0xFF) << 16) |
+    return (clampToByte(R))       |
+           (clampToByte(G) << 8)  |
+           (clampToByte(B) << 16) |
            0xFF000000;  // Fill the alpha channel with ones
 }
 
 
-void fillNV21FromNV21(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned) {
-    // The NV21 format provides a Y array of 8bit values, followed by a 1/2 x 1/2 interleave U/V array.
+// Scalar row kernels.  These handle the image edges that are not a multiple
+// of the vector width and act as the reference of the vectorized kernels.
+void convertRowYUYVToRGBA_C(const uint8_t* src, uint32_t* dst, unsigned width) {
+    for (unsigned c = 0; c < width/2; c++) {
+        // Note:  we're walking two pixels at a time here (even/odd)
+        const uint8_t Y1 = src[0];
+        const uint8_t U  = src[1];
+        const uint8_t Y2 = src[2];
+        const uint8_t V  = src[3];
+        src += 4;
+
+        // On the RGB output, we're writing one pixel at a time
+        *(dst+0) = yuvToRgbx(Y1, U, V);
+        *(dst+1) = yuvToRgbx(Y2, U, V);
+        dst += 2;
+    }
+}
+
+
+void convertRowsYUYVToNV21_C(const uint8_t* topSrc, const uint8_t* botSrc,
+                             uint8_t* yTopRow, uint8_t* yBotRow, uint8_t* uvRow,
+                             unsigned width) {
+    for (unsigned cellCol = 0; cellCol < width/2; cellCol++) {
+        // Collect the values from the YUYV interleaved data
+        const uint8_t* pTop = topSrc + cellCol*4;
+        const uint8_t* pBot = botSrc + cellCol*4;
+
+        // Store the Y values into the NV21 layout
+        yTopRow[cellCol*2]   = pTop[0];
+        yTopRow[cellCol*2+1] = pTop[2];
+        yBotRow[cellCol*2]   = pBot[0];
+        yBotRow[cellCol*2+1] = pBot[2];
+
+        // Down sample the V/U values by linear average between rows
+        uvRow[cellCol*2]     = (pTop[3] + pBot[3]) >> 1;
+        uvRow[cellCol*2+1]   = (pTop[1] + pBot[1]) >> 1;
+    }
+}
+
+
+void convertRowUYVYToYUYV_C(const uint8_t* src, uint8_t* dst, unsigned width) {
+    for (unsigned c = 0; c < width/2; c++) {
+        // Swap the bytes of each 16-bit pair
+        dst[0] = src[1];
+        dst[1] = src[0];
+        dst[2] = src[3];
+        dst[3] = src[2];
+        src += 4;
+        dst += 4;
+    }
+}
+
+
+#if defined(__ARM_NEON)
+// Vectorized row kernels; each iteration converts 16 pixels.  Columns beyond
+// the last multiple of 16 are handled by the scalar kernels.
+static inline void convertYUVToRGB_NEON(const int16x8_t Y,
+                                        const int16x8_t rv, const int16x8_t gv, const int16x8_t bv,
+                                        uint8x8_t* R, uint8x8_t* G, uint8x8_t* B) {
+    *R = vqmovun_s16(vaddq_s16(Y, rv));
+    *G = vqmovun_s16(vsubq_s16(Y, gv));
+    *B = vqmovun_s16(vaddq_s16(Y, bv));
+}
+
+
+unsigned convertRowYUYVToRGBA_NEON(const uint8_t* src, uint32_t* dst, unsigned width) {
+    const uint8x8_t bias = vdup_n_u8(128);
+    uint8x8x4_t out0, out1;
+    out0.val[3] = out1.val[3] = vdup_n_u8(0xFF);
+
+    unsigned c = 0;
+    for (; c + kPixelsPerVector <= width; c += kPixelsPerVector) {
+        // Deinterleaves 8 macro pixels into Y1, U, Y2, V lanes
+        const uint8x8x4_t yuyv = vld4_u8(src + c*2);
+        const int16x8_t U = vreinterpretq_s16_u16(vsubl_u8(yuyv.val[1], bias));
+        const int16x8_t V = vreinterpretq_s16_u16(vsubl_u8(yuyv.val[3], bias));
+
+        // Chroma contributions are shared by the even and the odd pixels
+        const int16x8_t rv = vrshrq_n_s16(vmulq_n_s16(V, kCoeffRV), kCoeffBits);
+        const int16x8_t gv = vrshrq_n_s16(vmlaq_n_s16(vmulq_n_s16(U, kCoeffGU), V, kCoeffGV),
+                                          kCoeffBits);
+        const int16x8_t bv = vrshrq_n_s16(vmulq_n_s16(U, kCoeffBU), kCoeffBits);
+
+        uint8x8_t R1, G1, B1, R2, G2, B2;
+        convertYUVToRGB_NEON(vreinterpretq_s16_u16(vmovl_u8(yuyv.val[0])), rv, gv, bv,
+                             &R1, &G1, &B1);
+        convertYUVToRGB_NEON(vreinterpretq_s16_u16(vmovl_u8(yuyv.val[2])), rv, gv, bv,
+                             &R2, &G2, &B2);
+
+        // Puts the even and the odd pixels back in order and stores them as RGBA
+        const uint8x8x2_t R = vzip_u8(R1, R2);
+        const uint8x8x2_t G = vzip_u8(G1, G2);
+        const uint8x8x2_t B = vzip_u8(B1, B2);
+        out0.val[0] = R.val[0]; out0.val[1] = G.val[0]; out0.val[2] = B.val[0];
+        out1.val[0] = R.val[1]; out1.val[1] = G.val[1]; out1.val[2] = B.val[1];
+        vst4_u8(reinterpret_cast<uint8_t*>(dst + c), out0);
+        vst4_u8(reinterpret_cast<uint8_t*>(dst + c + 8), out1);
+    }
+
+    return c;
+}
+
+
+unsigned convertRowsYUYVToNV21_NEON(const uint8_t* topSrc, const uint8_t* botSrc,
+                                    uint8_t* yTopRow, uint8_t* yBotRow, uint8_t* uvRow,
+                                    unsigned width) {
+    unsigned c = 0;
+    for (; c + kPixelsPerVector <= width; c += kPixelsPerVector) {
+        const uint8x8x4_t top = vld4_u8(topSrc + c*2);
+        const uint8x8x4_t bot = vld4_u8(botSrc + c*2);
+
+        // Y values are stored in the original pixel order
+        uint8x8x2_t out;
+        out.val[0] = top.val[0];
+        out.val[1] = top.val[2];
+        vst2_u8(yTopRow + c, out);
+        out.val[0] = bot.val[0];
+        out.val[1] = bot.val[2];
+        vst2_u8(yBotRow + c, out);
+
+        // Down sample the V/U values by linear average between rows
+        out.val[0] = vhadd_u8(top.val[3], bot.val[3]);
+        out.val[1] = vhadd_u8(top.val[1], bot.val[1]);
+        vst2_u8(uvRow + c, out);
+    }
+
+    return c;
+}
+
+
+unsigned convertRowUYVYToYUYV_NEON(const uint8_t* src, uint8_t* dst, unsigned width) {
+    unsigned c = 0;
+    for (; c + kPixelsPerVector <= width; c += kPixelsPerVector) {
+        vst1q_u8(dst + c*2,      vrev16q_u8(vld1q_u8(src + c*2)));
+        vst1q_u8(dst + c*2 + 16, vrev16q_u8(vld1q_u8(src + c*2 + 16)));
+    }
+
+    return c;
+}
+#endif  // __ARM_NEON
+
+
+// Converts a row with the vectorized kernel if available and finishes the
+// remaining pixels with the scalar kernel
+static void convertRowYUYVToRGBA(const uint8_t* src, uint32_t* dst, unsigned width) {
+    unsigned done = 0;
+#if defined(__ARM_NEON)
+    done = convertRowYUYVToRGBA_NEON(src, dst, width);
+#endif
+    convertRowYUYVToRGBA_C(src + done*2, dst + done, width - done);
+}
+
+
+static void convertRowsYUYVToNV21(const uint8_t* topSrc, const uint8_t* botSrc,
+                                  uint8_t* yTopRow, uint8_t* yBotRow, uint8_t* uvRow,
+                                  unsigned width) {
+    unsigned done = 0;
+#if defined(__ARM_NEON)
+    done = convertRowsYUYVToNV21_NEON(topSrc, botSrc, yTopRow, yBotRow, uvRow, width);
+#endif
+    convertRowsYUYVToNV21_C(topSrc + done*2, botSrc + done*2,
+                            yTopRow + done, yBotRow + done, uvRow + done,
+                            width - done);
+}
+
+
+static void convertRowUYVYToYUYV(const uint8_t* src, uint8_t* dst, unsigned width) {
+    unsigned done = 0;
+#if defined(__ARM_NEON)
+    done = convertRowUYVYToYUYV_NEON(src, dst, width);
+#endif
+    convertRowUYVYToYUYV_C(src + done*2, dst + done*2, width - done);
+}
+
+
+void fillNV21FromNV21(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned,
+                      unsigned startRow, unsigned endRow) {
+    // The NV21 format provides a Y array of 8bit values, followed by a 1/2 x 1/2 interleave V/U array.
     // It assumes an even width and height for the overall image, and a horizontal stride that is
     // an even multiple of 16 bytes for both the Y and UV arrays.
 
@@ -76,15 +252,19 @@ void fillNV21FromNV21(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, un
     const unsigned strideLum = align<16>(pDesc->width);
     const unsigned sizeY = strideLum * pDesc->height;
     const unsigned strideColor = strideLum;   // 1/2 the samples, but two interleaved channels
-    const unsigned sizeColor = strideColor * pDesc->height/2;
-    const unsigned totalBytes = sizeY + sizeColor;
-
-    // Simply copy the data byte for byte
-    memcpy(tgt, imgData, totalBytes);
+    const uint8_t* src = static_cast<const uint8_t*>(imgData);
+
+    // Simply copy the data byte for byte; luma rows first and then the chroma
+    // rows that belong to them
+    memcpy(tgt + startRow * strideLum, src + startRow * strideLum,
+           (endRow - startRow) * strideLum);
+    memcpy(tgt + sizeY + (startRow/2) * strideColor, src + sizeY + (startRow/2) * strideColor,
+           (endRow/2 - startRow/2) * strideColor);
 }
 
 
-void fillNV21FromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride) {
+void fillNV21FromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride,
+                      unsigned startRow, unsigned endRow) {
     // The YUYV format provides an interleaved array of pixel values with U and V subsampled in
     // the horizontal direction only.  Also known as interleaved 422 format.  A 4 byte
     // "macro pixel" provides the Y value for two adjacent pixels and the U and V values shared
@@ -93,13 +273,6 @@ void fillNV21FromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, un
     // to construct the NV21 format.
     // NV21 requires even width and height, so we assume that is the case for the incomming image
     // as well.
-    uint32_t *srcDataYUYV = (uint32_t*)imgData;
-    struct YUYVpixel {
-        uint8_t Y1;
-        uint8_t U;
-        uint8_t Y2;
-        uint8_t V;
-    };
 
     // Target image layout properties
     const AHardwareBuffer_Desc* pDesc =
@@ -109,130 +282,84 @@ void fillNV21FromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, un
     const unsigned strideColor = strideLum;   // 1/2 the samples, but two interleaved channels
 
     // Source image layout properties
-    const unsigned srcRowPixels = imgStride/4;  // imgStride is in units of bytes
-    const unsigned srcRowDoubleStep = srcRowPixels * 2;
-    uint32_t* topSrcRow =  srcDataYUYV;
-    uint32_t* botSrcRow =  srcDataYUYV + srcRowPixels;
+    const uint8_t* topSrcRow = static_cast<const uint8_t*>(imgData) + startRow * imgStride;
 
-    // We're going to work on one 2x2 cell in the output image at at time
-    for (unsigned cellRow = 0; cellRow < pDesc->height/2; cellRow++) {
+    // We're going to work on two rows of the output image at a time
+    for (unsigned cellRow = startRow/2; cellRow < endRow/2; cellRow++) {
 
         // Set up the output pointers
         uint8_t* yTopRow = tgt + (cellRow*2) * strideLum;
         uint8_t* yBotRow = yTopRow + strideLum;
         uint8_t* uvRow   = (tgt + sizeY) + cellRow * strideColor;
 
-        for (unsigned cellCol = 0; cellCol < pDesc->width/2; cellCol++) {
-            // Collect the values from the YUYV interleaved data
-            const YUYVpixel* pTopMacroPixel = (YUYVpixel*)&topSrcRow[cellCol];
-            const YUYVpixel* pBotMacroPixel = (YUYVpixel*)&botSrcRow[cellCol];
-
-            // Down sample the U/V values by linear average between rows
-            const uint8_t uValue = (pTopMacroPixel->U + pBotMacroPixel->U) >> 1;
-            const uint8_t vValue = (pTopMacroPixel->V + pBotMacroPixel->V) >> 1;
-
-            // Store the values into the NV21 layout
-            yTopRow[cellCol*2]   = pTopMacroPixel->Y1;
-            yTopRow[cellCol*2+1] = pTopMacroPixel->Y2;
-            yBotRow[cellCol*2]   = pBotMacroPixel->Y1;
-            yBotRow[cellCol*2+1] = pBotMacroPixel->Y2;
-            uvRow[cellCol*2]     = uValue;
-            uvRow[cellCol*2+1]   = vValue;
-        }
+        convertRowsYUYVToNV21(topSrcRow, topSrcRow + imgStride,
+                              yTopRow, yBotRow, uvRow, pDesc->width);
 
         // Skipping two rows to get to the next set of two source rows
-        topSrcRow += srcRowDoubleStep;
-        botSrcRow += srcRowDoubleStep;
+        topSrcRow += imgStride * 2;
     }
 }
 
 
-void fillRGBAFromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride) {
+void fillRGBAFromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride,
+                      unsigned startRow, unsigned endRow) {
     const AHardwareBuffer_Desc* pDesc =
         reinterpret_cast<const AHardwareBuffer_Desc*>(&tgtBuff.buffer.description);
     unsigned width = pDesc->width;
-    unsigned height = pDesc->height;
-    uint32_t* src = (uint32_t*)imgData;
-    uint32_t* dst = (uint32_t*)tgt;
-    unsigned srcStridePixels = imgStride / 2;
     unsigned dstStridePixels = pDesc->stride;
+    const uint8_t* src = static_cast<const uint8_t*>(imgData) + startRow * imgStride;
+    uint32_t* dst = (uint32_t*)tgt + startRow * dstStridePixels;
 
-    const int srcRowPadding32 = srcStridePixels/2 - width/2;  // 2 bytes per pixel, 4 bytes per word
-    const int dstRowPadding32 = dstStridePixels   - width;    // 4 bytes per pixel, 4 bytes per word
-
-    for (unsigned r=0; r<height; r++) {
-        for (unsigned c=0; c<width/2; c++) {
-            // Note:  we're walking two pixels at a time here (even/odd)
-            uint32_t srcPixel = *src++;
-
-            uint8_t Y1 = (srcPixel)       & 0xFF;
-            uint8_t U  = (srcPixel >> 8)  & 0xFF;
-            uint8_t Y2 = (srcPixel >> 16) & 0xFF;
-            uint8_t V  = (srcPixel >> 24) & 0xFF;
-
-            // On the RGB output, we're writing one pixel at a time
-            *(dst+0) = yuvToRgbx(Y1, U, V);
-            *(dst+1) = yuvToRgbx(Y2, U, V);
-            dst += 2;
-        }
+    for (unsigned r=startRow; r<endRow; r++) {
+        convertRowYUYVToRGBA(src, dst, width);
 
         // Skip over any extra data or end of row alignment padding
-        src += srcRowPadding32;
-        dst += dstRowPadding32;
+        src += imgStride;
+        dst += dstStridePixels;
     }
 }
 
 
-void fillYUYVFromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride) {
+void fillYUYVFromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride,
+                      unsigned startRow, unsigned endRow) {
     const AHardwareBuffer_Desc* pDesc =
         reinterpret_cast<const AHardwareBuffer_Desc*>(&tgtBuff.buffer.description);
     unsigned width = pDesc->width;
-    unsigned height = pDesc->height;
     uint8_t* src = (uint8_t*)imgData;
     uint8_t* dst = (uint8_t*)tgt;
     unsigned srcStrideBytes = imgStride;
     unsigned dstStrideBytes = pDesc->stride * 2;
 
-    for (unsigned r=0; r<height; r++) {
+    if (srcStrideBytes == dstStrideBytes && endRow > startRow) {
+        // Both images have the same layout so copy the rows at once
+        memcpy(dst + startRow*dstStrideBytes, src + startRow*srcStrideBytes,
+               dstStrideBytes * (endRow - startRow - 1) + width*2);
+        return;
+    }
+
+    for (unsigned r=startRow; r<endRow; r++) {
         // Copy a pixel row at a time (2 bytes per pixel, averaged over a YUYV macro pixel)
         memcpy(dst+r*dstStrideBytes, src+r*srcStrideBytes, width*2);
     }
 }
 
 
-void fillYUYVFromUYVY(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride) {
+void fillYUYVFromUYVY(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride,
+                      unsigned startRow, unsigned endRow) {
     const AHardwareBuffer_Desc* pDesc =
         reinterpret_cast<const AHardwareBuffer_Desc*>(&tgtBuff.buffer.description);
     unsigned width = pDesc->width;
-    unsigned height = pDesc->height;
-    uint32_t* src = (uint32_t*)imgData;
-    uint32_t* dst = (uint32_t*)tgt;
-    unsigned srcStridePixels = imgStride / 2;
-    unsigned dstStridePixels = pDesc->stride;
-
-    const int srcRowPadding32 = srcStridePixels/2 - width/2;  // 2 bytes per pixel, 4 bytes per word
-    const int dstRowPadding32 = dstStridePixels/2 - width/2;  // 2 bytes per pixel, 4 bytes per word
-
-    for (unsigned r=0; r<height; r++) {
-        for (unsigned c=0; c<width/2; c++) {
-            // Note:  we're walking two pixels at a time here (even/odd)
-            uint32_t srcPixel = *src++;
-
-            uint8_t Y1 = (srcPixel)       & 0xFF;
-            uint8_t U  = (srcPixel >> 8)  & 0xFF;
-            uint8_t Y2 = (srcPixel >> 16) & 0xFF;
-            uint8_t V  = (srcPixel >> 24) & 0xFF;
+    unsigned dstStrideBytes = pDesc->stride * 2;
+    const uint8_t* src = static_cast<const uint8_t*>(imgData) + startRow * imgStride;
+    uint8_t* dst = tgt + startRow * dstStrideBytes;
 
-            // Now we write back the pair of pixels with the components swizzled
-            *dst++ = (U)        |
-                     (Y1 << 8)  |
-                     (V  << 16) |
-                     (Y2 << 24);
-        }
+    for (unsigned r=startRow; r<endRow; r++) {
+        // Now we write back the pairs of pixels with the components swizzled
+        convertRowUYVYToYUYV(src, dst, width);
 
         // Skip over any extra data or end of row alignment padding
-        src += srcRowPadding32;
-        dst += dstRowPadding32;
+        src += imgStride;
+        dst += dstStrideBytes;
     }
 }
 
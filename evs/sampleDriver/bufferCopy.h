@@ -29,20 +29,66 @@ namespace V1_1 {
 namespace implementation {
 
 
+// BT.601 YUV to RGB coefficients in Q6 fixed point; 1.140, 0.395, 0.581, and
+// 2.032.  These are small enough that every intermediate value fits in 16
+// bits, so the vectorized and the scalar kernels produce identical results.
+// Every conversion into RGB uses these with a rounding shift by kCoeffBits.
+constexpr int kCoeffBits = 6;
+constexpr int kCoeffRV = 73;
+constexpr int kCoeffGU = 25;
+constexpr int kCoeffGV = 37;
+constexpr int kCoeffBU = 130;
+
+
+// Each function below converts the rows in [startRow, endRow) of the source
+// image into the target buffer.  Callers pass 0 and the image height to
+// convert a whole frame, or disjoint row bands to split a conversion across
+// threads.  Band boundaries must be even rows because NV21 chroma rows are
+// shared by two luma rows.  NV21 chroma is interleaved as V then U.
 void fillNV21FromNV21(const BufferDesc& tgtBuff, uint8_t* tgt,
-                      void* imgData, unsigned imgStride);
+                      void* imgData, unsigned imgStride,
+                      unsigned startRow, unsigned endRow);
 
 void fillNV21FromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt,
-                      void* imgData, unsigned imgStride);
+                      void* imgData, unsigned imgStride,
+                      unsigned startRow, unsigned endRow);
 
 void fillRGBAFromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt,
-                      void* imgData, unsigned imgStride);
+                      void* imgData, unsigned imgStride,
+                      unsigned startRow, unsigned endRow);
 
 void fillYUYVFromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt,
-                      void* imgData, unsigned imgStride);
+                      void* imgData, unsigned imgStride,
+                      unsigned startRow, unsigned endRow);
 
 void fillYUYVFromUYVY(const BufferDesc& tgtBuff, uint8_t* tgt,
-                      void* imgData, unsigned imgStride);
+                      void* imgData, unsigned imgStride,
+                      unsigned startRow, unsigned endRow);
+
+
+// Row kernels behind the functions above.  The scalar kernels convert whole
+// rows and are the reference of the vectorized kernels.  A vectorized kernel
+// converts the longest prefix of a row that is a multiple of
+// kPixelsPerVector pixels and returns the number of pixels it converted.
+void convertRowYUYVToRGBA_C(const uint8_t* src, uint32_t* dst, unsigned width);
+
+void convertRowsYUYVToNV21_C(const uint8_t* topSrc, const uint8_t* botSrc,
+                             uint8_t* yTopRow, uint8_t* yBotRow, uint8_t* uvRow,
+                             unsigned width);
+
+void convertRowUYVYToYUYV_C(const uint8_t* src, uint8_t* dst, unsigned width);
+
+#if defined(__ARM_NEON)
+constexpr unsigned kPixelsPerVector = 16;
+
+unsigned convertRowYUYVToRGBA_NEON(const uint8_t* src, uint32_t* dst, unsigned width);
+
+unsigned convertRowsYUYVToNV21_NEON(const uint8_t* topSrc, const uint8_t* botSrc,
+                                    uint8_t* yTopRow, uint8_t* yBotRow, uint8_t* uvRow,
+                                    unsigned width);
+
+unsigned convertRowUYVYToYUYV_NEON(const uint8_t* src, uint8_t* dst, unsigned width);
+#endif  // __ARM_NEON
 
 } // namespace implementation
 } // namespace V1_1
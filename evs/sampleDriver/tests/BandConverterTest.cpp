@@ -0,0 +1,143 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BandConverter.h"
+
+#include <linux/videodev2.h>
+
+#include <cstdlib>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+using namespace ::android::hardware::automotive::evs::V1_1::implementation;
+using ::android::hardware::automotive::evs::V1_1::BufferDesc;
+
+const unsigned kNumWorkers[] = {0, 1, 2, 3, 7};
+
+// Target heights that split into bands unevenly, including an odd one
+const unsigned kHeights[] = {2, 6, 240, 242, 363};
+constexpr unsigned kTargetWidth = 320;
+
+// Scaling conversions read from a larger frame, and crop into it
+constexpr unsigned kScaledSourceWidth = 640;
+constexpr unsigned kScaledSourceHeight = 480;
+
+std::vector<uint8_t> makeImage(size_t size) {
+    std::vector<uint8_t> image(size);
+    for (auto&& value : image) {
+        value = static_cast<uint8_t>(rand());
+    }
+    return image;
+}
+
+BufferDesc describeTarget(unsigned height) {
+    BufferDesc desc = {};
+    AHardwareBuffer_Desc* pDesc =
+        reinterpret_cast<AHardwareBuffer_Desc*>(&desc.buffer.description);
+    pDesc->width = kTargetWidth;
+    pDesc->height = height;
+    pDesc->stride = kTargetWidth;
+    return desc;
+}
+
+SourceFrame describeSource(const Conversion& conversion, const std::vector<uint8_t>& image,
+                           unsigned width, unsigned height) {
+    SourceFrame src;
+    src.data = image.data();
+    src.size = image.size();
+    src.width = width;
+    src.height = height;
+    src.stride = (conversion.srcFormat == V4L2_PIX_FMT_NV12 ||
+                  conversion.srcFormat == V4L2_PIX_FMT_NV21) ? width : width * 2;
+    src.cropWidth = width;
+    src.cropHeight = height;
+    if (conversion.flags & Conversion::SCALES) {
+        src.cropX = 6;
+        src.cropY = 4;
+        src.cropWidth = width - 20;
+        src.cropHeight = height - 10;
+    }
+    return src;
+}
+
+// Fails the frame from the band that starts at sFailingRow
+unsigned sFailingRow = 0;
+
+bool failAtRow(const BufferDesc&, uint8_t*, const SourceFrame&, unsigned startRow, unsigned) {
+    return startRow != sFailingRow;
+}
+
+TEST(BandConverterTest, BandedOutputMatchesWholeFrame) {
+    for (auto&& conversion : ConversionRegistry::get().getConversions()) {
+        if (!(conversion.flags & Conversion::BANDED)) {
+            continue;
+        }
+
+        for (auto height : kHeights) {
+            const bool scales = conversion.flags & Conversion::SCALES;
+            const unsigned srcWidth = scales ? kScaledSourceWidth : kTargetWidth;
+            const unsigned srcHeight = scales ? kScaledSourceHeight : height;
+
+            // Sized for the largest source and target formats
+            const auto image = makeImage(srcWidth * 2 * srcHeight);
+            const SourceFrame src = describeSource(conversion, image, srcWidth, srcHeight);
+            const BufferDesc desc = describeTarget(height);
+
+            std::vector<uint8_t> expected(kTargetWidth * 4 * height);
+            ASSERT_TRUE(conversion.convert(desc, expected.data(), src, 0, height));
+
+            for (auto numWorkers : kNumWorkers) {
+                BandConverter converter(numWorkers);
+                std::vector<uint8_t> actual(expected.size());
+                ASSERT_TRUE(converter.convert(conversion.convert, desc, actual.data(), src,
+                                              height));
+                EXPECT_EQ(actual, expected) << conversion.name << " " << conversion.srcFormat
+                                            << " to " << conversion.dstFormat << ", height "
+                                            << height << ", " << numWorkers << " workers";
+            }
+        }
+    }
+}
+
+TEST(BandConverterTest, FailingBandFailsFrame) {
+    constexpr unsigned kHeight = 240;
+    const BufferDesc desc = describeTarget(kHeight);
+    const SourceFrame src;
+    std::vector<uint8_t> target(kTargetWidth * 4 * kHeight);
+
+    for (auto numWorkers : kNumWorkers) {
+        BandConverter converter(numWorkers);
+        const unsigned numBands = numWorkers + 1;
+        const unsigned rowsPerBand = ((kHeight / 2 + numBands - 1) / numBands) * 2;
+
+        // Band 0 runs on the calling thread and the others on the workers
+        for (unsigned band = 0; band < numBands; ++band) {
+            sFailingRow = band * rowsPerBand;
+            EXPECT_FALSE(converter.convert(failAtRow, desc, target.data(), src, kHeight))
+                    << "Band " << band << " of " << numBands;
+        }
+
+        // A failure is not carried over into the next frame
+        sFailingRow = kHeight;
+        EXPECT_TRUE(converter.convert(failAtRow, desc, target.data(), src, kHeight))
+                << numWorkers << " workers";
+    }
+}
+
+}  // namespace
@@ -0,0 +1,87 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bufferCopy.h"
+
+#include <cstdlib>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+namespace {
+
+using namespace ::android::hardware::automotive::evs::V1_1::implementation;
+using ::android::hardware::automotive::evs::V1_1::BufferDesc;
+
+using FillFunction = void (*)(const BufferDesc&, uint8_t*, void*, unsigned, unsigned, unsigned);
+
+// Converts a whole YUYV or UYVY frame of state.range(0) x state.range(1)
+// pixels into a target with a given number of bytes per pixel
+void BM_Fill(benchmark::State& state, FillFunction fill, unsigned targetBytesPerPixel) {
+    const unsigned width = state.range(0);
+    const unsigned height = state.range(1);
+    const unsigned srcStride = width * 2;
+    const unsigned dstStride = (width + 15) & ~15u;
+
+    std::vector<uint8_t> src(srcStride * height);
+    for (auto&& value : src) {
+        value = static_cast<uint8_t>(rand());
+    }
+    std::vector<uint8_t> dst(dstStride * height * targetBytesPerPixel);
+
+    BufferDesc desc = {};
+    AHardwareBuffer_Desc* pDesc =
+        reinterpret_cast<AHardwareBuffer_Desc*>(&desc.buffer.description);
+    pDesc->width = width;
+    pDesc->height = height;
+    pDesc->stride = dstStride;
+
+    for (auto _ : state) {
+        fill(desc, dst.data(), src.data(), srcStride, 0, height);
+        benchmark::DoNotOptimize(dst.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * src.size());
+}
+
+// The scalar reference of fillRGBAFromYUYV, to compare the vectorized kernel
+// against
+void fillRGBAFromYUYV_C(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData,
+                        unsigned imgStride, unsigned startRow, unsigned endRow) {
+    const AHardwareBuffer_Desc* pDesc =
+        reinterpret_cast<const AHardwareBuffer_Desc*>(&tgtBuff.buffer.description);
+    for (unsigned r = startRow; r < endRow; ++r) {
+        convertRowYUYVToRGBA_C(static_cast<const uint8_t*>(imgData) + r * imgStride,
+                               reinterpret_cast<uint32_t*>(tgt) + r * pDesc->stride,
+                               pDesc->width);
+    }
+}
+
+// NV21 takes 1.5 bytes per pixel; the target is sized for 2.
+BENCHMARK_CAPTURE(BM_Fill, RGBAFromYUYV, fillRGBAFromYUYV, 4)
+        ->Args({1280, 720})->Args({1920, 1080});
+BENCHMARK_CAPTURE(BM_Fill, RGBAFromYUYV_C, fillRGBAFromYUYV_C, 4)
+        ->Args({1280, 720})->Args({1920, 1080});
+BENCHMARK_CAPTURE(BM_Fill, NV21FromYUYV, fillNV21FromYUYV, 2)
+        ->Args({1280, 720})->Args({1920, 1080});
+BENCHMARK_CAPTURE(BM_Fill, YUYVFromUYVY, fillYUYVFromUYVY, 2)
+        ->Args({1280, 720})->Args({1920, 1080});
+BENCHMARK_CAPTURE(BM_Fill, YUYVFromYUYV, fillYUYVFromYUYV, 2)
+        ->Args({1280, 720})->Args({1920, 1080});
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,164 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bufferCopy.h"
+
+#include <cstdlib>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+using namespace ::android::hardware::automotive::evs::V1_1::implementation;
+using ::android::hardware::automotive::evs::V1_1::BufferDesc;
+
+// Widths that leave a tail for the scalar kernels, including ones that split
+// a YUYV macro pixel
+const unsigned kWidths[] = {2, 6, 14, 17, 18, 30, 33, 34, 46, 62, 66, 127, 1282};
+constexpr unsigned kHeight = 6;
+
+std::vector<uint8_t> makeImage(size_t size) {
+    // Random bytes cover the clamped ends of the color conversion
+    std::vector<uint8_t> image(size);
+    for (auto&& value : image) {
+        value = static_cast<uint8_t>(rand());
+    }
+    return image;
+}
+
+BufferDesc describeTarget(unsigned width, unsigned height, unsigned stride) {
+    BufferDesc desc = {};
+    AHardwareBuffer_Desc* pDesc =
+        reinterpret_cast<AHardwareBuffer_Desc*>(&desc.buffer.description);
+    pDesc->width = width;
+    pDesc->height = height;
+    pDesc->stride = stride;
+    return desc;
+}
+
+unsigned align16(unsigned value) {
+    return (value + 15) & ~15u;
+}
+
+#if defined(__ARM_NEON)
+TEST(BufferCopyTest, VectorizedYUYVToRGBAMatchesScalar) {
+    for (auto width : kWidths) {
+        const auto src = makeImage(width * 2);
+        std::vector<uint32_t> expected(width), actual(width);
+        convertRowYUYVToRGBA_C(src.data(), expected.data(), width);
+
+        const auto done = convertRowYUYVToRGBA_NEON(src.data(), actual.data(), width);
+        EXPECT_EQ(done, width / kPixelsPerVector * kPixelsPerVector);
+        convertRowYUYVToRGBA_C(src.data() + done * 2, actual.data() + done, width - done);
+        EXPECT_EQ(actual, expected) << "Width " << width;
+    }
+}
+
+TEST(BufferCopyTest, VectorizedYUYVToNV21MatchesScalar) {
+    for (auto width : kWidths) {
+        const auto src = makeImage(width * 4);
+        const uint8_t* topSrc = src.data();
+        const uint8_t* botSrc = src.data() + width * 2;
+        std::vector<uint8_t> expected(width * 3), actual(width * 3);
+        convertRowsYUYVToNV21_C(topSrc, botSrc, expected.data(), expected.data() + width,
+                                expected.data() + width * 2, width);
+
+        const auto done = convertRowsYUYVToNV21_NEON(topSrc, botSrc, actual.data(),
+                                                     actual.data() + width,
+                                                     actual.data() + width * 2, width);
+        EXPECT_EQ(done, width / kPixelsPerVector * kPixelsPerVector);
+        convertRowsYUYVToNV21_C(topSrc + done * 2, botSrc + done * 2, actual.data() + done,
+                                actual.data() + width + done,
+                                actual.data() + width * 2 + done, width - done);
+        EXPECT_EQ(actual, expected) << "Width " << width;
+    }
+}
+
+TEST(BufferCopyTest, VectorizedUYVYToYUYVMatchesScalar) {
+    for (auto width : kWidths) {
+        const auto src = makeImage(width * 2);
+        std::vector<uint8_t> expected(width * 2), actual(width * 2);
+        convertRowUYVYToYUYV_C(src.data(), expected.data(), width);
+
+        const auto done = convertRowUYVYToYUYV_NEON(src.data(), actual.data(), width);
+        EXPECT_EQ(done, width / kPixelsPerVector * kPixelsPerVector);
+        convertRowUYVYToYUYV_C(src.data() + done * 2, actual.data() + done * 2, width - done);
+        EXPECT_EQ(actual, expected) << "Width " << width;
+    }
+}
+#endif  // __ARM_NEON
+
+// The frame conversions pick the vectorized kernels where available; they
+// match the scalar kernels applied to every row, with padded strides.
+TEST(BufferCopyTest, RGBAFromYUYVMatchesScalarRows) {
+    for (auto width : kWidths) {
+        const unsigned srcStride = width * 2 + 32;
+        const unsigned dstStride = width + 8;
+        auto src = makeImage(srcStride * kHeight);
+        std::vector<uint32_t> expected(dstStride * kHeight), actual(dstStride * kHeight);
+        for (unsigned r = 0; r < kHeight; ++r) {
+            convertRowYUYVToRGBA_C(src.data() + r * srcStride, expected.data() + r * dstStride,
+                                   width);
+        }
+
+        fillRGBAFromYUYV(describeTarget(width, kHeight, dstStride),
+                         reinterpret_cast<uint8_t*>(actual.data()), src.data(), srcStride,
+                         0, kHeight);
+        EXPECT_EQ(actual, expected) << "Width " << width;
+    }
+}
+
+TEST(BufferCopyTest, NV21FromYUYVMatchesScalarRows) {
+    for (auto width : kWidths) {
+        const unsigned srcStride = width * 2 + 32;
+        const unsigned dstStride = align16(width);
+        auto src = makeImage(srcStride * kHeight);
+        std::vector<uint8_t> expected(dstStride * kHeight * 3 / 2);
+        std::vector<uint8_t> actual(expected.size());
+        uint8_t* uvPlane = expected.data() + dstStride * kHeight;
+        for (unsigned r = 0; r < kHeight; r += 2) {
+            convertRowsYUYVToNV21_C(src.data() + r * srcStride,
+                                    src.data() + (r + 1) * srcStride,
+                                    expected.data() + r * dstStride,
+                                    expected.data() + (r + 1) * dstStride,
+                                    uvPlane + r / 2 * dstStride, width);
+        }
+
+        fillNV21FromYUYV(describeTarget(width, kHeight, dstStride), actual.data(), src.data(),
+                         srcStride, 0, kHeight);
+        EXPECT_EQ(actual, expected) << "Width " << width;
+    }
+}
+
+TEST(BufferCopyTest, YUYVFromUYVYMatchesScalarRows) {
+    for (auto width : kWidths) {
+        const unsigned srcStride = width * 2 + 32;
+        const unsigned dstStride = width + 8;
+        auto src = makeImage(srcStride * kHeight);
+        std::vector<uint8_t> expected(dstStride * 2 * kHeight), actual(expected.size());
+        for (unsigned r = 0; r < kHeight; ++r) {
+            convertRowUYVYToYUYV_C(src.data() + r * srcStride,
+                                   expected.data() + r * dstStride * 2, width);
+        }
+
+        fillYUYVFromUYVY(describeTarget(width, kHeight, dstStride), actual.data(), src.data(),
+                         srcStride, 0, kHeight);
+        EXPECT_EQ(actual, expected) << "Width " << width;
+    }
+}
+
+}  // namespace
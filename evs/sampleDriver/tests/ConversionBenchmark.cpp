@@ -0,0 +1,149 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ConversionRegistry.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <jpeglib.h>
+#include <linux/videodev2.h>
+
+#include <benchmark/benchmark.h>
+
+namespace {
+
+using namespace ::android::hardware::automotive::evs::V1_1::implementation;
+using ::android::hardware::automotive::evs::V1_1::BufferDesc;
+
+constexpr unsigned kTargetWidth = 1280;
+constexpr unsigned kTargetHeight = 720;
+
+// Scaling conversions are also measured from a larger capture
+constexpr unsigned kScaledSourceWidth = 1920;
+constexpr unsigned kScaledSourceHeight = 1080;
+
+std::vector<uint8_t> makeJpeg(unsigned width, unsigned height) {
+    jpeg_compress_struct cinfo;
+    jpeg_error_mgr errorManager;
+    cinfo.err = jpeg_std_error(&errorManager);
+    jpeg_create_compress(&cinfo);
+
+    unsigned char* buffer = nullptr;
+    unsigned long size = 0;
+    jpeg_mem_dest(&cinfo, &buffer, &size);
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_start_compress(&cinfo, TRUE);
+
+    std::vector<uint8_t> row(width * 3);
+    while (cinfo.next_scanline < height) {
+        for (auto&& value : row) {
+            value = static_cast<uint8_t>(rand());
+        }
+        JSAMPROW pRow = row.data();
+        jpeg_write_scanlines(&cinfo, &pRow, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+
+    std::vector<uint8_t> jpeg(buffer, buffer + size);
+    free(buffer);
+    jpeg_destroy_compress(&cinfo);
+    return jpeg;
+}
+
+// Converts a whole source frame of the given size into a 1280 x 720 target
+void BM_Convert(benchmark::State& state, Conversion conversion,
+                unsigned srcWidth, unsigned srcHeight) {
+    std::vector<uint8_t> src;
+    unsigned srcStride = 0;
+    if (conversion.srcFormat == V4L2_PIX_FMT_MJPEG) {
+        src = makeJpeg(srcWidth, srcHeight);
+    } else if (conversion.srcFormat == V4L2_PIX_FMT_NV12 ||
+               conversion.srcFormat == V4L2_PIX_FMT_NV21) {
+        srcStride = srcWidth;
+        src.resize(srcStride * srcHeight * 3 / 2);
+    } else {
+        srcStride = srcWidth * 2;
+        src.resize(srcStride * srcHeight);
+    }
+    if (conversion.srcFormat != V4L2_PIX_FMT_MJPEG) {
+        for (auto&& value : src) {
+            value = static_cast<uint8_t>(rand());
+        }
+    }
+
+    SourceFrame frame;
+    frame.data = src.data();
+    frame.size = src.size();
+    frame.width = srcWidth;
+    frame.height = srcHeight;
+    frame.stride = srcStride;
+    frame.cropWidth = srcWidth;
+    frame.cropHeight = srcHeight;
+
+    // Sized for the largest target format, RGBA, with a 16 pixel aligned stride
+    const unsigned dstStride = (kTargetWidth + 15) & ~15u;
+    std::vector<uint8_t> dst(dstStride * kTargetHeight * 4);
+
+    BufferDesc desc = {};
+    AHardwareBuffer_Desc* pDesc =
+        reinterpret_cast<AHardwareBuffer_Desc*>(&desc.buffer.description);
+    pDesc->width = kTargetWidth;
+    pDesc->height = kTargetHeight;
+    pDesc->stride = dstStride;
+    pDesc->format = conversion.dstFormat;
+
+    for (auto _ : state) {
+        if (!conversion.convert(desc, dst.data(), frame, 0, kTargetHeight)) {
+            state.SkipWithError("Conversion failed");
+            break;
+        }
+        benchmark::DoNotOptimize(dst.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * kTargetWidth * kTargetHeight);
+}
+
+std::string describe(const Conversion& conversion, unsigned srcWidth, unsigned srcHeight) {
+    char name[128];
+    snprintf(name, sizeof(name), "BM_Convert/%.4s_to_%u/%s/%ux%u",
+             reinterpret_cast<const char*>(&conversion.srcFormat), conversion.dstFormat,
+             conversion.name, srcWidth, srcHeight);
+    return name;
+}
+
+// Registers every conversion in the registry, so paths added later are
+// measured without changes here
+const bool kRegistered = [] {
+    for (auto&& conversion : ConversionRegistry::get().getConversions()) {
+        benchmark::RegisterBenchmark(describe(conversion, kTargetWidth, kTargetHeight).c_str(),
+                                     BM_Convert, conversion, kTargetWidth, kTargetHeight);
+        if (conversion.flags & Conversion::SCALES) {
+            benchmark::RegisterBenchmark(
+                    describe(conversion, kScaledSourceWidth, kScaledSourceHeight).c_str(),
+                    BM_Convert, conversion, kScaledSourceWidth, kScaledSourceHeight);
+        }
+    }
+    return true;
+}();
+
+}  // namespace
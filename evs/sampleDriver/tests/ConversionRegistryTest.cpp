@@ -0,0 +1,216 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ConversionRegistry.h"
+
+#include <linux/videodev2.h>
+#include <system/graphics.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+using namespace ::android::hardware::automotive::evs::V1_1::implementation;
+using ::android::hardware::automotive::evs::V1_1::BufferDesc;
+
+// Golden frames are 16 x 2 pixels so the NV21 rows need no padding
+constexpr unsigned kWidth = 16;
+constexpr unsigned kHeight = 2;
+
+// Y = 100, U = 90 and V = 170 in every YUYV macro pixel.  In RGB, this is
+// (148, 91, 23); the blue channel checks the rounding of a negative term.
+constexpr uint8_t kY = 100;
+constexpr uint8_t kU = 90;
+constexpr uint8_t kV = 170;
+constexpr uint32_t kRgba = 148 | (91 << 8) | (23 << 16) | 0xFF000000;
+
+// RGB565 (16, 32, 8), which expands to RGB (132, 130, 66) and converts to
+// Y = 123, U = 100 and V = 135
+constexpr uint16_t kRgb565 = (16 << 11) | (32 << 5) | 8;
+constexpr uint8_t kRgb565Y = 123;
+constexpr uint8_t kRgb565U = 100;
+constexpr uint8_t kRgb565V = 135;
+
+std::vector<uint8_t> makeYUYVFrame() {
+    std::vector<uint8_t> frame(kWidth * 2 * kHeight);
+    for (size_t i = 0; i < frame.size(); i += 4) {
+        frame[i] = kY;
+        frame[i + 1] = kU;
+        frame[i + 2] = kY;
+        frame[i + 3] = kV;
+    }
+    return frame;
+}
+
+std::vector<uint8_t> makeRGB565Frame() {
+    std::vector<uint8_t> frame(kWidth * 2 * kHeight);
+    for (size_t i = 0; i < frame.size(); i += 2) {
+        frame[i] = kRgb565 & 0xFF;
+        frame[i + 1] = kRgb565 >> 8;
+    }
+    return frame;
+}
+
+SourceFrame describeSource(const std::vector<uint8_t>& frame) {
+    SourceFrame src;
+    src.data = frame.data();
+    src.size = frame.size();
+    src.width = kWidth;
+    src.height = kHeight;
+    src.stride = kWidth * 2;
+    src.cropWidth = kWidth;
+    src.cropHeight = kHeight;
+    return src;
+}
+
+BufferDesc describeTarget() {
+    BufferDesc desc = {};
+    AHardwareBuffer_Desc* pDesc =
+        reinterpret_cast<AHardwareBuffer_Desc*>(&desc.buffer.description);
+    pDesc->width = kWidth;
+    pDesc->height = kHeight;
+    pDesc->stride = kWidth;
+    return desc;
+}
+
+// Runs the cheapest conversion between two formats over a whole frame
+std::vector<uint8_t> convert(uint32_t srcFormat, uint32_t dstFormat, bool needsScaling,
+                             const std::vector<uint8_t>& frame, size_t targetSize) {
+    Conversion conversion;
+    EXPECT_TRUE(ConversionRegistry::get().find(srcFormat, dstFormat, needsScaling, conversion));
+    if (conversion.convert == nullptr) {
+        return {};
+    }
+
+    std::vector<uint8_t> target(targetSize);
+    EXPECT_TRUE(conversion.convert(describeTarget(), target.data(), describeSource(frame),
+                                   0, kHeight));
+    return target;
+}
+
+class ConversionRegistryTest : public ::testing::TestWithParam<bool> {};
+
+// Both the row kernel and the sampled conversion write the NV21 chroma as V
+// then U
+TEST_P(ConversionRegistryTest, YUYVToNV21WritesVBeforeU) {
+    const auto target = convert(V4L2_PIX_FMT_YUYV, HAL_PIXEL_FORMAT_YCRCB_420_SP, GetParam(),
+                                makeYUYVFrame(), kWidth * kHeight * 3 / 2);
+    ASSERT_FALSE(target.empty());
+    for (unsigned i = 0; i < kWidth * kHeight; ++i) {
+        EXPECT_EQ(target[i], kY) << "Luma " << i;
+    }
+    for (unsigned i = kWidth * kHeight; i < target.size(); i += 2) {
+        EXPECT_EQ(target[i], kV) << "Chroma " << i;
+        EXPECT_EQ(target[i + 1], kU) << "Chroma " << i;
+    }
+}
+
+// Both the row kernel and the sampled conversion produce the same pixels
+TEST_P(ConversionRegistryTest, YUYVToRGBAMatchesGolden) {
+    const auto target = convert(V4L2_PIX_FMT_YUYV, HAL_PIXEL_FORMAT_RGBA_8888, GetParam(),
+                                makeYUYVFrame(), kWidth * kHeight * 4);
+    ASSERT_FALSE(target.empty());
+    const uint32_t* pixels = reinterpret_cast<const uint32_t*>(target.data());
+    for (unsigned i = 0; i < kWidth * kHeight; ++i) {
+        EXPECT_EQ(pixels[i], kRgba) << "Pixel " << i;
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(Scaling, ConversionRegistryTest, ::testing::Bool());
+
+TEST(ConversionRegistryGoldenTest, RGB565ToYUYVMatchesGolden) {
+    const auto target = convert(V4L2_PIX_FMT_RGB565, HAL_PIXEL_FORMAT_YCBCR_422_I, true,
+                                makeRGB565Frame(), kWidth * kHeight * 2);
+    ASSERT_FALSE(target.empty());
+    for (unsigned i = 0; i < target.size(); i += 4) {
+        EXPECT_EQ(target[i], kRgb565Y) << "Byte " << i;
+        EXPECT_EQ(target[i + 1], kRgb565U) << "Byte " << i;
+        EXPECT_EQ(target[i + 2], kRgb565Y) << "Byte " << i;
+        EXPECT_EQ(target[i + 3], kRgb565V) << "Byte " << i;
+    }
+}
+
+TEST(ConversionRegistryGoldenTest, RGB565ToNV21MatchesGolden) {
+    const auto target = convert(V4L2_PIX_FMT_RGB565, HAL_PIXEL_FORMAT_YCRCB_420_SP, true,
+                                makeRGB565Frame(), kWidth * kHeight * 3 / 2);
+    ASSERT_FALSE(target.empty());
+    for (unsigned i = 0; i < kWidth * kHeight; ++i) {
+        EXPECT_EQ(target[i], kRgb565Y) << "Luma " << i;
+    }
+    for (unsigned i = kWidth * kHeight; i < target.size(); i += 2) {
+        EXPECT_EQ(target[i], kRgb565V) << "Chroma " << i;
+        EXPECT_EQ(target[i + 1], kRgb565U) << "Chroma " << i;
+    }
+}
+
+// rgbToYuv keeps grays neutral
+TEST(ConversionRegistryGoldenTest, RGB565GraysStayNeutral) {
+    Conversion toYuyv;
+    ASSERT_TRUE(ConversionRegistry::get().find(V4L2_PIX_FMT_RGB565,
+                                               HAL_PIXEL_FORMAT_YCBCR_422_I, true, toYuyv));
+
+    for (const uint16_t value : {0x0000, 0xFFFF}) {
+        const std::vector<uint8_t> frame(kWidth * 2 * kHeight, value & 0xFF);
+        std::vector<uint8_t> yuyv(kWidth * 2 * kHeight);
+        ASSERT_TRUE(toYuyv.convert(describeTarget(), yuyv.data(), describeSource(frame),
+                                   0, kHeight));
+        EXPECT_EQ(yuyv[0], value & 0xFF) << "RGB565 " << value;
+        EXPECT_EQ(yuyv[1], 128) << "RGB565 " << value;
+        EXPECT_EQ(yuyv[3], 128) << "RGB565 " << value;
+    }
+}
+
+// rgbToYuv round-trips through the YUV to RGB conversion within the rounding
+// error.  Saturated colors are skipped because they fall outside of the YUV
+// gamut and are clamped.
+TEST(ConversionRegistryGoldenTest, RGB565RoundTripsThroughYUV) {
+    Conversion toYuyv, toRgba;
+    ASSERT_TRUE(ConversionRegistry::get().find(V4L2_PIX_FMT_RGB565,
+                                               HAL_PIXEL_FORMAT_YCBCR_422_I, true, toYuyv));
+    ASSERT_TRUE(ConversionRegistry::get().find(V4L2_PIX_FMT_YUYV,
+                                               HAL_PIXEL_FORMAT_RGBA_8888, false, toRgba));
+
+    for (unsigned r = 8; r < 24; r += 3) {
+        for (unsigned g = 16; g < 48; g += 5) {
+            for (unsigned b = 8; b < 24; b += 3) {
+                const uint16_t value = (r << 11) | (g << 5) | b;
+                std::vector<uint8_t> frame(kWidth * 2 * kHeight);
+                for (size_t i = 0; i < frame.size(); i += 2) {
+                    frame[i] = value & 0xFF;
+                    frame[i + 1] = value >> 8;
+                }
+
+                std::vector<uint8_t> yuyv(kWidth * 2 * kHeight);
+                ASSERT_TRUE(toYuyv.convert(describeTarget(), yuyv.data(), describeSource(frame),
+                                           0, kHeight));
+
+                std::vector<uint8_t> rgba(kWidth * 4 * kHeight);
+                ASSERT_TRUE(toRgba.convert(describeTarget(), rgba.data(), describeSource(yuyv),
+                                           0, kHeight));
+                const int expected[] = {static_cast<int>((r << 3) | (r >> 2)),
+                                        static_cast<int>((g << 2) | (g >> 4)),
+                                        static_cast<int>((b << 3) | (b >> 2))};
+                for (int c = 0; c < 3; ++c) {
+                    EXPECT_NEAR(rgba[c], expected[c], 3) << "RGB565 " << value << " channel " << c;
+                }
+            }
+        }
+    }
+}
+
+}  // namespace
@@ -0,0 +1,119 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "EvsEnumerator.h"
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+using ::android::hardware::automotive::evs::V1_1::implementation::EvsEnumerator;
+using VideoUevent = EvsEnumerator::VideoUevent;
+using namespace std::string_literals;
+
+// Builds a uevent message as the kernel sends it: a header followed by
+// null-terminated KEY=VALUE strings
+std::string makeUevent(const std::string& action,
+                       const std::string& subsystem,
+                       const std::string& devname) {
+    std::string msg = action + "@/devices/platform/usb/video4linux/" + devname;
+    msg += '\0';
+    const std::vector<std::string> fields = {
+        "ACTION=" + action,
+        "DEVPATH=/devices/platform/usb/video4linux/" + devname,
+        "SUBSYSTEM=" + subsystem,
+        "MAJOR=81",
+        "MINOR=2",
+        "DEVNAME=" + devname,
+        "SEQNUM=2048",
+    };
+    for (auto&& field : fields) {
+        msg += field;
+        msg += '\0';
+    }
+
+    return msg;
+}
+
+bool parse(const std::string& msg, VideoUevent& event) {
+    return EvsEnumerator::parseVideoUevent(msg.data(), msg.size(), event);
+}
+
+TEST(EvsEnumeratorTest, ParsesAddedVideoDevice) {
+    VideoUevent event;
+    ASSERT_TRUE(parse(makeUevent("add", "video4linux", "video2"), event));
+    EXPECT_EQ(event.action, VideoUevent::Action::ADD);
+    EXPECT_EQ(event.devpath, "/dev/video2");
+}
+
+TEST(EvsEnumeratorTest, ParsesRemovedVideoDevice) {
+    VideoUevent event;
+    ASSERT_TRUE(parse(makeUevent("remove", "video4linux", "video11"), event));
+    EXPECT_EQ(event.action, VideoUevent::Action::REMOVE);
+    EXPECT_EQ(event.devpath, "/dev/video11");
+}
+
+TEST(EvsEnumeratorTest, ReportsOtherActionsOnVideoDevices) {
+    VideoUevent event;
+    ASSERT_TRUE(parse(makeUevent("change", "video4linux", "video0"), event));
+    EXPECT_EQ(event.action, VideoUevent::Action::OTHER);
+    EXPECT_EQ(event.devpath, "/dev/video0");
+}
+
+TEST(EvsEnumeratorTest, IgnoresNonVideoDevices) {
+    VideoUevent event;
+    EXPECT_FALSE(parse(makeUevent("add", "usb", "bus/usb/001/004"), event));
+    EXPECT_FALSE(parse(makeUevent("add", "sound", "snd/pcmC0D0c"), event));
+    EXPECT_FALSE(parse(makeUevent("add", "video4linux2", "video0"), event));
+}
+
+TEST(EvsEnumeratorTest, IgnoresMessagesWithoutRequiredFields) {
+    VideoUevent event;
+    EXPECT_FALSE(parse(std::string(), event));
+    EXPECT_FALSE(parse(makeUevent("add", "video4linux", ""), event));
+
+    EXPECT_FALSE(parse("SUBSYSTEM=video4linux\0DEVNAME=video0\0"s, event));
+    EXPECT_FALSE(parse("ACTION=add\0DEVNAME=video0\0"s, event));
+}
+
+TEST(EvsEnumeratorTest, HandlesTruncatedMessages) {
+    const std::string msg = makeUevent("add", "video4linux", "video3");
+
+    // The last string may come without a terminator
+    VideoUevent event;
+    ASSERT_TRUE(EvsEnumerator::parseVideoUevent(msg.data(), msg.size() - 1, event));
+    EXPECT_EQ(event.devpath, "/dev/video3");
+
+    // Nothing past a given length is read
+    const auto devnamePos = msg.find("DEVNAME=");
+    ASSERT_NE(devnamePos, std::string::npos);
+    EXPECT_FALSE(EvsEnumerator::parseVideoUevent(msg.data(), devnamePos, event));
+    EXPECT_FALSE(EvsEnumerator::parseVideoUevent(msg.data(), devnamePos + 5, event));
+
+    // A value cut short is taken as it is
+    ASSERT_TRUE(EvsEnumerator::parseVideoUevent(msg.data(), devnamePos + 11, event));
+    EXPECT_EQ(event.devpath, "/dev/vid");
+
+    // Truncated in the middle of SUBSYSTEM
+    const auto subsysPos = msg.find("SUBSYSTEM=");
+    ASSERT_NE(subsysPos, std::string::npos);
+    EXPECT_FALSE(EvsEnumerator::parseVideoUevent(msg.data(), subsysPos + 12, event));
+}
+
+}  // namespace
@@ -0,0 +1,274 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "EvsV4lCamera.h"
+#include "VideoCapture.h"
+
+#include <android-base/unique_fd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <system/camera_metadata.h>
+#include <system/graphics.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+using namespace ::android::hardware::automotive::evs::V1_1::implementation;
+using ::android::sp;
+using ::android::base::unique_fd;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::Return;
+using ::android::hardware::Void;
+using ::android::hardware::automotive::evs::V1_1::EvsEventDesc;
+
+// Buffer identifiers of exported capture buffers have this bit set
+constexpr uint32_t kDmaBufIdFlag = 0x80000000;
+
+constexpr int kWidth = 640;
+constexpr int kHeight = 480;
+constexpr unsigned kFramesInFlight = 3;
+constexpr unsigned kNumFrames = 10;
+constexpr std::chrono::seconds kFrameTimeout(5);
+
+// Returns the first vivid capture node, or an empty string.  vim2m nodes are
+// memory-to-memory devices that produce a frame only for each one they are
+// given, so they cannot be streamed from like a camera.
+std::string findVividCamera() {
+    for (int i = 0; i < 64; ++i) {
+        const std::string path = "/dev/video" + std::to_string(i);
+        unique_fd fd(open(path.c_str(), O_RDWR | O_CLOEXEC));
+        if (fd < 0) {
+            continue;
+        }
+
+        v4l2_capability caps = {};
+        if (ioctl(fd, VIDIOC_QUERYCAP, &caps) < 0) {
+            continue;
+        }
+
+        const uint32_t deviceCaps = (caps.capabilities & V4L2_CAP_DEVICE_CAPS) ?
+                                    caps.device_caps : caps.capabilities;
+        if (strcmp(reinterpret_cast<const char*>(caps.driver), "vivid") == 0 &&
+            (deviceCaps & V4L2_CAP_VIDEO_CAPTURE) && (deviceCaps & V4L2_CAP_STREAMING)) {
+            return path;
+        }
+    }
+
+    return "";
+}
+
+// Keeps the frames delivered by a camera until the test returns them
+class FrameCollector : public IEvsCameraStream_1_1 {
+public:
+    Return<void> deliverFrame(const BufferDesc_1_0&) override {
+        ADD_FAILURE() << "Received a v1.0 frame from a v1.1 camera";
+        return Void();
+    }
+
+    Return<void> deliverFrame_1_1(const hidl_vec<BufferDesc_1_1>& buffers) override {
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            for (auto&& buffer : buffers) {
+                mFrames.push_back(buffer);
+            }
+        }
+        mSignal.notify_all();
+        return Void();
+    }
+
+    Return<void> notify(const EvsEventDesc&) override {
+        return Void();
+    }
+
+    // Waits for a frame and takes it
+    bool takeFrame(BufferDesc_1_1& buffer) {
+        std::unique_lock<std::mutex> lock(mLock);
+        if (!mSignal.wait_for(lock, kFrameTimeout, [this]() { return !mFrames.empty(); })) {
+            return false;
+        }
+
+        buffer = mFrames.front();
+        mFrames.erase(mFrames.begin());
+        return true;
+    }
+
+    std::vector<BufferDesc_1_1> takeAllFrames() {
+        std::vector<BufferDesc_1_1> frames;
+        std::lock_guard<std::mutex> lock(mLock);
+        frames.swap(mFrames);
+        return frames;
+    }
+
+private:
+    std::mutex mLock;
+    std::condition_variable mSignal;
+    std::vector<BufferDesc_1_1> mFrames;
+};
+
+class EvsV4lCameraTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        mDevicePath = findVividCamera();
+        if (mDevicePath.empty()) {
+            GTEST_SKIP() << "No vivid capture device; load the vivid module to run this test";
+        }
+    }
+
+    // Opens the vivid camera delivering kWidth x kHeight frames in the given
+    // format
+    sp<EvsV4lCamera> openCamera(int32_t format, bool zeroCopy) {
+        auto camInfo = std::make_unique<ConfigManager::CameraInfo>();
+        if (!camInfo->allocate(/* entry_cap = */ 1, /* data_cap = */ 1)) {
+            return nullptr;
+        }
+        camInfo->streamConfigurations[0] = {0, kWidth, kHeight, format,
+                                            ANDROID_SCALER_AVAILABLE_STREAM_CONFIGURATIONS_OUTPUT,
+                                            30};
+        camInfo->zeroCopy = zeroCopy;
+
+        sp<EvsV4lCamera> camera = EvsV4lCamera::CreateWithStreamId(mDevicePath.c_str(), camInfo,
+                                                                   /* streamId = */ 0);
+        if (camera == nullptr) {
+            return nullptr;
+        }
+
+        const EvsResult result = camera->setMaxFramesInFlight(kFramesInFlight);
+        if (result != EvsResult::OK) {
+            camera->shutdown();
+            return nullptr;
+        }
+        return camera;
+    }
+
+    // Streams kNumFrames frames, returning each before waiting for the next,
+    // and checks whether they are exported capture buffers
+    void streamFrames(const sp<EvsV4lCamera>& camera, int32_t format, bool expectExported) {
+        sp<FrameCollector> collector = new FrameCollector();
+        const EvsResult started = camera->startVideoStream(collector);
+        ASSERT_EQ(started, EvsResult::OK);
+
+        for (unsigned i = 0; i < kNumFrames; ++i) {
+            BufferDesc_1_1 buffer;
+            ASSERT_TRUE(collector->takeFrame(buffer)) << "Timed out waiting for frame " << i;
+
+            const AHardwareBuffer_Desc* pDesc =
+                reinterpret_cast<const AHardwareBuffer_Desc*>(&buffer.buffer.description);
+            EXPECT_EQ(pDesc->width, static_cast<uint32_t>(kWidth));
+            EXPECT_EQ(pDesc->height, static_cast<uint32_t>(kHeight));
+            EXPECT_EQ(pDesc->format, static_cast<uint32_t>(format));
+            EXPECT_EQ((buffer.bufferId & kDmaBufIdFlag) != 0, expectExported)
+                    << "Buffer " << buffer.bufferId;
+
+            const native_handle_t* handle = buffer.buffer.nativeHandle.getNativeHandle();
+            ASSERT_NE(handle, nullptr);
+            ASSERT_GE(handle->numFds, 1);
+            EXPECT_GE(fcntl(handle->data[0], F_GETFD), 0);
+
+            const EvsResult returned = camera->doneWithFrame_1_1({buffer});
+            ASSERT_EQ(returned, EvsResult::OK);
+        }
+
+        camera->stopVideoStream();
+        const auto remaining = collector->takeAllFrames();
+        if (!remaining.empty()) {
+            camera->doneWithFrame_1_1(remaining);
+        }
+    }
+
+    std::string mDevicePath;
+};
+
+// VIDIOC_EXPBUF gives one file descriptor per capture buffer, and each maps
+// the same memory that VideoCapture hands to its callback
+TEST_F(EvsV4lCameraTest, ExportedBuffersMapCapturedFrames) {
+    VideoCapture capture;
+    ASSERT_TRUE(capture.open(mDevicePath.c_str(), kWidth, kHeight));
+
+    std::atomic<unsigned> numCaptured = 0;
+    std::atomic<unsigned> numMismatched = 0;
+    auto onFrame = [&](VideoCapture* pCapture, imageBuffer* buf, void* data) {
+        const int fd = pCapture->getDmaBufFd(buf->index);
+        void* mapped = mmap(nullptr, buf->length, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapped == MAP_FAILED || memcmp(mapped, data, buf->bytesused) != 0) {
+            numMismatched.fetch_add(1);
+        }
+        if (mapped != MAP_FAILED) {
+            munmap(mapped, buf->length);
+        }
+
+        pCapture->markFrameConsumed(buf->index);
+        numCaptured.fetch_add(1);
+    };
+
+    ASSERT_TRUE(capture.startStream(onFrame, kFramesInFlight, /* exportBuffers = */ true));
+    ASSERT_TRUE(capture.hasDmaBufs());
+
+    std::vector<int> fds;
+    for (int i = 0; i < capture.getNumBuffers(); ++i) {
+        const int fd = capture.getDmaBufFd(i);
+        EXPECT_GE(fd, 0) << "Buffer " << i;
+        EXPECT_EQ(std::count(fds.begin(), fds.end(), fd), 0) << "Buffer " << i;
+        fds.push_back(fd);
+    }
+
+    const auto deadline = std::chrono::steady_clock::now() + kFrameTimeout;
+    while (numCaptured.load() < kNumFrames && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    capture.stopStream();
+    capture.close();
+
+    EXPECT_GE(numCaptured.load(), kNumFrames);
+    EXPECT_EQ(numMismatched.load(), 0u);
+}
+
+// A camera delivering its capture format hands out the capture buffers
+TEST_F(EvsV4lCameraTest, MatchingFormatDeliversCaptureBuffers) {
+    sp<EvsV4lCamera> camera = openCamera(HAL_PIXEL_FORMAT_YCBCR_422_I, /* zeroCopy = */ true);
+    ASSERT_NE(camera, nullptr);
+    streamFrames(camera, HAL_PIXEL_FORMAT_YCBCR_422_I, /* expectExported = */ true);
+    camera->shutdown();
+}
+
+// Frames are copied when they need a conversion, even if zero copy is enabled
+TEST_F(EvsV4lCameraTest, ConvertedFormatFallsBackToCopies) {
+    sp<EvsV4lCamera> camera = openCamera(HAL_PIXEL_FORMAT_RGBA_8888, /* zeroCopy = */ true);
+    ASSERT_NE(camera, nullptr);
+    streamFrames(camera, HAL_PIXEL_FORMAT_RGBA_8888, /* expectExported = */ false);
+    camera->shutdown();
+}
+
+// Frames are copied unless the camera is configured for zero copy
+TEST_F(EvsV4lCameraTest, ZeroCopyDisabledCopiesFrames) {
+    sp<EvsV4lCamera> camera = openCamera(HAL_PIXEL_FORMAT_YCBCR_422_I, /* zeroCopy = */ false);
+    ASSERT_NE(camera, nullptr);
+    streamFrames(camera, HAL_PIXEL_FORMAT_YCBCR_422_I, /* expectExported = */ false);
+    camera->shutdown();
+}
+
+}  // namespace
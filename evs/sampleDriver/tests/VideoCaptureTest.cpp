@@ -0,0 +1,461 @@
+/*
+ * Copyright 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "VideoCapture.h"
+
+#include <android-base/file.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+constexpr int kMaxBuffers = 4;
+constexpr int kWidth = 64;
+constexpr int kHeight = 32;
+
+// Emulates a V4L2 capture device backed by a regular file.  Each buffer is
+// either queued to the fake driver or dequeued and held by VideoCapture;
+// queueing a buffer that the driver already owns counts as a double free.
+class FakeV4l2Device {
+public:
+    // The sequence number and driver timestamp of a frame
+    struct Frame {
+        uint32_t sequence;
+        int64_t  timestampUs;
+    };
+
+    bool open() {
+        if (ftruncate(mFile.fd, kMaxBuffers * getpagesize()) < 0) {
+            return false;
+        }
+
+        struct stat st;
+        if (fstat(mFile.fd, &st) < 0) {
+            return false;
+        }
+        mInode = st.st_ino;
+        return true;
+    }
+
+    const char* getPath() const { return mFile.path; }
+
+    bool isDevice(int fd) const {
+        struct stat st;
+        return fstat(fd, &st) == 0 && st.st_ino == mInode;
+    }
+
+    int handle(unsigned long request, void* arg) {
+        switch (request) {
+            case VIDIOC_QUERYCAP: {
+                auto caps = static_cast<v4l2_capability*>(arg);
+                memset(caps, 0, sizeof(*caps));
+                strncpy(reinterpret_cast<char*>(caps->driver), "fake", sizeof(caps->driver));
+                caps->capabilities = V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_STREAMING;
+                return 0;
+            }
+
+            case VIDIOC_ENUM_FMT: {
+                auto desc = static_cast<v4l2_fmtdesc*>(arg);
+                if (desc->index > 0) {
+                    return fail(EINVAL);
+                }
+                desc->pixelformat = V4L2_PIX_FMT_YUYV;
+                return 0;
+            }
+
+            case VIDIOC_S_FMT:
+                return 0;
+
+            case VIDIOC_G_FMT: {
+                auto format = static_cast<v4l2_format*>(arg);
+                format->fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
+                format->fmt.pix.width = kWidth;
+                format->fmt.pix.height = kHeight;
+                format->fmt.pix.bytesperline = kWidth * 2;
+                return 0;
+            }
+
+            case VIDIOC_REQBUFS: {
+                auto request = static_cast<v4l2_requestbuffers*>(arg);
+                std::lock_guard<std::mutex> lock(mLock);
+                request->count = std::min<unsigned>(request->count, kMaxBuffers);
+                mNumBuffers = request->count;
+                mQueue.clear();
+                mQueued.assign(mNumBuffers, false);
+                return 0;
+            }
+
+            case VIDIOC_QUERYBUF: {
+                auto buf = static_cast<v4l2_buffer*>(arg);
+                buf->length = getpagesize();
+                buf->m.offset = buf->index * getpagesize();
+                return 0;
+            }
+
+            case VIDIOC_QBUF: {
+                auto buf = static_cast<v4l2_buffer*>(arg);
+                std::lock_guard<std::mutex> lock(mLock);
+                if (buf->index >= mQueued.size()) {
+                    return fail(EINVAL);
+                } else if (mQueued[buf->index]) {
+                    ++mNumDoubleQueues;
+                    return fail(EINVAL);
+                }
+
+                mQueued[buf->index] = true;
+                mQueue.push_back(buf->index);
+                mSignal.notify_all();
+                return 0;
+            }
+
+            case VIDIOC_DQBUF: {
+                auto buf = static_cast<v4l2_buffer*>(arg);
+                std::unique_lock<std::mutex> lock(mLock);
+                mWaiting = true;
+                mSignal.notify_all();
+                mSignal.wait(lock, [this]() {
+                    return mStopping || (!mPaused && !mQueue.empty() &&
+                                         (!mScripted || mNextFrame < mFrames.size()));
+                });
+                mWaiting = false;
+                if (mStopping) {
+                    return fail(EPIPE);
+                }
+
+                buf->index = mQueue.front();
+                mQueue.pop_front();
+                mQueued[buf->index] = false;
+                if (mScripted) {
+                    const Frame& frame = mFrames[mNextFrame++];
+                    buf->sequence = frame.sequence;
+                    buf->timestamp.tv_sec = frame.timestampUs / 1000000;
+                    buf->timestamp.tv_usec = frame.timestampUs % 1000000;
+                    return 0;
+                }
+
+                buf->sequence = mSequence++;
+                buf->timestamp.tv_sec = buf->sequence / 30;
+                buf->timestamp.tv_usec = (buf->sequence % 30) * 33333;
+                return 0;
+            }
+
+            case VIDIOC_STREAMON:
+                return 0;
+
+            case VIDIOC_STREAMOFF: {
+                std::lock_guard<std::mutex> lock(mLock);
+                mQueue.clear();
+                mQueued.assign(mNumBuffers, false);
+                return 0;
+            }
+
+            default:
+                return fail(EINVAL);
+        }
+    }
+
+    // Hands out these frames in order and then no more; call before the
+    // stream starts
+    void setFrames(std::vector<Frame> frames) {
+        std::lock_guard<std::mutex> lock(mLock);
+        mFrames = std::move(frames);
+        mNextFrame = 0;
+        mScripted = true;
+    }
+
+    // Stops handing out buffers and waits until the capture thread blocks
+    // in VIDIOC_DQBUF
+    void pause() {
+        std::unique_lock<std::mutex> lock(mLock);
+        mPaused = true;
+        mSignal.wait(lock, [this]() { return mWaiting; });
+    }
+
+    // Fails VIDIOC_DQBUF so the capture thread exits
+    void stop() {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStopping = true;
+        mSignal.notify_all();
+    }
+
+    int getNumQueued() {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mQueue.size();
+    }
+
+    int getNumBuffers() {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mNumBuffers;
+    }
+
+    int getNumDoubleQueues() {
+        std::lock_guard<std::mutex> lock(mLock);
+        return mNumDoubleQueues;
+    }
+
+private:
+    static int fail(int error) {
+        errno = error;
+        return -1;
+    }
+
+    TemporaryFile mFile;
+    ino_t mInode = 0;
+
+    std::mutex mLock;
+    std::condition_variable mSignal;
+    int mNumBuffers = 0;
+    std::deque<int> mQueue;
+    std::vector<bool> mQueued;
+    uint32_t mSequence = 0;
+    bool mScripted = false;
+    std::vector<Frame> mFrames;
+    size_t mNextFrame = 0;
+    int mNumDoubleQueues = 0;
+    bool mPaused = false;
+    bool mStopping = false;
+    bool mWaiting = false;
+};
+
+FakeV4l2Device* gDevice = nullptr;
+
+}  // namespace
+
+// VideoCapture talks to the driver only through ioctl(); route the calls on
+// the fake device to FakeV4l2Device and pass everything else to the kernel.
+#ifdef __BIONIC__
+extern "C" int ioctl(int fd, int request, ...) {
+#else
+extern "C" int ioctl(int fd, unsigned long request, ...) {
+#endif
+    va_list args;
+    va_start(args, request);
+    void* arg = va_arg(args, void*);
+    va_end(args);
+
+    if (gDevice != nullptr && gDevice->isDevice(fd)) {
+        return gDevice->handle(static_cast<unsigned>(request), arg);
+    }
+
+    return syscall(SYS_ioctl, fd, request, arg);
+}
+
+namespace {
+
+class VideoCaptureTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        ASSERT_TRUE(mDevice.open());
+        gDevice = &mDevice;
+    }
+
+    void TearDown() override {
+        gDevice = nullptr;
+    }
+
+    // Captures the given frames, converting each one with convert() before it
+    // is returned, and reports the resulting timing
+    CaptureStats captureFrames(std::vector<FakeV4l2Device::Frame> frames,
+                               std::function<void(unsigned)> convert = nullptr) {
+        const unsigned numFrames = frames.size();
+        mDevice.setFrames(std::move(frames));
+
+        VideoCapture capture;
+        EXPECT_TRUE(capture.open(mDevice.getPath()));
+
+        std::atomic<unsigned> numCaptured = 0;
+        auto onFrame = [&](VideoCapture* pCapture, imageBuffer* buf, void*) {
+            if (convert) {
+                convert(numCaptured.load());
+            }
+            pCapture->markFrameConverted(buf->index);
+            pCapture->markFrameConsumed(buf->index);
+            numCaptured.fetch_add(1);
+        };
+
+        EXPECT_TRUE(capture.startStream(onFrame, kMaxBuffers));
+        while (numCaptured.load() < numFrames) {
+            std::this_thread::yield();
+        }
+        const CaptureStats stats = capture.getCaptureStats();
+
+        mDevice.stop();
+        capture.stopStream();
+        capture.close();
+        return stats;
+    }
+
+    FakeV4l2Device mDevice;
+};
+
+TEST_F(VideoCaptureTest, ConcurrentReturnsNeitherLoseNorRequeueBuffers) {
+    constexpr int kNumFrames = 20000;
+    constexpr int kNumReturningThreads = 4;
+
+    VideoCapture capture;
+    ASSERT_TRUE(capture.open(mDevice.getPath()));
+
+    // Every captured buffer is returned twice from different threads at the
+    // same time; exactly one of them must requeue it.
+    std::mutex lock;
+    std::condition_variable signal;
+    std::deque<int> returns;
+    bool done = false;
+    std::atomic<int> numCaptured = 0;
+    auto onFrame = [&](VideoCapture*, imageBuffer* buf, void*) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            returns.push_back(buf->index);
+            returns.push_back(buf->index);
+        }
+        signal.notify_all();
+        numCaptured.fetch_add(1);
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kNumReturningThreads; ++i) {
+        threads.emplace_back([&]() {
+            while (true) {
+                int id;
+                {
+                    std::unique_lock<std::mutex> guard(lock);
+                    signal.wait(guard, [&]() { return done || !returns.empty(); });
+                    if (returns.empty()) {
+                        return;
+                    }
+                    id = returns.front();
+                    returns.pop_front();
+                }
+
+                // Reads the latest frame concurrently as consumers do
+                capture.isFrameReady();
+                capture.getLatestData();
+                capture.markFrameConsumed(id);
+            }
+        });
+    }
+
+    ASSERT_TRUE(capture.startStream(onFrame, kMaxBuffers));
+    ASSERT_EQ(capture.getNumBuffers(), kMaxBuffers);
+    while (numCaptured.load() < kNumFrames) {
+        std::this_thread::yield();
+    }
+
+    // Stops capturing and lets the returning threads drain their work
+    mDevice.pause();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        done = true;
+    }
+    signal.notify_all();
+    for (auto&& thread : threads) {
+        thread.join();
+    }
+
+    // Every buffer went back to the driver exactly once
+    EXPECT_EQ(mDevice.getNumDoubleQueues(), 0);
+    EXPECT_EQ(mDevice.getNumQueued(), mDevice.getNumBuffers());
+    EXPECT_FALSE(capture.isFrameReady());
+    EXPECT_EQ(capture.getLatestData(), nullptr);
+
+    mDevice.stop();
+    capture.stopStream();
+    capture.close();
+}
+
+TEST_F(VideoCaptureTest, StatsCoverOnlyTheMostRecentFrames) {
+    // The timing history holds 128 frames; the slow frames at the start of
+    // the stream must fall out of it once the ring wraps around.
+    constexpr int kNumFrames = 300;
+    constexpr int kNumSlowFrames = 100;
+    std::vector<FakeV4l2Device::Frame> frames;
+    int64_t timestampUs = 0;
+    for (int i = 0; i < kNumFrames; ++i) {
+        frames.push_back({static_cast<uint32_t>(i), timestampUs});
+        timestampUs += i < kNumSlowFrames ? 100000 : 33000;
+    }
+
+    const CaptureStats stats = captureFrames(frames);
+    EXPECT_EQ(stats.framesCaptured, kNumFrames);
+    EXPECT_EQ(stats.framesDropped, 0);
+    EXPECT_EQ(stats.meanIntervalNs, 33000000);
+    EXPECT_EQ(stats.maxIntervalNs, 33000000);
+    EXPECT_EQ(stats.jitterNs, 0);
+}
+
+TEST_F(VideoCaptureTest, StatsReportJitter) {
+    // Intervals of 30 and 40 ms average 35 ms with 5 ms of jitter
+    const CaptureStats stats = captureFrames({
+        {0, 0}, {1, 30000}, {2, 70000}, {3, 100000}, {4, 140000},
+    });
+    EXPECT_EQ(stats.framesCaptured, 5);
+    EXPECT_EQ(stats.meanIntervalNs, 35000000);
+    EXPECT_EQ(stats.maxIntervalNs, 40000000);
+    EXPECT_EQ(stats.jitterNs, 5000000);
+}
+
+TEST_F(VideoCaptureTest, StatsCountGapsInSequenceNumbers) {
+    // Two frames are missing after sequence 2 and three after 6; the wrap of
+    // the driver's counter is not a gap.
+    const CaptureStats stats = captureFrames({
+        {0xFFFFFFFE, 0}, {0xFFFFFFFF, 33000}, {0, 66000}, {1, 99000}, {2, 132000},
+        {5, 231000}, {6, 264000}, {10, 396000},
+    });
+    EXPECT_EQ(stats.framesCaptured, 8);
+    EXPECT_EQ(stats.framesDropped, 5);
+}
+
+TEST_F(VideoCaptureTest, StatsBucketConversionTimes) {
+    // Conversions take no time, at least 3 ms and at least 100 ms.  Sleeps may
+    // overrun, so only the lower bounds of the buckets are exact.
+    const std::chrono::milliseconds delays[] = {
+        std::chrono::milliseconds(0), std::chrono::milliseconds(3),
+        std::chrono::milliseconds(100),
+    };
+    const CaptureStats stats = captureFrames({{0, 0}, {1, 33000}, {2, 66000}},
+                                             [&delays](unsigned frame) {
+        std::this_thread::sleep_for(delays[frame]);
+    });
+
+    uint32_t numConverted = 0;
+    for (auto count : stats.conversionHistogram) {
+        numConverted += count;
+    }
+    EXPECT_EQ(numConverted, 3);
+
+    // Only the first frame can take under 2 ms, and the last one is slower
+    // than the last bucket's 64 ms limit
+    EXPECT_LE(stats.conversionHistogram[0] + stats.conversionHistogram[1], 1);
+    EXPECT_EQ(stats.conversionHistogram[CaptureStats::kNumConversionBuckets - 1], 1);
+    EXPECT_GE(stats.meanConversionNs, 103000000 / 3);
+}
+
+}  // namespace